@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+    Minimal benchmark harness for mz_bench.
+
+    A benchmark is a function that performs n operations; the runner
+    grows n until a run takes at least the minimum time, repeats the run
+    and keeps the fastest, and reports nanoseconds per operation. When an
+    operation processes several items (eg. one broadphase frame over
+    100k rects), items_per_op scales the items/s figure.
+*/
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../mz_common.hpp"
+
+namespace bench {
+
+    using namespace mz;
+
+    struct benchmark {
+        std::string name;
+        std::function<void(u64)> run;
+        u64 items_per_op;
+    };
+
+    struct result {
+        std::string name;
+        f64 ns_per_op;
+        f64 items_per_second;
+        u64 iterations;
+    };
+
+    std::vector<benchmark>& registry();
+
+    inline void add(std::string name, std::function<void(u64)> run, u64 items_per_op = 1) {
+        registry().push_back({ std::move(name), std::move(run), items_per_op });
+    }
+
+    // Keeps the compiler from discarding a value or hoisting work out of the timed loop
+    template <typename value_t>
+    mz_force_inline void keep(const value_t& value) {
+    #if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+    #else
+        const volatile char* p = (const volatile char*)&value;
+        (void)*p;
+    #endif
+    }
+
+    void register_vector();
+    void register_matrix();
+    void register_algorithms();
+    void register_broadphase();
+}
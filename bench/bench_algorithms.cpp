@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include "bench.hpp"
+#include "../mz_algorithms.hpp"
+#include "../mz_frustum.hpp"
+#include "../mz_morton.hpp"
+
+namespace bench {
+
+    // Regular polygon with n points around center
+    static std::vector<fvec2> regular_polygon(u32 n, fvec2 center, f32 radius) {
+        std::vector<fvec2> points(n);
+        for (u32 i = 0; i < n; i++) {
+            f32 a = (f32)i / (f32)n * 6.2831853f;
+            points[i] = fvec2(center.x + std::cos(a) * radius, center.y + std::sin(a) * radius);
+        }
+        return points;
+    }
+
+    void register_algorithms() {
+        constexpr size_t count = 1024;
+
+        struct data {
+            frect rects[count];
+            fvec2 points[count];
+            fray2d segments[count];
+        };
+        auto d = std::make_shared<data>();
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<f32> pos(0.f, 100.f), size(1.f, 20.f);
+        for (size_t i = 0; i < count; i++) {
+            d->rects[i]    = frect(pos(rng), pos(rng), size(rng), size(rng));
+            d->points[i]   = fvec2(pos(rng), pos(rng));
+            d->segments[i] = fray2d(pos(rng), pos(rng), pos(rng), pos(rng));
+        }
+
+        add("rects_intersect<f32>", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(rects_intersect(d->rects[i % count], d->rects[(i + 1) % count]));
+        });
+        add("rect_contains<f32>", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(rect_contains(d->rects[i % count], d->points[i % count]));
+        });
+        add("ray2ds_intersect<f32>", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                fvec2 hit;
+                keep(ray2ds_intersect(d->segments[i % count], d->segments[(i + 1) % count], &hit));
+                keep(hit);
+            }
+        });
+        add("ray2d_intersect_batch<f32>/1024", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                auto hit = ray2d_intersect_batch<f32>(d->segments[i % count], span<const fray2d>(d->segments, count));
+                keep(hit);
+            }
+        }, count);
+
+        for (u32 npoints : { 4u, 8u, 16u, 32u, 64u }) {
+            // Overlapping and separated pairs alternate, so both early-outs and full SAT runs are timed
+            auto a       = std::make_shared<std::vector<fvec2>>(regular_polygon(npoints, fvec2(0, 0), 10.f));
+            auto overlap = std::make_shared<std::vector<fvec2>>(regular_polygon(npoints, fvec2(15, 3), 10.f));
+            auto apart   = std::make_shared<std::vector<fvec2>>(regular_polygon(npoints, fvec2(25, 3), 10.f));
+
+            add("polygon2ds_intersect<f32>/" + std::to_string(npoints), [a, overlap, apart, npoints](u64 n) {
+                Polygon2D<f32> pa = { a->data(), npoints };
+                Polygon2D<f32> pb[2] = { { overlap->data(), npoints }, { apart->data(), npoints } };
+                for (u64 i = 0; i < n; i++) keep(polygon2ds_intersect<f32, f32>(pa, pb[i & 1]));
+            });
+            add("polygon2ds_intersect_gjk<f32>/" + std::to_string(npoints), [a, overlap, apart, npoints](u64 n) {
+                Polygon2D<f32> pa = { a->data(), npoints };
+                Polygon2D<f32> pb[2] = { { overlap->data(), npoints }, { apart->data(), npoints } };
+                for (u64 i = 0; i < n; i++) keep(polygon2ds_intersect_gjk(pa, pb[i & 1]));
+            });
+            // Same pairs every frame with one simplex cached per pair
+            add("polygon2ds_intersect_gjk<f32>/warm/" + std::to_string(npoints), [a, overlap, apart, npoints](u64 n) {
+                Polygon2D<f32> pa = { a->data(), npoints };
+                Polygon2D<f32> pb[2] = { { overlap->data(), npoints }, { apart->data(), npoints } };
+                Polygon2DSimplex<f32> cache[2];
+                for (u64 i = 0; i < n; i++) keep(polygon2ds_intersect_gjk(pa, pb[i & 1], &cache[i & 1]));
+            });
+            add("polygon2ds_separation<f32>/" + std::to_string(npoints), [a, overlap, apart, npoints](u64 n) {
+                Polygon2D<f32> pa = { a->data(), npoints };
+                Polygon2D<f32> pb[2] = { { overlap->data(), npoints }, { apart->data(), npoints } };
+                for (u64 i = 0; i < n; i++) keep(polygon2ds_separation(pa, pb[i & 1]).depth);
+            });
+            add("polygon2ds_contact<f32>/" + std::to_string(npoints), [a, overlap, apart, npoints](u64 n) {
+                Polygon2D<f32> pa = { a->data(), npoints };
+                Polygon2D<f32> pb[2] = { { overlap->data(), npoints }, { apart->data(), npoints } };
+                Polygon2DSimplex<f32> cache[2];
+                for (u64 i = 0; i < n; i++) keep(polygon2ds_contact(pa, pb[i & 1], &cache[i & 1]).depth);
+            });
+        }
+
+        // 1M objects scattered around a camera looking down -z, about a quarter visible
+        {
+            constexpr size_t objects = 1 << 20;
+            struct scene {
+                ffrustum f;
+                std::vector<fvec4> spheres, sorted;
+                std::vector<faabb> boxes;
+                std::vector<u64> visible;
+                std::vector<u32> indices;
+                std::vector<u8> hints;
+                executor pool;
+            };
+            auto sc = std::make_shared<scene>();
+            sc->f = ffrustum::from_matrix(projection::perspective(1.2f, 16.f / 9.f, .1f, 100.f) * transformation::translation(fvec3(0, 0, -10)));
+            std::uniform_real_distribution<f32> coord(-60.f, 60.f), radius(0.f, 5.f);
+            for (size_t i = 0; i < objects; i++) {
+                fvec3 c(coord(rng), coord(rng), coord(rng)), e(radius(rng), radius(rng), radius(rng));
+                sc->spheres.push_back(fvec4(c, radius(rng)));
+                sc->boxes.push_back(faabb(c - e, c + e));
+            }
+            // Hints pay off when neighbours in the array are neighbours in space
+            sc->sorted = sc->spheres;
+            std::sort(sc->sorted.begin(), sc->sorted.end(), [](const fvec4& a, const fvec4& b) { return a.x < b.x; });
+            sc->visible.resize(objects / 64);
+            sc->indices.resize(objects);
+            sc->hints.resize(objects);
+
+            add("frustum_cull/spheres/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->spheres, sc->visible, {}, 1); keep(sc->visible[i % 64]); }
+            }, objects);
+            add("frustum_cull/spheres_sorted/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->sorted, sc->visible, {}, 1); keep(sc->visible[i % 64]); }
+            }, objects);
+            add("frustum_cull/spheres_sorted_hinted/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->sorted, sc->visible, sc->hints, 1); keep(sc->visible[i % 64]); }
+            }, objects);
+            add("frustum_cull/boxes/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->boxes, sc->visible, {}, 1); keep(sc->visible[i % 64]); }
+            }, objects);
+            add("frustum_cull/spheres_threaded/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->spheres, sc->visible); keep(sc->visible[i % 64]); }
+            }, objects);
+            // Thread count vs a persistent pool: the difference is thread startup per call
+            add("frustum_cull/spheres_executor/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) { frustum_cull(sc->f, sc->spheres, sc->visible, {}, sc->pool); keep(sc->visible[i % 64]); }
+            }, objects);
+            add("parallel_reduce/visible_count/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) {
+                    keep(parallel_reduce(sc->visible.size(), 64, (size_t)0, sc->pool, [&](size_t begin, size_t end) {
+                        size_t c = 0;
+                        for (size_t w = begin; w < end; w++) c += popcount64(sc->visible[w]);
+                        return c;
+                    }, [](size_t a, size_t b) { return a + b; }));
+                }
+            }, objects);
+            add("frustum_cull_compact/spheres/1M", [sc](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(frustum_cull_compact(sc->f, sc->spheres, sc->indices, {}, 1));
+            }, objects);
+        }
+
+        // 1M random points in a cube, 30 bit keys so radix_sort takes 4 passes
+        {
+            constexpr size_t points = 1 << 20;
+            struct cloud {
+                std::vector<fvec3> points, scratch;
+                std::vector<u32vec3> cells;
+                std::vector<u64> keys, sorted_keys;
+                std::vector<u32> order;
+                executor pool;
+            };
+            auto c = std::make_shared<cloud>();
+            std::uniform_real_distribution<f32> coord(-100.f, 100.f);
+            for (size_t i = 0; i < points; i++) {
+                c->points.push_back(fvec3(coord(rng), coord(rng), coord(rng)));
+                c->cells.push_back(u32vec3(rng() & 1023, rng() & 1023, rng() & 1023));
+            }
+            c->keys.resize(points);
+            spatial_keys(c->points, c->keys);
+            c->order.resize(points);
+
+            add("morton_encode/u32vec3", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(morton_encode(c->cells[i % points]));
+            });
+            add("hilbert_encode/u32vec2", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(hilbert_encode(c->cells[i % points].xy));
+            });
+            add("hilbert_encode/u32vec3", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(hilbert_encode(c->cells[i % points]));
+            });
+            add("hilbert_encode/u32vec3/10_bits", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(hilbert_encode(c->cells[i % points], 10));
+            });
+            add("radix_sort/1M", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) {
+                    c->sorted_keys = c->keys;
+                    for (size_t j = 0; j < points; j++) c->order[j] = (u32)j;
+                    radix_sort(c->sorted_keys, c->order, 1);
+                    keep(c->order[i % points]);
+                }
+            }, points);
+            add("radix_sort/executor/1M", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) {
+                    c->sorted_keys = c->keys;
+                    for (size_t j = 0; j < points; j++) c->order[j] = (u32)j;
+                    radix_sort(c->sorted_keys, c->order, c->pool);
+                    keep(c->order[i % points]);
+                }
+            }, points);
+            add("std::sort/key_index_pairs/1M", [c](u64 n) {
+                std::vector<std::pair<u64, u32>> pairs(points);
+                for (u64 i = 0; i < n; i++) {
+                    for (size_t j = 0; j < points; j++) pairs[j] = { c->keys[j], (u32)j };
+                    std::sort(pairs.begin(), pairs.end());
+                    keep(pairs[i % points].second);
+                }
+            }, points);
+            add("spatial_sort/fvec3/morton/1M", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) {
+                    c->scratch = c->points;
+                    spatial_sort(c->scratch, curve::morton, 1);
+                    keep(c->scratch[i % points]);
+                }
+            }, points);
+            add("spatial_sort/fvec3/hilbert/1M", [c](u64 n) {
+                for (u64 i = 0; i < n; i++) {
+                    c->scratch = c->points;
+                    spatial_sort(c->scratch, curve::hilbert, 1);
+                    keep(c->scratch[i % points]);
+                }
+            }, points);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+#include "bench.hpp"
+#include "../mz_broadphase.hpp"
+
+namespace bench {
+
+    /*
+        100k rects in a 4000x4000 world with sizes spread over e^0..e^5,
+        the case where a uniform grid starts to degenerate. Every move op
+        nudges all rects by up to 2 units, like one frame of sprites.
+    */
+    constexpr size_t broadphase_count = 100000;
+
+    template <typename broadphase_t>
+    struct broadphase_data {
+        std::vector<frect> rects;
+        std::vector<frect> regions;
+        std::vector<u32> ids;
+        broadphase_t bp;
+        std::mt19937 rng{ 7 };
+
+        explicit broadphase_data(broadphase_t bp_) : bp(std::move(bp_)) {
+            std::mt19937 init(1);
+            std::uniform_real_distribution<f32> pos(0.f, 4000.f), size_exp(0.f, 5.f);
+            rects.resize(broadphase_count);
+            for (auto& r : rects) {
+                f32 s = std::exp(size_exp(init));
+                r = frect(pos(init), pos(init), s, s);
+            }
+            regions.resize(1024);
+            for (auto& r : regions) r = frect(pos(init), pos(init), 64.f, 64.f);
+
+            ids.resize(rects.size());
+            for (size_t i = 0; i < rects.size(); i++) ids[i] = bp.insert(rects[i]);
+        }
+    };
+
+    template <typename broadphase_t>
+    static void register_broadphase_type(const std::string& prefix, broadphase_t prototype) {
+        auto d = std::make_shared<broadphase_data<broadphase_t>>(prototype);
+
+        add(prefix + "/insert", [d, prototype](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                broadphase_t bp = prototype;
+                for (const frect& r : d->rects) keep(bp.insert(r));
+            }
+        }, broadphase_count);
+        add(prefix + "/move", [d](u64 n) {
+            std::uniform_real_distribution<f32> step(-2.f, 2.f);
+            for (u64 i = 0; i < n; i++) {
+                for (size_t r = 0; r < d->rects.size(); r++) {
+                    d->rects[r].x += step(d->rng);
+                    d->rects[r].y += step(d->rng);
+                    d->bp.move(d->ids[r], d->rects[r]);
+                }
+            }
+        }, broadphase_count);
+        add(prefix + "/query_pairs", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                size_t pairs = 0;
+                d->bp.query_pairs([&](u32, u32) { pairs++; });
+                keep(pairs);
+            }
+        }, broadphase_count);
+        add(prefix + "/query_rect", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                size_t hits = 0;
+                d->bp.query(d->regions[i % d->regions.size()], [&](u32) { hits++; });
+                keep(hits);
+            }
+        });
+    }
+
+    /*
+        Chunk lookups: a 512x512 block of occupied ivec2 keys, bigger than
+        L2, and the 3x3 neighbourhoods of random cells around it, about a
+        third of which miss.
+    */
+    template <typename map_t>
+    static void register_cell_map(const std::string& prefix) {
+        auto m = std::make_shared<map_t>();
+        for (s32 y = 0; y < 512; y++)
+            for (s32 x = 0; x < 512; x++) (*m)[ivec2(x, y)] = (u32)(x + y);
+
+        auto centers = std::make_shared<std::vector<ivec2>>(4096);
+        std::mt19937 init(5);
+        std::uniform_int_distribution<s32> c(-96, 608);
+        for (ivec2& p : *centers) p = ivec2(c(init), c(init));
+
+        add(prefix + "/insert/256k", [](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                map_t fresh;
+                for (s32 y = 0; y < 512; y++)
+                    for (s32 x = 0; x < 512; x++) fresh[ivec2(x, y)] = (u32)x;
+                keep(fresh.size());
+            }
+        }, 512 * 512);
+        add(prefix + "/find_3x3", [m, centers](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                const ivec2 p = (*centers)[i % centers->size()];
+                u32 sum = 0;
+                for (s32 y = -1; y <= 1; y++) {
+                    for (s32 x = -1; x <= 1; x++) {
+                        auto it = m->find(p + ivec2(x, y));
+                        if (it != m->end()) sum += it->second;
+                    }
+                }
+                keep(sum);
+            }
+        });
+    }
+
+    void register_broadphase() {
+        register_cell_map<std::unordered_map<ivec2, u32>>("std::unordered_map<ivec2>");
+        register_cell_map<flat_hash_map<ivec2, u32>>("flat_hash_map<ivec2>");
+        register_cell_map<flat_hash_map<ivec2, u32, morton_hash<ivec2>>>("flat_hash_map<ivec2,morton>");
+
+        register_broadphase_type("uniform_grid<f32>", funiform_grid(32.f));
+        register_broadphase_type("aabb_tree<f32>", faabb_tree(4.f));
+
+        auto tree = std::make_shared<broadphase_data<faabb_tree>>(faabb_tree(4.f));
+        add("aabb_tree<f32>/query_point", [tree](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                size_t hits = 0;
+                tree->bp.query(tree->regions[i % tree->regions.size()].xy, [&](u32) { hits++; });
+                keep(hits);
+            }
+        });
+        add("aabb_tree<f32>/cast_nearest", [tree](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                const frect& a = tree->regions[i % tree->regions.size()];
+                const frect& b = tree->regions[(i + 1) % tree->regions.size()];
+                f32 nearest = 1.f;
+                tree->bp.cast(fray2d(a.x, a.y, b.x, b.y), [&](u32, f32 t) { nearest = t; return t; });
+                keep(nearest);
+            }
+        });
+    }
+}
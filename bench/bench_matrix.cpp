@@ -0,0 +1,168 @@
+#include <memory>
+#include <vector>
+
+#include "bench.hpp"
+#include "../mz_hierarchy.hpp"
+#include "../mz_matrix.hpp"
+#include "../mz_matrix2d.hpp"
+
+namespace bench {
+
+    template <typename value_t>
+    static void register_mat4(const std::string& prefix) {
+        typedef mat4<value_t> mat_t;
+        typedef vec3<value_t> vec3_t;
+        typedef vec4<value_t> vec4_t;
+        constexpr size_t count = 256;
+
+        struct data {
+            mat_t m[count];
+            mat_t inverses[count];
+            vec4_t v[count];
+            std::vector<vec3_t> points, out;
+        };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < count; i++) {
+            value_t f = (value_t)i * (value_t)0.01;
+            d->m[i] = transformation::trs(vec3_t(f, (value_t)1 - f, (value_t)2), vec3_t(f, f * 2, f * 3), vec3_t((value_t)1 + f));
+            d->v[i] = vec4_t(f, (value_t)1, (value_t)2 - f, (value_t)1);
+        }
+        d->points.resize(4096);
+        d->out.resize(4096);
+        for (size_t i = 0; i < d->points.size(); i++) d->points[i] = vec3_t((value_t)i, (value_t)(i % 17), (value_t)1);
+
+        add(prefix + "/multiply", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count] * d->m[(i + 1) % count]; keep(r); }
+        });
+        add(prefix + "/multiply_vec4", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec4_t r = d->m[i % count] * d->v[i % count]; keep(r); }
+        });
+        add(prefix + "/invert", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count]; r.invert(); keep(r); }
+        });
+        add(prefix + "/try_invert", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count]; keep(r.try_invert()); keep(r); }
+        });
+        add(prefix + "/invert_all", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { keep(invert_all<value_t>(span<const mat_t>(d->m, count), span<mat_t>(d->inverses, count), {}, 1)); keep(d->inverses[0]); }
+        }, count);
+        add(prefix + "/invert_affine", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count]; r.invert_affine(); keep(r); }
+        });
+        add(prefix + "/rotate", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count]; r.rotate((value_t)0.5, vec3_t(0, 1, 0), precise); keep(r); }
+        });
+        add(prefix + "/rotate_fast", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = d->m[i % count]; r.rotate((value_t)0.5, vec3_t(0, 1, 0), fast); keep(r); }
+        });
+        add(prefix + "/perspective", [](u64 n) {
+            for (u64 i = 0; i < n; i++) { mat_t r = projection::perspective<value_t>((value_t)(1.0 + (i % 8) * 0.01), 16.f / 9.f, (value_t)0.1, (value_t)100); keep(r); }
+        });
+        add(prefix + "/look_at", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                const vec4_t& v = d->v[i % count];
+                mat_t r = projection::look_at(vec3_t(v.x, v.y, v.z), vec3_t(0, 0, 0), vec3_t(0, 1, 0));
+                keep(r);
+            }
+        });
+        add(prefix + "/trs", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                const vec4_t& v = d->v[i % count];
+                mat_t r = transformation::trs(vec3_t(v.x, v.y, v.z), vec3_t(v.z, v.x, v.y), vec3_t(v.w));
+                keep(r);
+            }
+        });
+        add(prefix + "/transform_points", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { transform_points(d->m[i % count], d->points, d->out); keep(d->out[0]); }
+        }, 4096);
+    }
+
+    // 64 roots with 16 children with 16 children each, 16K nodes 4 levels deep
+    static void register_hierarchy() {
+        struct data {
+            ftransform_hierarchy h;
+            std::vector<u32> roots, leaves;
+            executor pool;
+        };
+        auto d = std::make_shared<data>();
+        for (u32 r = 0; r < 64; r++) {
+            u32 root = d->h.insert();
+            d->roots.push_back(root);
+            for (u32 c = 0; c < 16; c++) {
+                u32 child = d->h.insert(root, fvec3((f32)c, 0, 0));
+                for (u32 g = 0; g < 16; g++)
+                    d->leaves.push_back(d->h.insert(child, fvec3(0, (f32)g, 0), fquat::from_axis_angle((f32)g * .1f, fvec3(0, 1, 0))));
+            }
+        }
+        d->h.update();
+        const u64 nodes = d->h.size();
+
+        add("hierarchy/update_all/16K", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { d->h.set_position(d->roots[0], fvec3((f32)(i & 7))); for (u32 r : d->roots) d->h.set_rotation(r, fquat()); d->h.update(1); keep(d->h.world()[0]); }
+        }, nodes);
+        add("hierarchy/update_all_executor/16K", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { for (u32 r : d->roots) d->h.set_rotation(r, fquat()); d->h.update(d->pool); keep(d->h.world()[0]); }
+        }, nodes);
+        add("hierarchy/update_one_root/16K", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { d->h.set_position(d->roots[i % 64], fvec3((f32)(i & 7))); d->h.update(1); keep(d->h.world()[0]); }
+        }, nodes);
+        add("hierarchy/update_64_leaves/16K", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) {
+                for (u32 k = 0; k < 64; k++) d->h.set_position(d->leaves[(i * 64 + k) * 61 % d->leaves.size()], fvec3((f32)k));
+                d->h.update(1);
+                keep(d->h.world()[0]);
+            }
+        }, nodes);
+    }
+
+    // 2D sprites: the same points and quads through mat2x3 and through mat4
+    static void register_mat2x3() {
+        struct data {
+            fmat2x3 m[256];
+            fmat4 m4[256];
+            std::vector<fvec2> points, out;
+            std::vector<fquad> quads, quads_out;
+        };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < 256; i++) {
+            f32 f = (f32)i * .01f;
+            d->m[i] = transformation::trs(fvec2(f, 1 - f), f, fvec2(1 + f, 2 - f));
+            d->m4[i] = d->m[i].to_mat4();
+        }
+        d->points.resize(4096);
+        d->out.resize(4096);
+        for (size_t i = 0; i < d->points.size(); i++) d->points[i] = fvec2((f32)i, (f32)(i % 17));
+        d->quads.resize(1024);
+        d->quads_out.resize(1024);
+        for (size_t i = 0; i < d->quads.size(); i++) d->quads[i] = fquad(fvec2(0, 0), fvec2(0, 1), fvec2(1, 1), fvec2((f32)i, 0));
+
+        add("mat2x3<f32>/multiply", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { fmat2x3 r = d->m[i % 256] * d->m[(i + 1) % 256]; keep(r); }
+        });
+        add("mat2x3<f32>/multiply_vec2", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { fvec2 r = d->m[i % 256] * d->points[i % 4096]; keep(r); }
+        });
+        add("mat2x3<f32>/trs", [](u64 n) {
+            for (u64 i = 0; i < n; i++) { fmat2x3 r = transformation::trs(fvec2((f32)i, 1), (f32)(i % 64) * .01f, fvec2(2)); keep(r); }
+        });
+        add("mat2x3<f32>/invert", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { fmat2x3 r = d->m[i % 256]; r.invert(); keep(r); }
+        });
+        add("mat2x3<f32>/transform_points", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { transform_points(d->m[i % 256], d->points, d->out); keep(d->out[0]); }
+        }, 4096);
+        add("mat4<f32>/transform_points_vec2", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { transform_points(d->m4[i % 256], d->points, d->out); keep(d->out[0]); }
+        }, 4096);
+        add("mat2x3<f32>/transform_quads", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { transform_quads(d->m[i % 256], d->quads, d->quads_out); keep(d->quads_out[0]); }
+        }, 1024);
+    }
+
+    void register_matrix() {
+        register_mat4<f32>("mat4<f32>");
+        register_mat4<f64>("mat4<f64>");
+        register_mat2x3();
+        register_hierarchy();
+    }
+}
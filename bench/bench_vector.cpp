@@ -0,0 +1,233 @@
+#include <memory>
+#include <vector>
+
+#include "bench.hpp"
+#include "../mz_color.hpp"
+#include "../mz_expr.hpp"
+#include "../mz_fixed.hpp"
+#include "../mz_packed.hpp"
+
+namespace bench {
+
+    template <template <typename> class vec_tmpl, typename value_t>
+    static void register_vec(const std::string& prefix) {
+        typedef vec_tmpl<value_t> vec_t;
+        constexpr size_t count = 1024, components = sizeof(vec_t) / sizeof(value_t);
+
+        struct data { vec_t a[count], b[count]; };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < count; i++) {
+            for (size_t c = 0; c < components; c++) {
+                d->a[i].ptr[c] = (value_t)(1 + (i + c) % 7);
+                d->b[i].ptr[c] = (value_t)(1 + (i * 3 + c) % 5);
+            }
+        }
+
+        add(prefix + "/add", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count] + d->b[i % count]; keep(r); }
+        });
+        add(prefix + "/subtract", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count] - d->b[i % count]; keep(r); }
+        });
+        add(prefix + "/multiply", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count] * d->b[i % count]; keep(r); }
+        });
+        add(prefix + "/divide", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count] / d->b[i % count]; keep(r); }
+        });
+        add(prefix + "/normalize", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count].normalize(precise); keep(r); }
+        });
+        add(prefix + "/magnitude", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(d->a[i % count].magnitude(precise));
+        });
+        if constexpr (std::is_floating_point<value_t>::value) {
+            add(prefix + "/normalize_fast", [d](u64 n) {
+                for (u64 i = 0; i < n; i++) { vec_t r = d->a[i % count].normalize(fast); keep(r); }
+            });
+            add(prefix + "/magnitude_fast", [d](u64 n) {
+                for (u64 i = 0; i < n; i++) keep(d->a[i % count].magnitude(fast));
+            });
+        }
+    }
+
+    template <typename value_t>
+    static void register_trig(const char* type_name) {
+        constexpr size_t count = 1024;
+        auto angles = std::make_shared<std::vector<value_t>>(count);
+        for (size_t i = 0; i < count; i++) (*angles)[i] = (value_t)((f64)i * 0.0123 - 6.0);
+
+        std::string suffix = std::string("<") + type_name + ">";
+        add("math/sin" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(math::sin((*angles)[i % count], precise));
+        });
+        add("math/sin_fast" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(math::sin((*angles)[i % count], fast));
+        });
+        add("math/sincos" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) { value_t s = 0, c = 0; math::sincos((*angles)[i % count], s, c, precise); keep(s); keep(c); }
+        });
+        add("math/sincos_fast" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) { value_t s = 0, c = 0; math::sincos((*angles)[i % count], s, c, fast); keep(s); keep(c); }
+        });
+        add("math/rsqrt" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(math::rsqrt((*angles)[i % count] + (value_t)7, precise));
+        });
+        add("math/rsqrt_fast" + suffix, [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) keep(math::rsqrt((*angles)[i % count] + (value_t)7, fast));
+        });
+        add("vec2" + suffix + "/from_angle", [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec2<value_t> r = vec2<value_t>::from_angle((*angles)[i % count], precise); keep(r); }
+        });
+        add("vec2" + suffix + "/from_angle_fast", [angles](u64 n) {
+            for (u64 i = 0; i < n; i++) { vec2<value_t> r = vec2<value_t>::from_angle((*angles)[i % count], fast); keep(r); }
+        });
+    }
+
+    template <typename value_t>
+    static void register_scalar(const char* type_name) {
+        register_vec<vec2, value_t>(std::string("vec2<") + type_name + ">");
+        register_vec<vec3, value_t>(std::string("vec3<") + type_name + ">");
+        register_vec<vec4, value_t>(std::string("vec4<") + type_name + ">");
+    }
+
+    // a * s + b * t - c over fvec3/dvec3/ivec3, computed in f64 either way:
+    // eager with explicit conversions vs mz_expr
+    static void register_expr() {
+        constexpr size_t count = 1024;
+
+        struct data { fvec3 a[count]; dvec3 b[count]; ivec3 c[count]; fvec3 out[count]; };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < count; i++) {
+            d->a[i] = fvec3((f32)(i % 7), (f32)(i % 5), (f32)(i % 3));
+            d->b[i] = dvec3((f64)(i % 11), (f64)(i % 13), (f64)(i % 17));
+            d->c[i] = ivec3((s32)(i % 19), (s32)(i % 23), (s32)(i % 29));
+        }
+
+        add("vec3<mixed>/chain", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { size_t j = i % count; fvec3 r = fvec3(dvec3(d->a[j]) * 0.5 + d->b[j] * 0.25 - dvec3(d->c[j])); keep(r); }
+        });
+        add("vec3<mixed>/chain_expr", [d](u64 n) {
+            for (u64 i = 0; i < n; i++) { size_t j = i % count; fvec3 r = lazy(d->a[j]) * 0.5 + lazy(d->b[j]) * 0.25 - d->c[j]; keep(r); }
+        });
+        add("vec3<mixed>/chain_array", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) {
+                for (size_t j = 0; j < count; j++) d->out[j] = fvec3(dvec3(d->a[j]) * 0.5 + d->b[j] * 0.25 - dvec3(d->c[j]));
+                keep(d->out[k % count]);
+            }
+        }, count);
+        add("vec3<mixed>/chain_array_expr", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) {
+                expr::assign(span<fvec3>(d->out), lazy(span<const fvec3>(d->a)) * 0.5 + lazy(span<const dvec3>(d->b)) * 0.25 - lazy(span<const ivec3>(d->c)));
+                keep(d->out[k % count]);
+            }
+        }, count);
+    }
+
+    // Whole array conversions, one item per vector
+    template <typename packed_t, typename vec_t>
+    static void register_packed(const std::string& name) {
+        constexpr size_t count = 4096;
+
+        struct data { vec_t v[count]; packed_t p[count]; };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < count; i++) {
+            for (size_t c = 0; c < sizeof(vec_t) / sizeof(f32); c++)
+                d->v[i].ptr[c] = (f32)((i * 7 + c * 13) % 101) / 50.f - 1.f;
+            d->p[i] = d->v[i];
+        }
+
+        add("pack/" + name, [d](u64 n) {
+            for (u64 k = 0; k < n; k++) {
+                packed_t::pack(span<const vec_t>(d->v), span<packed_t>(d->p));
+                keep(d->p[k % count]);
+            }
+        }, count);
+        add("unpack/" + name, [d](u64 n) {
+            for (u64 k = 0; k < n; k++) {
+                packed_t::unpack(span<const packed_t>(d->p), span<vec_t>(d->v));
+                keep(d->v[k % count]);
+            }
+        }, count);
+    }
+
+    // Whole image conversions, 4096 pixels per call
+    static void register_color() {
+        constexpr size_t count = 4096;
+
+        struct data { fcolor16 f[count], out[count]; bcolor4 b[count]; };
+        auto d = std::make_shared<data>();
+        for (size_t i = 0; i < count; i++) {
+            d->f[i] = fcolor16((f32)(i % 251) / 250.f, (f32)(i * 7 % 239) / 238.f, (f32)(i * 13 % 101) / 100.f, (f32)(i % 17) / 16.f);
+            d->b[i] = to_bcolor(d->f[i]);
+        }
+
+        add("color/to_fcolor", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { to_fcolor(span<const bcolor4>(d->b), span<fcolor16>(d->out)); keep(d->out[k % count]); }
+        }, count);
+        add("color/to_bcolor", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { to_bcolor(span<const fcolor16>(d->f), span<bcolor4>(d->b)); keep(d->b[k % count]); }
+        }, count);
+        add("color/srgb_to_linear", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { srgb_to_linear(span<const fcolor16>(d->f), span<fcolor16>(d->out), precise); keep(d->out[k % count]); }
+        }, count);
+        add("color/srgb_to_linear_fast", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { srgb_to_linear(span<const fcolor16>(d->f), span<fcolor16>(d->out), fast); keep(d->out[k % count]); }
+        }, count);
+        add("color/linear_to_srgb", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { linear_to_srgb(span<const fcolor16>(d->f), span<fcolor16>(d->out), precise); keep(d->out[k % count]); }
+        }, count);
+        add("color/linear_to_srgb_fast", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { linear_to_srgb(span<const fcolor16>(d->f), span<fcolor16>(d->out), fast); keep(d->out[k % count]); }
+        }, count);
+        add("color/srgb8_to_linear", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { srgb8_to_linear(span<const bcolor4>(d->b), span<fcolor16>(d->out)); keep(d->out[k % count]); }
+        }, count);
+        add("color/linear_to_srgb8", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { linear_to_srgb8(span<const fcolor16>(d->f), span<bcolor4>(d->b)); keep(d->b[k % count]); }
+        }, count);
+        // Premultiplying twice would drift, so each pass starts from the source
+        add("color/premultiply", [d](u64 n) {
+            for (u64 k = 0; k < n; k++) { memcpy(d->out, d->f, sizeof(d->f)); premultiply(span<fcolor16>(d->out)); keep(d->out[k % count]); }
+        }, count);
+        add("color/premultiply_u8", [d](u64 n) {
+            std::vector<bcolor4> src(d->b, d->b + count);
+            for (u64 k = 0; k < n; k++) { memcpy(d->b, src.data(), sizeof(d->b)); premultiply(span<bcolor4>(d->b)); keep(d->b[k % count]); }
+        }, count);
+        add("color/unpremultiply_u8", [d](u64 n) {
+            std::vector<bcolor4> src(d->b, d->b + count);
+            for (u64 k = 0; k < n; k++) { memcpy(d->b, src.data(), sizeof(d->b)); unpremultiply(span<bcolor4>(d->b)); keep(d->b[k % count]); }
+        }, count);
+    }
+
+    void register_vector() {
+        register_scalar<f32>("f32");
+        register_scalar<f64>("f64");
+        register_scalar<u8>("u8");
+        register_scalar<s8>("s8");
+        register_scalar<u16>("u16");
+        register_scalar<s16>("s16");
+        register_scalar<u32>("u32");
+        register_scalar<s32>("s32");
+        register_scalar<u64>("u64");
+        register_scalar<s64>("s64");
+        register_scalar<q16_16>("q16_16");
+        register_scalar<q32_32>("q32_32");
+
+        register_trig<f32>("f32");
+        register_trig<f64>("f64");
+        register_trig<q16_16>("q16_16");
+        register_trig<q32_32>("q32_32");
+
+        register_expr();
+
+        register_packed<hvec3, fvec3>("hvec3");
+        register_packed<hvec4, fvec4>("hvec4");
+        register_packed<unorm8vec4, fvec4>("unorm8vec4");
+        register_packed<snorm16vec3, fvec3>("snorm16vec3");
+        register_packed<snorm1010102, fvec4>("snorm1010102");
+        register_packed<oct32, fvec3>("oct32");
+
+        register_color();
+    }
+}
@@ -0,0 +1,165 @@
+/*
+    mz_bench: times the hot mz primitives and optionally compares against
+    a stored baseline.
+
+        mz_bench [--filter <substring>] [--min-time <ms>] [--repeat <n>]
+                 [--json <out.json>] [--baseline <in.json>] [--threshold <fraction>]
+
+    With --baseline, every benchmark present in both runs is compared and
+    the exit code is 1 if any got slower than the baseline by more than
+    threshold (default 0.10 = 10%).
+*/
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.hpp"
+
+namespace bench {
+
+    std::vector<benchmark>& registry() {
+        static std::vector<benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    static f64 time_ns(const benchmark& b, u64 n) {
+        auto start = std::chrono::steady_clock::now();
+        b.run(n);
+        return std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static result measure(const benchmark& b, f64 min_time_ns, u32 repeat) {
+        // Grow n until one run is long enough to time reliably
+        u64 n = 1;
+        f64 elapsed = time_ns(b, n);
+        while (elapsed < min_time_ns) {
+            f64 scale = elapsed > 0 ? min_time_ns / elapsed * 1.2 : 10.0;
+            if (scale > 10.0) scale = 10.0;
+            if (scale < 2.0)  scale = 2.0;
+            n = (u64)((f64)n * scale);
+            elapsed = time_ns(b, n);
+        }
+
+        f64 best = elapsed;
+        for (u32 r = 1; r < repeat; r++) {
+            f64 t = time_ns(b, n);
+            if (t < best) best = t;
+        }
+
+        f64 ns_per_op = best / (f64)n;
+        return { b.name, ns_per_op, (f64)b.items_per_op * 1e9 / ns_per_op, n };
+    }
+
+    static bool write_json(const char* path, const std::vector<result>& results) {
+        std::ofstream out(path);
+        if (!out) return false;
+
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const result& r = results[i];
+            char line[512];
+            snprintf(line, sizeof(line), "    { \"name\": \"%s\", \"ns_per_op\": %.4f, \"items_per_second\": %.1f, \"iterations\": %llu }%s\n",
+                r.name.c_str(), r.ns_per_op, r.items_per_second, (unsigned long long)r.iterations, i + 1 < results.size() ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+        return (bool)out;
+    }
+
+    // Reads the name -> ns_per_op pairs of a file written by write_json
+    static bool read_json(const char* path, std::map<std::string, f64>& baseline) {
+        std::ifstream in(path);
+        if (!in) return false;
+
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string text = ss.str();
+
+        const std::string name_key = "\"name\": \"", ns_key = "\"ns_per_op\": ";
+        size_t pos = 0;
+        while ((pos = text.find(name_key, pos)) != std::string::npos) {
+            pos += name_key.size();
+            size_t name_end = text.find('"', pos);
+            size_t ns_pos = text.find(ns_key, name_end);
+            if (name_end == std::string::npos || ns_pos == std::string::npos) return false;
+
+            baseline[text.substr(pos, name_end - pos)] = strtod(text.c_str() + ns_pos + ns_key.size(), NULL);
+            pos = ns_pos;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace bench;
+
+    const char* filter = NULL;
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    f64 min_time_ms = 20.0;
+    f64 threshold = 0.10;
+    u32 repeat = 3;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if      (!strcmp(argv[i], "--filter")    && has_value) filter        = argv[++i];
+        else if (!strcmp(argv[i], "--json")      && has_value) json_path     = argv[++i];
+        else if (!strcmp(argv[i], "--baseline")  && has_value) baseline_path = argv[++i];
+        else if (!strcmp(argv[i], "--min-time")  && has_value) min_time_ms   = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--threshold") && has_value) threshold     = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--repeat")    && has_value) repeat        = (u32)atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <ms>] [--repeat <n>] [--json <out.json>] [--baseline <in.json>] [--threshold <fraction>]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repeat == 0) repeat = 1;
+
+    std::map<std::string, f64> baseline;
+    if (baseline_path && !read_json(baseline_path, baseline)) {
+        fprintf(stderr, "could not read baseline '%s'\n", baseline_path);
+        return 2;
+    }
+
+    register_vector();
+    register_matrix();
+    register_algorithms();
+    register_broadphase();
+
+    std::vector<result> results;
+    u32 regressions = 0;
+    printf("%-48s %14s %16s %10s\n", "benchmark", "ns/op", "items/s", baseline_path ? "vs base" : "");
+    for (const benchmark& b : registry()) {
+        if (filter && b.name.find(filter) == std::string::npos) continue;
+
+        result r = measure(b, min_time_ms * 1e6, repeat);
+        results.push_back(r);
+
+        char delta[32] = "";
+        auto base = baseline.find(r.name);
+        if (base != baseline.end() && base->second > 0) {
+            f64 change = r.ns_per_op / base->second - 1.0;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            snprintf(delta, sizeof(delta), "%+8.1f%%%s", change * 100.0, regressed ? " !" : "");
+        }
+        printf("%-48s %14.3f %16.4g %10s\n", r.name.c_str(), r.ns_per_op, r.items_per_second, delta);
+        fflush(stdout);
+    }
+
+    if (json_path && !write_json(json_path, results)) {
+        fprintf(stderr, "could not write '%s'\n", json_path);
+        return 2;
+    }
+
+    if (baseline_path) {
+        printf("\n%u regression(s) over %.0f%%\n", regressions, threshold * 100.0);
+        return regressions ? 1 : 0;
+    }
+    return 0;
+}
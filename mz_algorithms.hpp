@@ -25,16 +25,30 @@ SOFTWARE.
 
 */
 
+#include <algorithm>
+#include <vector>
+
+#include "mz_parallel.hpp"
 #include "mz_vector.hpp"
 
 namespace mz {
+    // Edges of a rect, which is laid out as (x, y, width, height)
+    template <typename value_t>
+    constexpr mz_force_inline value_t rect_left(const rect<value_t>& r)   { return r.x; }
+    template <typename value_t>
+    constexpr mz_force_inline value_t rect_right(const rect<value_t>& r)  { return r.x + r.width; }
+    template <typename value_t>
+    constexpr mz_force_inline value_t rect_bottom(const rect<value_t>& r) { return r.y; }
+    template <typename value_t>
+    constexpr mz_force_inline value_t rect_top(const rect<value_t>& r)    { return r.y + r.height; }
+
     template <typename lhs_t, typename rhs_t>
     constexpr inline bool rect_contains(const rect<lhs_t>& r, const vec2<rhs_t>& p) {
         static_assert(std::is_convertible<lhs_t, rhs_t>() || std::is_convertible<rhs_t, lhs_t>(), "mz::contains: types are not convertible");
         if constexpr (std::is_convertible<lhs_t, rhs_t>()) {
-            return p.x > (rhs_t)r.left() && p.x < (rhs_t)r.right() && p.y > (rhs_t)r.bot() && p.y < (rhs_t)r.top();
+            return (rhs_t)rect_left(r) < p.x && (rhs_t)rect_right(r) > p.x && (rhs_t)rect_bottom(r) < p.y && (rhs_t)rect_top(r) > p.y;
         } else {
-            return (rhs_t)p.x > r.left() && (rhs_t)p.x < r.right() && (rhs_t)p.y > r.bot() && (rhs_t)p.y < r.top();
+            return rect_left(r) < (lhs_t)p.x && rect_right(r) > (lhs_t)p.x && rect_bottom(r) < (lhs_t)p.y && rect_top(r) > (lhs_t)p.y;
         }
     }
 
@@ -43,16 +57,16 @@ namespace mz {
         static_assert(std::is_convertible<lhs_t, rhs_t>() || std::is_convertible<rhs_t, lhs_t>(), "mz::intersects: types are not convertible");
 
         if constexpr (std::is_convertible<lhs_t, rhs_t>()) {
-            return (rhs_t)a.left()   < b.right() && (rhs_t)a.right() > b.left() 
-                && (rhs_t)a.bottom() < b.top()   && (rhs_t)a.top()   > b.bottom();
+            return (rhs_t)rect_left(a)   < rect_right(b) && (rhs_t)rect_right(a) > rect_left(b) 
+                && (rhs_t)rect_bottom(a) < rect_top(b)   && (rhs_t)rect_top(a)   > rect_bottom(b);
         } else {
-            return a.left()   < (lhs_t)b.right() && a.right() > (lhs_t)b.left() 
-                && a.bottom() < (lhs_t)b.top()   && a.top()   > (lhs_t)b.bottom();
+            return rect_left(a)   < (lhs_t)rect_right(b) && rect_right(a) > (lhs_t)rect_left(b) 
+                && rect_bottom(a) < (lhs_t)rect_top(b)   && rect_top(a)   > (lhs_t)rect_bottom(b);
         }
     }
 
     template <typename lhs_t, typename rhs_t, typename intersection_t = f32>
-    constexpr inline bool ray2ds_intersect(const ray2d<lhs_t>& a, const ray2d<rhs_t>& b, const vec2<intersection_t>* intersection = NULL) {
+    constexpr inline bool ray2ds_intersect(const ray2d<lhs_t>& a, const ray2d<rhs_t>& b, vec2<intersection_t>* intersection = NULL) {
         static_assert(std::is_convertible<lhs_t, rhs_t>() || std::is_convertible<rhs_t, lhs_t>(), "mz::intersects: types are not convertible");
 
         if constexpr (std::is_convertible<lhs_t, rhs_t>()) {
@@ -60,9 +74,13 @@ namespace mz {
             s1_x = (rhs_t)(a.p2.x - a.p1.x); s1_y = (rhs_t)(a.p2.y - a.p1.y);
             s2_x = b.p2.x - b.p1.x; s2_y = b.p2.y - b.p1.y;
 
+            // Parallel or degenerate segments never intersect
+            rhs_t denom = -s2_x * s1_y + s1_x * s2_y;
+            if (denom == 0) return false;
+
             rhs_t s, t;
-            s = (-s1_y * ((rhs_t)a.p1.x - b.p1.x) + s1_x * ((rhs_t)a.p1.y - b.p1.y)) / (-s2_x * s1_y + s1_x * s2_y);
-            t = ( s2_x * ((rhs_t)a.p1.y - b.p1.y) - s2_y * ((rhs_t)a.p1.x - b.p1.x)) / (-s2_x * s1_y + s1_x * s2_y);
+            s = (-s1_y * ((rhs_t)a.p1.x - b.p1.x) + s1_x * ((rhs_t)a.p1.y - b.p1.y)) / denom;
+            t = ( s2_x * ((rhs_t)a.p1.y - b.p1.y) - s2_y * ((rhs_t)a.p1.x - b.p1.x)) / denom;
 
             if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
             {
@@ -79,9 +97,13 @@ namespace mz {
             s1_x = a.p2.x - a.p1.x; s1_y = a.p2.y - a.p1.y;
             s2_x = (lhs_t)(b.p2.x - b.p1.x); s2_y = (lhs_t)(b.p2.y - b.p1.y);
 
+            // Parallel or degenerate segments never intersect
+            lhs_t denom = -s2_x * s1_y + s1_x * s2_y;
+            if (denom == 0) return false;
+
             lhs_t s, t;
-            s = (-s1_y * (a.p1.x - (lhs_t)b.p1.x) + s1_x * (a.p1.y - (lhs_t)b.p1.y)) / (-s2_x * s1_y + s1_x * s2_y);
-            t = ( s2_x * (a.p1.y - (lhs_t)b.p1.y) - s2_y * (a.p1.x - (lhs_t)b.p1.x)) / (-s2_x * s1_y + s1_x * s2_y);
+            s = (-s1_y * (a.p1.x - (lhs_t)b.p1.x) + s1_x * (a.p1.y - (lhs_t)b.p1.y)) / denom;
+            t = ( s2_x * (a.p1.y - (lhs_t)b.p1.y) - s2_y * (a.p1.x - (lhs_t)b.p1.x)) / denom;
 
             if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
             {
@@ -96,6 +118,112 @@ namespace mz {
         }
     }
 
+    /*
+        Result of ray2d_intersect_batch. nearest is the index of the closest
+        segment hit (-1 if none), t the fraction along the cast segment at
+        which it is hit and point the hit position.
+    */
+    template <typename value_t>
+    struct Ray2DBatchHit {
+        s64 nearest = -1;
+        value_t t = 0;
+        vec2<value_t> point;
+        size_t count = 0;
+    };
+
+    /*
+        Tests the segment ray against every segment in segments, with the
+        same math as ray2ds_intersect. Bit i of hits (word i / 64, bit
+        i % 64) is set if segments[i] is hit, and ts[i] receives its
+        fraction along ray; both are optional and ts is only written for
+        hit segments. Spans shorter than that only get their first
+        hits.size() * 64 bits and ts.size() fractions; the returned result
+        still covers every segment. Segments whose bounds miss the ray's
+        bounds, or that are parallel to it, are rejected before any
+        division. f32 runs 4 segments at a time on SIMD backends.
+    */
+    template <typename value_t>
+    inline Ray2DBatchHit<value_t> ray2d_intersect_batch(const ray2d<value_t>& ray, span<const ray2d<typename vec4<value_t>::value_type>> segments, 
+                                                        span<u64> hits = {}, span<typename vec4<value_t>::value_type> ts = {}) {
+        static_assert(std::is_floating_point<value_t>::value, "mz::ray2d_intersect_batch: only floating point segments are supported");
+
+        Ray2DBatchHit<value_t> result;
+        const size_t n = segments.size();
+        for (size_t w = 0; w < (n + 63) / 64 && w < hits.size(); w++) hits[w] = 0;
+
+        const value_t s1_x = ray.p2.x - ray.p1.x, s1_y = ray.p2.y - ray.p1.y;
+        const value_t min_x = std::min(ray.p1.x, ray.p2.x), max_x = std::max(ray.p1.x, ray.p2.x);
+        const value_t min_y = std::min(ray.p1.y, ray.p2.y), max_y = std::max(ray.p1.y, ray.p2.y);
+
+        auto report = [&](size_t i, value_t t) {
+            result.count++;
+            if (i / 64 < hits.size()) hits[i / 64] |= (u64)1 << (i % 64);
+            if (i < ts.size())        ts[i] = t;
+            if (result.nearest < 0 || t < result.t) {
+                result.nearest = (s64)i;
+                result.t = t;
+            }
+        };
+
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            using namespace simd;
+            const f32x4 v_s1_x = set1(s1_x), v_s1_y = set1(s1_y);
+            const f32x4 v_p1_x = set1(ray.p1.x), v_p1_y = set1(ray.p1.y);
+            const f32x4 v_min_x = set1(min_x), v_max_x = set1(max_x);
+            const f32x4 v_min_y = set1(min_y), v_max_y = set1(max_y);
+            const f32x4 zero = set1(0.f), one = set1(1.f);
+
+            for (const size_t simd_end = n & ~(size_t)3; i < simd_end; i += 4) {
+                f32x4 p1_x, p1_y, p2_x, p2_y;
+                load4(segments[i].ptr, p1_x, p1_y, p2_x, p2_y);
+
+                f32x4 candidate = bit_and(bit_and(cmpge(max(p1_x, p2_x), v_min_x), cmple(min(p1_x, p2_x), v_max_x)),
+                                          bit_and(cmpge(max(p1_y, p2_y), v_min_y), cmple(min(p1_y, p2_y), v_max_y)));
+                if (!movemask(candidate)) continue;
+
+                f32x4 s2_x = sub(p2_x, p1_x), s2_y = sub(p2_y, p1_y);
+                f32x4 denom = sub(mul(v_s1_x, s2_y), mul(s2_x, v_s1_y));
+                candidate = bit_and(candidate, cmpneq(denom, zero));
+                if (!movemask(candidate)) continue;
+
+                f32x4 dx = sub(v_p1_x, p1_x), dy = sub(v_p1_y, p1_y);
+                f32x4 s = div(sub(mul(v_s1_x, dy), mul(v_s1_y, dx)), denom);
+                f32x4 t = div(sub(mul(s2_x, dy), mul(s2_y, dx)), denom);
+
+                f32x4 hit = bit_and(bit_and(cmpge(s, zero), cmple(s, one)), bit_and(cmpge(t, zero), cmple(t, one)));
+                u32 mask = movemask(bit_and(candidate, hit));
+                if (!mask) continue;
+
+                f32 lanes[4];
+                store(lanes, t);
+                for (u32 lane = 0; lane < 4; lane++) {
+                    if (mask & (1u << lane)) report(i + lane, lanes[lane]);
+                }
+            }
+        }
+
+        for (; i < n; i++) {
+            const ray2d<value_t>& seg = segments[i];
+            if (std::max(seg.p1.x, seg.p2.x) < min_x || std::min(seg.p1.x, seg.p2.x) > max_x
+             || std::max(seg.p1.y, seg.p2.y) < min_y || std::min(seg.p1.y, seg.p2.y) > max_y) continue;
+
+            value_t s2_x = seg.p2.x - seg.p1.x, s2_y = seg.p2.y - seg.p1.y;
+            value_t denom = s1_x * s2_y - s2_x * s1_y;
+            if (denom == 0) continue;
+
+            value_t dx = ray.p1.x - seg.p1.x, dy = ray.p1.y - seg.p1.y;
+            value_t s = (s1_x * dy - s1_y * dx) / denom;
+            value_t t = (s2_x * dy - s2_y * dx) / denom;
+            if (s >= 0 && s <= 1 && t >= 0 && t <= 1) report(i, t);
+        }
+
+        if (result.nearest >= 0) {
+            result.point = vec2<value_t>(ray.p1.x + result.t * s1_x, ray.p1.y + result.t * s1_y);
+        }
+        return result;
+    }
+
     template <typename value_t>
     struct Polygon2D {
         typedef vec2<value_t> vec2_t;
@@ -103,50 +231,561 @@ namespace mz {
         u32 npoints;
     };
 
+    /*
+        SAT over the edge normals of a only. Returns true if one of them
+        separates a and b. Normals are left unnormalized since only the
+        ordering of projections matters.
+    */
+    template <typename lhs_t, typename rhs_t = lhs_t>
+    inline bool polygon2d_edges_separate(const Polygon2D<lhs_t>& a, const Polygon2D<rhs_t>& b) {
+        typedef typename std::common_type<lhs_t, rhs_t>::type value_t;
+
+        vec2<value_t> prev = a.points[a.npoints - 1];
+        for (u32 i = 0; i < a.npoints; i++) {
+            vec2<value_t> cur = a.points[i];
+            vec2<value_t> axis(prev.y - cur.y, cur.x - prev.x);
+            prev = cur;
+
+            value_t a_min = axis.dot(vec2<value_t>(a.points[0])), a_max = a_min;
+            for (u32 j = 1; j < a.npoints; j++) {
+                value_t proj = axis.dot(vec2<value_t>(a.points[j]));
+                if (proj < a_min) a_min = proj;
+                if (proj > a_max) a_max = proj;
+            }
+
+            value_t b_min = axis.dot(vec2<value_t>(b.points[0])), b_max = b_min;
+            for (u32 j = 1; j < b.npoints; j++) {
+                value_t proj = axis.dot(vec2<value_t>(b.points[j]));
+                if (proj < b_min) b_min = proj;
+                if (proj > b_max) b_max = proj;
+            }
+
+            if (a_max < b_min || b_max < a_min) return true;
+        }
+        return false;
+    }
+
+    // SAT over the edge normals of both polygons; touching counts as intersecting
     template <typename lhs_t, typename rhs_t>
-    inline bool polygon2ds_intersect(const Polygon2D<lhs_t>& a, const Polygon2D<rhs_t>& b)
-    {
-        // loop over the vertices(-> edges -> axis) of the first polygon
-        for(auto i = 0u; i < a.npoints + 0; ++i) {
-            // calculate the normal vector of the current edge
-            // this is the axis will we check in this loop
-            auto current = a.points[i];
-            auto next = a.points[(i + 1) % a.npoints];
-            auto edge = next - current;
-
-            vec2<rhs_t> axis;
-            axis.x = -edge.normalize().y;
-            axis.y = edge.normalize().x;
-
-            // loop over all vertices of both polygons and project them
-            // onto the axis. We are only interested in max/min projections
-            auto aMaxProj = -std::numeric_limits<float>::infinity();
-            auto aMinProj = std::numeric_limits<float>::infinity();
-            auto bMaxProj = -std::numeric_limits<float>::infinity();
-            auto bMinProj = std::numeric_limits<float>::infinity();
-            for (u32 j = 0; j < a.npoints; j++) {
-                auto proj = axis.dot(a.points[j]);
-                if(proj < aMinProj) aMinProj = proj;
-                if(proj > aMaxProj) aMaxProj = proj;
-            }
-
-            for (u32 j = 0; j < b.npoints; j++) {
-                auto proj = axis.dot(b.points[j]);
-                if(proj < bMinProj) bMinProj = proj;
-                if(proj > bMaxProj) bMaxProj = proj;
-            }
-
-            // now check if the intervals the both polygons projected on the
-            // axis overlap. If they don't, we have found an axis of separation and
-            // the given polygons cannot overlap
-            if(aMaxProj < bMinProj || aMinProj > bMaxProj) {
-                return false;
-            }
-        }
-
-        // at this point, we have checked all axis but found no separating axis
-        // which means that the polygons must intersect.
-        return true;
+    inline bool polygon2ds_intersect(const Polygon2D<lhs_t>& a, const Polygon2D<rhs_t>& b) {
+        return !polygon2d_edges_separate(a, b) && !polygon2d_edges_separate(b, a);
+    }
+
+    template <typename value_t>
+    struct Polygon2DSeparation {
+        // Unit axis of least overlap, pointing from a towards b
+        vec2<value_t> normal;
+        // Overlap along normal if intersecting (push b by normal * depth to
+        // resolve), otherwise minus the gap along the best separating axis
+        value_t depth;
+        bool intersects;
+    };
+
+    // Full SAT (edge normals of both polygons) tracking the axis of least overlap
+    template <typename value_t>
+    inline Polygon2DSeparation<value_t> polygon2ds_separation(const Polygon2D<value_t>& a, const Polygon2D<value_t>& b) {
+        Polygon2DSeparation<value_t> result;
+        result.depth = std::numeric_limits<value_t>::max();
+        result.intersects = true;
+
+        const Polygon2D<value_t>* polys[2] = { &a, &b };
+        for (u32 p = 0; p < 2; p++) {
+            const Polygon2D<value_t>& poly = *polys[p];
+            vec2<value_t> prev = poly.points[poly.npoints - 1];
+            for (u32 i = 0; i < poly.npoints; i++) {
+                vec2<value_t> cur = poly.points[i];
+                vec2<value_t> axis = vec2<value_t>(prev.y - cur.y, cur.x - prev.x).normalize();
+                prev = cur;
+
+                value_t a_min = axis.dot(a.points[0]), a_max = a_min;
+                for (u32 j = 1; j < a.npoints; j++) {
+                    value_t proj = axis.dot(a.points[j]);
+                    if (proj < a_min) a_min = proj;
+                    if (proj > a_max) a_max = proj;
+                }
+                value_t b_min = axis.dot(b.points[0]), b_max = b_min;
+                for (u32 j = 1; j < b.npoints; j++) {
+                    value_t proj = axis.dot(b.points[j]);
+                    if (proj < b_min) b_min = proj;
+                    if (proj > b_max) b_max = proj;
+                }
+
+                // Overlap when pushing b along +axis vs -axis
+                value_t forward  = a_max - b_min;
+                value_t backward = b_max - a_min;
+                value_t overlap  = forward < backward ? forward : backward;
+
+                if (overlap < (value_t)0) {
+                    if (result.intersects || overlap > result.depth) {
+                        result.intersects = false;
+                        result.depth = overlap;
+                        result.normal = forward < backward ? axis : -axis;
+                    }
+                } else if (result.intersects && overlap < result.depth) {
+                    result.depth = overlap;
+                    result.normal = forward < backward ? axis : -axis;
+                }
+            }
+        }
+        return result;
+    }
+
+    /*
+        GJK and EPA on convex polygons of either winding.
+
+        polygon2ds_intersect_gjk answers the same question as
+        polygon2ds_intersect, usually in a handful of support queries
+        instead of O(n * (n + m)) projections. polygon2ds_contact also
+        returns contact data: when the polygons are apart, GJK's closest
+        points and distance; when they overlap, EPA's penetration depth
+        and normal, with the deepest points of each polygon.
+
+        Supports walk the polygon from the vertex found last time instead of
+        scanning it, since d.p has a single maximum over a convex polygon.
+        Pass the same Polygon2DSimplex for a pair frame after frame: GJK
+        starts from the vertices it ended on, which for slowly moving pairs
+        is usually already the answer. A fresh one (count 0) starts cold.
+    */
+    template <typename value_t>
+    struct Polygon2DSimplex {
+        // Vertex indices into a and b of each simplex point
+        u32 a[3], b[3];
+        u32 count = 0;
+    };
+
+    template <typename value_t>
+    struct Polygon2DContact {
+        // Unit axis from a towards b: push b by normal * depth to separate them
+        vec2<value_t> normal;
+        // Penetration depth if intersecting, otherwise minus the distance
+        value_t depth;
+        // Deepest (intersecting) or closest (apart) points, point_b - point_a = -normal * depth
+        vec2<value_t> point_a, point_b;
+        bool intersects;
+    };
+
+    namespace detail {
+        template <typename value_t>
+        constexpr mz_force_inline value_t cross2(const vec2<value_t>& a, const vec2<value_t>& b) {
+            return a.x * b.y - a.y * b.x;
+        }
+
+        // Vertex of poly furthest along d, hill climbing from start
+        template <typename value_t>
+        inline u32 polygon2d_support(const Polygon2D<value_t>& poly, const vec2<value_t>& d, u32 start) {
+            const u32 n = poly.npoints;
+            u32 i = start < n ? start : 0;
+            value_t best = d.dot(poly.points[i]);
+            for (u32 steps = 0; steps < n; steps++) {
+                const u32 next = i + 1 == n ? 0 : i + 1;
+                const u32 prev = i == 0 ? n - 1 : i - 1;
+                const value_t dn = d.dot(poly.points[next]);
+                const value_t dp = d.dot(poly.points[prev]);
+                if (dn > best && dn >= dp) { i = next; best = dn; }
+                else if (dp > best)        { i = prev; best = dp; }
+                else {
+                    // Stuck: a maximum unless a neighbour ties it up to rounding (collinear or
+                    // near duplicate points), when the climb may have stopped short of it
+                    const vec2<value_t> p = poly.points[i];
+                    const value_t tolerance = 8 * std::numeric_limits<value_t>::epsilon() * (std::abs(d.x * p.x) + std::abs(d.y * p.y));
+                    if (dn < best - tolerance && dp < best - tolerance) return i;
+                    break;
+                }
+            }
+
+            for (u32 j = 0; j < n; j++) {
+                const value_t dj = d.dot(poly.points[j]);
+                if (dj > best) { i = j; best = dj; }
+            }
+            return i;
+        }
+
+        // Point of the Minkowski difference b - a, with the vertices it comes from
+        template <typename value_t>
+        struct gjk_vertex {
+            vec2<value_t> wa, wb, w;
+            value_t u;
+            u32 ia, ib;
+
+            mz_force_inline void set(const Polygon2D<value_t>& a, const Polygon2D<value_t>& b, u32 va, u32 vb) {
+                ia = va;
+                ib = vb;
+                wa = a.points[va];
+                wb = b.points[vb];
+                w = wb - wa;
+            }
+        };
+
+        // Closest point of the segment s[0] s[1] to the origin, dropping s[1] if that's s[0]
+        template <typename value_t>
+        inline void gjk_solve2(gjk_vertex<value_t>* s, u32& count) {
+            const vec2<value_t> e = s[1].w - s[0].w;
+            const value_t d2 = -s[0].w.dot(e);
+            if (d2 <= (value_t)0) {
+                s[0].u = (value_t)1;
+                count = 1;
+                return;
+            }
+            const value_t d1 = s[1].w.dot(e);
+            if (d1 <= (value_t)0) {
+                s[0] = s[1];
+                s[0].u = (value_t)1;
+                count = 1;
+                return;
+            }
+            const value_t inv = (value_t)1 / (d1 + d2);
+            s[0].u = d1 * inv;
+            s[1].u = d2 * inv;
+            count = 2;
+        }
+
+        // Same for the triangle, keeping the vertices of the closest feature; count 3 contains the origin
+        template <typename value_t>
+        inline void gjk_solve3(gjk_vertex<value_t>* s, u32& count) {
+            const vec2<value_t> w1 = s[0].w, w2 = s[1].w, w3 = s[2].w;
+
+            const vec2<value_t> e12 = w2 - w1, e13 = w3 - w1, e23 = w3 - w2;
+            const value_t d12_1 = w2.dot(e12), d12_2 = -w1.dot(e12);
+            const value_t d13_1 = w3.dot(e13), d13_2 = -w1.dot(e13);
+            const value_t d23_1 = w3.dot(e23), d23_2 = -w2.dot(e23);
+
+            const value_t n123 = cross2(e12, e13);
+            const value_t d123_1 = n123 * cross2(w2, w3);
+            const value_t d123_2 = n123 * cross2(w3, w1);
+            const value_t d123_3 = n123 * cross2(w1, w2);
+
+            if (d12_2 <= (value_t)0 && d13_2 <= (value_t)0) {
+                s[0].u = (value_t)1;
+                count = 1;
+            } else if (d12_1 > (value_t)0 && d12_2 > (value_t)0 && d123_3 <= (value_t)0) {
+                const value_t inv = (value_t)1 / (d12_1 + d12_2);
+                s[0].u = d12_1 * inv;
+                s[1].u = d12_2 * inv;
+                count = 2;
+            } else if (d13_1 > (value_t)0 && d13_2 > (value_t)0 && d123_2 <= (value_t)0) {
+                const value_t inv = (value_t)1 / (d13_1 + d13_2);
+                s[0].u = d13_1 * inv;
+                s[1] = s[2];
+                s[1].u = d13_2 * inv;
+                count = 2;
+            } else if (d12_1 <= (value_t)0 && d23_2 <= (value_t)0) {
+                s[0] = s[1];
+                s[0].u = (value_t)1;
+                count = 1;
+            } else if (d13_1 <= (value_t)0 && d23_1 <= (value_t)0) {
+                s[0] = s[2];
+                s[0].u = (value_t)1;
+                count = 1;
+            } else if (d23_1 > (value_t)0 && d23_2 > (value_t)0 && d123_1 <= (value_t)0) {
+                const value_t inv = (value_t)1 / (d23_1 + d23_2);
+                s[0] = s[2];
+                s[0].u = d23_2 * inv;
+                s[1].u = d23_1 * inv;
+                count = 2;
+            } else {
+                const value_t inv = (value_t)1 / (d123_1 + d123_2 + d123_3);
+                s[0].u = d123_1 * inv;
+                s[1].u = d123_2 * inv;
+                s[2].u = d123_3 * inv;
+                count = 3;
+            }
+        }
+
+        // Closest point of the simplex to the origin, on b - a
+        template <typename value_t>
+        inline vec2<value_t> gjk_closest(const gjk_vertex<value_t>* s, u32 count) {
+            return count == 1 ? s[0].w : s[0].w * s[0].u + s[1].w * s[1].u;
+        }
+
+        // Squared distance of gjk_closest from the origin below which the
+        // polygons touch: its rounding grows with the largest vertex
+        template <typename value_t>
+        inline value_t gjk_touch_tolerance2(const gjk_vertex<value_t>* s, u32 count) {
+            const value_t tolerance = 16 * std::numeric_limits<value_t>::epsilon();
+            value_t scale = (value_t)1;
+            for (u32 i = 0; i < count; i++) scale = std::max(scale, s[i].w.dot(s[i].w));
+            return tolerance * tolerance * scale;
+        }
+
+        /*
+            GJK distance loop in the style of Box2D's b2Distance. Leaves the
+            simplex of the closest feature of b - a in s and returns its
+            count, 3 if it contains the origin. With early_out it returns 0
+            as soon as a separating axis turns up.
+        */
+        template <typename value_t>
+        inline u32 gjk(const Polygon2D<value_t>& a, const Polygon2D<value_t>& b, Polygon2DSimplex<value_t>* cache, gjk_vertex<value_t>* s, bool early_out) {
+            const value_t eps = std::numeric_limits<value_t>::epsilon();
+
+            u32 count = 0;
+            if (cache) {
+                for (; count < cache->count && count < 3; count++) {
+                    if (cache->a[count] >= a.npoints || cache->b[count] >= b.npoints) break;
+                    s[count].set(a, b, cache->a[count], cache->b[count]);
+                }
+                // Restart when the shapes changed so much that the old simplex is degenerate
+                if (count != cache->count ||
+                    (count == 2 && (s[1].w - s[0].w).dot(s[1].w - s[0].w) <= eps * eps) ||
+                    (count == 3 && std::abs(cross2(s[1].w - s[0].w, s[2].w - s[0].w)) <= eps * eps)) count = 0;
+            }
+            if (count == 0) {
+                s[0].set(a, b, 0, 0);
+                count = 1;
+            }
+            u32 last_a = s[count - 1].ia, last_b = s[count - 1].ib;
+
+            for (u32 iteration = 0; iteration < a.npoints + b.npoints + 8; iteration++) {
+                u32 saved_a[3], saved_b[3];
+                const u32 saved = count;
+                for (u32 i = 0; i < count; i++) {
+                    saved_a[i] = s[i].ia;
+                    saved_b[i] = s[i].ib;
+                }
+
+                if (count == 2) gjk_solve2(s, count);
+                else if (count == 3) gjk_solve3(s, count);
+                if (count == 3) break;
+
+                // The origin is on the simplex, ie. the polygons touch
+                const vec2<value_t> c = gjk_closest(s, count);
+                if (c.dot(c) <= gjk_touch_tolerance2(s, count)) break;
+
+                // Towards the origin from the closest feature
+                vec2<value_t> d;
+                if (count == 1) {
+                    d = -s[0].w;
+                } else {
+                    const vec2<value_t> e = s[1].w - s[0].w;
+                    d = cross2(e, -s[0].w) > (value_t)0 ? vec2<value_t>(-e.y, e.x) : vec2<value_t>(e.y, -e.x);
+                }
+
+                last_a = polygon2d_support(a, -d, last_a);
+                last_b = polygon2d_support(b, d, last_b);
+                s[count].set(a, b, last_a, last_b);
+                if (early_out && s[count].w.dot(d) < (value_t)0) {
+                    count = 0;
+                    break;
+                }
+
+                // No new vertex: converged
+                bool duplicate = false;
+                for (u32 i = 0; i < saved; i++)
+                    duplicate |= saved_a[i] == last_a && saved_b[i] == last_b;
+                if (duplicate) break;
+                count++;
+            }
+
+            if (cache) {
+                cache->count = count;
+                for (u32 i = 0; i < count; i++) {
+                    cache->a[i] = s[i].ia;
+                    cache->b[i] = s[i].ib;
+                }
+            }
+            return count;
+        }
+
+    }
+
+    // Same result as polygon2ds_intersect, see above
+    template <typename value_t>
+    inline bool polygon2ds_intersect_gjk(const Polygon2D<value_t>& a, const Polygon2D<value_t>& b, Polygon2DSimplex<value_t>* cache = NULL) {
+        detail::gjk_vertex<value_t> s[3];
+        const u32 count = detail::gjk(a, b, cache, s, true);
+        if (count == 0) return false;
+        if (count == 3) return true;
+
+        const vec2<value_t> c = detail::gjk_closest(s, count);
+        return c.dot(c) <= detail::gjk_touch_tolerance2(s, count);
+    }
+
+    // GJK, then EPA when the polygons overlap, see above
+    template <typename value_t>
+    inline Polygon2DContact<value_t> polygon2ds_contact(const Polygon2D<value_t>& a, const Polygon2D<value_t>& b, Polygon2DSimplex<value_t>* cache = NULL) {
+        typedef vec2<value_t> vec2_t;
+        const value_t eps = std::numeric_limits<value_t>::epsilon();
+
+        detail::gjk_vertex<value_t> s[3];
+        const u32 count = detail::gjk(a, b, cache, s, false);
+
+        Polygon2DContact<value_t> result;
+        if (count < 3) {
+            result.point_a = count == 1 ? s[0].wa : s[0].wa * s[0].u + s[1].wa * s[1].u;
+            result.point_b = count == 1 ? s[0].wb : s[0].wb * s[0].u + s[1].wb * s[1].u;
+            const vec2_t c = detail::gjk_closest(s, count);
+            result.intersects = c.dot(c) <= detail::gjk_touch_tolerance2(s, count);
+            if (!result.intersects) {
+                const value_t distance = c.magnitude();
+                result.normal = c / distance;
+                result.depth = -distance;
+                return result;
+            }
+        }
+
+        /*
+            EPA: grow a polygon inside b - a, always expanding the edge
+            closest to the origin, until the support along its normal adds
+            nothing. It refines only around that edge, so the 64 vertex cap
+            is rarely reached; if it is, depth comes out slightly low.
+        */
+        constexpr u32 capacity = 64;
+        detail::gjk_vertex<value_t> poly[capacity];
+        u32 n = 0;
+        if (count == 3) {
+            poly[0] = s[0];
+            poly[1] = s[1];
+            poly[2] = s[2];
+            if (detail::cross2(poly[1].w - poly[0].w, poly[2].w - poly[0].w) < (value_t)0) std::swap(poly[1], poly[2]);
+            n = 3;
+        } else {
+            // The origin is on a vertex or edge of the simplex: touching, or a deep
+            // overlap GJK happened to stop on. Start from supports along the axes
+            const vec2_t axes[4] = { vec2_t((value_t)1, (value_t)0), vec2_t((value_t)0, (value_t)1), vec2_t((value_t)-1, (value_t)0), vec2_t((value_t)0, (value_t)-1) };
+            u32 ia = s[0].ia, ib = s[0].ib;
+            for (u32 i = 0; i < 4; i++) {
+                ia = detail::polygon2d_support(a, -axes[i], ia);
+                ib = detail::polygon2d_support(b, axes[i], ib);
+                if (n == 0 || ia != poly[n - 1].ia || ib != poly[n - 1].ib) poly[n++].set(a, b, ia, ib);
+            }
+            if (n > 1 && poly[n - 1].ia == poly[0].ia && poly[n - 1].ib == poly[0].ib) n--;
+
+            // b - a has no area, ie. a or b doesn't
+            if (n < 3) {
+                const vec2_t towards_b = b.points[0] - a.points[0];
+                result.normal = towards_b.dot(towards_b) > (value_t)0 ? towards_b.normalize() : vec2_t((value_t)1, (value_t)0);
+                result.depth = (value_t)0;
+                return result;
+            }
+        }
+
+        // The distances' rounding grows with the largest vertex, see gjk_touch_tolerance2
+        value_t scale = (value_t)1;
+        for (u32 i = 0; i < n; i++) scale = std::max(scale, poly[i].w.magnitude());
+
+        u32 edge = 0;
+        vec2_t normal;
+        value_t depth = (value_t)0;
+        u32 last_a = poly[0].ia, last_b = poly[0].ib;
+        for (;;) {
+            depth = std::numeric_limits<value_t>::max();
+            for (u32 i = 0; i < n; i++) {
+                const u32 j = i + 1 == n ? 0 : i + 1;
+                const vec2_t e = poly[j].w - poly[i].w;
+                const value_t length = e.magnitude();
+                if (length <= (value_t)0) continue;
+                const vec2_t outward(e.y / length, -e.x / length);
+                const value_t distance = outward.dot(poly[i].w);
+                if (distance < depth) {
+                    depth = distance;
+                    normal = outward;
+                    edge = i;
+                }
+            }
+            if (n == capacity) break;
+
+            last_a = detail::polygon2d_support(a, -normal, last_a);
+            last_b = detail::polygon2d_support(b, normal, last_b);
+            detail::gjk_vertex<value_t> v;
+            v.set(a, b, last_a, last_b);
+            // Done once the support is already on the closest edge, or adds no
+            // more than rounding noise beyond it
+            const detail::gjk_vertex<value_t>& e0 = poly[edge];
+            const detail::gjk_vertex<value_t>& e1 = poly[edge + 1 == n ? 0 : edge + 1];
+            if ((v.ia == e0.ia && v.ib == e0.ib) || (v.ia == e1.ia && v.ib == e1.ib)) break;
+            if (normal.dot(v.w) - depth <= 16 * eps * scale) break;
+            scale = std::max(scale, v.w.magnitude());
+
+            u32 at = edge + 1;
+            for (u32 k = n; k > at; k--) poly[k] = poly[k - 1];
+            poly[at] = v;
+            n++;
+
+            // The GJK triangle needn't lie on the hull of b - a (the cold start
+            // and cached vertices are arbitrary), so drop points v makes reflex
+            for (u32 side = 0; side < 2; side++) {
+                while (n > 3) {
+                    const u32 p = side == 0 ? (at == 0 ? n - 1 : at - 1) : (at + 1 == n ? 0 : at + 1);
+                    const u32 q = side == 0 ? (p == 0 ? n - 1 : p - 1) : (p + 1 == n ? 0 : p + 1);
+                    const value_t turn = side == 0 ? detail::cross2(poly[p].w - poly[q].w, poly[at].w - poly[p].w)
+                                                   : detail::cross2(poly[p].w - poly[at].w, poly[q].w - poly[p].w);
+                    if (turn > (value_t)0) break;
+                    for (u32 k = p; k + 1 < n; k++) poly[k] = poly[k + 1];
+                    if (p < at) at--;
+                    n--;
+                }
+            }
+        }
+
+        // Point of the closest edge nearest to the origin, on both polygons
+        const detail::gjk_vertex<value_t>& p0 = poly[edge];
+        const detail::gjk_vertex<value_t>& p1 = poly[edge + 1 == n ? 0 : edge + 1];
+        const vec2_t e = p1.w - p0.w;
+        value_t t = e.dot(e) > (value_t)0 ? (normal * depth - p0.w).dot(e) / e.dot(e) : (value_t)0;
+        t = std::min(std::max(t, (value_t)0), (value_t)1);
+
+        result.intersects = true;
+        result.normal = -normal;
+        result.depth = depth;
+        result.point_a = p0.wa + (p1.wa - p0.wa) * t;
+        result.point_b = p0.wb + (p1.wb - p0.wb) * t;
+        return result;
+    }
+
+    /*
+        Many polygons flattened into one vertex buffer. Polygon i is the
+        points [ranges[i].x, ranges[i].x + ranges[i].y), ie. each range is
+        (offset, count).
+    */
+    template <typename value_t>
+    struct Polygon2DSoup {
+        typedef value_t value_type;
+
+        span<const vec2<value_t>> points;
+        span<const uvec2> ranges;
+
+        mz_force_inline Polygon2D<value_t> operator[](size_t i) const {
+            return { points.ptr + ranges[i].x, ranges[i].y };
+        }
+        mz_force_inline size_t size() const {
+            return ranges.size();
+        }
+    };
+
+    /*
+        Narrow phase for many candidate pairs at once. Bit i of hits (word
+        i / 64, bit i % 64) is set if the polygons pairs[i].x and pairs[i].y
+        of soup intersect. hits needs (pairs.size() + 63) / 64 words; with
+        fewer, only the first hits.size() * 64 pairs are tested. Uses full
+        SAT over both polygons' edges, with unnormalized axes.
+    */
+    template <typename value_t>
+    inline void polygon2ds_intersect_batch(const Polygon2DSoup<value_t>& soup, span<const uvec2> pairs, span<u64> hits, parallelism par = {}) {
+        size_t n = pairs.size();
+        if (hits.size() < (n + 63) / 64) n = hits.size() * 64;
+        // 512 pairs = 8 words = one cache line of output per chunk boundary
+        parallel_for(n, 512, par, [&](size_t begin, size_t end) {
+            for (size_t word_begin = begin; word_begin < end; word_begin += 64) {
+                size_t word_end = word_begin + 64 < end ? word_begin + 64 : end;
+                u64 word = 0;
+                for (size_t i = word_begin; i < word_end; i++) {
+                    Polygon2D<value_t> a = soup[pairs[i].x];
+                    Polygon2D<value_t> b = soup[pairs[i].y];
+                    if (!polygon2d_edges_separate(a, b) && !polygon2d_edges_separate(b, a))
+                        word |= (u64)1 << (i - word_begin);
+                }
+                hits[word_begin / 64] = word;
+            }
+        });
+    }
+
+    // Same as polygon2ds_intersect_batch but writes full separation data per pair
+    template <typename value_t>
+    inline void polygon2ds_separation_batch(const Polygon2DSoup<value_t>& soup, span<const uvec2> pairs, span<Polygon2DSeparation<typename Polygon2DSoup<value_t>::value_type>> out, parallelism par = {}) {
+        size_t n = pairs.size() < out.size() ? pairs.size() : out.size();
+        parallel_for(n, 64, par, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                out[i] = polygon2ds_separation(soup[pairs[i].x], soup[pairs[i].y]);
+        });
     }
 
     template <typename lhs_t, typename rhs_t>
@@ -0,0 +1,712 @@
+#pragma once
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mz_algorithms.hpp"
+#include "mz_hashmap.hpp"
+
+namespace mz {
+
+    /*
+        Uniform grid (spatial hash) broadphase over rect<value_t>. Every
+        proxy is registered in each cell its rect touches; cells are hashed
+        so the grid is unbounded and only occupied cells cost memory.
+
+        move() is incremental: a proxy whose rect stays within the same cell
+        range is only updated in place, otherwise just the cells that were
+        entered or left are touched. rebuild() replaces the whole contents
+        when most proxies changed anyway.
+
+        Overlaps are reported with rects_intersect as the final filter, so
+        rects that only share an edge do not count as overlapping. Queries
+        stamp proxies to avoid duplicate reports and are therefore not safe
+        to run concurrently on the same grid.
+    */
+    template <typename value_t>
+    struct uniform_grid {
+        typedef rect<value_t> rect_type;
+
+        explicit uniform_grid(value_t cell_size)
+            : _cell_size(cell_size), _inv_cell_size(1.0 / (f64)cell_size) {}
+
+        u32 insert(const rect_type& r) {
+            u32 id;
+            if (!_free.empty()) {
+                id = _free.back();
+                _free.pop_back();
+            } else {
+                id = (u32)_proxies.size();
+                _proxies.emplace_back();
+            }
+
+            proxy& p = _proxies[id];
+            p.r      = r;
+            p.cells  = cell_range(r);
+            p.stamp  = 0;
+            p.alive  = true;
+            add_to_cells(id, p.cells);
+            _count++;
+            return id;
+        }
+
+        void move(u32 id, const rect_type& r) {
+            proxy& p = _proxies[id];
+            p.r = r;
+
+            ivec4 cells = cell_range(r);
+            if (cells == p.cells) return;
+
+            // Leave cells outside the new range, enter cells outside the old one
+            for (s32 y = p.cells.y; y <= p.cells.w; y++) {
+                for (s32 x = p.cells.x; x <= p.cells.z; x++) {
+                    if (!in_range(cells, x, y)) remove_from_cell(id, ivec2(x, y));
+                }
+            }
+            for (s32 y = cells.y; y <= cells.w; y++) {
+                for (s32 x = cells.x; x <= cells.z; x++) {
+                    if (!in_range(p.cells, x, y)) _cells[ivec2(x, y)].push_back(id);
+                }
+            }
+            p.cells = cells;
+        }
+
+        void remove(u32 id) {
+            proxy& p = _proxies[id];
+            for (s32 y = p.cells.y; y <= p.cells.w; y++) {
+                for (s32 x = p.cells.x; x <= p.cells.z; x++) {
+                    remove_from_cell(id, ivec2(x, y));
+                }
+            }
+            p.alive = false;
+            _free.push_back(id);
+            _count--;
+        }
+
+        // Replaces all proxies; the id of rects[i] becomes i
+        void rebuild(span<const rect_type> rects) {
+            clear();
+            _proxies.resize(rects.size());
+            for (size_t i = 0; i < rects.size(); i++) {
+                proxy& p = _proxies[i];
+                p.r      = rects[i];
+                p.cells  = cell_range(rects[i]);
+                p.stamp  = 0;
+                p.alive  = true;
+                add_to_cells((u32)i, p.cells);
+            }
+            _count = rects.size();
+        }
+
+        void clear() {
+            _cells.clear();
+            _proxies.clear();
+            _free.clear();
+            _count = 0;
+            _stamp = 0;
+        }
+
+        // Calls fn(id) once for every proxy whose rect intersects region
+        template <typename fn_t>
+        void query(const rect_type& region, fn_t fn) const {
+            u32 stamp = next_stamp();
+            ivec4 cells = cell_range(region);
+            for (s32 y = cells.y; y <= cells.w; y++) {
+                for (s32 x = cells.x; x <= cells.z; x++) {
+                    auto it = _cells.find(ivec2(x, y));
+                    if (it == _cells.end()) continue;
+
+                    for (u32 id : it->second) {
+                        const proxy& p = _proxies[id];
+                        if (p.stamp == stamp) continue;
+                        p.stamp = stamp;
+                        if (rects_intersect(p.r, region)) fn(id);
+                    }
+                }
+            }
+        }
+
+        // Calls fn(a, b) with a < b once for every pair of intersecting proxies
+        template <typename fn_t>
+        void query_pairs(fn_t fn) const {
+            for (const auto& cell : _cells) {
+                const ivec2& c = cell.first;
+                const std::vector<u32>& ids = cell.second;
+                for (size_t i = 0; i < ids.size(); i++) {
+                    const proxy& a = _proxies[ids[i]];
+                    for (size_t j = i + 1; j < ids.size(); j++) {
+                        const proxy& b = _proxies[ids[j]];
+
+                        // A pair sharing several cells is only reported from the
+                        // first cell both occupy
+                        if (std::max(a.cells.x, b.cells.x) != c.x || std::max(a.cells.y, b.cells.y) != c.y) continue;
+                        if (!rects_intersect(a.r, b.r)) continue;
+
+                        if (ids[i] < ids[j]) fn(ids[i], ids[j]);
+                        else                 fn(ids[j], ids[i]);
+                    }
+                }
+            }
+        }
+
+        bool is_valid(u32 id) const { return id < _proxies.size() && _proxies[id].alive; }
+        const rect_type& get(u32 id) const { return _proxies[id].r; }
+        size_t size() const { return _count; }
+        value_t cell_size() const { return _cell_size; }
+
+        // Inclusive cell coordinates (x1, y1, x2, y2) covered by r
+        ivec4 cell_range(const rect_type& r) const {
+            return ivec4(cell_coord(rect_left(r)),  cell_coord(rect_bottom(r)),
+                         cell_coord(rect_right(r)), cell_coord(rect_top(r)));
+        }
+
+    private:
+        struct proxy {
+            rect_type r;
+            ivec4 cells;
+            mutable u32 stamp = 0;
+            bool alive = false;
+        };
+
+        mz_force_inline s32 cell_coord(value_t v) const {
+            return (s32)std::floor((f64)v * _inv_cell_size);
+        }
+
+        static mz_force_inline bool in_range(const ivec4& cells, s32 x, s32 y) {
+            return x >= cells.x && x <= cells.z && y >= cells.y && y <= cells.w;
+        }
+
+        void add_to_cells(u32 id, const ivec4& cells) {
+            for (s32 y = cells.y; y <= cells.w; y++) {
+                for (s32 x = cells.x; x <= cells.z; x++) {
+                    _cells[ivec2(x, y)].push_back(id);
+                }
+            }
+        }
+
+        void remove_from_cell(u32 id, const ivec2& c) {
+            auto it = _cells.find(c);
+            if (it == _cells.end()) return;
+
+            std::vector<u32>& ids = it->second;
+            for (size_t i = 0; i < ids.size(); i++) {
+                if (ids[i] == id) {
+                    ids[i] = ids.back();
+                    ids.pop_back();
+                    break;
+                }
+            }
+            if (ids.empty()) _cells.erase(it);
+        }
+
+        u32 next_stamp() const {
+            if (++_stamp == 0) {
+                for (const proxy& p : _proxies) p.stamp = 0;
+                _stamp = 1;
+            }
+            return _stamp;
+        }
+
+        value_t _cell_size;
+        f64 _inv_cell_size;
+        flat_hash_map<ivec2, std::vector<u32>> _cells;
+        std::vector<proxy> _proxies;
+        std::vector<u32> _free;
+        size_t _count = 0;
+        mutable u32 _stamp = 0;
+    };
+
+    typedef uniform_grid<f32> funiform_grid;
+    typedef uniform_grid<f64> duniform_grid;
+    typedef uniform_grid<s32> iuniform_grid;
+
+    /*
+        Dynamic bounding volume tree over rect<value_t>, for worlds where
+        object sizes vary too much for a uniform grid. Leaves store the
+        tight rect and a box fattened by margin on every side; move() only
+        reinserts a leaf once its rect leaves the fat box, so small motion
+        costs nothing. Insertion descends by surface area heuristic (in 2D
+        the perimeter) and the path back to the root is rebalanced with
+        rotations. All nodes live in one contiguous pool, and the id of a
+        proxy is the index of its leaf.
+
+        Boxes are kept internally as (x1, y1, x2, y2). Traversal tests the
+        fat boxes inclusively and leaves are then filtered with
+        rect_contains / rects_intersect on the tight rects.
+    */
+    template <typename value_t>
+    struct aabb_tree {
+        typedef rect<value_t> rect_type;
+        typedef vec4<value_t> bounds_type;
+        typedef typename std::conditional<std::is_floating_point<value_t>::value, value_t, f32>::type fraction_type;
+
+        static constexpr u32 null_node = (u32)-1;
+
+        explicit aabb_tree(value_t margin = 0) : _margin(margin) {}
+
+        u32 insert(const rect_type& r) {
+            u32 id = allocate_node();
+            node& n  = _nodes[id];
+            n.r      = r;
+            n.fat    = fatten(r);
+            n.height = 0;
+            insert_leaf(id);
+            _count++;
+            return id;
+        }
+
+        // Returns true if the leaf had to be reinserted
+        bool move(u32 id, const rect_type& r) {
+            node& n = _nodes[id];
+            n.r = r;
+            if (contains(n.fat, to_bounds(r))) return false;
+
+            remove_leaf(id);
+            _nodes[id].fat = fatten(r);
+            insert_leaf(id);
+            return true;
+        }
+
+        void remove(u32 id) {
+            remove_leaf(id);
+            free_node(id);
+            _count--;
+        }
+
+        void clear() {
+            _nodes.clear();
+            _root  = null_node;
+            _free  = null_node;
+            _count = 0;
+        }
+
+        // Calls fn(id) for every proxy whose rect contains p
+        template <typename fn_t>
+        void query(const vec2<value_t>& p, fn_t fn) const {
+            bounds_type b(p.x, p.y, p.x, p.y);
+            traverse(b, [&](u32 id) {
+                if (rect_contains(_nodes[id].r, p)) fn(id);
+            });
+        }
+
+        // Calls fn(id) for every proxy whose rect intersects region
+        template <typename fn_t>
+        void query(const rect_type& region, fn_t fn) const {
+            traverse(to_bounds(region), [&](u32 id) {
+                if (rects_intersect(_nodes[id].r, region)) fn(id);
+            });
+        }
+
+        /*
+            Casts the segment seg.p1 -> seg.p2 and calls fn(id, t) for every
+            rect it enters, where t in [0, 1] is the entry fraction along
+            the segment. fn returns the new maximum fraction: t to look only
+            for closer hits, 1 to keep collecting every hit, or 0 to stop.
+            Hits are not reported in order.
+        */
+        template <typename fn_t>
+        void cast(const ray2d<value_t>& seg, fn_t fn) const {
+            if (_root == null_node) return;
+
+            vec2<fraction_type> p((fraction_type)seg.p1.x, (fraction_type)seg.p1.y);
+            vec2<fraction_type> d((fraction_type)seg.p2.x - p.x, (fraction_type)seg.p2.y - p.y);
+            fraction_type max_t = 1;
+
+            node_stack stack;
+            stack.push(_root);
+            while (!stack.empty()) {
+                const node& n = _nodes[stack.pop()];
+                fraction_type t;
+                if (!segment_enters(p, d, n.fat, max_t, t)) continue;
+
+                if (n.is_leaf()) {
+                    if (!segment_enters(p, d, to_bounds(n.r), max_t, t)) continue;
+                    u32 id = (u32)(&n - _nodes.data());
+                    fraction_type new_max = fn(id, t);
+                    if (new_max <= 0) return;
+                    if (new_max < max_t) max_t = new_max;
+                } else {
+                    stack.push(n.child1);
+                    stack.push(n.child2);
+                }
+            }
+        }
+
+        // Calls fn(a, b) with a < b once for every pair of intersecting proxies
+        template <typename fn_t>
+        void query_pairs(fn_t fn) const {
+            if (_root == null_node) return;
+
+            // Walks the tree against itself; a pair (i, i) stands for all pairs
+            // within subtree i, and only the larger box of a pair is split
+            node_stack stack;
+            stack.push(_root);
+            stack.push(_root);
+            while (!stack.empty()) {
+                u32 ib = stack.pop(), ia = stack.pop();
+                const node& a = _nodes[ia];
+                const node& b = _nodes[ib];
+
+                if (ia == ib) {
+                    if (a.is_leaf()) continue;
+                    push_pair(stack, a.child1, a.child1);
+                    push_pair(stack, a.child2, a.child2);
+                    push_pair(stack, a.child1, a.child2);
+                    continue;
+                }
+
+                if (!overlaps(a.fat, b.fat)) continue;
+
+                if (a.is_leaf() && b.is_leaf()) {
+                    if (rects_intersect(a.r, b.r)) {
+                        if (ia < ib) fn(ia, ib);
+                        else         fn(ib, ia);
+                    }
+                } else if (b.is_leaf() || (!a.is_leaf() && perimeter(a.fat) >= perimeter(b.fat))) {
+                    push_pair(stack, a.child1, ib);
+                    push_pair(stack, a.child2, ib);
+                } else {
+                    push_pair(stack, ia, b.child1);
+                    push_pair(stack, ia, b.child2);
+                }
+            }
+        }
+
+        const rect_type&   get(u32 id)        const { return _nodes[id].r; }
+        const bounds_type& fat_bounds(u32 id) const { return _nodes[id].fat; }
+        size_t size()   const { return _count; }
+        s32    height() const { return _root == null_node ? 0 : _nodes[_root].height; }
+        value_t margin() const { return _margin; }
+
+    private:
+        struct node {
+            rect_type r;
+            bounds_type fat;
+            u32 parent = null_node; // next free node while on the free list
+            u32 child1 = null_node;
+            u32 child2 = null_node;
+            s32 height = -1;        // -1 while on the free list, 0 for leaves
+
+            mz_force_inline bool is_leaf() const { return child1 == null_node; }
+        };
+
+        // Traversal stack that only touches the heap for very deep trees
+        struct node_stack {
+            u32 fixed[64];
+            std::vector<u32> heap;
+            u32* data = fixed;
+            size_t count = 0, capacity = 64;
+
+            mz_force_inline void push(u32 i) {
+                if (count == capacity) grow();
+                data[count++] = i;
+            }
+            mz_force_inline u32  pop()         { return data[--count]; }
+            mz_force_inline bool empty() const { return count == 0; }
+
+            void grow() {
+                if (data == fixed) heap.assign(fixed, fixed + count);
+                capacity *= 2;
+                heap.resize(capacity);
+                data = heap.data();
+            }
+        };
+
+        static mz_force_inline void push_pair(node_stack& stack, u32 a, u32 b) {
+            stack.push(a);
+            stack.push(b);
+        }
+
+        static mz_force_inline bounds_type to_bounds(const rect_type& r) {
+            return bounds_type(rect_left(r), rect_bottom(r), rect_right(r), rect_top(r));
+        }
+        mz_force_inline bounds_type fatten(const rect_type& r) const {
+            return bounds_type(rect_left(r) - _margin, rect_bottom(r) - _margin, rect_right(r) + _margin, rect_top(r) + _margin);
+        }
+        static mz_force_inline bounds_type combine(const bounds_type& a, const bounds_type& b) {
+            return bounds_type(std::min(a.x1, b.x1), std::min(a.y1, b.y1), std::max(a.x2, b.x2), std::max(a.y2, b.y2));
+        }
+        static mz_force_inline f64 perimeter(const bounds_type& b) {
+            return 2.0 * (((f64)b.x2 - (f64)b.x1) + ((f64)b.y2 - (f64)b.y1));
+        }
+        static mz_force_inline bool contains(const bounds_type& outer, const bounds_type& inner) {
+            return outer.x1 <= inner.x1 && outer.y1 <= inner.y1 && inner.x2 <= outer.x2 && inner.y2 <= outer.y2;
+        }
+        static mz_force_inline bool overlaps(const bounds_type& a, const bounds_type& b) {
+            return a.x1 <= b.x2 && b.x1 <= a.x2 && a.y1 <= b.y2 && b.y1 <= a.y2;
+        }
+
+        // Slab test of p + d * t for t in [0, max_t]
+        static inline bool segment_enters(const vec2<fraction_type>& p, const vec2<fraction_type>& d, const bounds_type& b, fraction_type max_t, fraction_type& t_enter) {
+            fraction_type t0 = 0, t1 = max_t;
+            for (u32 axis = 0; axis < 2; axis++) {
+                fraction_type lo = (fraction_type)b.ptr[axis], hi = (fraction_type)b.ptr[axis + 2];
+                if (d.ptr[axis] == 0) {
+                    if (p.ptr[axis] < lo || p.ptr[axis] > hi) return false;
+                    continue;
+                }
+                fraction_type inv = (fraction_type)1 / d.ptr[axis];
+                fraction_type ta = (lo - p.ptr[axis]) * inv;
+                fraction_type tb = (hi - p.ptr[axis]) * inv;
+                if (ta > tb) std::swap(ta, tb);
+                if (ta > t0) t0 = ta;
+                if (tb < t1) t1 = tb;
+                if (t0 > t1) return false;
+            }
+            t_enter = t0;
+            return true;
+        }
+
+        // Calls fn(leaf) for every leaf whose fat box overlaps b
+        template <typename fn_t>
+        void traverse(const bounds_type& b, fn_t fn) const {
+            if (_root == null_node) return;
+
+            node_stack stack;
+            stack.push(_root);
+            while (!stack.empty()) {
+                u32 i = stack.pop();
+                const node& n = _nodes[i];
+                if (!overlaps(n.fat, b)) continue;
+
+                if (n.is_leaf()) {
+                    fn(i);
+                } else {
+                    stack.push(n.child1);
+                    stack.push(n.child2);
+                }
+            }
+        }
+
+        u32 allocate_node() {
+            if (_free != null_node) {
+                u32 i = _free;
+                _free = _nodes[i].parent;
+                _nodes[i] = node();
+                return i;
+            }
+            _nodes.emplace_back();
+            return (u32)_nodes.size() - 1;
+        }
+
+        void free_node(u32 i) {
+            _nodes[i].parent = _free;
+            _nodes[i].child1 = null_node;
+            _nodes[i].child2 = null_node;
+            _nodes[i].height = -1;
+            _free = i;
+        }
+
+        void insert_leaf(u32 leaf) {
+            if (_root == null_node) {
+                _root = leaf;
+                _nodes[leaf].parent = null_node;
+                return;
+            }
+
+            // Descend towards the sibling with the cheapest enlargement, stopping
+            // when pairing with the current node is cheaper than going deeper
+            bounds_type leaf_fat = _nodes[leaf].fat;
+            u32 index = _root;
+            while (!_nodes[index].is_leaf()) {
+                const node& n = _nodes[index];
+                f64 area     = perimeter(n.fat);
+                f64 combined = perimeter(combine(n.fat, leaf_fat));
+
+                f64 cost        = 2.0 * combined;
+                f64 inheritance = 2.0 * (combined - area);
+
+                f64 cost1 = child_cost(n.child1, leaf_fat) + inheritance;
+                f64 cost2 = child_cost(n.child2, leaf_fat) + inheritance;
+
+                if (cost < cost1 && cost < cost2) break;
+                index = cost1 < cost2 ? n.child1 : n.child2;
+            }
+            u32 sibling = index;
+
+            u32 old_parent = _nodes[sibling].parent;
+            u32 new_parent = allocate_node();
+            node& p  = _nodes[new_parent];
+            p.parent = old_parent;
+            p.fat    = combine(leaf_fat, _nodes[sibling].fat);
+            p.height = _nodes[sibling].height + 1;
+            p.child1 = sibling;
+            p.child2 = leaf;
+            _nodes[sibling].parent = new_parent;
+            _nodes[leaf].parent    = new_parent;
+
+            if (old_parent != null_node) {
+                if (_nodes[old_parent].child1 == sibling) _nodes[old_parent].child1 = new_parent;
+                else                                      _nodes[old_parent].child2 = new_parent;
+            } else {
+                _root = new_parent;
+            }
+
+            refit(_nodes[leaf].parent);
+        }
+
+        void remove_leaf(u32 leaf) {
+            if (leaf == _root) {
+                _root = null_node;
+                return;
+            }
+
+            u32 parent  = _nodes[leaf].parent;
+            u32 grand   = _nodes[parent].parent;
+            u32 sibling = _nodes[parent].child1 == leaf ? _nodes[parent].child2 : _nodes[parent].child1;
+
+            if (grand != null_node) {
+                if (_nodes[grand].child1 == parent) _nodes[grand].child1 = sibling;
+                else                                _nodes[grand].child2 = sibling;
+                _nodes[sibling].parent = grand;
+                free_node(parent);
+                refit(grand);
+            } else {
+                _root = sibling;
+                _nodes[sibling].parent = null_node;
+                free_node(parent);
+            }
+        }
+
+        f64 child_cost(u32 child, const bounds_type& leaf_fat) const {
+            const node& c = _nodes[child];
+            f64 enlarged = perimeter(combine(leaf_fat, c.fat));
+            return c.is_leaf() ? enlarged : enlarged - perimeter(c.fat);
+        }
+
+        // Rebalances and refits every node from index up to the root
+        void refit(u32 index) {
+            while (index != null_node) {
+                index = balance(index);
+
+                node& n = _nodes[index];
+                const node& c1 = _nodes[n.child1];
+                const node& c2 = _nodes[n.child2];
+                n.height = 1 + std::max(c1.height, c2.height);
+                n.fat    = combine(c1.fat, c2.fat);
+
+                index = n.parent;
+            }
+        }
+
+        // Rotates the taller grandchild of a up if a's children differ in height by more than 1
+        u32 balance(u32 ia) {
+            node* a = &_nodes[ia];
+            if (a->is_leaf() || a->height < 2) return ia;
+
+            u32 ib = a->child1, ic = a->child2;
+            node* b = &_nodes[ib];
+            node* c = &_nodes[ic];
+            s32 diff = c->height - b->height;
+
+            if (diff > 1) {
+                u32 i_f = c->child1, i_g = c->child2;
+                node* f = &_nodes[i_f];
+                node* g = &_nodes[i_g];
+
+                c->child1 = ia;
+                c->parent = a->parent;
+                a->parent = ic;
+                replace_child(c->parent, ia, ic);
+
+                if (f->height > g->height) {
+                    c->child2 = i_f;
+                    a->child2 = i_g;
+                    g->parent = ia;
+                    a->fat    = combine(b->fat, g->fat);
+                    c->fat    = combine(a->fat, f->fat);
+                    a->height = 1 + std::max(b->height, g->height);
+                    c->height = 1 + std::max(a->height, f->height);
+                } else {
+                    c->child2 = i_g;
+                    a->child2 = i_f;
+                    f->parent = ia;
+                    a->fat    = combine(b->fat, f->fat);
+                    c->fat    = combine(a->fat, g->fat);
+                    a->height = 1 + std::max(b->height, f->height);
+                    c->height = 1 + std::max(a->height, g->height);
+                }
+                return ic;
+            }
+
+            if (diff < -1) {
+                u32 i_d = b->child1, i_e = b->child2;
+                node* d = &_nodes[i_d];
+                node* e = &_nodes[i_e];
+
+                b->child1 = ia;
+                b->parent = a->parent;
+                a->parent = ib;
+                replace_child(b->parent, ia, ib);
+
+                if (d->height > e->height) {
+                    b->child2 = i_d;
+                    a->child1 = i_e;
+                    e->parent = ia;
+                    a->fat    = combine(c->fat, e->fat);
+                    b->fat    = combine(a->fat, d->fat);
+                    a->height = 1 + std::max(c->height, e->height);
+                    b->height = 1 + std::max(a->height, d->height);
+                } else {
+                    b->child2 = i_e;
+                    a->child1 = i_d;
+                    d->parent = ia;
+                    a->fat    = combine(c->fat, d->fat);
+                    b->fat    = combine(a->fat, e->fat);
+                    a->height = 1 + std::max(c->height, d->height);
+                    b->height = 1 + std::max(a->height, e->height);
+                }
+                return ib;
+            }
+
+            return ia;
+        }
+
+        void replace_child(u32 parent, u32 old_child, u32 new_child) {
+            if (parent == null_node) {
+                _root = new_child;
+            } else if (_nodes[parent].child1 == old_child) {
+                _nodes[parent].child1 = new_child;
+            } else {
+                _nodes[parent].child2 = new_child;
+            }
+        }
+
+        value_t _margin;
+        std::vector<node> _nodes;
+        u32 _root = null_node;
+        u32 _free = null_node;
+        size_t _count = 0;
+    };
+
+    typedef aabb_tree<f32> faabb_tree;
+    typedef aabb_tree<f64> daabb_tree;
+    typedef aabb_tree<s32> iaabb_tree;
+}
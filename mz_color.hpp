@@ -0,0 +1,374 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_packed.hpp"
+
+/*
+    Conversions between fcolor16 (f32 RGBA, 0-1) and bcolor4 (u8 RGBA,
+    0-255). The cast constructors between the two only convert component by
+    component; these scale.
+
+    - to_fcolor / to_bcolor:            0-255 <-> 0-1, correctly rounded
+    - srgb_to_linear / linear_to_srgb:  sRGB transfer function on floats. The
+                                        precise versions use f64 pow, the fast
+                                        ones clamp to [0, 1] and use polynomials
+                                        in f32, within 3e-5 relative error to
+                                        linear (normal floats) and 1e-5
+                                        absolute error to sRGB
+    - srgb8_to_linear / linear_to_srgb8: 8 bit sRGB <-> linear floats through
+                                        tables built at compile time, correctly
+                                        rounded both ways
+    - premultiply / unpremultiply:      rgb * a and back. u8 colors round to
+                                        nearest, a zero alpha gives zero rgb
+
+    Alpha is linear and never goes through the transfer function. Everything
+    also takes spans of whole images, in place when the input and output are
+    the same. With a SIMD backend the span versions go 4 pixels at a time;
+    table lookups and the u8 unpremultiply division stay scalar.
+*/
+namespace mz {
+namespace math {
+namespace detail {
+    // x^(1 / n) for x >= 0 by Newton's method, converging from above. Only
+    // for the tables and constant expressions, std::pow does this at runtime.
+    constexpr f64 root(f64 x, u32 n) {
+        f64 r = x > 1. ? x : 1.;
+        for (u32 i = 0; i < 256; i++) {
+            f64 p = 1.;
+            for (u32 j = 1; j < n; j++) p *= r;
+            f64 next = ((n - 1) * r + x / p) / n;
+            if (!(next < r)) break;
+            r = next;
+        }
+        return r;
+    }
+
+    // The sRGB transfer function with only constexpr arithmetic, for the tables
+    constexpr f64 srgb_to_linear_newton(f64 c) {
+        if (c <= 0.04045) return c / 12.92;
+        f64 y = (c + 0.055) / 1.055, y4 = y * y * y * y;
+        return root(y4 * y4 * y4, 5);
+    }
+    constexpr f64 linear_to_srgb_newton(f64 l) {
+        if (l <= 0.0031308) return l * 12.92;
+        return 1.055 * root(l * l * l * l * l, 12) - 0.055;
+    }
+
+    constexpr mz_force_inline f64 srgb_to_linear(f64 c) {
+        if (mz_is_constant_evaluated()) return srgb_to_linear_newton(c);
+        return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+    constexpr mz_force_inline f64 linear_to_srgb(f64 l) {
+        if (mz_is_constant_evaluated()) return linear_to_srgb_newton(l);
+        return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1. / 2.4) - 0.055;
+    }
+
+    struct srgb8_tables {
+        f32 to_linear[256];
+        // lower[k] is the smallest linear value that rounds to sRGB code k,
+        // with 2 as a sentinel past the end
+        f64 lower[257];
+    };
+    constexpr srgb8_tables make_srgb8_tables() {
+        srgb8_tables t{};
+        for (u32 i = 0; i < 256; i++) {
+            t.to_linear[i] = (f32)srgb_to_linear_newton(i / 255.);
+            t.lower[i] = i ? srgb_to_linear_newton((i - 0.5) / 255.) : 0.;
+        }
+        t.lower[256] = 2.;
+        return t;
+    }
+    inline constexpr srgb8_tables srgb8 = make_srgb8_tables();
+
+    /*
+        The fast transfer functions on [0, 1]. With y = (c + 0.055) / 1.055,
+        y^2.4 is y^2 times a polynomial in sqrt(y), and l^(1 / 2.4) is a
+        polynomial in the 4th root of l. The SIMD versions do the same
+        operations lane by lane, so both give the same bits.
+    */
+    constexpr mz_force_inline f32 srgb_to_linear_poly(f32 c) {
+        f32 y = (c + 0.055f) * (1.f / 1.055f);
+        f32 t = math::sqrt(y);
+        f32 p = ((((8.797515184e-02f * t - 3.724940419e-01f) * t + 6.784268618e-01f) * t - 7.536025047e-01f) * t + 1.322428703e+00f) * t + 3.726972640e-02f;
+        return c <= 0.04045f ? c * (1.f / 12.92f) : p * (y * y);
+    }
+    constexpr mz_force_inline f32 linear_to_srgb_poly(f32 l) {
+        f32 u = math::sqrt(math::sqrt(l));
+        f32 p = ((((-6.275898963e-02f * u + 2.727522552e-01f) * u - 5.575556755e-01f) * u + 1.244213939e+00f) * u + 1.649740040e-01f) * u - 6.162970513e-02f;
+        return l <= 0.0031308f ? l * 12.92f : p;
+    }
+
+    mz_force_inline simd::f32x4 clamp01(simd::f32x4 v) {
+        v = simd::bit_and(v, simd::cmple(v, v)); // NaN to 0 on every backend
+        return simd::min(simd::max(v, simd::set1(0.f)), simd::set1(1.f));
+    }
+    mz_force_inline simd::f32x4 srgb_to_linear_poly(simd::f32x4 c) {
+        simd::f32x4 y = simd::mul(simd::add(c, simd::set1(0.055f)), simd::set1(1.f / 1.055f));
+        simd::f32x4 t = simd::sqrt(y);
+        simd::f32x4 p = simd::add(simd::mul(simd::set1(8.797515184e-02f), t), simd::set1(-3.724940419e-01f));
+        p = simd::add(simd::mul(p, t), simd::set1(6.784268618e-01f));
+        p = simd::add(simd::mul(p, t), simd::set1(-7.536025047e-01f));
+        p = simd::add(simd::mul(p, t), simd::set1(1.322428703e+00f));
+        p = simd::add(simd::mul(p, t), simd::set1(3.726972640e-02f));
+        return simd::select(simd::cmple(c, simd::set1(0.04045f)), simd::mul(c, simd::set1(1.f / 12.92f)), simd::mul(p, simd::mul(y, y)));
+    }
+    mz_force_inline simd::f32x4 linear_to_srgb_poly(simd::f32x4 l) {
+        simd::f32x4 u = simd::sqrt(simd::sqrt(l));
+        simd::f32x4 p = simd::add(simd::mul(simd::set1(-6.275898963e-02f), u), simd::set1(2.727522552e-01f));
+        p = simd::add(simd::mul(p, u), simd::set1(-5.575556755e-01f));
+        p = simd::add(simd::mul(p, u), simd::set1(1.244213939e+00f));
+        p = simd::add(simd::mul(p, u), simd::set1(1.649740040e-01f));
+        p = simd::add(simd::mul(p, u), simd::set1(-6.162970513e-02f));
+        return simd::select(simd::cmple(l, simd::set1(0.0031308f)), simd::mul(l, simd::set1(12.92f)), p);
+    }
+
+    // l clamped to [0, 1] and an estimate of its sRGB code within half a
+    // code, which can then only be one off and is fixed with the table
+    constexpr mz_force_inline u8 srgb8_from_estimate(f32 l, f32 estimate) {
+        s32 k = (s32)(estimate + 0.5f);
+        k -= l < srgb8.lower[k];
+        k += l >= srgb8.lower[k + 1];
+        return (u8)k;
+    }
+
+    constexpr mz_force_inline f32 clamp01(f32 v) {
+        return v > 0.f ? (v < 1.f ? v : 1.f) : 0.f;
+    }
+}
+}
+
+    constexpr mz_force_inline fcolor16 to_fcolor(const bcolor4& c) {
+        return fcolor16(c.x / 255.f, c.y / 255.f, c.z / 255.f, c.w / 255.f);
+    }
+    constexpr mz_force_inline bcolor4 to_bcolor(const fcolor16& c) {
+        return bcolor4(unorm<u8>::encode(c.x), unorm<u8>::encode(c.y), unorm<u8>::encode(c.z), unorm<u8>::encode(c.w));
+    }
+
+    constexpr mz_force_inline f32 srgb_to_linear(f32 c, precise_t) {
+        return (f32)math::detail::srgb_to_linear((f64)c);
+    }
+    constexpr mz_force_inline f32 srgb_to_linear(f32 c, fast_t) {
+        return math::detail::srgb_to_linear_poly(math::detail::clamp01(c));
+    }
+    constexpr mz_force_inline f32 srgb_to_linear(f32 c) {
+        return srgb_to_linear(c, default_precision);
+    }
+    constexpr mz_force_inline f32 linear_to_srgb(f32 l, precise_t) {
+        return (f32)math::detail::linear_to_srgb((f64)l);
+    }
+    constexpr mz_force_inline f32 linear_to_srgb(f32 l, fast_t) {
+        return math::detail::linear_to_srgb_poly(math::detail::clamp01(l));
+    }
+    constexpr mz_force_inline f32 linear_to_srgb(f32 l) {
+        return linear_to_srgb(l, default_precision);
+    }
+
+    template <typename precision_t = default_precision_t>
+    constexpr mz_force_inline fcolor16 srgb_to_linear(const fcolor16& c, precision_t precision = precision_t()) {
+        return fcolor16(srgb_to_linear(c.x, precision), srgb_to_linear(c.y, precision), srgb_to_linear(c.z, precision), c.w);
+    }
+    template <typename precision_t = default_precision_t>
+    constexpr mz_force_inline fcolor16 linear_to_srgb(const fcolor16& c, precision_t precision = precision_t()) {
+        return fcolor16(linear_to_srgb(c.x, precision), linear_to_srgb(c.y, precision), linear_to_srgb(c.z, precision), c.w);
+    }
+
+    constexpr mz_force_inline f32 srgb8_to_linear(u8 c) {
+        return math::detail::srgb8.to_linear[c];
+    }
+    constexpr mz_force_inline u8 linear_to_srgb8(f32 l) {
+        l = math::detail::clamp01(l);
+        return math::detail::srgb8_from_estimate(l, math::detail::linear_to_srgb_poly(l) * 255.f);
+    }
+
+    constexpr mz_force_inline fcolor16 srgb8_to_linear(const bcolor4& c) {
+        return fcolor16(srgb8_to_linear(c.x), srgb8_to_linear(c.y), srgb8_to_linear(c.z), c.w / 255.f);
+    }
+    constexpr mz_force_inline bcolor4 linear_to_srgb8(const fcolor16& c) {
+        return bcolor4(linear_to_srgb8(c.x), linear_to_srgb8(c.y), linear_to_srgb8(c.z), unorm<u8>::encode(c.w));
+    }
+
+    constexpr mz_force_inline fcolor16 premultiply(const fcolor16& c) {
+        return fcolor16(c.x * c.w, c.y * c.w, c.z * c.w, c.w);
+    }
+    constexpr mz_force_inline fcolor16 unpremultiply(const fcolor16& c) {
+        return c.w != 0.f ? fcolor16(c.x / c.w, c.y / c.w, c.z / c.w, c.w) : fcolor16(0.f, 0.f, 0.f, c.w);
+    }
+    constexpr mz_force_inline bcolor4 premultiply(const bcolor4& c) {
+        u32 r = c.x * c.w + 128u, g = c.y * c.w + 128u, b = c.z * c.w + 128u;
+        return bcolor4((r + (r >> 8)) >> 8, (g + (g >> 8)) >> 8, (b + (b >> 8)) >> 8, c.w);
+    }
+    // Components above alpha (not a valid premultiplied color) clamp to 255
+    constexpr mz_force_inline bcolor4 unpremultiply(const bcolor4& c) {
+        if (!c.w) return bcolor4(0, 0, 0, 0);
+        u32 r = (c.x * 255u + c.w / 2u) / c.w, g = (c.y * 255u + c.w / 2u) / c.w, b = (c.z * 255u + c.w / 2u) / c.w;
+        return bcolor4(r < 255u ? r : 255u, g < 255u ? g : 255u, b < 255u ? b : 255u, c.w);
+    }
+
+    /*
+        Whole images. Each converts min(in.count, out.count) pixels.
+    */
+
+    inline void to_fcolor(span<const bcolor4> in, span<fcolor16> out) {
+        const size_t count = in.count < out.count ? in.count : out.count;
+        for (size_t i = 0; i < count; i++) {
+            if constexpr (simd::enabled) simd::unpack_norm4(in.ptr[i].ptr, out.ptr[i].ptr);
+            else out.ptr[i] = to_fcolor(in.ptr[i]);
+        }
+    }
+    inline void to_bcolor(span<const fcolor16> in, span<bcolor4> out) {
+        const size_t count = in.count < out.count ? in.count : out.count;
+        for (size_t i = 0; i < count; i++) {
+            if constexpr (simd::enabled) simd::pack_norm4(in.ptr[i].ptr, out.ptr[i].ptr);
+            else out.ptr[i] = to_bcolor(in.ptr[i]);
+        }
+    }
+
+    inline void srgb_to_linear(span<const fcolor16> in, span<fcolor16> out, precise_t) {
+        const size_t count = in.count < out.count ? in.count : out.count;
+        for (size_t i = 0; i < count; i++)
+            out.ptr[i] = srgb_to_linear(in.ptr[i], precise);
+    }
+    inline void srgb_to_linear(span<const fcolor16> in, span<fcolor16> out, fast_t) {
+        const size_t count = in.count < out.count ? in.count : out.count, blocks = count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4) {
+                simd::f32x4 r, g, b, a;
+                simd::load4(in.ptr[i].ptr, r, g, b, a);
+                r = math::detail::srgb_to_linear_poly(math::detail::clamp01(r));
+                g = math::detail::srgb_to_linear_poly(math::detail::clamp01(g));
+                b = math::detail::srgb_to_linear_poly(math::detail::clamp01(b));
+                simd::store4(out.ptr[i].ptr, r, g, b, a);
+            }
+        }
+        for (; i < count; i++)
+            out.ptr[i] = srgb_to_linear(in.ptr[i], fast);
+    }
+    inline void srgb_to_linear(span<const fcolor16> in, span<fcolor16> out) {
+        srgb_to_linear(in, out, default_precision);
+    }
+
+    inline void linear_to_srgb(span<const fcolor16> in, span<fcolor16> out, precise_t) {
+        const size_t count = in.count < out.count ? in.count : out.count;
+        for (size_t i = 0; i < count; i++)
+            out.ptr[i] = linear_to_srgb(in.ptr[i], precise);
+    }
+    inline void linear_to_srgb(span<const fcolor16> in, span<fcolor16> out, fast_t) {
+        const size_t count = in.count < out.count ? in.count : out.count, blocks = count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4) {
+                simd::f32x4 r, g, b, a;
+                simd::load4(in.ptr[i].ptr, r, g, b, a);
+                r = math::detail::linear_to_srgb_poly(math::detail::clamp01(r));
+                g = math::detail::linear_to_srgb_poly(math::detail::clamp01(g));
+                b = math::detail::linear_to_srgb_poly(math::detail::clamp01(b));
+                simd::store4(out.ptr[i].ptr, r, g, b, a);
+            }
+        }
+        for (; i < count; i++)
+            out.ptr[i] = linear_to_srgb(in.ptr[i], fast);
+    }
+    inline void linear_to_srgb(span<const fcolor16> in, span<fcolor16> out) {
+        linear_to_srgb(in, out, default_precision);
+    }
+
+    inline void srgb8_to_linear(span<const bcolor4> in, span<fcolor16> out) {
+        const size_t count = in.count < out.count ? in.count : out.count;
+        for (size_t i = 0; i < count; i++)
+            out.ptr[i] = srgb8_to_linear(in.ptr[i]);
+    }
+    // The code estimates are computed 4 pixels at a time, the table fix-up is scalar
+    inline void linear_to_srgb8(span<const fcolor16> in, span<bcolor4> out) {
+        const size_t count = in.count < out.count ? in.count : out.count, blocks = count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4) {
+                f32 clamped[16], estimates[16];
+                simd::f32x4 r, g, b, a;
+                simd::load4(in.ptr[i].ptr, r, g, b, a);
+                r = math::detail::clamp01(r);
+                g = math::detail::clamp01(g);
+                b = math::detail::clamp01(b);
+                simd::store4(clamped, r, g, b, a);
+                simd::f32x4 scale = simd::set1(255.f);
+                simd::store4(estimates, simd::mul(math::detail::linear_to_srgb_poly(r), scale), simd::mul(math::detail::linear_to_srgb_poly(g), scale),
+                                        simd::mul(math::detail::linear_to_srgb_poly(b), scale), a);
+                for (u32 j = 0; j < 4; j++) {
+                    u8* dst = out.ptr[i + j].ptr;
+                    for (u32 c = 0; c < 3; c++)
+                        dst[c] = math::detail::srgb8_from_estimate(clamped[j * 4 + c], estimates[j * 4 + c]);
+                    dst[3] = unorm<u8>::encode(clamped[j * 4 + 3]);
+                }
+            }
+        }
+        for (; i < count; i++)
+            out.ptr[i] = linear_to_srgb8(in.ptr[i]);
+    }
+
+    inline void premultiply(span<fcolor16> colors) {
+        const size_t blocks = colors.count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4) {
+                simd::f32x4 r, g, b, a;
+                simd::load4(colors.ptr[i].ptr, r, g, b, a);
+                simd::store4(colors.ptr[i].ptr, simd::mul(r, a), simd::mul(g, a), simd::mul(b, a), a);
+            }
+        }
+        for (; i < colors.count; i++)
+            colors.ptr[i] = premultiply(colors.ptr[i]);
+    }
+    inline void unpremultiply(span<fcolor16> colors) {
+        const size_t blocks = colors.count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4) {
+                simd::f32x4 r, g, b, a;
+                simd::load4(colors.ptr[i].ptr, r, g, b, a);
+                simd::store4(colors.ptr[i].ptr, simd::div_or_zero(r, a), simd::div_or_zero(g, a), simd::div_or_zero(b, a), a);
+            }
+        }
+        for (; i < colors.count; i++)
+            colors.ptr[i] = unpremultiply(colors.ptr[i]);
+    }
+    inline void premultiply(span<bcolor4> colors) {
+        const size_t blocks = colors.count & ~(size_t)3;
+        size_t i = 0;
+        if constexpr (simd::enabled) {
+            for (; i < blocks; i += 4)
+                simd::premultiply_rgba8x4(colors.ptr[i].ptr);
+        }
+        for (; i < colors.count; i++)
+            colors.ptr[i] = premultiply(colors.ptr[i]);
+    }
+    inline void unpremultiply(span<bcolor4> colors) {
+        for (size_t i = 0; i < colors.count; i++)
+            colors.ptr[i] = unpremultiply(colors.ptr[i]);
+    }
+}
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <iomanip>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <functional>
+#include <utility>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "mz_config.hpp"
 
@@ -20,6 +27,57 @@ namespace mz {
 
     constexpr f64 PI = 3.141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067982148086513282306647093844609550582231725359408128481;
 
+    // Non-owning view over a contiguous array, like Polygon2D but for any type.
+    // Used by the batch/bulk functions so they accept raw pointers, C arrays
+    // and std::vector alike.
+    template <typename value_t>
+    struct span {
+        typedef value_t value_type;
+
+        value_t* ptr;
+        size_t count;
+
+        constexpr span() : ptr(NULL), count(0) {}
+        constexpr span(value_t* ptr, size_t count) : ptr(ptr), count(count) {}
+        template <size_t N>
+        constexpr span(value_t (&arr)[N]) : ptr(arr), count(N) {}
+        template <typename container_t, typename = typename std::enable_if<std::is_convertible<decltype(std::declval<container_t&>().data() + std::declval<container_t&>().size()), value_t*>::value>::type>
+        constexpr span(container_t& container) : ptr(container.data()), count(container.size()) {}
+        template <typename other_t, typename = typename std::enable_if<std::is_convertible<other_t(*)[], value_t(*)[]>::value>::type>
+        constexpr span(const span<other_t>& other) : ptr(other.ptr), count(other.count) {}
+
+        constexpr value_t& operator[](size_t i) const { return ptr[i]; }
+        constexpr value_t* data() const { return ptr; }
+        constexpr size_t size() const { return count; }
+        constexpr bool empty() const { return count == 0; }
+        constexpr value_t* begin() const { return ptr; }
+        constexpr value_t* end() const { return ptr + count; }
+
+        constexpr span subspan(size_t offset, size_t n) const {
+            return span(ptr + offset, n);
+        }
+    };
+
+    // Bit counting for the u64 hit masks the batch functions write
+    constexpr mz_force_inline u32 popcount64(u64 v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return (u32)__builtin_popcountll(v);
+#else
+        v = v - ((v >> 1) & 0x5555555555555555ull);
+        v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return (u32)((v * 0x0101010101010101ull) >> 56);
+#endif
+    }
+    // Index of the lowest set bit, v must not be 0
+    constexpr mz_force_inline u32 ctz64(u64 v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return (u32)__builtin_ctzll(v);
+#else
+        return popcount64((v & (0 - v)) - 1);
+#endif
+    }
+
     template <typename value_t>
     value_t to_radians(value_t deg) {
         return deg * (value_t)PI / (value_t)180;
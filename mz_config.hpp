@@ -35,3 +35,68 @@
     #define MZ_API 
 #endif
 
+/*
+    SIMD backend for vec4<f32> and mat4<f32>. Opt in by defining one of
+    these before including mz:
+
+        MZ_SIMD       - pick the widest instruction set the compiler targets
+        MZ_SIMD_AVX   - 256-bit AVX (also enables the SSE paths)
+        MZ_SIMD_SSE   - 128-bit SSE2
+        MZ_SIMD_NEON  - 128-bit NEON (AArch64)
+
+    The scalar templates stay as the fallback for every other type. The
+    SIMD paths evaluate in the same order as the scalar code so results
+    are bit-identical, unless the compiler contracts the scalar code into
+    FMA (-ffp-contract=fast, /fp:fast), in which case they differ by at
+    most mz::simd::tolerance_ulp ULP per component, measured against the
+    absolute terms where a sum cancels (see mz_simd.hpp).
+*/
+#if defined(MZ_SIMD) && !defined(MZ_SIMD_AVX) && !defined(MZ_SIMD_SSE) && !defined(MZ_SIMD_NEON)
+    #if defined(__AVX__)
+        #define MZ_SIMD_AVX
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define MZ_SIMD_SSE
+    #elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+        #define MZ_SIMD_NEON
+    #endif
+#endif
+
+#if defined(MZ_SIMD_AVX) && !defined(MZ_SIMD_SSE)
+    #define MZ_SIMD_SSE
+#endif
+
+#if defined(MZ_SIMD_SSE) || defined(MZ_SIMD_NEON)
+    #define MZ_SIMD_ENABLED
+#endif
+
+
+/*
+    mz_is_constant_evaluated() is true while a constexpr function is being
+    evaluated at compile time. SIMD paths and runtime math are skipped
+    there, which is what lets mat4, transformation:: and projection:: be
+    used in constant expressions. Compilers without the builtin always
+    take the runtime paths, so those functions only work at runtime.
+*/
+#if !defined(mz_is_constant_evaluated)
+    #if defined(__has_builtin)
+        #if __has_builtin(__builtin_is_constant_evaluated)
+            #define mz_is_constant_evaluated() __builtin_is_constant_evaluated()
+        #endif
+    #endif
+    #if !defined(mz_is_constant_evaluated) && ((defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925))
+        #define mz_is_constant_evaluated() __builtin_is_constant_evaluated()
+    #endif
+    #if !defined(mz_is_constant_evaluated)
+        #define mz_is_constant_evaluated() false
+    #endif
+#endif
+
+/*
+    MZ_FAST_MATH makes mz::fast the default precision, so normalize(),
+    from_angle(), mat4::rotate() and math::sin/cos/tan/rsqrt use the
+    approximations documented in mz_math.hpp. Without it they stay exact
+    and mz::fast can still be passed per call:
+
+        v.normalize(mz::fast);
+        mz::math::sincos(angle, s, c, mz::fast);
+*/
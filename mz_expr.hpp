@@ -0,0 +1,313 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "mz_vector.hpp"
+
+/*
+    Opt-in expression templates for vec2/vec3/vec4 arithmetic. Wrapping an
+    operand in mz::lazy() makes the operators it takes part in build an
+    expression instead of a vector:
+
+        fvec3 r = lazy(a) * s + lazy(b) * t - c;
+
+    The whole chain is evaluated once per component when the expression is
+    converted to a vector, without a temporary or a conversion per step.
+    Wrap every operand that would otherwise be combined eagerly first
+    (lazy(b) * t above; b * t alone is an ordinary fvec3).
+
+    Vector operands may have different element types. Their types are
+    promoted once with expr::promote_t and every component is computed in
+    that type. Scalars are converted to it, like the eager operators
+    convert them to the vector's type.
+
+    Spans and containers of vectors can be wrapped too. Those expressions
+    are written out with expr::assign(out, e), one loop over the elements
+    where single vectors in the expression are broadcast. It stops at the
+    shortest of out and the arrays in the expression.
+
+    Leaves hold named vectors by reference, temporary vectors by value and
+    arrays by pointer, so an expression stored with auto must not outlive
+    the vectors and arrays it was built from.
+*/
+namespace mz {
+namespace expr {
+
+    template <size_t size, bool is_signed>
+    struct integer_of;
+    template <> struct integer_of<1, true>  { typedef s8  type; };
+    template <> struct integer_of<1, false> { typedef u8  type; };
+    template <> struct integer_of<2, true>  { typedef s16 type; };
+    template <> struct integer_of<2, false> { typedef u16 type; };
+    template <> struct integer_of<4, true>  { typedef s32 type; };
+    template <> struct integer_of<4, false> { typedef u32 type; };
+    template <> struct integer_of<8, true>  { typedef s64 type; };
+    template <> struct integer_of<8, false> { typedef u64 type; };
+
+    template <typename a_t, typename b_t, bool any_floating = std::is_floating_point<a_t>::value || std::is_floating_point<b_t>::value>
+    struct promote;
+
+    // The widest floating type wins over any integer
+    template <typename a_t, typename b_t>
+    struct promote<a_t, b_t, true> {
+        typedef typename std::conditional<!std::is_floating_point<b_t>::value || (std::is_floating_point<a_t>::value && sizeof(a_t) >= sizeof(b_t)), a_t, b_t>::type type;
+    };
+
+    // Integers keep the widest size and are signed if either is. Unlike
+    // the built-in rules there is no promotion to int, so u8 + u8 is u8.
+    template <typename a_t, typename b_t>
+    struct promote<a_t, b_t, false> {
+        typedef typename integer_of<(sizeof(a_t) > sizeof(b_t) ? sizeof(a_t) : sizeof(b_t)), std::is_signed<a_t>::value || std::is_signed<b_t>::value>::type type;
+    };
+
+    template <typename a_t, typename b_t>
+    using promote_t = typename promote<a_t, b_t>::type;
+
+    template <typename value_t, u32 width>
+    struct vector_of;
+    template <typename value_t> struct vector_of<value_t, 2> { typedef vec2<value_t> type; };
+    template <typename value_t> struct vector_of<value_t, 3> { typedef vec3<value_t> type; };
+    template <typename value_t> struct vector_of<value_t, 4> { typedef vec4<value_t> type; };
+
+    template <typename vec_t>
+    struct width_of { static constexpr u32 value = 0; };
+    template <typename value_t> struct width_of<vec2<value_t>> { static constexpr u32 value = 2; };
+    template <typename value_t> struct width_of<vec3<value_t>> { static constexpr u32 value = 3; };
+    template <typename value_t> struct width_of<vec4<value_t>> { static constexpr u32 value = 4; };
+
+    template <u32 c, typename vec_t>
+    constexpr mz_force_inline typename vec_t::value_type component(const vec_t& v) {
+        if constexpr (c == 0)      return v.x;
+        else if constexpr (c == 1) return v.y;
+        else if constexpr (c == 2) return v.z;
+        else                       return v.w;
+    }
+
+    /*
+        Base of every expression. derived_t provides value_type, width,
+        is_array, size() and get<c>(i), component c of element i (i is
+        ignored by single vectors and scalars).
+    */
+    template <typename derived_t>
+    struct node {
+        typedef void expression_tag;
+
+        constexpr mz_force_inline const derived_t& self() const {
+            return static_cast<const derived_t&>(*this);
+        }
+
+        template <typename vec_t>
+        constexpr mz_force_inline vec_t make(size_t i) const {
+            typedef typename vec_t::value_type out_t;
+            const derived_t& e = self();
+            if constexpr (derived_t::width == 2)
+                return vec_t((out_t)e.template get<0>(i), (out_t)e.template get<1>(i));
+            else if constexpr (derived_t::width == 3)
+                return vec_t((out_t)e.template get<0>(i), (out_t)e.template get<1>(i), (out_t)e.template get<2>(i));
+            else
+                return vec_t((out_t)e.template get<0>(i), (out_t)e.template get<1>(i), (out_t)e.template get<2>(i), (out_t)e.template get<3>(i));
+        }
+
+        // Single vector expressions only, arrays go through expr::assign
+        template <typename d_t = derived_t>
+        constexpr mz_force_inline typename vector_of<typename d_t::value_type, d_t::width>::type eval() const {
+            static_assert(!d_t::is_array, "mz::expr: array expressions are evaluated with expr::assign");
+            return make<typename vector_of<typename d_t::value_type, d_t::width>::type>(0);
+        }
+
+        template <typename vec_t, typename d_t = derived_t, typename = typename std::enable_if<width_of<vec_t>::value == d_t::width>::type>
+        constexpr mz_force_inline operator vec_t() const {
+            static_assert(!d_t::is_array, "mz::expr: array expressions are evaluated with expr::assign");
+            return make<vec_t>(0);
+        }
+    };
+
+    // Named vectors are held by reference, temporaries by value
+    template <typename vec_t, bool by_reference>
+    struct vector_leaf : node<vector_leaf<vec_t, by_reference>> {
+        typedef typename vec_t::value_type value_type;
+        static constexpr u32  width    = width_of<vec_t>::value;
+        static constexpr bool is_array = false;
+
+        typename std::conditional<by_reference, const vec_t&, vec_t>::type v;
+
+        constexpr mz_force_inline vector_leaf(const vec_t& v) : v(v) {}
+
+        constexpr mz_force_inline size_t size() const { return 1; }
+        template <u32 c>
+        constexpr mz_force_inline value_type get(size_t) const { return component<c>(v); }
+    };
+
+    template <typename vec_t>
+    struct array_leaf : node<array_leaf<vec_t>> {
+        typedef typename vec_t::value_type value_type;
+        static constexpr u32  width    = width_of<vec_t>::value;
+        static constexpr bool is_array = true;
+
+        const vec_t* ptr;
+        size_t count;
+
+        constexpr mz_force_inline array_leaf(const vec_t* ptr, size_t count) : ptr(ptr), count(count) {}
+
+        constexpr mz_force_inline size_t size() const { return count; }
+        template <u32 c>
+        constexpr mz_force_inline value_type get(size_t i) const { return component<c>(ptr[i]); }
+    };
+
+    // Scalars have no width and take the type of whatever they are combined with
+    template <typename scalar_t>
+    struct scalar_leaf : node<scalar_leaf<scalar_t>> {
+        typedef scalar_t value_type;
+        static constexpr u32  width    = 0;
+        static constexpr bool is_array = false;
+
+        scalar_t s;
+
+        constexpr mz_force_inline scalar_leaf(scalar_t s) : s(s) {}
+
+        constexpr mz_force_inline size_t size() const { return 1; }
+        template <u32 c>
+        constexpr mz_force_inline value_type get(size_t) const { return s; }
+    };
+
+    struct add_op      { template <typename value_t> static constexpr mz_force_inline value_t apply(value_t a, value_t b) { return (value_t)(a + b); } };
+    struct subtract_op { template <typename value_t> static constexpr mz_force_inline value_t apply(value_t a, value_t b) { return (value_t)(a - b); } };
+    struct multiply_op { template <typename value_t> static constexpr mz_force_inline value_t apply(value_t a, value_t b) { return (value_t)(a * b); } };
+    struct divide_op   { template <typename value_t> static constexpr mz_force_inline value_t apply(value_t a, value_t b) { return (value_t)(a / b); } };
+
+    template <typename lhs_t, typename rhs_t>
+    struct binary_type {
+        typedef typename std::conditional<lhs_t::width == 0, typename rhs_t::value_type,
+                typename std::conditional<rhs_t::width == 0, typename lhs_t::value_type,
+                promote_t<typename lhs_t::value_type, typename rhs_t::value_type>>::type>::type type;
+    };
+
+    template <typename op_t, typename lhs_t, typename rhs_t>
+    struct binary : node<binary<op_t, lhs_t, rhs_t>> {
+        static_assert(lhs_t::width == 0 || rhs_t::width == 0 || lhs_t::width == rhs_t::width, "mz::expr: vector operands must have the same number of components");
+
+        typedef typename binary_type<lhs_t, rhs_t>::type value_type;
+        static constexpr u32  width    = lhs_t::width > rhs_t::width ? lhs_t::width : rhs_t::width;
+        static constexpr bool is_array = lhs_t::is_array || rhs_t::is_array;
+
+        lhs_t lhs;
+        rhs_t rhs;
+
+        constexpr mz_force_inline binary(const lhs_t& lhs, const rhs_t& rhs) : lhs(lhs), rhs(rhs) {}
+
+        // Shortest array operand
+        constexpr mz_force_inline size_t size() const {
+            if constexpr (lhs_t::is_array && rhs_t::is_array) return lhs.size() < rhs.size() ? lhs.size() : rhs.size();
+            else return lhs_t::is_array ? lhs.size() : rhs.size();
+        }
+        template <u32 c>
+        constexpr mz_force_inline value_type get(size_t i) const {
+            return op_t::apply((value_type)lhs.template get<c>(i), (value_type)rhs.template get<c>(i));
+        }
+    };
+
+    template <typename operand_t>
+    struct negate : node<negate<operand_t>> {
+        typedef typename operand_t::value_type value_type;
+        static constexpr u32  width    = operand_t::width;
+        static constexpr bool is_array = operand_t::is_array;
+
+        operand_t operand;
+
+        constexpr mz_force_inline negate(const operand_t& operand) : operand(operand) {}
+
+        constexpr mz_force_inline size_t size() const { return operand.size(); }
+        template <u32 c>
+        constexpr mz_force_inline value_type get(size_t i) const { return (value_type)-operand.template get<c>(i); }
+    };
+
+    // Operand type (as deduced by a forwarding reference) -> leaf type,
+    // void for types that can't take part
+    template <typename operand_t, typename = void>
+    struct leaf_of { typedef void type; };
+    template <typename operand_t>
+    struct leaf_of<operand_t, typename std::enable_if<is_expression<typename std::decay<operand_t>::type>::value>::type> { typedef typename std::decay<operand_t>::type type; };
+    template <typename operand_t>
+    struct leaf_of<operand_t, typename std::enable_if<std::is_arithmetic<typename std::decay<operand_t>::type>::value>::type> { typedef scalar_leaf<typename std::decay<operand_t>::type> type; };
+    template <typename operand_t>
+    struct leaf_of<operand_t, typename std::enable_if<width_of<typename std::decay<operand_t>::type>::value != 0>::type> {
+        typedef vector_leaf<typename std::decay<operand_t>::type, std::is_lvalue_reference<operand_t>::value> type;
+    };
+
+    template <typename lhs_t, typename rhs_t>
+    constexpr bool is_operation = (is_expression<typename std::decay<lhs_t>::type>::value || is_expression<typename std::decay<rhs_t>::type>::value)
+                               && !std::is_void<typename leaf_of<lhs_t>::type>::value
+                               && !std::is_void<typename leaf_of<rhs_t>::type>::value;
+
+    template <typename op_t, typename lhs_t, typename rhs_t>
+    using binary_of = binary<op_t, typename leaf_of<lhs_t>::type, typename leaf_of<rhs_t>::type>;
+
+    template <typename lhs_t, typename rhs_t, typename = typename std::enable_if<is_operation<lhs_t, rhs_t>>::type>
+    constexpr mz_force_inline binary_of<add_op, lhs_t, rhs_t> operator+(lhs_t&& lhs, rhs_t&& rhs) {
+        return binary_of<add_op, lhs_t, rhs_t>(lhs, rhs);
+    }
+    template <typename lhs_t, typename rhs_t, typename = typename std::enable_if<is_operation<lhs_t, rhs_t>>::type>
+    constexpr mz_force_inline binary_of<subtract_op, lhs_t, rhs_t> operator-(lhs_t&& lhs, rhs_t&& rhs) {
+        return binary_of<subtract_op, lhs_t, rhs_t>(lhs, rhs);
+    }
+    template <typename lhs_t, typename rhs_t, typename = typename std::enable_if<is_operation<lhs_t, rhs_t>>::type>
+    constexpr mz_force_inline binary_of<multiply_op, lhs_t, rhs_t> operator*(lhs_t&& lhs, rhs_t&& rhs) {
+        return binary_of<multiply_op, lhs_t, rhs_t>(lhs, rhs);
+    }
+    template <typename lhs_t, typename rhs_t, typename = typename std::enable_if<is_operation<lhs_t, rhs_t>>::type>
+    constexpr mz_force_inline binary_of<divide_op, lhs_t, rhs_t> operator/(lhs_t&& lhs, rhs_t&& rhs) {
+        return binary_of<divide_op, lhs_t, rhs_t>(lhs, rhs);
+    }
+    template <typename operand_t, typename = typename std::enable_if<is_expression<typename std::decay<operand_t>::type>::value>::type>
+    constexpr mz_force_inline negate<typename std::decay<operand_t>::type> operator-(operand_t&& operand) {
+        return negate<typename std::decay<operand_t>::type>(operand);
+    }
+
+    // Writes element i of e to out[i] for every element out and the arrays in e all have
+    template <typename out_t, typename expr_t>
+    constexpr mz_force_inline void assign(out_t&& out, const expr_t& e) {
+        static_assert(is_expression<expr_t>::value, "mz::expr::assign: not an expression");
+        auto* dst = out.data();
+        typedef typename std::remove_reference<decltype(*dst)>::type vec_t;
+        size_t n = out.size();
+        if constexpr (expr_t::is_array) n = e.size() < n ? e.size() : n;
+        for (size_t i = 0; i < n; i++)
+            dst[i] = e.template make<vec_t>(i);
+    }
+}
+
+    template <typename vec_t, typename leaf_t = typename expr::leaf_of<vec_t>::type, typename = typename std::enable_if<expr::width_of<typename std::decay<vec_t>::type>::value != 0>::type>
+    constexpr mz_force_inline leaf_t lazy(vec_t&& v) {
+        return leaf_t(v);
+    }
+
+    // Spans, std::vector and anything else with data() and size()
+    template <typename container_t, typename vec_t = typename std::remove_cv<typename std::remove_pointer<decltype(std::declval<const container_t&>().data())>::type>::type,
+              typename = typename std::enable_if<expr::width_of<vec_t>::value != 0>::type>
+    constexpr mz_force_inline expr::array_leaf<vec_t> lazy(const container_t& vectors) {
+        return expr::array_leaf<vec_t>(vectors.data(), vectors.size());
+    }
+}
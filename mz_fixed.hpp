@@ -0,0 +1,488 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "mz_matrix.hpp"
+
+/*
+    Fixed point scalars: fixed<frac_bits, storage_t> is a storage_t (s32 or
+    s64) counting units of 2^-frac_bits. They work as value_t of vec2/3/4
+    and mat4, and everything is done with integer operations, so results
+    are the same bit for bit on every compiler and platform, at compile
+    time included.
+
+    - +, - and unary - saturate instead of wrapping
+    - * and / round to nearest (halves up) and saturate, / by 0 gives the
+      saturated value with the sign of the dividend (0 for 0 / 0)
+    - Conversions from integers saturate, from floats round to nearest and
+      saturate (NaN gives 0). Conversions out are explicit; to integers
+      they truncate toward 0 like float to int does.
+    - math::sqrt and vector magnitudes round to nearest, negative input
+      gives 0. Magnitudes sum the squares in double width, so they don't
+      overflow before the square root does.
+    - math::sin/cos interpolate a quarter wave table with 1024 segments:
+      within 1 unit of the last place for q16_16, within 3e-7 for q32_32.
+      math::tan is sin / cos.
+
+    With a SIMD backend, vec4<q16_16> add, subtract and multiply run on
+    the 4 packed lanes with the same results. Division stays per component.
+*/
+namespace mz {
+    template <u32 frac_bits, typename storage_t>
+    struct fixed;
+
+namespace math {
+    namespace detail {
+
+        // Unsigned 128 bit integer for the s64 backed formats. The products and
+        // quotients use __int128 where the compiler has it, same results either way.
+        struct u128 {
+            u64 hi, lo;
+        };
+
+        constexpr u128 add(u128 a, u128 b) {
+            u64 lo = a.lo + b.lo;
+            return { a.hi + b.hi + (lo < a.lo), lo };
+        }
+        constexpr u128 sub(u128 a, u128 b) {
+            return { a.hi - b.hi - (a.lo < b.lo), a.lo - b.lo };
+        }
+        constexpr bool less(u128 a, u128 b) {
+            return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+        }
+        constexpr u128 shr(u128 a, u32 n) {
+            if (n == 0)  return a;
+            if (n >= 64) return { 0, a.hi >> (n - 64) };
+            return { a.hi >> n, (a.hi << (64 - n)) | (a.lo >> n) };
+        }
+        constexpr u128 shl(u128 a, u32 n) {
+            if (n == 0)  return a;
+            if (n >= 64) return { a.lo << (n - 64), 0 };
+            return { (a.hi << n) | (a.lo >> (64 - n)), a.lo << n };
+        }
+
+        constexpr u128 mul_u64(u64 a, u64 b) {
+#if defined(__SIZEOF_INT128__)
+            unsigned __int128 p = (unsigned __int128)a * b;
+            return { (u64)(p >> 64), (u64)p };
+#endif
+            u64 a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+            u64 b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+            u64 p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+            u64 mid = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+            return { p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32), (mid << 32) | (p0 & 0xFFFFFFFF) };
+        }
+        // Two's complement product, the unsigned one minus b << 64 if a < 0 and vice versa
+        constexpr u128 mul_s64(s64 a, s64 b) {
+            u128 p = mul_u64((u64)a, (u64)b);
+            if (a < 0) p.hi -= (u64)b;
+            if (b < 0) p.hi -= (u64)a;
+            return p;
+        }
+
+        // n / d for a quotient that fits in 64 bits (n.hi < d), remainder in rem
+        constexpr u64 div_u128(u128 n, u64 d, u64& rem) {
+#if defined(__SIZEOF_INT128__)
+            unsigned __int128 wide = ((unsigned __int128)n.hi << 64) | n.lo;
+            rem = (u64)(wide % d);
+            return (u64)(wide / d);
+#endif
+            u64 r = n.hi, q = 0;
+            for (s32 i = 63; i >= 0; i--) {
+                bool carry = (r >> 63) != 0;
+                r = (r << 1) | ((n.lo >> i) & 1);
+                q <<= 1;
+                if (carry || r >= d) {
+                    r -= d;
+                    q |= 1;
+                }
+            }
+            rem = r;
+            return q;
+        }
+
+        /*
+            Square roots rounded to nearest. At runtime they start from the f64
+            square root, which is correctly rounded on every IEEE platform and
+            so at most 1 off the integer one, and correct it exactly. At
+            compile time they go bit by bit.
+        */
+        constexpr u64 isqrt(u64 n) {
+            if (!mz_is_constant_evaluated()) {
+                u64 r = (u64)std::sqrt((f64)n);
+                if (r > 0xFFFFFFFF) r = 0xFFFFFFFF;
+                if (r * r > n) r--;
+                u64 rem = n - r * r;
+                if (rem > 2 * r) {
+                    rem -= 2 * r + 1;
+                    r++;
+                }
+                return rem > r ? r + 1 : r;
+            }
+            u64 r = 0, bit = (u64)1 << 62;
+            while (bit > n) bit >>= 2;
+            while (bit) {
+                if (n >= r + bit) {
+                    n -= r + bit;
+                    r = (r >> 1) + bit;
+                } else {
+                    r >>= 1;
+                }
+                bit >>= 2;
+            }
+            return n > r ? r + 1 : r;
+        }
+        constexpr u128 isqrt(u128 n) {
+#if defined(__SIZEOF_INT128__)
+            if (!mz_is_constant_evaluated()) {
+                // One Newton step takes the f64 estimate to within 1
+                unsigned __int128 wide = ((unsigned __int128)n.hi << 64) | n.lo;
+                if (!wide) return { 0, 0 };
+                unsigned __int128 r = (unsigned __int128)std::sqrt((f64)wide);
+                if (r > 0xFFFFFFFFFFFFFFFF) r = 0xFFFFFFFFFFFFFFFF;
+                if (r == 0) r = 1;
+                r = (r + wide / r) >> 1;
+                if (r > 0xFFFFFFFFFFFFFFFF) r = 0xFFFFFFFFFFFFFFFF;
+                while (r * r > wide) r--;
+                unsigned __int128 rem = wide - r * r;
+                while (rem > 2 * r) {
+                    rem -= 2 * r + 1;
+                    r++;
+                }
+                return rem > r ? add({ 0, (u64)r }, { 0, 1 }) : u128{ 0, (u64)r };
+            }
+#endif
+            u128 r = { 0, 0 }, bit = { (u64)1 << 62, 0 };
+            while (less(n, bit)) bit = shr(bit, 2);
+            while (bit.hi || bit.lo) {
+                u128 trial = add(r, bit);
+                if (!less(n, trial)) {
+                    n = sub(n, trial);
+                    r = add(shr(r, 1), bit);
+                } else {
+                    r = shr(r, 1);
+                }
+                bit = shr(bit, 2);
+            }
+            return less(r, n) ? add(r, { 0, 1 }) : r;
+        }
+
+        // sin over the first quadrant in Q1.30, 1024 segments, plus one entry
+        // mirrored past pi / 2 so the interpolation never reads out of bounds
+        struct quarter_wave {
+            static constexpr u32 segment_bits = 10;
+            static constexpr u32 segments     = 1 << segment_bits;
+            s32 values[segments + 2];
+        };
+        constexpr quarter_wave make_quarter_wave() {
+            quarter_wave table = {};
+            for (u32 i = 0; i <= quarter_wave::segments; i++) {
+                f64 s = 0, c = 0;
+                sincos(half_pi * i / quarter_wave::segments, s, c);
+                table.values[i] = (s32)(s * (1 << 30) + 0.5);
+            }
+            table.values[quarter_wave::segments + 1] = table.values[quarter_wave::segments - 1];
+            return table;
+        }
+        inline constexpr quarter_wave sine_table = make_quarter_wave();
+
+        /*
+            sin in Q1.30 of a phase counted in quarter turns, the quadrant in
+            bits 32 and 33 and the position within it in the low 32 bits.
+            Odd quadrants read the table backwards, the upper half negates.
+        */
+        constexpr s32 sin_phase(u64 phase) {
+            constexpr u32 rem_bits = 32 - quarter_wave::segment_bits;
+            u32 quadrant = (u32)(phase >> 32) & 3;
+            u64 position = phase & 0xFFFFFFFF;
+            if (quadrant & 1) position = ((u64)1 << 32) - position;
+            u32 i = (u32)(position >> rem_bits);
+            s64 rem = (s64)(position & (((u64)1 << rem_bits) - 1));
+            s32 a = sine_table.values[i], b = sine_table.values[i + 1];
+            s32 v = a + (s32)(((b - a) * rem + ((s64)1 << (rem_bits - 1))) >> rem_bits);
+            return (quadrant & 2) ? -v : v;
+        }
+    }
+}
+
+    template <u32 frac_bits, typename storage_t = s32>
+    struct fixed {
+        static_assert(std::is_same<storage_t, s32>::value || std::is_same<storage_t, s64>::value, "fixed is stored in s32 or s64");
+        static_assert(frac_bits >= 1 && frac_bits <= sizeof(storage_t) * 8 - 2, "fixed needs at least 1 fraction bit and 1 integer bit");
+
+        typedef storage_t storage_type;
+        static constexpr u32       fraction_bits = frac_bits;
+        static constexpr storage_t raw_max       = std::numeric_limits<storage_t>::max();
+        static constexpr storage_t raw_min       = std::numeric_limits<storage_t>::min();
+        static constexpr storage_t raw_one       = (storage_t)1 << frac_bits;
+
+        storage_t raw;
+
+        constexpr mz_force_inline fixed() = default;
+        template <typename value_t, typename = typename std::enable_if<std::is_arithmetic<value_t>::value>::type>
+        constexpr mz_force_inline fixed(value_t v) : raw(to_raw(v)) {}
+        template <u32 rhs_frac_bits, typename rhs_storage_t>
+        constexpr explicit mz_force_inline fixed(fixed<rhs_frac_bits, rhs_storage_t> rhs) : raw(to_raw(rhs)) {}
+
+        static constexpr mz_force_inline fixed from_raw(storage_t raw) {
+            fixed f{};
+            f.raw = raw;
+            return f;
+        }
+        static constexpr mz_force_inline fixed highest() { return from_raw(raw_max); }
+        static constexpr mz_force_inline fixed lowest()  { return from_raw(raw_min); }
+        static constexpr mz_force_inline fixed epsilon() { return from_raw(1); }
+
+        template <typename value_t, typename = typename std::enable_if<std::is_arithmetic<value_t>::value>::type>
+        constexpr explicit mz_force_inline operator value_t() const {
+            if constexpr (std::is_same<value_t, bool>::value) {
+                return raw != 0;
+            } else if constexpr (std::is_floating_point<value_t>::value) {
+                return (value_t)((f64)raw / (f64)raw_one);
+            } else {
+                return (value_t)(raw / raw_one);
+            }
+        }
+
+        friend constexpr mz_force_inline fixed operator+(fixed a, fixed b) {
+            storage_t r = (storage_t)((unsigned_t)a.raw + (unsigned_t)b.raw);
+            return from_raw(((a.raw ^ r) & (b.raw ^ r)) < 0 ? saturated(a.raw < 0) : r);
+        }
+        friend constexpr mz_force_inline fixed operator-(fixed a, fixed b) {
+            storage_t r = (storage_t)((unsigned_t)a.raw - (unsigned_t)b.raw);
+            return from_raw(((a.raw ^ b.raw) & (a.raw ^ r)) < 0 ? saturated(a.raw < 0) : r);
+        }
+        friend constexpr mz_force_inline fixed operator*(fixed a, fixed b) {
+            if constexpr (sizeof(storage_t) == 4) {
+                s64 r = ((s64)a.raw * b.raw + ((s64)1 << (frac_bits - 1))) >> frac_bits;
+                return from_raw(r > raw_max ? raw_max : r < raw_min ? raw_min : (storage_t)r);
+            } else {
+                math::detail::u128 p = math::detail::add(math::detail::mul_s64(a.raw, b.raw), { 0, (u64)1 << (frac_bits - 1) });
+                s64 r = (s64)math::detail::shr(p, frac_bits).lo;
+                // Fits if the bits above the result are all copies of its sign
+                if (((s64)p.hi >> (frac_bits - 1)) != (r >> 63)) return from_raw(saturated((s64)p.hi < 0));
+                return from_raw(r);
+            }
+        }
+        friend constexpr mz_force_inline fixed operator/(fixed a, fixed b) {
+            if (b.raw == 0) return from_raw(a.raw == 0 ? 0 : saturated(a.raw < 0));
+            bool negative = (a.raw < 0) != (b.raw < 0);
+            u64 n = a.raw < 0 ? (u64)0 - (u64)a.raw : (u64)a.raw;
+            u64 d = b.raw < 0 ? (u64)0 - (u64)b.raw : (u64)b.raw;
+            u64 q = 0, rem = 0;
+            if constexpr (sizeof(storage_t) == 4) {
+                n <<= frac_bits;
+                q   = n / d;
+                rem = n % d;
+            } else {
+                math::detail::u128 wide = math::detail::shl({ 0, n }, frac_bits);
+                if (wide.hi >= d) return from_raw(saturated(negative));
+                q = math::detail::div_u128(wide, d, rem);
+            }
+            // Halves round up, so away from 0 above it and toward 0 below it
+            q += negative ? rem > d - rem : rem >= d - rem;
+            if (negative) return from_raw(q > (u64)0 - (u64)raw_min ? raw_min : (storage_t)((u64)0 - q));
+            return from_raw(q > (u64)raw_max ? raw_max : (storage_t)q);
+        }
+
+        friend constexpr mz_force_inline fixed operator-(fixed a) {
+            return from_raw(a.raw == raw_min ? raw_max : -a.raw);
+        }
+        friend constexpr mz_force_inline fixed operator+(fixed a) {
+            return a;
+        }
+
+        constexpr mz_force_inline fixed& operator+=(fixed rhs) { return *this = *this + rhs; }
+        constexpr mz_force_inline fixed& operator-=(fixed rhs) { return *this = *this - rhs; }
+        constexpr mz_force_inline fixed& operator*=(fixed rhs) { return *this = *this * rhs; }
+        constexpr mz_force_inline fixed& operator/=(fixed rhs) { return *this = *this / rhs; }
+
+        friend constexpr mz_force_inline bool operator==(fixed a, fixed b) { return a.raw == b.raw; }
+        friend constexpr mz_force_inline bool operator!=(fixed a, fixed b) { return a.raw != b.raw; }
+        friend constexpr mz_force_inline bool operator<(fixed a, fixed b)  { return a.raw < b.raw; }
+        friend constexpr mz_force_inline bool operator<=(fixed a, fixed b) { return a.raw <= b.raw; }
+        friend constexpr mz_force_inline bool operator>(fixed a, fixed b)  { return a.raw > b.raw; }
+        friend constexpr mz_force_inline bool operator>=(fixed a, fixed b) { return a.raw >= b.raw; }
+
+    private:
+        typedef typename std::make_unsigned<storage_t>::type unsigned_t;
+
+        static constexpr mz_force_inline storage_t saturated(bool negative) {
+            return negative ? raw_min : raw_max;
+        }
+
+        template <typename value_t>
+        static constexpr storage_t to_raw(value_t v) {
+            if constexpr (std::is_floating_point<value_t>::value) {
+                constexpr f64 limit = (f64)((u64)1 << (sizeof(storage_t) * 8 - 1));
+                f64 scaled = (f64)v * (f64)raw_one + 0.5;
+                if (scaled != scaled) return 0;
+                if (scaled >= limit)  return raw_max;
+                if (scaled < -limit)  return raw_min;
+                storage_t r = (storage_t)scaled;
+                return (f64)r > scaled ? r - 1 : r;
+            } else if constexpr (std::is_same<value_t, bool>::value) {
+                return v ? raw_one : 0;
+            } else {
+                constexpr storage_t int_max = raw_max >> frac_bits, int_min = raw_min >> frac_bits;
+                if constexpr (std::is_signed<value_t>::value) {
+                    if ((s64)v > (s64)int_max) return raw_max;
+                    if ((s64)v < (s64)int_min) return raw_min;
+                } else {
+                    if ((u64)v > (u64)int_max) return raw_max;
+                }
+                return (storage_t)v * raw_one;
+            }
+        }
+
+        template <u32 rhs_frac_bits, typename rhs_storage_t>
+        static constexpr storage_t to_raw(fixed<rhs_frac_bits, rhs_storage_t> rhs) {
+            s64 v = rhs.raw;
+            if constexpr (rhs_frac_bits >= frac_bits) {
+                constexpr u32 shift = rhs_frac_bits - frac_bits;
+                if constexpr (shift > 0) v = (v >> shift) + ((v >> (shift - 1)) & 1);
+                return v > raw_max ? raw_max : v < raw_min ? raw_min : (storage_t)v;
+            } else {
+                constexpr u32 shift = frac_bits - rhs_frac_bits;
+                if (v > (raw_max >> shift)) return raw_max;
+                if (v < (raw_min >> shift)) return raw_min;
+                return (storage_t)v * ((storage_t)1 << shift);
+            }
+        }
+    };
+
+    typedef fixed<16, s32> q16_16;
+    typedef fixed<32, s64> q32_32;
+
+    typedef vec2<q16_16> q16vec2;
+    typedef vec3<q16_16> q16vec3;
+    typedef vec4<q16_16> q16vec4;
+    typedef mat4<q16_16> q16mat4;
+
+    typedef vec2<q32_32> q32vec2;
+    typedef vec3<q32_32> q32vec3;
+    typedef vec4<q32_32> q32vec4;
+    typedef mat4<q32_32> q32mat4;
+
+    template <u32 frac_bits, typename storage_t>
+    struct scalar_traits<fixed<frac_bits, storage_t>> {
+        typedef fixed<frac_bits, storage_t> value_t;
+
+        static constexpr bool custom  = true;
+        static constexpr bool packed4 = simd::enabled && std::is_same<storage_t, s32>::value;
+
+        static constexpr value_t sqrt(value_t x) {
+            if (x.raw <= 0) return value_t::from_raw(0);
+            if constexpr (sizeof(storage_t) == 4) {
+                return value_t::from_raw((storage_t)math::detail::isqrt((u64)x.raw << frac_bits));
+            } else {
+                return value_t::from_raw((storage_t)math::detail::isqrt(math::detail::shl({ 0, (u64)x.raw }, frac_bits)).lo);
+            }
+        }
+
+        // The root of the summed raw squares is the raw length, no shift needed
+        template <typename... rest_t>
+        static constexpr value_t length(value_t a, rest_t... rest) {
+            const value_t values[] = { a, (value_t)rest... };
+            if constexpr (sizeof(storage_t) == 4) {
+                u64 sum = 0;
+                for (value_t v : values) {
+                    u64 next = sum + (u64)((s64)v.raw * v.raw);
+                    if (next < sum) return value_t::highest();
+                    sum = next;
+                }
+                u64 r = math::detail::isqrt(sum);
+                return r > (u64)value_t::raw_max ? value_t::highest() : value_t::from_raw((storage_t)r);
+            } else {
+                math::detail::u128 sum = { 0, 0 };
+                for (value_t v : values) {
+                    math::detail::u128 next = math::detail::add(sum, math::detail::mul_s64(v.raw, v.raw));
+                    if (math::detail::less(next, sum)) return value_t::highest();
+                    sum = next;
+                }
+                math::detail::u128 r = math::detail::isqrt(sum);
+                return r.hi || r.lo > (u64)value_t::raw_max ? value_t::highest() : value_t::from_raw((storage_t)r.lo);
+            }
+        }
+
+        static constexpr void sincos(value_t x, value_t& s, value_t& c) {
+            u64 p = phase(x);
+            s = from_q1_30(math::detail::sin_phase(p));
+            c = from_q1_30(math::detail::sin_phase(p + ((u64)1 << 32)));
+        }
+        static constexpr value_t sin(value_t x) {
+            return from_q1_30(math::detail::sin_phase(phase(x)));
+        }
+        static constexpr value_t cos(value_t x) {
+            return from_q1_30(math::detail::sin_phase(phase(x) + ((u64)1 << 32)));
+        }
+        static constexpr value_t tan(value_t x) {
+            value_t s = value_t::from_raw(0), c = value_t::from_raw(0);
+            sincos(x, s, c);
+            return s / c;
+        }
+
+        static mz_force_inline void add4(value_t* dst, const value_t* rhs) {
+            simd::add4_saturate(reinterpret_cast<s32*>(dst), reinterpret_cast<const s32*>(rhs));
+        }
+        static mz_force_inline void subtract4(value_t* dst, const value_t* rhs) {
+            simd::subtract4_saturate(reinterpret_cast<s32*>(dst), reinterpret_cast<const s32*>(rhs));
+        }
+        static mz_force_inline void multiply4(value_t* dst, const value_t* rhs) {
+            simd::multiply4_fixed<frac_bits>(reinterpret_cast<s32*>(dst), reinterpret_cast<const s32*>(rhs));
+        }
+
+    private:
+        static_assert(sizeof(value_t) == sizeof(storage_t), "fixed must be layout compatible with its storage");
+
+        // x * 2 / pi in quarter turns: the quadrant in bits 32 and 33, the position below.
+        // Wraps around harmlessly, only the quadrant and position matter.
+        static constexpr u64 phase(value_t x) {
+            if constexpr (sizeof(storage_t) == 4) {
+                constexpr s64 two_over_pi = 0xA2F9836E; // 2 / pi * 2^32
+                return (u64)(((s64)x.raw * two_over_pi) >> frac_bits);
+            } else {
+                constexpr u64 two_over_pi = 0xA2F9836E4E44152A; // 2 / pi * 2^64
+                math::detail::u128 p = math::detail::mul_u64((u64)x.raw, two_over_pi);
+                if (x.raw < 0) p.hi -= two_over_pi;
+                return math::detail::shr(p, frac_bits + 32).lo;
+            }
+        }
+
+        static constexpr value_t from_q1_30(s32 v) {
+            if constexpr (frac_bits < 30) {
+                return value_t::from_raw((storage_t)((v + ((s32)1 << (29 - frac_bits))) >> (30 - frac_bits)));
+            } else {
+                return value_t::from_raw((storage_t)v * ((storage_t)1 << (frac_bits - 30)));
+            }
+        }
+    };
+
+    template <typename TStream, u32 frac_bits, typename storage_t>
+    inline TStream& operator<<(TStream& str, fixed<frac_bits, storage_t> v) {
+        return str << (f64)v;
+    }
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_algorithms.hpp"
+#include "mz_matrix.hpp"
+
+/*
+    View frustum culling.
+
+    frustum<value_t>::from_matrix extracts the 6 planes bounding the clip
+    volume of a view projection matrix (-w <= x, y, z <= w like mz's
+    projections, or 0 <= z <= w with zero_to_one_depth) as vec4(normal, d),
+    with unit normals pointing inwards so that dot(normal, p) + d is the
+    signed distance of p from the plane.
+
+    Spheres are vec4(center, radius), boxes are aabb (min and max corners).
+    The tests are conservative: an object is culled only when it is entirely
+    outside one of the planes, so a few objects just outside the corners of
+    the frustum pass.
+
+    The batch versions set bit i of visible (word i / 64, bit i % 64) for
+    every object that passes, or write the passing indices in order and
+    return how many there are. f32 runs 4 objects at a time on SIMD
+    backends, with the same results as the single tests. Large arrays are
+    split across threads with parallel_for, par being a thread count or an
+    executor (mz_parallel.hpp).
+
+    hints is an optional per object plane index for temporal coherence: a
+    plane that culled the object last time is tested first, and the hint is
+    updated whenever the object is culled. Objects culled by the same plane
+    frame after frame then cost one plane test instead of six. The SIMD path
+    tests all 6 planes of 4 objects without branching, which is cheaper than
+    any early out, and leaves hints alone; they only ever change the cost,
+    never the result. Initialize hints to 0.
+*/
+namespace mz {
+
+    template <typename value_t>
+    struct aabb {
+        typedef value_t value_type;
+
+        vec3<value_t> min, max;
+
+        constexpr aabb() = default;
+        constexpr aabb(const vec3<value_t>& min, const vec3<value_t>& max) : min(min), max(max) {}
+    };
+
+    typedef aabb<f32> faabb;
+    typedef aabb<f64> daabb;
+
+    template <typename value_t>
+    struct frustum {
+        typedef value_t value_type;
+        typedef vec3<value_t> vec3_type;
+        typedef vec4<value_t> vec4_type;
+
+        static constexpr u32 left = 0, right = 1, bottom = 2, top = 3, near_ = 4, far_ = 5, plane_count = 6;
+
+        vec4_type planes[plane_count];
+
+        static constexpr frustum from_matrix(const mat4<value_t>& view_projection, bool zero_to_one_depth = false) {
+            const vec4_type& r0 = view_projection.rows[0];
+            const vec4_type& r1 = view_projection.rows[1];
+            const vec4_type& r2 = view_projection.rows[2];
+            const vec4_type& r3 = view_projection.rows[3];
+
+            frustum f{};
+            f.planes[left]   = r3 + r0;
+            f.planes[right]  = r3 - r0;
+            f.planes[bottom] = r3 + r1;
+            f.planes[top]    = r3 - r1;
+            f.planes[near_]  = zero_to_one_depth ? r2 : r3 + r2;
+            f.planes[far_]   = r3 - r2;
+            for (u32 i = 0; i < plane_count; i++) {
+                vec4_type& p = f.planes[i];
+                value_t length = (value_t)math::length(p.x, p.y, p.z);
+                if (length > 0) p = vec4_type(p.x / length, p.y / length, p.z / length, p.w / length);
+            }
+            return f;
+        }
+
+        constexpr mz_force_inline value_t distance(u32 plane, const vec3_type& p) const {
+            const vec4_type& n = planes[plane];
+            return ((n.x * p.x + n.y * p.y) + n.z * p.z) + n.w;
+        }
+
+        constexpr bool contains(const vec3_type& p) const {
+            for (u32 i = 0; i < plane_count; i++) {
+                if (!(distance(i, p) >= 0)) return false;
+            }
+            return true;
+        }
+
+        // Plane i culls the sphere / box. NaNs are culled.
+        constexpr mz_force_inline bool culls(u32 plane, const vec4_type& sphere) const {
+            return !(distance(plane, vec3_type(sphere.x, sphere.y, sphere.z)) >= -sphere.w);
+        }
+        constexpr mz_force_inline bool culls(u32 plane, const aabb<value_t>& box) const {
+            // Distance of the corner furthest along the normal
+            const vec4_type& n = planes[plane];
+            value_t lx = n.x * box.min.x, hx = n.x * box.max.x;
+            value_t ly = n.y * box.min.y, hy = n.y * box.max.y;
+            value_t lz = n.z * box.min.z, hz = n.z * box.max.z;
+            return !(((lx > hx ? lx : hx) + (ly > hy ? ly : hy)) + (lz > hz ? lz : hz) + n.w >= 0);
+        }
+
+        template <typename object_t>
+        constexpr bool intersects(const object_t& object) const {
+            for (u32 i = 0; i < plane_count; i++) {
+                if (culls(i, object)) return false;
+            }
+            return true;
+        }
+
+        // Same as intersects, testing plane *hint first and storing the culling plane in it
+        template <typename object_t>
+        constexpr bool intersects(const object_t& object, u8* hint) const {
+            u32 first = *hint < plane_count ? *hint : 0;
+            for (u32 k = 0; k < plane_count; k++) {
+                u32 plane = k == 0 ? first : k <= first ? k - 1 : k;
+                if (culls(plane, object)) {
+                    *hint = (u8)plane;
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    typedef frustum<f32> ffrustum;
+    typedef frustum<f64> dfrustum;
+
+    namespace detail {
+        // The planes of a frustum<f32> with every component in its own register
+        struct frustum_broadcast {
+            simd::f32x4 n[frustum<f32>::plane_count][4];
+
+            mz_force_inline frustum_broadcast(const frustum<f32>& f) {
+                for (u32 i = 0; i < frustum<f32>::plane_count; i++) {
+                    for (u32 c = 0; c < 4; c++) n[i][c] = simd::set1(f.planes[i].ptr[c]);
+                }
+            }
+
+            // 4 spheres / boxes in planar form, boxes as the min and max of each axis
+            struct spheres4 { simd::f32x4 x, y, z, neg_r; };
+            struct boxes4   { simd::f32x4 lx, hx, ly, hy, lz, hz; };
+
+            static mz_force_inline spheres4 load(const vec4<f32>* spheres) {
+                spheres4 s;
+                simd::load4(spheres->ptr, s.x, s.y, s.z, s.neg_r);
+                s.neg_r = simd::sub(simd::set1(0.f), s.neg_r);
+                return s;
+            }
+            static mz_force_inline boxes4 load(const aabb<f32>* boxes) {
+                // 2 boxes are 4 vec3s: min, max, min, max
+                boxes4 b;
+                simd::f32x4 ax, ay, az, bx, by, bz;
+                simd::load3(boxes[0].min.ptr, ax, ay, az);
+                simd::load3(boxes[2].min.ptr, bx, by, bz);
+                simd::unzip(ax, bx, b.lx, b.hx);
+                simd::unzip(ay, by, b.ly, b.hy);
+                simd::unzip(az, bz, b.lz, b.hz);
+                return b;
+            }
+
+            // Mask of the lanes plane i doesn't cull, same math as frustum::culls
+            mz_force_inline simd::f32x4 passes(u32 i, const spheres4& s) const {
+                simd::f32x4 d = simd::add(simd::add(simd::add(simd::mul(n[i][0], s.x), simd::mul(n[i][1], s.y)), simd::mul(n[i][2], s.z)), n[i][3]);
+                return simd::cmpge(d, s.neg_r);
+            }
+            mz_force_inline simd::f32x4 passes(u32 i, const boxes4& b) const {
+                simd::f32x4 d = simd::add(simd::max(simd::mul(n[i][0], b.lx), simd::mul(n[i][0], b.hx)), simd::max(simd::mul(n[i][1], b.ly), simd::mul(n[i][1], b.hy)));
+                d = simd::add(simd::add(d, simd::max(simd::mul(n[i][2], b.lz), simd::mul(n[i][2], b.hz))), n[i][3]);
+                return simd::cmpge(d, simd::set1(0.f));
+            }
+        };
+
+        // Visibility words for objects [begin, end), begin a multiple of 64.
+        // planes is only used (and only set) when value_t is accelerated.
+        template <typename value_t, typename object_t>
+        inline void frustum_cull_words(const frustum<value_t>& f, const frustum_broadcast* planes, const object_t* objects, size_t begin, size_t end, u64* visible, u8* hints) {
+            for (size_t word_begin = begin; word_begin < end; word_begin += 64) {
+                const size_t word_end = word_begin + 64 < end ? word_begin + 64 : end;
+                u64 word = 0;
+                size_t i = word_begin;
+                if constexpr (simd::accelerated<value_t>) {
+                    // All planes without branching, with no use for hints: early outs
+                    // mispredict too often to pay off at this cost per plane
+                    for (const size_t simd_end = word_begin + ((word_end - word_begin) & ~(size_t)3); i < simd_end; i += 4) {
+                        const auto group = frustum_broadcast::load(objects + i);
+                        simd::f32x4 mask = planes->passes(0, group);
+                        for (u32 k = 1; k < frustum<f32>::plane_count; k++)
+                            mask = simd::bit_and(mask, planes->passes(k, group));
+                        word |= (u64)simd::movemask(mask) << (i - word_begin);
+                    }
+                }
+                for (; i < word_end; i++) {
+                    bool inside = hints ? f.intersects(objects[i], hints + i) : f.intersects(objects[i]);
+                    word |= (u64)inside << (i - word_begin);
+                }
+                visible[word_begin / 64] = word;
+            }
+        }
+
+        template <typename value_t, typename object_t>
+        inline void frustum_cull_range(const frustum<value_t>& f, const object_t* objects, size_t begin, size_t end, u64* visible, u8* hints) {
+            if constexpr (simd::accelerated<value_t>) {
+                const frustum_broadcast planes(f);
+                frustum_cull_words(f, &planes, objects, begin, end, visible, hints);
+            } else {
+                frustum_cull_words(f, (const frustum_broadcast*)NULL, objects, begin, end, visible, hints);
+            }
+        }
+    }
+
+    namespace detail {
+        template <typename value_t, typename object_t>
+        inline void frustum_cull_batch(const frustum<value_t>& f, span<const object_t> objects, span<u64> visible, span<u8> hints, parallelism par) {
+            size_t n = objects.size();
+            if (visible.size() < (n + 63) / 64) n = visible.size() * 64;
+            u8* const hint_ptr = hints.size() < n ? (u8*)NULL : hints.ptr;
+            // 512 objects = 8 words = one cache line of output per chunk boundary
+            parallel_for(n, 512, par, [&](size_t begin, size_t end) {
+                frustum_cull_range(f, objects.ptr, begin, end, visible.ptr, hint_ptr);
+            });
+        }
+    }
+
+    // visible needs (objects.size() + 63) / 64 words; with fewer, only the first
+    // visible.size() * 64 objects are tested. hints are used only if they cover
+    // every tested object.
+    template <typename value_t>
+    inline void frustum_cull(const frustum<value_t>& f, span<const typename frustum<value_t>::vec4_type> spheres, span<u64> visible, span<u8> hints = {}, parallelism par = {}) {
+        detail::frustum_cull_batch(f, spheres, visible, hints, par);
+    }
+    template <typename value_t>
+    inline void frustum_cull(const frustum<value_t>& f, span<const aabb<typename frustum<value_t>::value_type>> boxes, span<u64> visible, span<u8> hints = {}, parallelism par = {}) {
+        detail::frustum_cull_batch(f, boxes, visible, hints, par);
+    }
+
+    namespace detail {
+        template <typename value_t, typename object_t>
+        inline size_t frustum_cull_compact(const frustum<value_t>& f, span<const object_t> objects, span<u32> indices, span<u8> hints, parallelism par) {
+            const size_t n = objects.size() < indices.size() ? objects.size() : indices.size();
+            std::vector<u64> visible((n + 63) / 64);
+            frustum_cull(f, objects.subspan(0, n), span<u64>(visible), hints, par);
+
+            // Each word's first output slot, then the words are expanded in parallel
+            std::vector<size_t> offsets(visible.size() + 1, 0);
+            for (size_t w = 0; w < visible.size(); w++)
+                offsets[w + 1] = offsets[w] + popcount64(visible[w]);
+
+            parallel_for(visible.size(), 64, par, [&](size_t begin, size_t end) {
+                for (size_t w = begin; w < end; w++) {
+                    u32* out = indices.ptr + offsets[w];
+                    for (u64 bits = visible[w]; bits; bits &= bits - 1)
+                        *out++ = (u32)(w * 64 + ctz64(bits));
+                }
+            });
+            return offsets.back();
+        }
+    }
+
+    // Writes the indices of the objects that pass, in order, and returns how many.
+    // min(objects.size(), indices.size()) objects are tested.
+    template <typename value_t>
+    inline size_t frustum_cull_compact(const frustum<value_t>& f, span<const typename frustum<value_t>::vec4_type> spheres, span<u32> indices, span<u8> hints = {}, parallelism par = {}) {
+        return detail::frustum_cull_compact(f, spheres, indices, hints, par);
+    }
+    template <typename value_t>
+    inline size_t frustum_cull_compact(const frustum<value_t>& f, span<const aabb<typename frustum<value_t>::value_type>> boxes, span<u32> indices, span<u8> hints = {}, parallelism par = {}) {
+        return detail::frustum_cull_compact(f, boxes, indices, hints, par);
+    }
+}
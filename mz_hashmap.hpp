@@ -0,0 +1,465 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "mz_morton.hpp"
+#include "mz_vector.hpp"
+
+/*
+    Flat hash map and set for integer keys and integer vector keys, eg.
+    ivec2 grid cells or ivec3 voxel chunks.
+
+    Open addressing with the control byte layout of SwissTable: every slot
+    has one byte that is empty, deleted or the low 7 bits of the key's
+    hash, and lookups compare a whole group of control bytes at once (16
+    with SSE2 or NEON, 8 in a u64 otherwise) before touching any key. Keys
+    and values live in two separate arrays, so probing only reads the
+    control bytes and the keys. Groups are probed triangularly and the
+    table grows at 7/8 load.
+
+    vec_hash packs the components into 64 bit words and runs them through
+    a multiply-xorshift mix; std::hash is the identity for integers on most
+    standard libraries, which is what makes std::unordered_map<ivec2, ...>
+    cluster. morton_hash interleaves the coordinate bits first and hashes
+    each aligned run of 4 Morton codes (2x2 cells in 2D, 2x2x1 in 3D) to the
+    same group, so neighbouring lookups share cache lines. The price is a
+    lumpier spread, since keys land in groups 4 at a time, and a costlier
+    hash; it only pays off when lookups cluster heavily in a table much
+    larger than the cache, and vec_hash is faster on the find_3x3 bench.
+
+    Values must be default constructible: unused slots hold value_t(), and
+    erased values are reset to it. Iterators and references are invalidated
+    by any insert that grows the table. Iterating the map yields
+    std::pair<const key_t&, value_t&>, so it->first and it->second and
+    structured bindings work as with std::unordered_map. erase(it) does not
+    return the next iterator.
+*/
+
+namespace mz {
+
+    constexpr mz_force_inline u64 hash_mix(u64 x) {
+        x ^= x >> 32;
+        x *= 0xd6e8feb86659fd93ull;
+        x ^= x >> 32;
+        x *= 0xd6e8feb86659fd93ull;
+        x ^= x >> 32;
+        return x;
+    }
+
+    namespace detail {
+        template <typename value_t>
+        constexpr mz_force_inline u64 hash_bits(value_t v) {
+            static_assert(std::is_integral<value_t>::value, "mz hashes only support integer keys");
+            return (u64)(std::make_unsigned_t<value_t>)v;
+        }
+
+        // Two components in one word, before mixing
+        template <typename value_t>
+        constexpr mz_force_inline u64 hash_pack(value_t a, value_t b) {
+            if (sizeof(value_t) <= 4) return hash_bits(a) | (hash_bits(b) << 32);
+            return hash_bits(a) ^ hash_mix(hash_bits(b));
+        }
+
+        // Runs of 4 Morton codes share a group, their low bits keep them apart in the control byte
+        constexpr mz_force_inline u64 morton_to_hash(u64 m) {
+            return (hash_mix(m >> 2) & ~(u64)3) | (m & 3);
+        }
+    }
+
+    template <typename key_t>
+    struct vec_hash {
+        constexpr u64 operator()(key_t v) const { return hash_mix(detail::hash_bits(v)); }
+    };
+    template <typename value_t>
+    struct vec_hash<vec2<value_t>> {
+        constexpr u64 operator()(const vec2<value_t>& v) const { return hash_mix(detail::hash_pack(v.x, v.y)); }
+    };
+    template <typename value_t>
+    struct vec_hash<vec3<value_t>> {
+        constexpr u64 operator()(const vec3<value_t>& v) const {
+            return hash_mix(detail::hash_pack(v.x, v.y) ^ hash_mix(detail::hash_bits(v.z)));
+        }
+    };
+    template <typename value_t>
+    struct vec_hash<vec4<value_t>> {
+        constexpr u64 operator()(const vec4<value_t>& v) const {
+            return hash_mix(detail::hash_pack(v.x, v.y) ^ hash_mix(detail::hash_pack(v.z, v.w)));
+        }
+    };
+
+    // Locality preserving hash for 2D and 3D keys, see the top of the file
+    template <typename key_t>
+    struct morton_hash;
+    template <typename value_t>
+    struct morton_hash<vec2<value_t>> {
+        u64 operator()(const vec2<value_t>& v) const {
+            return detail::morton_to_hash(morton_encode(u32vec2((u32)detail::hash_bits(v.x), (u32)detail::hash_bits(v.y))));
+        }
+    };
+    template <typename value_t>
+    struct morton_hash<vec3<value_t>> {
+        u64 operator()(const vec3<value_t>& v) const {
+            return detail::morton_to_hash(morton_encode(u32vec3((u32)detail::hash_bits(v.x), (u32)detail::hash_bits(v.y), (u32)detail::hash_bits(v.z))));
+        }
+    };
+
+    namespace detail {
+        constexpr u8 ctrl_empty   = 0x80;
+        constexpr u8 ctrl_deleted = 0xfe;
+
+        /*
+            One group of control bytes. The match functions return a mask
+            with one bit set per matching byte; ctz64(mask) >> shift is the
+            byte's index in the group. Full slots are 0-127, so the high bit
+            alone tells free (empty or deleted) slots apart.
+        */
+        struct ctrl_group {
+#if defined(MZ_SIMD_SSE)
+            static constexpr size_t width = 16;
+            static constexpr u32 shift = 0;
+
+            explicit ctrl_group(const u8* ctrl) : c(_mm_loadu_si128((const __m128i*)ctrl)) {}
+
+            mz_force_inline u64 match(u8 h2) const { return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8((char)h2))); }
+            mz_force_inline u64 match_empty() const { return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8((char)ctrl_empty))); }
+            mz_force_inline u64 match_free() const { return (u32)_mm_movemask_epi8(c); }
+
+            __m128i c;
+#elif defined(MZ_SIMD_NEON)
+            static constexpr size_t width = 16;
+            static constexpr u32 shift = 2;
+
+            explicit ctrl_group(const u8* ctrl) : c(vld1q_u8(ctrl)) {}
+
+            mz_force_inline u64 match(u8 h2) const { return bits(vceqq_u8(c, vdupq_n_u8(h2))); }
+            mz_force_inline u64 match_empty() const { return bits(vceqq_u8(c, vdupq_n_u8(ctrl_empty))); }
+            mz_force_inline u64 match_free() const { return bits(vtstq_u8(c, vdupq_n_u8(0x80))); }
+
+            // 0x00/0xff bytes to one bit per nibble
+            static mz_force_inline u64 bits(uint8x16_t m) {
+                return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0) & 0x8888888888888888ull;
+            }
+
+            uint8x16_t c;
+#else
+            static constexpr size_t width = 8;
+            static constexpr u32 shift = 3;
+
+            explicit ctrl_group(const u8* ctrl) : c(0) {
+                for (u32 i = 0; i < 8; i++) c |= (u64)ctrl[i] << (i * 8);
+            }
+
+            // Can report a false match right after a real one, always on a full slot
+            mz_force_inline u64 match(u8 h2) const {
+                u64 x = c ^ (lsbs * h2);
+                return (x - lsbs) & ~x & msbs;
+            }
+            mz_force_inline u64 match_empty() const { return c & ~(c << 6) & msbs; }
+            mz_force_inline u64 match_free() const { return c & msbs; }
+
+            static constexpr u64 lsbs = 0x0101010101010101ull;
+            static constexpr u64 msbs = 0x8080808080808080ull;
+
+            u64 c;
+#endif
+        };
+
+        // Value array of a flat table, nothing for sets. Values are wrapped
+        // in slot so that bool gets real references, not vector<bool> proxies.
+        template <typename key_t, typename value_t>
+        struct flat_values {
+            template <bool is_const>
+            using reference = std::pair<const key_t&, std::conditional_t<is_const, const value_t&, value_t&>>;
+
+            template <bool is_const, typename values_t>
+            static mz_force_inline reference<is_const> at(const key_t& key, values_t& values, size_t i) { return { key, values.v[i].value }; }
+
+            mz_force_inline value_t& operator[](size_t i) { return v[i].value; }
+
+            void resize(size_t n) { v.clear(); v.resize(n); }
+            void reset(size_t i) { v[i].value = value_t(); }
+            void move_from(flat_values& other, size_t from, size_t to) { v[to].value = std::move(other.v[from].value); }
+            void swap(flat_values& other) { v.swap(other.v); }
+
+            struct slot { value_t value; };
+            std::vector<slot> v;
+        };
+        template <typename key_t>
+        struct flat_values<key_t, void> {
+            template <bool is_const>
+            using reference = const key_t&;
+
+            template <bool is_const, typename values_t>
+            static mz_force_inline const key_t& at(const key_t& key, values_t&, size_t) { return key; }
+
+            void resize(size_t) {}
+            void reset(size_t) {}
+            void move_from(flat_values&, size_t, size_t) {}
+            void swap(flat_values&) {}
+        };
+
+        // Shared by flat_hash_map and flat_hash_set, value_t is void for sets
+        template <typename key_t, typename value_t, typename hash_t>
+        struct flat_table {
+            typedef key_t key_type;
+            typedef flat_values<key_t, value_t> values_type;
+
+            template <bool is_const>
+            struct basic_iterator {
+                typedef std::conditional_t<is_const, const flat_table*, flat_table*> table_ptr;
+                typedef typename values_type::template reference<is_const> reference;
+                typedef std::forward_iterator_tag iterator_category;
+                typedef std::remove_cv_t<std::remove_reference_t<reference>> value_type;
+                typedef std::ptrdiff_t difference_type;
+
+                // Keeps the pair that operator* makes alive for operator->
+                struct arrow {
+                    reference r;
+                    auto operator->() const { return &r; }
+                };
+                typedef arrow pointer;
+
+                basic_iterator() : _t(nullptr), _i(0) {}
+                basic_iterator(table_ptr t, size_t i) : _t(t), _i(i) {}
+                operator basic_iterator<true>() const { return { _t, _i }; }
+
+                reference operator*() const { return values_type::template at<is_const>(_t->_keys[_i], _t->_values, _i); }
+                arrow operator->() const { return { **this }; }
+
+                basic_iterator& operator++() { _i = _t->next_full(_i + 1); return *this; }
+                basic_iterator operator++(int) { basic_iterator r = *this; ++*this; return r; }
+
+                bool operator==(const basic_iterator& rhs) const { return _i == rhs._i; }
+                bool operator!=(const basic_iterator& rhs) const { return _i != rhs._i; }
+
+                size_t index() const { return _i; }
+
+            private:
+                table_ptr _t;
+                size_t _i;
+            };
+            typedef basic_iterator<false> iterator;
+            typedef basic_iterator<true> const_iterator;
+
+            flat_table() = default;
+            explicit flat_table(size_t n) { reserve(n); }
+
+            iterator begin() { return { this, next_full(0) }; }
+            iterator end() { return { this, capacity() }; }
+            const_iterator begin() const { return { this, next_full(0) }; }
+            const_iterator end() const { return { this, capacity() }; }
+
+            size_t size() const { return _size; }
+            bool empty() const { return _size == 0; }
+            size_t capacity() const { return _ctrl.size(); }
+
+            iterator find(const key_t& key) { return { this, find_index(key) }; }
+            const_iterator find(const key_t& key) const { return { this, find_index(key) }; }
+            bool contains(const key_t& key) const { return find_index(key) != capacity(); }
+            size_t count(const key_t& key) const { return contains(key) ? 1 : 0; }
+
+            void erase(const_iterator it) { erase_index(it.index()); }
+            size_t erase(const key_t& key) {
+                size_t i = find_index(key);
+                if (i == capacity()) return 0;
+                erase_index(i);
+                return 1;
+            }
+
+            // Keeps the capacity
+            void clear() {
+                if (_size == 0 && _growth_left == max_load(capacity())) return;
+                for (size_t i = 0; i < capacity(); i++)
+                    if (is_full(_ctrl[i])) _values.reset(i);
+                std::fill(_ctrl.begin(), _ctrl.end(), ctrl_empty);
+                _size = 0;
+                _growth_left = max_load(capacity());
+            }
+
+            // Makes room for n elements without growing
+            void reserve(size_t n) {
+                size_t cap = min_capacity;
+                while (max_load(cap) < n) cap *= 2;
+                if (cap > capacity()) rehash(cap);
+            }
+
+            void swap(flat_table& other) {
+                _ctrl.swap(other._ctrl);
+                _keys.swap(other._keys);
+                _values.swap(other._values);
+                std::swap(_size, other._size);
+                std::swap(_growth_left, other._growth_left);
+                std::swap(_group_mask, other._group_mask);
+                std::swap(_hash, other._hash);
+            }
+
+        protected:
+            typedef ctrl_group group;
+            static constexpr size_t min_capacity = group::width < 16 ? 16 : group::width;
+
+            static mz_force_inline bool is_full(u8 c) { return (c & 0x80) == 0; }
+            static constexpr size_t max_load(size_t cap) { return cap - cap / 8; }
+
+            mz_force_inline size_t find_index(const key_t& key) const {
+                if (_size == 0) return capacity();
+
+                const u64 h = (u64)_hash(key);
+                const u8 h2 = (u8)(h & 0x7f);
+                size_t g = (size_t)(h >> 7) & _group_mask;
+                for (size_t step = 1;; step++) {
+                    const size_t base = g * group::width;
+                    const group grp(&_ctrl[base]);
+                    for (u64 m = grp.match(h2); m; m &= m - 1) {
+                        const size_t i = base + (ctz64(m) >> group::shift);
+                        if (_keys[i] == key) return i;
+                    }
+                    if (grp.match_empty()) return capacity();
+                    g = (g + step) & _group_mask;
+                }
+            }
+
+            // First empty or deleted slot on the probe sequence of h
+            mz_force_inline size_t find_free(u64 h) const {
+                size_t g = (size_t)(h >> 7) & _group_mask;
+                for (size_t step = 1;; step++) {
+                    const u64 m = group(&_ctrl[g * group::width]).match_free();
+                    if (m) return g * group::width + (ctz64(m) >> group::shift);
+                    g = (g + step) & _group_mask;
+                }
+            }
+
+            // Index of key and true if it was inserted; the value is value_t() then
+            std::pair<size_t, bool> find_or_insert(const key_t& key) {
+                size_t i = find_index(key);
+                if (i != capacity()) return { i, false };
+
+                const u64 h = (u64)_hash(key);
+                if (capacity() == 0) rehash(min_capacity);
+                i = find_free(h);
+                if (_growth_left == 0 && _ctrl[i] != ctrl_deleted) {
+                    // Mostly tombstones: clean up in place instead of doubling
+                    rehash(_size < max_load(capacity()) / 2 ? capacity() : capacity() * 2);
+                    i = find_free(h);
+                }
+                if (_ctrl[i] == ctrl_empty) _growth_left--;
+                _ctrl[i] = (u8)(h & 0x7f);
+                _keys[i] = key;
+                _size++;
+                return { i, true };
+            }
+
+            void erase_index(size_t i) {
+                // A group that still has an empty slot ends every probe sequence
+                // reaching it, so the slot can go back to empty
+                const size_t base = i & ~(group::width - 1);
+                if (group(&_ctrl[base]).match_empty()) {
+                    _ctrl[i] = ctrl_empty;
+                    _growth_left++;
+                } else {
+                    _ctrl[i] = ctrl_deleted;
+                }
+                _values.reset(i);
+                _size--;
+            }
+
+            size_t next_full(size_t i) const {
+                while (i < capacity() && !is_full(_ctrl[i])) i++;
+                return i;
+            }
+
+            void rehash(size_t cap) {
+                std::vector<u8> ctrl(cap, ctrl_empty);
+                std::vector<key_t> keys(cap);
+                values_type values;
+                values.resize(cap);
+
+                ctrl.swap(_ctrl);
+                keys.swap(_keys);
+                values.swap(_values);
+                _group_mask = cap / group::width - 1;
+
+                for (size_t i = 0; i < ctrl.size(); i++) {
+                    if (!is_full(ctrl[i])) continue;
+                    const size_t j = find_free((u64)_hash(keys[i]));
+                    _ctrl[j] = ctrl[i];
+                    _keys[j] = keys[i];
+                    _values.move_from(values, i, j);
+                }
+                _growth_left = max_load(cap) - _size;
+            }
+
+            std::vector<u8> _ctrl;
+            std::vector<key_t> _keys;
+            values_type _values;
+            size_t _size = 0;
+            size_t _growth_left = 0;
+            size_t _group_mask = 0;
+            hash_t _hash;
+        };
+    }
+
+    template <typename key_t, typename value_t, typename hash_t = vec_hash<key_t>>
+    struct flat_hash_map : detail::flat_table<key_t, value_t, hash_t> {
+        typedef detail::flat_table<key_t, value_t, hash_t> table_type;
+        typedef value_t mapped_type;
+        typedef typename table_type::iterator iterator;
+        typedef typename table_type::const_iterator const_iterator;
+
+        using table_type::table_type;
+
+        value_t& operator[](const key_t& key) { return this->_values[this->find_or_insert(key).first]; }
+
+        // Leaves the value alone if key is already there
+        std::pair<iterator, bool> insert(const key_t& key, const value_t& value) {
+            auto r = this->find_or_insert(key);
+            if (r.second) this->_values[r.first] = value;
+            return { iterator(this, r.first), r.second };
+        }
+        std::pair<iterator, bool> insert(const key_t& key, value_t&& value) {
+            auto r = this->find_or_insert(key);
+            if (r.second) this->_values[r.first] = std::move(value);
+            return { iterator(this, r.first), r.second };
+        }
+    };
+
+    template <typename key_t, typename hash_t = vec_hash<key_t>>
+    struct flat_hash_set : detail::flat_table<key_t, void, hash_t> {
+        typedef detail::flat_table<key_t, void, hash_t> table_type;
+        typedef typename table_type::iterator iterator;
+        typedef typename table_type::const_iterator const_iterator;
+
+        using table_type::table_type;
+
+        std::pair<iterator, bool> insert(const key_t& key) {
+            auto r = this->find_or_insert(key);
+            return { iterator(this, r.first), r.second };
+        }
+    };
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "mz_parallel.hpp"
+#include "mz_quaternion.hpp"
+
+namespace mz {
+
+    /*
+        Scene graph transforms: every node has a local position, rotation
+        and scale, and update() computes its world matrix as
+        world(parent) * trs(position, rotation, scale).
+
+        Nodes are stored in flat arrays sorted by depth (all roots, then all
+        their children, ...), with the parent of every node earlier in the
+        arrays. Setting a local transform only flags the node; update() then
+        recomputes the flagged nodes and everything below them, and nothing
+        else. Each depth level is one contiguous range whose nodes only read
+        the levels above, so update() splits the levels across threads with
+        parallel_for; pass an executor when updating every frame.
+
+        world() is all world matrices in one contiguous array, ready to
+        upload as is. Node ids are stable, but their position in the arrays
+        (index()) only holds until an update() that follows an insert,
+        remove or set_parent, which re-sorts the arrays. remove() drops the
+        node and all of its descendants at that point too, and their ids are
+        reused afterwards.
+    */
+    template <typename value_t>
+    struct transform_hierarchy {
+        typedef vec3<value_t> vec3_type;
+        typedef quat<value_t> quat_type;
+        typedef mat4<value_t> mat_type;
+
+        static constexpr u32 null_node = (u32)-1;
+
+        u32 insert(u32 parent = null_node, const vec3_type& position = vec3_type((value_t)0), const quat_type& rotation = quat_type(), const vec3_type& scale = vec3_type((value_t)1)) {
+            u32 id;
+            if (!_free.empty()) {
+                id = _free.back();
+                _free.pop_back();
+            } else {
+                id = (u32)_slot.size();
+                _slot.push_back(null_node);
+            }
+
+            _slot[id] = (u32)_ids.size();
+            _ids.push_back(id);
+            _parent.push_back(parent == null_node ? null_node : _slot[parent]);
+            _position.push_back(position);
+            _rotation.push_back(rotation);
+            _scale.push_back(scale);
+            _world.emplace_back();
+            _dirty.push_back(1);
+            _alive.push_back(1);
+            _layout_dirty = true;
+            _any_dirty = true;
+            return id;
+        }
+
+        // Removes id and its descendants at the next update()
+        void remove(u32 id) {
+            _alive[_slot[id]] = 0;
+            _layout_dirty = true;
+        }
+
+        // Returns false, and changes nothing, if parent is id or one of its descendants
+        bool set_parent(u32 id, u32 parent) {
+            const u32 s = _slot[id];
+            const u32 p = parent == null_node ? null_node : _slot[parent];
+            for (u32 a = p; a != null_node; a = _parent[a])
+                if (a == s) return false;
+
+            _parent[s] = p;
+            _dirty[s] = 1;
+            _layout_dirty = true;
+            _any_dirty = true;
+            return true;
+        }
+
+        void set_local(u32 id, const vec3_type& position, const quat_type& rotation, const vec3_type& scale) {
+            const u32 s = mark(id);
+            _position[s] = position;
+            _rotation[s] = rotation;
+            _scale[s]    = scale;
+        }
+        void set_position(u32 id, const vec3_type& position) { _position[mark(id)] = position; }
+        void set_rotation(u32 id, const quat_type& rotation) { _rotation[mark(id)] = rotation; }
+        void set_scale(u32 id, const vec3_type& scale)       { _scale[mark(id)] = scale; }
+
+        const vec3_type& position(u32 id) const { return _position[_slot[id]]; }
+        const quat_type& rotation(u32 id) const { return _rotation[_slot[id]]; }
+        const vec3_type& scale(u32 id) const    { return _scale[_slot[id]]; }
+        u32 parent(u32 id) const {
+            const u32 p = _parent[_slot[id]];
+            return p == null_node ? null_node : _ids[p];
+        }
+
+        // As of the last update()
+        const mat_type& world(u32 id) const { return _world[_slot[id]]; }
+        span<const mat_type> world() const  { return span<const mat_type>(_world.data(), _world.size()); }
+        u32 index(u32 id) const             { return _slot[id]; }
+        span<const u32> ids() const         { return span<const u32>(_ids.data(), _ids.size()); }
+        size_t size() const                 { return _ids.size(); }
+
+        void update(parallelism par = {}) {
+            if (_layout_dirty) sort();
+            if (!_any_dirty) return;
+
+            for (size_t level = 0; level + 1 < _levels.size(); level++) {
+                const size_t first = _levels[level];
+                parallel_for(_levels[level + 1] - first, 256, par, [&](size_t begin, size_t end) {
+                    update_range(first + begin, first + end);
+                });
+            }
+            std::fill(_dirty.begin(), _dirty.end(), (u8)0);
+            _any_dirty = false;
+        }
+
+        void clear() {
+            _ids.clear();
+            _parent.clear();
+            _position.clear();
+            _rotation.clear();
+            _scale.clear();
+            _world.clear();
+            _dirty.clear();
+            _alive.clear();
+            _slot.clear();
+            _free.clear();
+            _levels.clear();
+            _layout_dirty = false;
+            _any_dirty = false;
+        }
+
+    private:
+        mz_force_inline u32 mark(u32 id) {
+            const u32 s = _slot[id];
+            _dirty[s] = 1;
+            _any_dirty = true;
+            return s;
+        }
+
+        void update_range(size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const u32 p = _parent[i];
+                if (p == null_node) {
+                    if (_dirty[i])
+                        _world[i] = transformation::trs(_position[i], _rotation[i], _scale[i]);
+                } else if (_dirty[i] | _dirty[p]) {
+                    // Flags the children of this node on the next level
+                    _dirty[i] = 1;
+                    _world[i] = _world[p] * transformation::trs(_position[i], _rotation[i], _scale[i]);
+                }
+            }
+        }
+
+        // Drops removed subtrees and re-sorts by depth, each level by parent
+        void sort() {
+            const size_t n = _ids.size();
+            constexpr u32 unknown = (u32)-1, dropped = (u32)-2;
+
+            std::vector<u32> depth(n, unknown), chain;
+            u32 max_depth = 0;
+            for (u32 s = 0; s < n; s++) {
+                u32 c = s;
+                chain.clear();
+                while (c != null_node && depth[c] == unknown) {
+                    chain.push_back(c);
+                    c = _parent[c];
+                }
+                bool drop = c != null_node && depth[c] == dropped;
+                u32 d = c == null_node ? 0 : depth[c] + 1;
+                for (size_t k = chain.size(); k-- > 0;) {
+                    drop = drop || !_alive[chain[k]];
+                    depth[chain[k]] = drop ? dropped : d++;
+                }
+                if (!drop && d > max_depth) max_depth = d;
+            }
+
+            // order[] is old slots in the new order, slot_map[] the other way around
+            std::vector<u32> order, slot_map(n, null_node);
+            std::vector<size_t> counts(max_depth + 1, 0);
+            for (u32 s = 0; s < n; s++)
+                if (depth[s] != dropped) counts[depth[s] + 1]++;
+            for (size_t l = 1; l < counts.size(); l++) counts[l] += counts[l - 1];
+            _levels = counts;
+            order.resize(counts.back());
+            for (u32 s = 0; s < n; s++)
+                if (depth[s] != dropped) order[counts[depth[s]]++] = s;
+
+            for (size_t l = 0; l + 1 < _levels.size(); l++) {
+                u32* first = order.data() + _levels[l];
+                u32* last  = order.data() + _levels[l + 1];
+                if (l > 0)
+                    std::stable_sort(first, last, [&](u32 a, u32 b) { return slot_map[_parent[a]] < slot_map[_parent[b]]; });
+                for (u32* o = first; o != last; o++)
+                    slot_map[*o] = (u32)(o - order.data());
+            }
+
+            for (u32 s = 0; s < n; s++) {
+                if (depth[s] == dropped) {
+                    _slot[_ids[s]] = null_node;
+                    _free.push_back(_ids[s]);
+                }
+            }
+
+            permute(_ids, order);
+            permute(_position, order);
+            permute(_rotation, order);
+            permute(_scale, order);
+            permute(_world, order);
+            permute(_dirty, order);
+            permute(_parent, order);
+            _alive.assign(order.size(), 1);
+            for (u32 s = 0; s < order.size(); s++) {
+                _slot[_ids[s]] = s;
+                if (_parent[s] != null_node) _parent[s] = slot_map[_parent[s]];
+            }
+            _layout_dirty = false;
+        }
+
+        template <typename array_t>
+        static void permute(array_t& a, const std::vector<u32>& order) {
+            array_t sorted;
+            sorted.reserve(order.size());
+            for (u32 s : order) sorted.push_back(a[s]);
+            a.swap(sorted);
+        }
+
+        // Indexed by position in the arrays
+        std::vector<u32> _ids;
+        std::vector<u32> _parent;
+        std::vector<vec3_type> _position;
+        std::vector<quat_type> _rotation;
+        std::vector<vec3_type> _scale;
+        std::vector<mat_type> _world;
+        std::vector<u8> _dirty;
+        std::vector<u8> _alive;
+
+        // Indexed by id
+        std::vector<u32> _slot;
+        std::vector<u32> _free;
+
+        // Level l is [_levels[l], _levels[l + 1])
+        std::vector<size_t> _levels;
+        bool _layout_dirty = false;
+        bool _any_dirty = false;
+    };
+
+    typedef transform_hierarchy<f32> ftransform_hierarchy;
+    typedef transform_hierarchy<f64> dtransform_hierarchy;
+}
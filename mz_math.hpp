@@ -0,0 +1,390 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_common.hpp"
+#include "mz_simd.hpp"
+
+/*
+    Precision policy. Functions that have a faster, less exact variant take
+    a trailing mz::precise or mz::fast tag; calls without a tag use
+    mz::default_precision, which is mz::fast when MZ_FAST_MATH is defined
+    (see mz_config.hpp) and mz::precise otherwise.
+*/
+namespace mz {
+
+    struct precise_t { explicit constexpr precise_t() = default; };
+    struct fast_t    { explicit constexpr fast_t() = default; };
+
+    constexpr precise_t precise{};
+    constexpr fast_t    fast{};
+
+#ifdef MZ_FAST_MATH
+    typedef fast_t default_precision_t;
+#else
+    typedef precise_t default_precision_t;
+#endif
+    constexpr default_precision_t default_precision{};
+
+    /*
+        Scalar types other than the built-in ones (see mz_fixed.hpp)
+        specialize scalar_traits with custom = true and provide static
+        sqrt, length, sin, cos, sincos and tan, which math:: then uses
+        instead of the std/f64 versions. packed4 = true additionally routes
+        vec4 add, subtract and multiply through add4/subtract4/multiply4 on
+        the 4 packed components.
+    */
+    template <typename value_t>
+    struct scalar_traits {
+        static constexpr bool custom  = false;
+        static constexpr bool packed4 = false;
+    };
+}
+
+/*
+    sqrt, sin, cos, tan and acos that also work in constant expressions. At
+    runtime they forward to the standard library for the argument type.
+    At compile time they are evaluated in f64: sqrt by Newton iteration,
+    sin/cos/tan by reduction to [-pi/4, pi/4] and Taylor series, acos by
+    half angle reduction to a Taylor series of asin on [-0.5, 0.5]. For
+    |x| < 2^20 compile-time results are within 1 ulp of the runtime ones.
+    Integer arguments are computed in f64, like std::sqrt and friends.
+*/
+namespace mz {
+namespace math {
+
+    constexpr f64 pi      = 3.14159265358979323846;
+    constexpr f64 half_pi = 1.57079632679489661923;
+
+    namespace detail {
+
+        constexpr f64 quiet_nan = std::numeric_limits<f64>::quiet_NaN();
+        constexpr f64 infinity  = std::numeric_limits<f64>::infinity();
+
+        constexpr f64 sqrt(f64 x) {
+            if (x != x || x < 0) return quiet_nan;
+            if (x == 0 || x == infinity) return x;
+
+            // Scale into [1, 4) by powers of 4 so the result scales by powers of 2 exactly
+            f64 scale = 1;
+            while (x >= 4) { x *= 0.25; scale *= 2; }
+            while (x < 1)  { x *= 4;    scale *= 0.5; }
+
+            f64 y = 1.5;
+            for (u32 i = 0; i < 6; i++) y = 0.5 * (y + x / y);
+            return y * scale;
+        }
+
+        // x reduced to [-pi/4, pi/4] plus the quadrant it came from (Cody-Waite, pi/2 split in three)
+        constexpr f64 reduce(f64 x, s64& quadrant) {
+            constexpr f64 pio2_1  = 1.57079632673412561417e+00;
+            constexpr f64 pio2_2  = 6.07710050630396597660e-11;
+            constexpr f64 pio2_2t = 2.02226624879595063154e-21;
+
+            f64 k = x * (1.0 / half_pi);
+            quadrant = (s64)(k < 0 ? k - 0.5 : k + 0.5);
+            f64 q = (f64)quadrant;
+            return ((x - q * pio2_1) - q * pio2_2) - q * pio2_2t;
+        }
+
+        // Taylor series, exact to f64 precision on [-pi/4, pi/4]
+        constexpr f64 sin_kernel(f64 x) {
+            f64 x2 = x * x;
+            f64 p = 1.0 / 121645100408832000.0;           // 1/19!
+            p = -1.0 / 355687428096000.0 + x2 * p;       // 1/17!
+            p =  1.0 / 1307674368000.0   + x2 * p;       // 1/15!
+            p = -1.0 / 6227020800.0      + x2 * p;       // 1/13!
+            p =  1.0 / 39916800.0        + x2 * p;       // 1/11!
+            p = -1.0 / 362880.0          + x2 * p;       // 1/9!
+            p =  1.0 / 5040.0            + x2 * p;
+            p = -1.0 / 120.0             + x2 * p;
+            p =  1.0 / 6.0               + x2 * p;
+            return x - x * x2 * p;
+        }
+        constexpr f64 cos_kernel(f64 x) {
+            f64 x2 = x * x;
+            f64 p = 1.0 / 6402373705728000.0;            // 1/18!
+            p = -1.0 / 20922789888000.0  + x2 * p;       // 1/16!
+            p =  1.0 / 87178291200.0     + x2 * p;       // 1/14!
+            p = -1.0 / 479001600.0       + x2 * p;       // 1/12!
+            p =  1.0 / 3628800.0         + x2 * p;       // 1/10!
+            p = -1.0 / 40320.0           + x2 * p;
+            p =  1.0 / 720.0             + x2 * p;
+            p = -1.0 / 24.0              + x2 * p;
+            p =  1.0 / 2.0               + x2 * p;
+            return 1.0 - x2 * p;
+        }
+
+        constexpr void sincos(f64 x, f64& s, f64& c) {
+            if (x != x || x == infinity || x == -infinity) {
+                s = c = quiet_nan;
+                return;
+            }
+            s64 quadrant = 0;
+            f64 r = reduce(x, quadrant);
+            f64 sr = sin_kernel(r), cr = cos_kernel(r);
+            switch (quadrant & 3) {
+                case 0:  s =  sr; c =  cr; break;
+                case 1:  s =  cr; c = -sr; break;
+                case 2:  s = -sr; c = -cr; break;
+                default: s = -cr; c =  sr; break;
+            }
+        }
+
+        // Taylor series of asin, exact to f64 precision on [-0.5, 0.5]
+        constexpr f64 asin_kernel(f64 x) {
+            const f64 x2 = x * x;
+            f64 term = x, sum = x;
+            for (u32 n = 1; n < 30; n++) {
+                term *= x2 * (f64)((2 * n - 1) * (2 * n - 1)) / (f64)((2 * n) * (2 * n + 1));
+                sum += term;
+            }
+            return sum;
+        }
+
+        // acos(x) = 2 asin(sqrt((1 - x) / 2)) keeps the series argument small near +-1
+        constexpr f64 acos(f64 x) {
+            if (x != x || x > 1 || x < -1) return quiet_nan;
+            if (x > 0.5)  return 2 * asin_kernel(sqrt((1 - x) * 0.5));
+            if (x < -0.5) return pi - 2 * asin_kernel(sqrt((1 + x) * 0.5));
+            return half_pi - asin_kernel(x);
+        }
+
+        // x reduced to [-pi/4, pi/4] in f32, pi/2 split in three (Cephes sinf).
+        // Accurate for |x| <= 8192.
+        constexpr mz_force_inline f32 reduce_fast(f32 x, s32& quadrant) {
+            f32 k = x * (f32)(1.0 / half_pi);
+            quadrant = (s32)(k + (k < 0 ? -0.5f : 0.5f));
+            f32 q = (f32)quadrant;
+            return ((x - q * 1.5703125f) - q * 4.837512969970703125e-4f) - q * 7.54978995489188216e-8f;
+        }
+
+        // Minimax polynomials for [-pi/4, pi/4] (Cephes sinf/cosf)
+        constexpr mz_force_inline f32 sin_kernel_fast(f32 x) {
+            f32 x2 = x * x;
+            return ((-1.9515295891e-4f * x2 + 8.3321608736e-3f) * x2 - 1.6666654611e-1f) * x2 * x + x;
+        }
+        constexpr mz_force_inline f32 cos_kernel_fast(f32 x) {
+            f32 x2 = x * x;
+            return ((2.443315711809948e-5f * x2 - 1.388731625493765e-3f) * x2 + 4.166664568298827e-2f) * x2 * x2 - 0.5f * x2 + 1.f;
+        }
+
+        // Both kernels are evaluated and picked by multiplying with 0/1 and
+        // +-1 (exact), so there are no branches and loops over these vectorize
+        constexpr mz_force_inline void sincos_fast(f32 x, f32& s, f32& c) {
+            s32 quadrant = 0;
+            f32 r = reduce_fast(x, quadrant);
+            f32 sr = sin_kernel_fast(r), cr = cos_kernel_fast(r);
+            f32 odd = (f32)(quadrant & 1);
+            s = (cr * odd + sr * (1.f - odd)) * (f32)(1 - (quadrant & 2));
+            c = (sr * odd + cr * (1.f - odd)) * (f32)(1 - ((quadrant + 1) & 2));
+        }
+    }
+
+    template <typename value_t>
+    using result_t = typename std::conditional<std::is_floating_point<value_t>::value || scalar_traits<value_t>::custom, value_t, f64>::type;
+
+    template <typename value_t>
+    constexpr bool has_fast_path = std::is_same<result_t<value_t>, f32>::value;
+
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> sqrt(value_t x) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return scalar_traits<value_t>::sqrt(x);
+        } else {
+            if (mz_is_constant_evaluated()) return (result_t<value_t>)detail::sqrt((f64)x);
+            return std::sqrt((result_t<value_t>)x);
+        }
+    }
+
+    // sqrt(a * a + b * b + ...), summed left to right like the vector code always did
+    template <typename value_t, typename... rest_t>
+    constexpr mz_force_inline result_t<value_t> length(value_t a, rest_t... rest) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return scalar_traits<value_t>::length(a, rest...);
+        } else {
+            return sqrt(((a * a) + ... + (rest * rest)));
+        }
+    }
+
+    /*
+        1 / sqrt(x). The fast version for f32 uses the hardware estimate
+        refined by Newton iteration when a SIMD backend is enabled, within
+        4 ulp for positive normal x. 0 and infinity give NaN instead of
+        infinity and 0, so check for them first. Without a backend, and
+        for other types, it is the same as the precise version.
+    */
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> rsqrt(value_t x, precise_t) {
+        return (result_t<value_t>)1 / sqrt(x);
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> rsqrt(value_t x, fast_t) {
+        if constexpr (has_fast_path<value_t>) {
+            if (!mz_is_constant_evaluated()) return simd::rsqrt1((f32)x);
+        }
+        return rsqrt(x, precise);
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> rsqrt(value_t x) {
+        return rsqrt(x, default_precision);
+    }
+
+    /*
+        Trig. The fast versions for f32 are minimax polynomials evaluated in
+        f32 without branches, within 1 ulp of the correctly rounded result
+        for |x| <= pi and with an absolute error below 8e-8 for |x| <= 8192.
+        They expect finite arguments in that range; use mz::precise outside
+        of it. For other types fast is the same as precise.
+    */
+    template <typename value_t>
+    constexpr mz_force_inline void sincos(value_t x, result_t<value_t>& s, result_t<value_t>& c, precise_t) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            scalar_traits<value_t>::sincos(x, s, c);
+        } else {
+            if (mz_is_constant_evaluated()) {
+                f64 sd = 0, cd = 0;
+                detail::sincos((f64)x, sd, cd);
+                s = (result_t<value_t>)sd;
+                c = (result_t<value_t>)cd;
+                return;
+            }
+            s = std::sin((result_t<value_t>)x);
+            c = std::cos((result_t<value_t>)x);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline void sincos(value_t x, result_t<value_t>& s, result_t<value_t>& c, fast_t) {
+        if constexpr (has_fast_path<value_t>) {
+            detail::sincos_fast((f32)x, s, c);
+        } else {
+            sincos(x, s, c, precise);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline void sincos(value_t x, result_t<value_t>& s, result_t<value_t>& c) {
+        sincos(x, s, c, default_precision);
+    }
+
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> sin(value_t x, precise_t) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return scalar_traits<value_t>::sin(x);
+        } else {
+            if (mz_is_constant_evaluated()) {
+                f64 s = 0, c = 0;
+                detail::sincos((f64)x, s, c);
+                return (result_t<value_t>)s;
+            }
+            return std::sin((result_t<value_t>)x);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> sin(value_t x, fast_t) {
+        if constexpr (has_fast_path<value_t>) {
+            f32 s = 0, c = 0;
+            detail::sincos_fast((f32)x, s, c);
+            return s;
+        } else {
+            return sin(x, precise);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> sin(value_t x) {
+        return sin(x, default_precision);
+    }
+
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> cos(value_t x, precise_t) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return scalar_traits<value_t>::cos(x);
+        } else {
+            if (mz_is_constant_evaluated()) {
+                f64 s = 0, c = 0;
+                detail::sincos((f64)x, s, c);
+                return (result_t<value_t>)c;
+            }
+            return std::cos((result_t<value_t>)x);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> cos(value_t x, fast_t) {
+        if constexpr (has_fast_path<value_t>) {
+            f32 s = 0, c = 0;
+            detail::sincos_fast((f32)x, s, c);
+            return c;
+        } else {
+            return cos(x, precise);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> cos(value_t x) {
+        return cos(x, default_precision);
+    }
+
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> tan(value_t x, precise_t) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return scalar_traits<value_t>::tan(x);
+        } else {
+            if (mz_is_constant_evaluated()) {
+                f64 s = 0, c = 0;
+                detail::sincos((f64)x, s, c);
+                return (result_t<value_t>)(s / c);
+            }
+            return std::tan((result_t<value_t>)x);
+        }
+    }
+    // s / c of the fast sincos, within 3 ulp for |x| < 1.5
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> tan(value_t x, fast_t) {
+        if constexpr (has_fast_path<value_t>) {
+            f32 s = 0, c = 0;
+            detail::sincos_fast((f32)x, s, c);
+            return s / c;
+        } else {
+            return tan(x, precise);
+        }
+    }
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> tan(value_t x) {
+        return tan(x, default_precision);
+    }
+
+    // No fast variant. Custom scalar types go through the f64 series, which
+    // is plain arithmetic and so gives the same bits everywhere.
+    template <typename value_t>
+    constexpr mz_force_inline result_t<value_t> acos(value_t x) {
+        if constexpr (scalar_traits<value_t>::custom) {
+            return (value_t)detail::acos((f64)x);
+        } else {
+            if (mz_is_constant_evaluated()) return (result_t<value_t>)detail::acos((f64)x);
+            return std::acos((result_t<value_t>)x);
+        }
+    }
+}
+}
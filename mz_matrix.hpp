@@ -26,12 +26,14 @@ SOFTWARE.
 
 */
 
-#include <string.h>
-
-#include "mz_common.hpp"
+#include "mz_parallel.hpp"
+#include "mz_vector.hpp"
 
 namespace mz {
 
+    template <typename value_t>
+    struct affine3;
+
     template <typename value_t>
     struct MZ_API mat4 {
         typedef mat4<value_t> mat_type;
@@ -45,18 +47,25 @@ namespace mz {
             value_t ptr [4 * 4];
         };
 
-        mz_force_inline mat4() {
-            memset(data, 0, 4 * 4 * sizeof(value_t));
-            rows[0].x = rows[1].y = rows[2].z = rows[3].w = (value_t)1;
-        }
+        constexpr mz_force_inline mat4() : mat4((value_t)1) {}
 
-        mz_force_inline mat4(value_t diagonal) {
-            memset(data, 0, 4 * 4 * sizeof(value_t));
-            rows[0].x = rows[1].y = rows[2].z = rows[3].w = diagonal;
-        }
-        
+        constexpr mz_force_inline mat4(value_t diagonal) : rows{
+            vec4_type(diagonal, (value_t)0, (value_t)0, (value_t)0),
+            vec4_type((value_t)0, diagonal, (value_t)0, (value_t)0),
+            vec4_type((value_t)0, (value_t)0, diagonal, (value_t)0),
+            vec4_type((value_t)0, (value_t)0, (value_t)0, diagonal)
+        } {}
+
+        constexpr mz_force_inline mat4(const vec4_type& r0, const vec4_type& r1, const vec4_type& r2, const vec4_type& r3) : rows{ r0, r1, r2, r3 } {}
+
+        constexpr mz_force_inline mat4& multiply(const mat4& other) {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    simd::mat4_multiply(data, other.data);
+                    return *this;
+                }
+            }
 
-        mz_force_inline mat4& multiply(const mat4& other) {
             vec4_type const dstc0 = { rows[0].x, rows[1].x, rows[2].x, rows[3].x };
             vec4_type const dstc1 = { rows[0].y, rows[1].y, rows[2].y, rows[3].y };
             vec4_type const dstc2 = { rows[0].z, rows[1].z, rows[2].z, rows[3].z };
@@ -80,7 +89,14 @@ namespace mz {
             return *this;
         }
 
-        mz_force_inline vec4_type multiply(const vec4_type& vec) const {
+        constexpr mz_force_inline vec4_type multiply(const vec4_type& vec) const {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    vec4_type result;
+                    simd::mat4_multiply_vec4(data, vec.ptr, result.ptr);
+                    return result;
+                }
+            }
             return {
                 rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z + rows[0].w * vec.w,
                 rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z + rows[1].w * vec.w,
@@ -88,41 +104,41 @@ namespace mz {
                 rows[3].x * vec.x + rows[3].y * vec.y + rows[3].z * vec.z + rows[3].w * vec.w
             };
         }
-        mz_force_inline vec3_type multiply(const vec3_type& vec) const {
+        constexpr mz_force_inline vec3_type multiply(const vec3_type& vec) const {
             return {
                 rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z + rows[0].w,
                 rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z + rows[1].w,
                 rows[2].x * vec.x + rows[2].y * vec.y + rows[2].z * vec.z + rows[2].w
             };
         }
-        mz_force_inline vec2_type multiply(const vec2_type& vec) const {
+        constexpr mz_force_inline vec2_type multiply(const vec2_type& vec) const {
             return {
                 rows[0].x * vec.x + rows[0].y * vec.y + rows[0].w,
                 rows[1].x * vec.x + rows[1].y * vec.y + rows[1].w
             };
         }
 
-        mz_force_inline friend mat_type operator*(mat_type left, const mat_type& right) {
+        constexpr mz_force_inline friend mat_type operator*(mat_type left, const mat_type& right) {
             return left.multiply(right);
         }
 
-        mz_force_inline mat_type& operator*=(const mat_type& other) {
+        constexpr mz_force_inline mat_type& operator*=(const mat_type& other) {
             return multiply(other);
         }
 
-        mz_force_inline friend vec2_type operator*(const mat_type& left, const vec2_type& right) {
+        constexpr mz_force_inline friend vec2_type operator*(const mat_type& left, const vec2_type& right) {
             return left.multiply(right);
         }
 
-        mz_force_inline friend vec3_type operator*(const mat_type& left, const vec3_type& right) {
+        constexpr mz_force_inline friend vec3_type operator*(const mat_type& left, const vec3_type& right) {
             return left.multiply(right);
         }
 
-        mz_force_inline friend vec4_type operator*(const mat_type& left, const vec4_type& right) {
+        constexpr mz_force_inline friend vec4_type operator*(const mat_type& left, const vec4_type& right) {
             return left.multiply(right);
         }
 
-        mz_force_inline vec3_type get_translation() {
+        constexpr mz_force_inline vec3_type get_translation() const {
             vec3_type vec (
                 rows[0].w,
                 rows[1].w,
@@ -131,7 +147,7 @@ namespace mz {
             return vec;
         }
 
-        mz_force_inline mat_type& translate(const vec3_type& amount) {
+        constexpr mz_force_inline mat_type& translate(const vec3_type& amount) {
             
             vec3_type c1 = { rows[0].x, rows[1].x, rows[2].x };
             vec3_type c2 = { rows[0].y, rows[1].y, rows[2].y };
@@ -150,48 +166,57 @@ namespace mz {
             return *this;
         }
 
-        mz_force_inline mat_type& rotate(value_t angle, const vec3_type& axis) {
+        constexpr mz_force_inline mat_type& rotate(value_t angle, const vec3_type& axis) {
+            return rotate(angle, axis, default_precision);
+        }
+        template <typename precision_t>
+        constexpr mz_force_inline mat_type& rotate(value_t angle, const vec3_type& axis, precision_t precision) {
             mat_type rotation((value_t)1);
 
-            value_t r = angle;
-            value_t c = cos(r);
-            value_t s = sin(r);
+            math::result_t<value_t> s_r = 0, c_r = 0;
+            math::sincos(angle, s_r, c_r, precision);
+            value_t c = (value_t)c_r;
+            value_t s = (value_t)s_r;
             value_t omc = 1.0f - c;
 
             value_t x = axis.x;
             value_t y = axis.y;
             value_t z = axis.z;
 
-            rotation.data[0 + 0 * 4] = x * x * omc + c;
-            rotation.data[0 + 1 * 4] = y * x * omc + z * s;
-            rotation.data[0 + 2 * 4] = x * z * omc - y * s;
+            rotation.rows[0].x = x * x * omc + c;
+            rotation.rows[1].x = y * x * omc + z * s;
+            rotation.rows[2].x = x * z * omc - y * s;
 
-            rotation.data[1 + 0 * 4] = x * y * omc - z * s;
-            rotation.data[1 + 1 * 4] = y * y * omc + c;
-            rotation.data[1 + 2 * 4] = y * z * omc + x * s;
+            rotation.rows[0].y = x * y * omc - z * s;
+            rotation.rows[1].y = y * y * omc + c;
+            rotation.rows[2].y = y * z * omc + x * s;
 
-            rotation.data[2 + 0 * 4] = x * z * omc + y * s;
-            rotation.data[2 + 1 * 4] = y * z * omc - x * s;
-            rotation.data[2 + 2 * 4] = z * z * omc + c;
+            rotation.rows[0].z = x * z * omc + y * s;
+            rotation.rows[1].z = y * z * omc - x * s;
+            rotation.rows[2].z = z * z * omc + c;
 
             this->multiply(rotation);
 
             return *this;
         }
 
-        mz_force_inline mat_type& scale(const vec3_type& scale) {
-            mat_type mat((value_t)1);
+        // Same as multiplying by a diagonal matrix of (1 + scale), which
+        // only touches the first three columns
+        constexpr mz_force_inline mat_type& scale(const vec3_type& scale) {
+            value_t sx = (value_t)1 + scale.x;
+            value_t sy = (value_t)1 + scale.y;
+            value_t sz = (value_t)1 + scale.z;
 
-            mat.rows[0].x += scale.x;
-            mat.rows[1].y += scale.y;
-            mat.rows[2].z += scale.z;
-
-            this->multiply(mat);
+            for (u32 i = 0; i < 4; i++) {
+                rows[i].x *= sx;
+                rows[i].y *= sy;
+                rows[i].z *= sz;
+            }
 
             return *this;
         }
 
-        mz_force_inline mat_type& transpose() {
+        constexpr mz_force_inline mat_type& transpose() {
             mat_type temp = *this;
 
             rows[0] = vec4<value_t>(temp.rows[0].x, temp.rows[1].x, temp.rows[2].x, temp.rows[3].x);
@@ -202,217 +227,644 @@ namespace mz {
             return *this;
         }
 
-        mz_force_inline mat_type& invert() {
-            value_t temp[16];
-
-            temp[0] = data[5] * data[10] * data[15] -
-                data[5] * data[11] * data[14] -
-                data[9] * data[6] * data[15] +
-                data[9] * data[7] * data[14] +
-                data[13] * data[6] * data[11] -
-                data[13] * data[7] * data[10];
-
-            temp[4] = -data[4] * data[10] * data[15] +
-                data[4] * data[11] * data[14] +
-                data[8] * data[6] * data[15] -
-                data[8] * data[7] * data[14] -
-                data[12] * data[6] * data[11] +
-                data[12] * data[7] * data[10];
-
-            temp[8] = data[4] * data[9] * data[15] -
-                data[4] * data[11] * data[13] -
-                data[8] * data[5] * data[15] +
-                data[8] * data[7] * data[13] +
-                data[12] * data[5] * data[11] -
-                data[12] * data[7] * data[9];
-
-            temp[12] = -data[4] * data[9] * data[14] +
-                data[4] * data[10] * data[13] +
-                data[8] * data[5] * data[14] -
-                data[8] * data[6] * data[13] -
-                data[12] * data[5] * data[10] +
-                data[12] * data[6] * data[9];
-
-            temp[1] = -data[1] * data[10] * data[15] +
-                data[1] * data[11] * data[14] +
-                data[9] * data[2] * data[15] -
-                data[9] * data[3] * data[14] -
-                data[13] * data[2] * data[11] +
-                data[13] * data[3] * data[10];
-
-            temp[5] = data[0] * data[10] * data[15] -
-                data[0] * data[11] * data[14] -
-                data[8] * data[2] * data[15] +
-                data[8] * data[3] * data[14] +
-                data[12] * data[2] * data[11] -
-                data[12] * data[3] * data[10];
-
-            temp[9] = -data[0] * data[9] * data[15] +
-                data[0] * data[11] * data[13] +
-                data[8] * data[1] * data[15] -
-                data[8] * data[3] * data[13] -
-                data[12] * data[1] * data[11] +
-                data[12] * data[3] * data[9];
-
-            temp[13] = data[0] * data[9] * data[14] -
-                data[0] * data[10] * data[13] -
-                data[8] * data[1] * data[14] +
-                data[8] * data[2] * data[13] +
-                data[12] * data[1] * data[10] -
-                data[12] * data[2] * data[9];
-
-            temp[2] = data[1] * data[6] * data[15] -
-                data[1] * data[7] * data[14] -
-                data[5] * data[2] * data[15] +
-                data[5] * data[3] * data[14] +
-                data[13] * data[2] * data[7] -
-                data[13] * data[3] * data[6];
-
-            temp[6] = -data[0] * data[6] * data[15] +
-                data[0] * data[7] * data[14] +
-                data[4] * data[2] * data[15] -
-                data[4] * data[3] * data[14] -
-                data[12] * data[2] * data[7] +
-                data[12] * data[3] * data[6];
-
-            temp[10] = data[0] * data[5] * data[15] -
-                data[0] * data[7] * data[13] -
-                data[4] * data[1] * data[15] +
-                data[4] * data[3] * data[13] +
-                data[12] * data[1] * data[7] -
-                data[12] * data[3] * data[5];
-
-            temp[14] = -data[0] * data[5] * data[14] +
-                data[0] * data[6] * data[13] +
-                data[4] * data[1] * data[14] -
-                data[4] * data[2] * data[13] -
-                data[12] * data[1] * data[6] +
-                data[12] * data[2] * data[5];
-
-            temp[3] = -data[1] * data[6] * data[11] +
-                data[1] * data[7] * data[10] +
-                data[5] * data[2] * data[11] -
-                data[5] * data[3] * data[10] -
-                data[9] * data[2] * data[7] +
-                data[9] * data[3] * data[6];
-
-            temp[7] = data[0] * data[6] * data[11] -
-                data[0] * data[7] * data[10] -
-                data[4] * data[2] * data[11] +
-                data[4] * data[3] * data[10] +
-                data[8] * data[2] * data[7] -
-                data[8] * data[3] * data[6];
-
-            temp[11] = -data[0] * data[5] * data[11] +
-                data[0] * data[7] * data[9] +
-                data[4] * data[1] * data[11] -
-                data[4] * data[3] * data[9] -
-                data[8] * data[1] * data[7] +
-                data[8] * data[3] * data[5];
-
-            temp[15] = data[0] * data[5] * data[10] -
-                data[0] * data[6] * data[9] -
-                data[4] * data[1] * data[10] +
-                data[4] * data[2] * data[9] +
-                data[8] * data[1] * data[6] -
-                data[8] * data[2] * data[5];
-
-            value_t determinant = data[0] * temp[0] + data[1] * temp[4] + data[2] * temp[8] + data[3] * temp[12];
-            determinant = 1.0f / determinant;
-
-            for (u8 i = 0; i < 4 * 4; i++)
-                data[i] = temp[i] * determinant;
+        // True if the bottom row is exactly (0, 0, 0, 1)
+        constexpr mz_force_inline bool is_affine() const {
+            return rows[3].x == (value_t)0 && rows[3].y == (value_t)0 && rows[3].z == (value_t)0 && rows[3].w == (value_t)1;
+        }
+
+        // Cheaper invert() for matrices where is_affine() holds, eg. model
+        // matrices built with transformation:: and views from look_at
+        constexpr mz_force_inline mat_type& invert_affine() {
+            *this = affine3<value_t>(*this).invert().to_mat4();
+            return *this;
+        }
+
+        // Cheapest invert() for rotation + translation only (no scale), eg. look_at
+        constexpr mz_force_inline mat_type& invert_rigid() {
+            *this = affine3<value_t>(*this).invert_rigid().to_mat4();
+            return *this;
+        }
+
+        // By 2x2 minors, ~30 multiplies
+        constexpr mz_force_inline value_t determinant() const {
+            const vec4_type &r0 = rows[0], &r1 = rows[1], &r2 = rows[2], &r3 = rows[3];
+            return (r0.x * r1.y - r1.x * r0.y) * (r2.z * r3.w - r3.z * r2.w)
+                 - (r0.x * r1.z - r1.x * r0.z) * (r2.y * r3.w - r3.y * r2.w)
+                 + (r0.x * r1.w - r1.x * r0.w) * (r2.y * r3.z - r3.y * r2.z)
+                 + (r0.y * r1.z - r1.y * r0.z) * (r2.x * r3.w - r3.x * r2.w)
+                 - (r0.y * r1.w - r1.y * r0.w) * (r2.x * r3.z - r3.x * r2.z)
+                 + (r0.z * r1.w - r1.z * r0.w) * (r2.x * r3.y - r3.x * r2.y);
+        }
+
+        // Singular matrices (determinant 0, or so small that its reciprocal
+        // overflows) end up as inf/NaN; see try_invert
+        constexpr mz_force_inline mat_type& invert() {
+            inverse(*this);
+            return *this;
+        }
+
+        // Inverts and returns true, or returns false and leaves the matrix
+        // unchanged if it's singular: its determinant is 0 up to rounding
+        // relative to determinant_bound(), see invertible. The determinant
+        // comes out of the same pass as the inverse.
+        constexpr mz_force_inline bool try_invert() {
+            mat_type result;
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    if (!invertible(simd::mat4_inverse(data, result.data), determinant_bound())) return false;
+                    *this = result;
+                    return true;
+                }
+            }
+            const value_t det = adjugate(result);
+            if (!invertible(det, determinant_bound())) return false;
+            const value_t inv_det = (value_t)1 / det;
+            for (u32 i = 0; i < 4; i++)
+                rows[i] = result.rows[i] * inv_det;
+            return true;
+        }
+
+        // Writes the inverse to out (which may be this) and returns the determinant
+        constexpr mz_force_inline value_t inverse(mat_type& out) const {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated())
+                    return simd::mat4_inverse(data, out.data);
+            }
+            const value_t det = adjugate(out);
+            const value_t inv_det = (value_t)1 / det;
+            for (u32 i = 0; i < 4; i++)
+                out.rows[i] *= inv_det;
+            return det;
+        }
+
+        // Writes the adjugate (transposed cofactors, ie. the inverse times
+        // the determinant) to out, which may be this, and returns the
+        // determinant. Uses the 2x2 minors of the top (s) and bottom (c) two
+        // rows, ~80 multiplies, and reads rows only, for constant expressions.
+        constexpr mz_force_inline value_t adjugate(mat_type& out) const {
+            const vec4_type a = rows[0], b = rows[1], c = rows[2], d = rows[3];
+
+            const value_t s0 = a.x * b.y - b.x * a.y;
+            const value_t s1 = a.x * b.z - b.x * a.z;
+            const value_t s2 = a.x * b.w - b.x * a.w;
+            const value_t s3 = a.y * b.z - b.y * a.z;
+            const value_t s4 = a.y * b.w - b.y * a.w;
+            const value_t s5 = a.z * b.w - b.z * a.w;
+
+            const value_t c5 = c.z * d.w - d.z * c.w;
+            const value_t c4 = c.y * d.w - d.y * c.w;
+            const value_t c3 = c.y * d.z - d.y * c.z;
+            const value_t c2 = c.x * d.w - d.x * c.w;
+            const value_t c1 = c.x * d.z - d.x * c.z;
+            const value_t c0 = c.x * d.y - d.x * c.y;
+
+            out.rows[0] = vec4_type( b.y * c5 - b.z * c4 + b.w * c3, -a.y * c5 + a.z * c4 - a.w * c3,
+                                     d.y * s5 - d.z * s4 + d.w * s3, -c.y * s5 + c.z * s4 - c.w * s3);
+            out.rows[1] = vec4_type(-b.x * c5 + b.z * c2 - b.w * c1,  a.x * c5 - a.z * c2 + a.w * c1,
+                                    -d.x * s5 + d.z * s2 - d.w * s1,  c.x * s5 - c.z * s2 + c.w * s1);
+            out.rows[2] = vec4_type( b.x * c4 - b.y * c2 + b.w * c0, -a.x * c4 + a.y * c2 - a.w * c0,
+                                     d.x * s4 - d.y * s2 + d.w * s0, -c.x * s4 + c.y * s2 - c.w * s0);
+            out.rows[3] = vec4_type(-b.x * c3 + b.y * c1 - b.z * c0,  a.x * c3 - a.y * c1 + a.z * c0,
+                                    -d.x * s3 + d.y * s1 - d.z * s0,  c.x * s3 - c.y * s1 + c.z * s0);
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        }
+
+        // Upper bound on |determinant()| (Hadamard's inequality): the
+        // smaller of the products of the row and of the column lengths
+        constexpr mz_force_inline value_t determinant_bound() const {
+            value_t by_rows = (value_t)1, by_columns = (value_t)1;
+            for (u32 i = 0; i < 4; i++) {
+                by_rows *= rows[i].magnitude();
+                by_columns *= (value_t)math::length(rows[0].ptr[i], rows[1].ptr[i], rows[2].ptr[i], rows[3].ptr[i]);
+            }
+            return by_rows < by_columns ? by_rows : by_columns;
+        }
+        // Looser bound without square roots: the product of the rows'
+        // absolute sums, each at least the row's length and at most twice it
+        constexpr mz_force_inline value_t determinant_bound(fast_t) const {
+            value_t bound = (value_t)1;
+            for (u32 i = 0; i < 4; i++) {
+                value_t sum = (value_t)0;
+                for (u32 j = 0; j < 4; j++) sum += rows[i].ptr[j] < (value_t)0 ? -rows[i].ptr[j] : rows[i].ptr[j];
+                bound *= sum;
+            }
+            return bound;
+        }
+
+        // Relative size below which a determinant counts as rounding noise
+        static constexpr value_t singular_epsilon = 64 * std::numeric_limits<value_t>::epsilon();
+
+        /*
+            False if det is within singular_epsilon * bound of 0, bound being
+            the matrix's determinant_bound(), or if its reciprocal overflows.
+            The ratio |det| / bound doesn't change when rows or columns are
+            scaled and is only small when they are nearly linearly dependent,
+            so matrices that are singular up to rounding are rejected no
+            matter their scale or which backend computed det.
+        */
+        static constexpr mz_force_inline bool invertible(value_t det, value_t bound) {
+            const value_t magnitude = det < (value_t)0 ? -det : det;
+            if (!(magnitude > singular_epsilon * bound)) return false;
+            const value_t inv_det = (value_t)1 / det;
+            return inv_det != (value_t)0 && inv_det - inv_det == (value_t)0;
+        }
+    };
+
+    /*
+        Affine transform stored as the top 3 rows of a mat4, with the bottom
+        row implicitly (0, 0, 0, 1). Everything transformation:: and look_at
+        produce is affine. Compared to mat4 it skips the constant row in
+        multiply (36 vs 64 multiplies) and inverts via the 3x3 part.
+    */
+    template <typename value_t>
+    struct MZ_API affine3 {
+        typedef affine3<value_t> affine_type;
+        typedef mat4<value_t>    mat4_type;
+        typedef vec4<value_t>    vec4_type;
+        typedef vec3<value_t>    vec3_type;
+
+        union {
+            value_t data[3 * 4];
+            vec4_type rows[3];
+            value_t ptr [3 * 4];
+        };
+
+        constexpr mz_force_inline affine3() : rows{
+            vec4_type((value_t)1, (value_t)0, (value_t)0, (value_t)0),
+            vec4_type((value_t)0, (value_t)1, (value_t)0, (value_t)0),
+            vec4_type((value_t)0, (value_t)0, (value_t)1, (value_t)0)
+        } {}
+
+        // Drops the bottom row of m, which is assumed to be (0, 0, 0, 1)
+        constexpr mz_force_inline explicit affine3(const mat4_type& m) : rows{ m.rows[0], m.rows[1], m.rows[2] } {}
+
+        constexpr mz_force_inline mat4_type to_mat4() const {
+            return mat4_type(rows[0], rows[1], rows[2], vec4_type((value_t)0, (value_t)0, (value_t)0, (value_t)1));
+        }
+
+        // *this = *this * other
+        constexpr mz_force_inline affine_type& multiply(const affine_type& other) {
+            const vec4_type& b0 = other.rows[0];
+            const vec4_type& b1 = other.rows[1];
+            const vec4_type& b2 = other.rows[2];
+
+            vec4_type r[3];
+            for (u32 i = 0; i < 3; i++) {
+                const vec4_type& a = rows[i];
+                r[i] = vec4_type(
+                    a.x * b0.x + a.y * b1.x + a.z * b2.x,
+                    a.x * b0.y + a.y * b1.y + a.z * b2.y,
+                    a.x * b0.z + a.y * b1.z + a.z * b2.z,
+                    a.x * b0.w + a.y * b1.w + a.z * b2.w + a.w
+                );
+            }
+
+            rows[0] = r[0];
+            rows[1] = r[1];
+            rows[2] = r[2];
+            return *this;
+        }
+
+        constexpr mz_force_inline vec3_type multiply(const vec3_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z + rows[0].w,
+                rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z + rows[1].w,
+                rows[2].x * vec.x + rows[2].y * vec.y + rows[2].z * vec.z + rows[2].w
+            };
+        }
+        constexpr mz_force_inline vec4_type multiply(const vec4_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z + rows[0].w * vec.w,
+                rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z + rows[1].w * vec.w,
+                rows[2].x * vec.x + rows[2].y * vec.y + rows[2].z * vec.z + rows[2].w * vec.w,
+                vec.w
+            };
+        }
+        // Like multiply(vec3) but ignores translation
+        constexpr mz_force_inline vec3_type transform_vector(const vec3_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z,
+                rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z,
+                rows[2].x * vec.x + rows[2].y * vec.y + rows[2].z * vec.z
+            };
+        }
+
+        constexpr mz_force_inline friend affine_type operator*(affine_type left, const affine_type& right) {
+            return left.multiply(right);
+        }
+        constexpr mz_force_inline affine_type& operator*=(const affine_type& other) {
+            return multiply(other);
+        }
+        constexpr mz_force_inline friend vec3_type operator*(const affine_type& left, const vec3_type& right) {
+            return left.multiply(right);
+        }
+        constexpr mz_force_inline friend vec4_type operator*(const affine_type& left, const vec4_type& right) {
+            return left.multiply(right);
+        }
+
+        constexpr mz_force_inline vec3_type get_translation() const {
+            return vec3_type(rows[0].w, rows[1].w, rows[2].w);
+        }
+
+        // Determinant of the 3x3 part, which is also the determinant of the full matrix
+        constexpr mz_force_inline value_t determinant() const {
+            return rows[0].x * (rows[1].y * rows[2].z - rows[1].z * rows[2].y)
+                 + rows[0].y * (rows[1].z * rows[2].x - rows[1].x * rows[2].z)
+                 + rows[0].z * (rows[1].x * rows[2].y - rows[1].y * rows[2].x);
+        }
+
+        // General affine inverse: invert the 3x3 part by cofactors and map
+        // the translation through it. ~45 multiplies and one division.
+        constexpr mz_force_inline affine_type& invert() {
+            value_t a = rows[0].x, b = rows[0].y, c = rows[0].z;
+            value_t d = rows[1].x, e = rows[1].y, f = rows[1].z;
+            value_t g = rows[2].x, h = rows[2].y, i = rows[2].z;
+
+            value_t c00 = e * i - f * h;
+            value_t c10 = f * g - d * i;
+            value_t c20 = d * h - e * g;
+
+            value_t inv_det = (value_t)1 / (a * c00 + b * c10 + c * c20);
+
+            vec3_type r0 = vec3_type(c00, c * h - b * i, b * f - c * e) * inv_det;
+            vec3_type r1 = vec3_type(c10, a * i - c * g, c * d - a * f) * inv_det;
+            vec3_type r2 = vec3_type(c20, b * g - a * h, a * e - b * d) * inv_det;
 
+            vec3_type t = get_translation();
+            rows[0] = vec4_type(r0, -r0.dot(t));
+            rows[1] = vec4_type(r1, -r1.dot(t));
+            rows[2] = vec4_type(r2, -r2.dot(t));
+            return *this;
+        }
+
+        // Inverse of a rotation + translation (no scale or shear): transpose
+        // the rotation and rotate the negated translation. 9 multiplies.
+        constexpr mz_force_inline affine_type& invert_rigid() {
+            vec3_type r0 = vec3_type(rows[0].x, rows[1].x, rows[2].x);
+            vec3_type r1 = vec3_type(rows[0].y, rows[1].y, rows[2].y);
+            vec3_type r2 = vec3_type(rows[0].z, rows[1].z, rows[2].z);
+
+            vec3_type t = get_translation();
+            rows[0] = vec4_type(r0, -r0.dot(t));
+            rows[1] = vec4_type(r1, -r1.dot(t));
+            rows[2] = vec4_type(r2, -r2.dot(t));
             return *this;
         }
     };
 
     namespace transformation {
         template <typename value_t>
-        mat4<value_t> translation(vec3<value_t> value) {
+        constexpr mat4<value_t> translation(vec3<value_t> value) {
             mat4<value_t> mat(1.f);
             mat.translate(value);
             return mat;
         }
 
         template <typename value_t>
-        mat4<value_t> rotation(value_t angle, vec3<value_t> axis) {
+        constexpr mat4<value_t> rotation(value_t angle, vec3<value_t> axis) {
             mat4<value_t> mat(1.f);
             mat.rotate(angle, axis);
             return mat;
         }
 
         template <typename value_t>
-        mat4<value_t> scale(vec3<value_t> value) {
+        constexpr mat4<value_t> scale(vec3<value_t> value) {
             mat4<value_t> mat(1.f);
             mat.rows[0].x = value.x;
             mat.rows[1].y = value.y;
             mat.rows[2].z = value.z;
             return mat;
         }
+
+        // Rotation matrix for euler angles, applied like
+        // .rotate(euler.x, { 1, 0, 0 }).rotate(euler.y, { 0, 1, 0 }).rotate(euler.z, { 0, 0, 1 })
+        template <typename value_t>
+        constexpr void euler_rotation_3x3(const vec3<value_t>& euler, vec3<value_t>& r0, vec3<value_t>& r1, vec3<value_t>& r2) {
+            value_t sx = (value_t)math::sin(euler.x), cx = (value_t)math::cos(euler.x);
+            value_t sy = (value_t)math::sin(euler.y), cy = (value_t)math::cos(euler.y);
+            value_t sz = (value_t)math::sin(euler.z), cz = (value_t)math::cos(euler.z);
+
+            r0 = vec3<value_t>( cy * cz,                -cy * sz,                 sy);
+            r1 = vec3<value_t>( sx * sy * cz + cx * sz, -sx * sy * sz + cx * cz, -sx * cy);
+            r2 = vec3<value_t>(-cx * sy * cz + sx * sz,  cx * sy * sz + sx * cz,  cx * cy);
+        }
+
+        // translation(position) * rotation(r0, r1, r2) * scale(scale), written directly
+        template <typename value_t>
+        constexpr mz_force_inline mat4<value_t> trs(const vec3<value_t>& position, const vec3<value_t>& r0, const vec3<value_t>& r1, const vec3<value_t>& r2, const vec3<value_t>& scale) {
+            mat4<value_t> mat((value_t)1);
+            mat.rows[0] = vec4<value_t>(r0.x * scale.x, r0.y * scale.y, r0.z * scale.z, position.x);
+            mat.rows[1] = vec4<value_t>(r1.x * scale.x, r1.y * scale.y, r1.z * scale.z, position.y);
+            mat.rows[2] = vec4<value_t>(r2.x * scale.x, r2.y * scale.y, r2.z * scale.z, position.z);
+            return mat;
+        }
+
+        // Inverse of trs() with the same arguments: scale(1 / scale) * transpose(rotation) * translation(-position)
+        template <typename value_t>
+        constexpr mz_force_inline mat4<value_t> inverse_trs(const vec3<value_t>& position, const vec3<value_t>& r0, const vec3<value_t>& r1, const vec3<value_t>& r2, const vec3<value_t>& scale) {
+            vec3<value_t> c0 = vec3<value_t>(r0.x, r1.x, r2.x) / scale.x;
+            vec3<value_t> c1 = vec3<value_t>(r0.y, r1.y, r2.y) / scale.y;
+            vec3<value_t> c2 = vec3<value_t>(r0.z, r1.z, r2.z) / scale.z;
+
+            mat4<value_t> mat((value_t)1);
+            mat.rows[0] = vec4<value_t>(c0, -c0.dot(position));
+            mat.rows[1] = vec4<value_t>(c1, -c1.dot(position));
+            mat.rows[2] = vec4<value_t>(c2, -c2.dot(position));
+            return mat;
+        }
+
+        /*
+            Same result as
+                translation(position).rotate(euler.x, { 1, 0, 0 }).rotate(euler.y, { 0, 1, 0 }).rotate(euler.z, { 0, 0, 1 }) * scale(scale)
+            with 3 sin/cos pairs and ~30 multiplies instead of 4 full matrix multiplies.
+        */
+        template <typename value_t>
+        constexpr mat4<value_t> trs(const vec3<value_t>& position, const vec3<value_t>& euler, const vec3<value_t>& scale) {
+            vec3<value_t> r0, r1, r2;
+            euler_rotation_3x3(euler, r0, r1, r2);
+            return trs(position, r0, r1, r2, scale);
+        }
+
+        template <typename value_t>
+        constexpr mat4<value_t> inverse_trs(const vec3<value_t>& position, const vec3<value_t>& euler, const vec3<value_t>& scale) {
+            vec3<value_t> r0, r1, r2;
+            euler_rotation_3x3(euler, r0, r1, r2);
+            return inverse_trs(position, r0, r1, r2, scale);
+        }
+
+        // Batch trs()/inverse_trs() over parallel arrays, min of all sizes
+        // is written. value_t can't be deduced from containers, so call as
+        // trs<f32>(positions, eulers, scales, out).
+        template <typename value_t>
+        inline void trs(span<const vec3<value_t>> positions, span<const vec3<value_t>> eulers, span<const vec3<value_t>> scales, span<mat4<value_t>> out) {
+            size_t n = out.size();
+            if (positions.size() < n) n = positions.size();
+            if (eulers.size() < n)    n = eulers.size();
+            if (scales.size() < n)    n = scales.size();
+
+            for (size_t i = 0; i < n; i++)
+                out[i] = trs(positions[i], eulers[i], scales[i]);
+        }
+
+        template <typename value_t>
+        inline void inverse_trs(span<const vec3<value_t>> positions, span<const vec3<value_t>> eulers, span<const vec3<value_t>> scales, span<mat4<value_t>> out) {
+            size_t n = out.size();
+            if (positions.size() < n) n = positions.size();
+            if (eulers.size() < n)    n = eulers.size();
+            if (scales.size() < n)    n = scales.size();
+
+            for (size_t i = 0; i < n; i++)
+                out[i] = inverse_trs(positions[i], eulers[i], scales[i]);
+        }
     }
 
     namespace projection {
 
         template <typename value_t>
-        mat4<value_t> ortho(value_t left, value_t right, value_t bottom, value_t top, value_t near_, value_t far_) {
-            mat4 result(1.0f);
+        constexpr mat4<value_t> ortho(value_t left, value_t right, value_t bottom, value_t top, value_t near_, value_t far_) {
+            mat4<value_t> result((value_t)1);
 
-            result.data[0 + 0 * 4] = 2.0f / (right - left);
+            result.rows[0].x = 2.0f / (right - left);
 
-            result.data[1 + 1 * 4] = 2.0f / (top - bottom);
+            result.rows[1].y = 2.0f / (top - bottom);
 
-            result.data[2 + 2 * 4] = 2.0f / (near_ - far_);
+            result.rows[2].z = 2.0f / (near_ - far_);
 
-            result.data[3 + 0 * 4] = (left + right) / (left - right);
-            result.data[3 + 1 * 4] = (bottom + top) / (bottom - top);
-            result.data[3 + 2 * 4] = (far_ + near_) / (far_ - near_);
+            result.rows[0].w = (left + right) / (left - right);
+            result.rows[1].w = (bottom + top) / (bottom - top);
+            result.rows[2].w = (far_ + near_) / (far_ - near_);
 
             return result;
         }
 
         template <typename value_t>
-        mat4<value_t> perspective(value_t fov, f32 aspectRatio, value_t near_, value_t far_) {
+        constexpr mat4<value_t> perspective(value_t fov, f32 aspectRatio, value_t near_, value_t far_) {
             mat4<value_t> result((value_t)1);
 
-            value_t q = (value_t)(1.0f / tan(0.5f * fov));
+            value_t q = (value_t)(1.0f / math::tan(0.5f * fov));
             value_t a = (value_t)((f32)q / aspectRatio);
 
             value_t b = (value_t)((near_+ far_) / (near_- far_));
             value_t c = (value_t)((2.0f * near_* far_) / (near_- far_));
 
-            result.data[0 + 0 * 4] = a;
-            result.data[1 + 1 * 4] = q;
-            result.data[2 + 2 * 4] = b;
-            result.data[2 + 3 * 4] = -1.0f;
-            result.data[3 + 2 * 4] = c;
+            result.rows[0].x = a;
+            result.rows[1].y = q;
+            result.rows[2].z = b;
+            result.rows[3].z = -1.0f;
+            result.rows[3].w = 0;
+            result.rows[2].w = c;
 
             return result;
         }
 
         template <typename value_t>
-        mat4<value_t> look_at(const vec3<value_t>& camera, const vec3<value_t>& object, const vec3<value_t>& up) {
-            mat4<value_t> result = mat4<value_t>((value_t)0);
+        constexpr mat4<value_t> look_at(const vec3<value_t>& camera, const vec3<value_t>& object, const vec3<value_t>& up) {
+            mat4<value_t> result = mat4<value_t>((value_t)1);
             vec3<value_t> f = (object - camera).normalize();
-            vec3<value_t> s = f.cross(up.normalize());
+            vec3<value_t> s = f.cross(up.normalize()).normalize();
             vec3<value_t> u = s.cross(f);
 
-            result.data[0 + 0 * 4] = s.x;
-            result.data[0 + 1 * 4] = s.y;
-            result.data[0 + 2 * 4] = s.z;
+            result.rows[0].x = s.x;
+            result.rows[1].x = s.y;
+            result.rows[2].x = s.z;
 
-            result.data[1 + 0 * 4] = u.x;
-            result.data[1 + 1 * 4] = u.y;
-            result.data[1 + 2 * 4] = u.z;
+            result.rows[0].y = u.x;
+            result.rows[1].y = u.y;
+            result.rows[2].y = u.z;
 
-            result.data[2 + 0 * 4] = -f.x;
-            result.data[2 + 1 * 4] = -f.y;
-            result.data[2 + 2 * 4] = -f.z;
+            result.rows[0].z = -f.x;
+            result.rows[1].z = -f.y;
+            result.rows[2].z = -f.z;
 
             return result * mat4<value_t>((value_t)1.f).translate(vec3<value_t>(-camera.x, -camera.y, -camera.z));
         }
     }
 
+    /*
+        Batch transforms over arrays of vectors. The matrix is loaded once
+        and kept in registers, and mat4<f32> runs 4 vectors per iteration
+        when a SIMD backend is enabled. Results match calling multiply() on
+        each element. in and out may be the same array (in-place), but must
+        not otherwise overlap. min(in.size(), out.size()) elements are
+        transformed.
+    */
+
+    // out[i] = m * (in[i], 0, 1)
+    template <typename value_t>
+    inline void transform_points(const mat4<value_t>& m, span<const typename mat4<value_t>::vec2_type> in, span<typename mat4<value_t>::vec2_type> out) {
+        size_t n = in.size() < out.size() ? in.size() : out.size();
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            simd::mat4_broadcast mb(m.data);
+            for (; i + 4 <= n; i += 4) {
+                simd::f32x4 x, y;
+                simd::load2(in[i].ptr, x, y);
+                simd::store2(out[i].ptr, mb.point(0, x, y), mb.point(1, x, y));
+            }
+        }
+        const mat4<value_t> local = m;
+        for (; i < n; i++)
+            out[i] = local.multiply(in[i]);
+    }
+
+    // out[i] = m * (in[i], 1)
+    template <typename value_t>
+    inline void transform_points(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out) {
+        size_t n = in.size() < out.size() ? in.size() : out.size();
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            simd::mat4_broadcast mb(m.data);
+            for (; i + 4 <= n; i += 4) {
+                simd::f32x4 x, y, z;
+                simd::load3(in[i].ptr, x, y, z);
+                simd::store3(out[i].ptr, mb.point(0, x, y, z), mb.point(1, x, y, z), mb.point(2, x, y, z));
+            }
+        }
+        const mat4<value_t> local = m;
+        for (; i < n; i++)
+            out[i] = local.multiply(in[i]);
+    }
+
+    // out[i] = m * (in[i], 0), ie. ignores translation
+    template <typename value_t>
+    inline void transform_vectors(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out) {
+        size_t n = in.size() < out.size() ? in.size() : out.size();
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            simd::mat4_broadcast mb(m.data);
+            for (; i + 4 <= n; i += 4) {
+                simd::f32x4 x, y, z;
+                simd::load3(in[i].ptr, x, y, z);
+                simd::store3(out[i].ptr, mb.vector(0, x, y, z), mb.vector(1, x, y, z), mb.vector(2, x, y, z));
+            }
+        }
+        const mat4<value_t> local = m;
+        for (; i < n; i++) {
+            vec3<value_t> v = in[i];
+            out[i] = vec3<value_t>(
+                local.rows[0].x * v.x + local.rows[0].y * v.y + local.rows[0].z * v.z,
+                local.rows[1].x * v.x + local.rows[1].y * v.y + local.rows[1].z * v.z,
+                local.rows[2].x * v.x + local.rows[2].y * v.y + local.rows[2].z * v.z
+            );
+        }
+    }
+
+    // out[i] = m * in[i]
+    template <typename value_t>
+    inline void transform_vec4(const mat4<value_t>& m, span<const typename mat4<value_t>::vec4_type> in, span<typename mat4<value_t>::vec4_type> out) {
+        size_t n = in.size() < out.size() ? in.size() : out.size();
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            simd::mat4_broadcast mb(m.data);
+            for (; i + 4 <= n; i += 4) {
+                simd::f32x4 x, y, z, w;
+                simd::load4(in[i].ptr, x, y, z, w);
+                simd::store4(out[i].ptr, mb.full(0, x, y, z, w), mb.full(1, x, y, z, w), mb.full(2, x, y, z, w), mb.full(3, x, y, z, w));
+            }
+        }
+        const mat4<value_t> local = m;
+        for (; i < n; i++)
+            out[i] = local.multiply(in[i]);
+    }
+
+    // out[i] = (m * (in[i], 1)).xyz / w, for projecting points with a
+    // projection or view-projection matrix
+    template <typename value_t>
+    inline void transform_points_perspective(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out) {
+        size_t n = in.size() < out.size() ? in.size() : out.size();
+        size_t i = 0;
+        if constexpr (simd::accelerated<value_t>) {
+            simd::mat4_broadcast mb(m.data);
+            for (; i + 4 <= n; i += 4) {
+                simd::f32x4 x, y, z;
+                simd::load3(in[i].ptr, x, y, z);
+                simd::f32x4 w = mb.point(3, x, y, z);
+                simd::store3(out[i].ptr, simd::div(mb.point(0, x, y, z), w), simd::div(mb.point(1, x, y, z), w), simd::div(mb.point(2, x, y, z), w));
+            }
+        }
+        const mat4<value_t> local = m;
+        for (; i < n; i++) {
+            vec4<value_t> r = local.multiply(vec4<value_t>(in[i], (value_t)1));
+            out[i] = vec3<value_t>(r.x / r.w, r.y / r.w, r.z / r.w);
+        }
+    }
+
+    /*
+        Inverts every matrix of in into out (which may be in). Singular
+        matrices, the ones try_invert rejects (determinant 0 up to
+        rounding relative to determinant_bound, see invertible), are copied
+        unchanged and set bit i of singular (word i / 64, bit i % 64) if
+        given. A mask shorter than (n + 63) / 64 words only gets its first
+        singular.size() words. Returns the number of singular matrices.
+        n = min(in.size(), out.size()) matrices are inverted, split across
+        threads like the other batch functions.
+    */
+    template <typename value_t = f32>
+    inline size_t invert_all(span<const typename mat4<value_t>::mat_type> in, span<typename mat4<value_t>::mat_type> out, span<u64> singular = {}, parallelism par = {}) {
+        const size_t n = in.size() < out.size() ? in.size() : out.size();
+        std::atomic<size_t> count(0);
+        // 4096 matrices = 64 words = whole cache lines of singular per range
+        parallel_for(n, 4096, par, [&](size_t begin, size_t end) {
+            size_t local = 0;
+            for (size_t word_begin = begin; word_begin < end; word_begin += 64) {
+                const size_t word_end = word_begin + 64 < end ? word_begin + 64 : end;
+                u64 word = 0;
+                for (size_t i = word_begin; i < word_end; i++) {
+                    mat4<value_t> inverse;
+                    const value_t det = in[i].inverse(inverse);
+                    // Anything the looser bound accepts the exact one does too, so the
+                    // square roots are only paid for nearly singular matrices
+                    if (mat4<value_t>::invertible(det, in[i].determinant_bound(fast)) || mat4<value_t>::invertible(det, in[i].determinant_bound())) {
+                        out[i] = inverse;
+                    } else {
+                        out[i] = in[i];
+                        word |= (u64)1 << (i - word_begin);
+                        local++;
+                    }
+                }
+                if (word_begin / 64 < singular.size()) singular[word_begin / 64] = word;
+            }
+            count.fetch_add(local, std::memory_order_relaxed);
+        });
+        return count.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Same batch transforms split across threads, par being a thread count
+        or an executor (mz_parallel.hpp). Ranges are multiples of 2048
+        elements, so threads never share an output cache line.
+    */
+    namespace detail {
+        template <typename in_t, typename out_t, typename fn_t>
+        inline void transform_parallel(span<const in_t> in, span<out_t> out, parallelism par, fn_t fn) {
+            size_t n = in.size() < out.size() ? in.size() : out.size();
+            parallel_for(n, 2048, par, [&](size_t begin, size_t end) {
+                fn(in.subspan(begin, end - begin), out.subspan(begin, end - begin));
+            });
+        }
+    }
+
+    template <typename value_t>
+    inline void transform_points(const mat4<value_t>& m, span<const typename mat4<value_t>::vec2_type> in, span<typename mat4<value_t>::vec2_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_points(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_points(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_points(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_vectors(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_vectors(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_vec4(const mat4<value_t>& m, span<const typename mat4<value_t>::vec4_type> in, span<typename mat4<value_t>::vec4_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_vec4(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_points_perspective(const mat4<value_t>& m, span<const typename mat4<value_t>::vec3_type> in, span<typename mat4<value_t>::vec3_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_points_perspective(m, i, o); });
+    }
+
     template<typename TStream, typename value_t>
     inline TStream& operator<<(TStream& str, const mat4<value_t>& m) {
         return str << "mat4:\n"
@@ -425,4 +877,7 @@ namespace mz {
     typedef mat4<f32> fmat4;
     typedef mat4<f64> dmat4;
     typedef mat4<s32> imat4;
+
+    typedef affine3<f32> faffine3;
+    typedef affine3<f64> daffine3;
 }
\ No newline at end of file
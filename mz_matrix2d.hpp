@@ -0,0 +1,499 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_matrix.hpp"
+
+namespace mz {
+
+    /*
+        2D affine transform: the top two rows of a 3x3 matrix, with the
+        bottom row implicitly (0, 0, 1).
+
+            | x.x  x.y  x.z |   rows[0]: (a, b, translation x)
+            | y.x  y.y  y.z |   rows[1]: (c, d, translation y)
+
+        Points are column vectors like with mat4, so a * b applies b first.
+        6 values instead of mat4's 16, and 4 multiplies per point instead of
+        the 6 mat4::multiply(vec2) does. translate, rotate and scale apply
+        the transform before the existing one, like mat4's; scale takes the
+        factors themselves (mat4::scale adds 1 to them).
+    */
+    template <typename value_t>
+    struct MZ_API mat2x3 {
+        typedef mat2x3<value_t> mat_type;
+        typedef mat4<value_t>   mat4_type;
+        typedef vec3<value_t>   vec3_type;
+        typedef vec2<value_t>   vec2_type;
+        typedef quad<value_t>   quad_type;
+
+        union {
+            value_t data[2 * 3];
+            vec3_type rows[2];
+            value_t ptr [2 * 3];
+        };
+
+        constexpr mz_force_inline mat2x3() : mat2x3((value_t)1) {}
+
+        constexpr mz_force_inline mat2x3(value_t diagonal) : rows{
+            vec3_type(diagonal, (value_t)0, (value_t)0),
+            vec3_type((value_t)0, diagonal, (value_t)0)
+        } {}
+
+        constexpr mz_force_inline mat2x3(const vec3_type& r0, const vec3_type& r1) : rows{ r0, r1 } {}
+
+        // Embeds the transform in the xy plane, z passes through
+        constexpr mz_force_inline mat4_type to_mat4() const {
+            return mat4_type(
+                vec4<value_t>(rows[0].x, rows[0].y, (value_t)0, rows[0].z),
+                vec4<value_t>(rows[1].x, rows[1].y, (value_t)0, rows[1].z),
+                vec4<value_t>((value_t)0, (value_t)0, (value_t)1, (value_t)0),
+                vec4<value_t>((value_t)0, (value_t)0, (value_t)0, (value_t)1)
+            );
+        }
+
+        // *this = *this * other
+        constexpr mz_force_inline mat_type& multiply(const mat_type& other) {
+            const vec3_type& b0 = other.rows[0];
+            const vec3_type& b1 = other.rows[1];
+
+            vec3_type r[2];
+            for (u32 i = 0; i < 2; i++) {
+                const vec3_type& a = rows[i];
+                r[i] = vec3_type(
+                    a.x * b0.x + a.y * b1.x,
+                    a.x * b0.y + a.y * b1.y,
+                    a.x * b0.z + a.y * b1.z + a.z
+                );
+            }
+
+            rows[0] = r[0];
+            rows[1] = r[1];
+            return *this;
+        }
+
+        constexpr mz_force_inline vec2_type multiply(const vec2_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z,
+                rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z
+            };
+        }
+        constexpr mz_force_inline quad_type multiply(const quad_type& q) const {
+            return quad_type(multiply(q.x), multiply(q.y), multiply(q.z), multiply(q.w));
+        }
+        // Like multiply(vec2) but ignores translation
+        constexpr mz_force_inline vec2_type transform_vector(const vec2_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y,
+                rows[1].x * vec.x + rows[1].y * vec.y
+            };
+        }
+
+        constexpr mz_force_inline friend mat_type operator*(mat_type left, const mat_type& right) {
+            return left.multiply(right);
+        }
+        constexpr mz_force_inline mat_type& operator*=(const mat_type& other) {
+            return multiply(other);
+        }
+        constexpr mz_force_inline friend vec2_type operator*(const mat_type& left, const vec2_type& right) {
+            return left.multiply(right);
+        }
+        constexpr mz_force_inline friend quad_type operator*(const mat_type& left, const quad_type& right) {
+            return left.multiply(right);
+        }
+
+        constexpr mz_force_inline vec2_type get_translation() const {
+            return vec2_type(rows[0].z, rows[1].z);
+        }
+
+        constexpr mz_force_inline mat_type& translate(const vec2_type& amount) {
+            rows[0].z += rows[0].x * amount.x + rows[0].y * amount.y;
+            rows[1].z += rows[1].x * amount.x + rows[1].y * amount.y;
+            return *this;
+        }
+
+        constexpr mz_force_inline mat_type& rotate(value_t angle) {
+            return rotate(angle, default_precision);
+        }
+        // Counter-clockwise for positive angles, with y up
+        template <typename precision_t>
+        constexpr mz_force_inline mat_type& rotate(value_t angle, precision_t precision) {
+            math::result_t<value_t> s_r = 0, c_r = 0;
+            math::sincos(angle, s_r, c_r, precision);
+            const value_t c = (value_t)c_r;
+            const value_t s = (value_t)s_r;
+
+            for (u32 i = 0; i < 2; i++) {
+                const value_t x = rows[i].x, y = rows[i].y;
+                rows[i].x = x * c + y * s;
+                rows[i].y = y * c - x * s;
+            }
+            return *this;
+        }
+
+        constexpr mz_force_inline mat_type& scale(const vec2_type& factors) {
+            for (u32 i = 0; i < 2; i++) {
+                rows[i].x *= factors.x;
+                rows[i].y *= factors.y;
+            }
+            return *this;
+        }
+
+        constexpr mz_force_inline value_t determinant() const {
+            return rows[0].x * rows[1].y - rows[0].y * rows[1].x;
+        }
+
+        // Inverse of the 2x2 part, and the translation mapped through it.
+        // 10 multiplies and one division; singular matrices end up as
+        // inf/NaN, see try_invert.
+        constexpr mz_force_inline mat_type& invert() {
+            invert(determinant());
+            return *this;
+        }
+
+        // Upper bound on |determinant()|, like mat4::determinant_bound
+        constexpr mz_force_inline value_t determinant_bound() const {
+            const value_t by_rows = (value_t)math::length(rows[0].x, rows[0].y) * (value_t)math::length(rows[1].x, rows[1].y);
+            const value_t by_columns = (value_t)math::length(rows[0].x, rows[1].x) * (value_t)math::length(rows[0].y, rows[1].y);
+            return by_rows < by_columns ? by_rows : by_columns;
+        }
+
+        // Inverts and returns true, or returns false and leaves the matrix
+        // unchanged if it's singular, like mat4::try_invert
+        constexpr mz_force_inline bool try_invert() {
+            const value_t det = determinant();
+            if (!mat4_type::invertible(det, determinant_bound())) return false;
+            invert(det);
+            return true;
+        }
+
+        // Inverse of a rotation + translation (no scale or shear), 4 multiplies
+        constexpr mz_force_inline mat_type& invert_rigid() {
+            const value_t a = rows[0].x, b = rows[0].y, c = rows[1].x, d = rows[1].y;
+            const vec2_type t = get_translation();
+            rows[0] = vec3_type(a, c, -(a * t.x + c * t.y));
+            rows[1] = vec3_type(b, d, -(b * t.x + d * t.y));
+            return *this;
+        }
+
+    private:
+        constexpr mz_force_inline void invert(value_t det) {
+            const value_t inv_det = (value_t)1 / det;
+            const value_t a = rows[1].y * inv_det, b = -rows[0].y * inv_det;
+            const value_t c = -rows[1].x * inv_det, d = rows[0].x * inv_det;
+            const vec2_type t = get_translation();
+            rows[0] = vec3_type(a, b, -(a * t.x + b * t.y));
+            rows[1] = vec3_type(c, d, -(c * t.x + d * t.y));
+        }
+    };
+
+    /*
+        3x3 linear transform, eg. the normal matrix of a mat4
+        (transformation::normal_matrix) or a 2D transform in homogeneous
+        coordinates.
+    */
+    template <typename value_t>
+    struct MZ_API mat3 {
+        typedef mat3<value_t> mat_type;
+        typedef mat4<value_t> mat4_type;
+        typedef vec3<value_t> vec3_type;
+
+        union {
+            value_t data[3 * 3];
+            vec3_type rows[3];
+            value_t ptr [3 * 3];
+        };
+
+        constexpr mz_force_inline mat3() : mat3((value_t)1) {}
+
+        constexpr mz_force_inline mat3(value_t diagonal) : rows{
+            vec3_type(diagonal, (value_t)0, (value_t)0),
+            vec3_type((value_t)0, diagonal, (value_t)0),
+            vec3_type((value_t)0, (value_t)0, diagonal)
+        } {}
+
+        constexpr mz_force_inline mat3(const vec3_type& r0, const vec3_type& r1, const vec3_type& r2) : rows{ r0, r1, r2 } {}
+
+        // The upper left 3x3 of m
+        constexpr mz_force_inline explicit mat3(const mat4_type& m) : rows{
+            vec3_type(m.rows[0].x, m.rows[0].y, m.rows[0].z),
+            vec3_type(m.rows[1].x, m.rows[1].y, m.rows[1].z),
+            vec3_type(m.rows[2].x, m.rows[2].y, m.rows[2].z)
+        } {}
+
+        // m with its implicit (0, 0, 1) row
+        constexpr mz_force_inline explicit mat3(const mat2x3<value_t>& m) : rows{
+            m.rows[0], m.rows[1], vec3_type((value_t)0, (value_t)0, (value_t)1)
+        } {}
+
+        constexpr mz_force_inline mat4_type to_mat4() const {
+            return mat4_type(
+                vec4<value_t>(rows[0], (value_t)0),
+                vec4<value_t>(rows[1], (value_t)0),
+                vec4<value_t>(rows[2], (value_t)0),
+                vec4<value_t>((value_t)0, (value_t)0, (value_t)0, (value_t)1)
+            );
+        }
+
+        // *this = *this * other
+        constexpr mz_force_inline mat_type& multiply(const mat_type& other) {
+            const vec3_type& b0 = other.rows[0];
+            const vec3_type& b1 = other.rows[1];
+            const vec3_type& b2 = other.rows[2];
+
+            vec3_type r[3];
+            for (u32 i = 0; i < 3; i++) {
+                const vec3_type& a = rows[i];
+                r[i] = vec3_type(
+                    a.x * b0.x + a.y * b1.x + a.z * b2.x,
+                    a.x * b0.y + a.y * b1.y + a.z * b2.y,
+                    a.x * b0.z + a.y * b1.z + a.z * b2.z
+                );
+            }
+
+            rows[0] = r[0];
+            rows[1] = r[1];
+            rows[2] = r[2];
+            return *this;
+        }
+
+        constexpr mz_force_inline vec3_type multiply(const vec3_type& vec) const {
+            return {
+                rows[0].x * vec.x + rows[0].y * vec.y + rows[0].z * vec.z,
+                rows[1].x * vec.x + rows[1].y * vec.y + rows[1].z * vec.z,
+                rows[2].x * vec.x + rows[2].y * vec.y + rows[2].z * vec.z
+            };
+        }
+
+        constexpr mz_force_inline friend mat_type operator*(mat_type left, const mat_type& right) {
+            return left.multiply(right);
+        }
+        constexpr mz_force_inline mat_type& operator*=(const mat_type& other) {
+            return multiply(other);
+        }
+        constexpr mz_force_inline friend vec3_type operator*(const mat_type& left, const vec3_type& right) {
+            return left.multiply(right);
+        }
+
+        constexpr mz_force_inline mat_type& transpose() {
+            const mat_type temp = *this;
+            rows[0] = vec3_type(temp.rows[0].x, temp.rows[1].x, temp.rows[2].x);
+            rows[1] = vec3_type(temp.rows[0].y, temp.rows[1].y, temp.rows[2].y);
+            rows[2] = vec3_type(temp.rows[0].z, temp.rows[1].z, temp.rows[2].z);
+            return *this;
+        }
+
+        constexpr mz_force_inline value_t determinant() const {
+            return rows[0].x * (rows[1].y * rows[2].z - rows[1].z * rows[2].y)
+                 + rows[0].y * (rows[1].z * rows[2].x - rows[1].x * rows[2].z)
+                 + rows[0].z * (rows[1].x * rows[2].y - rows[1].y * rows[2].x);
+        }
+
+        // Writes the adjugate (transposed cofactors) to out, which may be
+        // this, and returns the determinant
+        constexpr mz_force_inline value_t adjugate(mat_type& out) const {
+            const value_t a = rows[0].x, b = rows[0].y, c = rows[0].z;
+            const value_t d = rows[1].x, e = rows[1].y, f = rows[1].z;
+            const value_t g = rows[2].x, h = rows[2].y, i = rows[2].z;
+
+            const value_t c00 = e * i - f * h;
+            const value_t c10 = f * g - d * i;
+            const value_t c20 = d * h - e * g;
+
+            out.rows[0] = vec3_type(c00, c * h - b * i, b * f - c * e);
+            out.rows[1] = vec3_type(c10, a * i - c * g, c * d - a * f);
+            out.rows[2] = vec3_type(c20, b * g - a * h, a * e - b * d);
+            return a * c00 + b * c10 + c * c20;
+        }
+
+        // Singular matrices end up as inf/NaN, see try_invert
+        constexpr mz_force_inline mat_type& invert() {
+            const value_t inv_det = (value_t)1 / adjugate(*this);
+            for (u32 i = 0; i < 3; i++)
+                rows[i] *= inv_det;
+            return *this;
+        }
+
+        // Upper bound on |determinant()|, like mat4::determinant_bound
+        constexpr mz_force_inline value_t determinant_bound() const {
+            value_t by_rows = (value_t)1, by_columns = (value_t)1;
+            for (u32 i = 0; i < 3; i++) {
+                by_rows *= rows[i].magnitude();
+                by_columns *= (value_t)math::length(rows[0].ptr[i], rows[1].ptr[i], rows[2].ptr[i]);
+            }
+            return by_rows < by_columns ? by_rows : by_columns;
+        }
+
+        // Inverts and returns true, or returns false and leaves the matrix
+        // unchanged if it's singular, like mat4::try_invert
+        constexpr mz_force_inline bool try_invert() {
+            mat_type result;
+            const value_t det = adjugate(result);
+            if (!mat4_type::invertible(det, determinant_bound())) return false;
+            const value_t inv_det = (value_t)1 / det;
+            for (u32 i = 0; i < 3; i++)
+                rows[i] = result.rows[i] * inv_det;
+            return true;
+        }
+    };
+
+    namespace transformation {
+        template <typename value_t>
+        constexpr mat2x3<value_t> translation(const vec2<value_t>& value) {
+            return mat2x3<value_t>(vec3<value_t>((value_t)1, (value_t)0, value.x), vec3<value_t>((value_t)0, (value_t)1, value.y));
+        }
+
+        template <typename value_t>
+        constexpr mat2x3<value_t> rotation(value_t angle) {
+            return mat2x3<value_t>().rotate(angle);
+        }
+
+        template <typename value_t>
+        constexpr mat2x3<value_t> scale(const vec2<value_t>& value) {
+            return mat2x3<value_t>(vec3<value_t>(value.x, (value_t)0, (value_t)0), vec3<value_t>((value_t)0, value.y, (value_t)0));
+        }
+
+        // translation(position) * rotation(angle) * scale(scale), with one sin/cos pair
+        template <typename value_t>
+        constexpr mat2x3<value_t> trs(const vec2<value_t>& position, value_t angle, const vec2<value_t>& scale) {
+            math::result_t<value_t> s_r = 0, c_r = 0;
+            math::sincos(angle, s_r, c_r, default_precision);
+            const value_t c = (value_t)c_r, s = (value_t)s_r;
+            return mat2x3<value_t>(vec3<value_t>(c * scale.x, -s * scale.y, position.x), vec3<value_t>(s * scale.x, c * scale.y, position.y));
+        }
+
+        // Inverse of trs() with the same arguments
+        template <typename value_t>
+        constexpr mat2x3<value_t> inverse_trs(const vec2<value_t>& position, value_t angle, const vec2<value_t>& scale) {
+            math::result_t<value_t> s_r = 0, c_r = 0;
+            math::sincos(angle, s_r, c_r, default_precision);
+            const value_t c = (value_t)c_r, s = (value_t)s_r;
+            const vec2<value_t> r0 = vec2<value_t>(c, s) / scale.x;
+            const vec2<value_t> r1 = vec2<value_t>(-s, c) / scale.y;
+            return mat2x3<value_t>(vec3<value_t>(r0.x, r0.y, -r0.dot(position)), vec3<value_t>(r1.x, r1.y, -r1.dot(position)));
+        }
+
+        // Inverse transpose of the upper left 3x3 of m, for transforming
+        // normals. The adjugate is the transposed cofactor matrix, so this
+        // is the adjugate / determinant, transposed back.
+        template <typename value_t>
+        constexpr mat3<value_t> normal_matrix(const mat4<value_t>& m) {
+            mat3<value_t> result(m);
+            const value_t inv_det = (value_t)1 / result.adjugate(result);
+            result.transpose();
+            for (u32 i = 0; i < 3; i++)
+                result.rows[i] *= inv_det;
+            return result;
+        }
+    }
+
+    /*
+        Batch transforms over arrays of 2D points and quads, with the same
+        rules as the mat4 ones: mat2x3<f32> runs 4 points at a time when a
+        SIMD backend is enabled, results match multiply() on each element,
+        in and out may be the same array but must not otherwise overlap,
+        and min(in.size(), out.size()) elements are transformed.
+    */
+    namespace detail {
+        template <typename value_t, bool translate>
+        inline void transform_2d(const mat2x3<value_t>& m, const vec2<value_t>* in, vec2<value_t>* out, size_t n) {
+            size_t i = 0;
+            if constexpr (simd::accelerated<value_t>) {
+                const simd::f32x4 a = simd::set1(m.rows[0].x), b = simd::set1(m.rows[0].y), tx = simd::set1(translate ? m.rows[0].z : 0.f);
+                const simd::f32x4 c = simd::set1(m.rows[1].x), d = simd::set1(m.rows[1].y), ty = simd::set1(translate ? m.rows[1].z : 0.f);
+                for (; i + 4 <= n; i += 4) {
+                    simd::f32x4 x, y;
+                    simd::load2(in[i].ptr, x, y);
+                    simd::f32x4 rx = simd::add(simd::mul(a, x), simd::mul(b, y));
+                    simd::f32x4 ry = simd::add(simd::mul(c, x), simd::mul(d, y));
+                    if constexpr (translate) {
+                        rx = simd::add(rx, tx);
+                        ry = simd::add(ry, ty);
+                    }
+                    simd::store2(out[i].ptr, rx, ry);
+                }
+            }
+            const mat2x3<value_t> local = m;
+            for (; i < n; i++)
+                out[i] = translate ? local.multiply(in[i]) : local.transform_vector(in[i]);
+        }
+    }
+
+    // out[i] = m * in[i]
+    template <typename value_t>
+    inline void transform_points(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::vec2_type> in, span<typename mat2x3<value_t>::vec2_type> out) {
+        detail::transform_2d<value_t, true>(m, in.ptr, out.ptr, in.size() < out.size() ? in.size() : out.size());
+    }
+
+    // Like transform_points but ignores translation
+    template <typename value_t>
+    inline void transform_vectors(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::vec2_type> in, span<typename mat2x3<value_t>::vec2_type> out) {
+        detail::transform_2d<value_t, false>(m, in.ptr, out.ptr, in.size() < out.size() ? in.size() : out.size());
+    }
+
+    // All 4 corners of every quad, eg. sprite vertices
+    template <typename value_t>
+    inline void transform_quads(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::quad_type> in, span<typename mat2x3<value_t>::quad_type> out) {
+        static_assert(sizeof(quad<value_t>) == 4 * sizeof(vec2<value_t>), "mz::transform_quads: quad is expected to be 4 packed vec2");
+        const size_t n = in.size() < out.size() ? in.size() : out.size();
+        detail::transform_2d<value_t, true>(m, (const vec2<value_t>*)in.ptr, (vec2<value_t>*)out.ptr, n * 4);
+    }
+
+    template <typename value_t>
+    inline void transform_points(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::vec2_type> in, span<typename mat2x3<value_t>::vec2_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_points(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_vectors(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::vec2_type> in, span<typename mat2x3<value_t>::vec2_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_vectors(m, i, o); });
+    }
+    template <typename value_t>
+    inline void transform_quads(const mat2x3<value_t>& m, span<const typename mat2x3<value_t>::quad_type> in, span<typename mat2x3<value_t>::quad_type> out, parallelism par) {
+        detail::transform_parallel(in, out, par, [&](auto i, auto o) { transform_quads(m, i, o); });
+    }
+
+    template<typename TStream, typename value_t>
+    inline TStream& operator<<(TStream& str, const mat2x3<value_t>& m) {
+        return str << "mat2x3:\n"
+               << m.rows[0] << "\n"
+               << m.rows[1];
+    }
+
+    template<typename TStream, typename value_t>
+    inline TStream& operator<<(TStream& str, const mat3<value_t>& m) {
+        return str << "mat3:\n"
+               << m.rows[0] << "\n"
+               << m.rows[1] << "\n"
+               << m.rows[2];
+    }
+
+    typedef mat2x3<f32> fmat2x3;
+    typedef mat2x3<f64> dmat2x3;
+
+    typedef mat3<f32> fmat3;
+    typedef mat3<f64> dmat3;
+}
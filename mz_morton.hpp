@@ -0,0 +1,448 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+#include <vector>
+
+#include "mz_parallel.hpp"
+#include "mz_vector.hpp"
+
+#if defined(MZ_SIMD_SSE) && !defined(MZ_NO_BMI2) && (defined(__x86_64__) || defined(_M_X64)) && (defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__)))
+    #include <immintrin.h>
+    #define MZ_BMI2
+#endif
+
+/*
+    Space filling curves and spatial sorting.
+
+    morton_encode interleaves the coordinate bits, x lowest: all 32 bits of
+    a u32vec2 into 64, the low 21 bits of each component of a u32vec3 into
+    63. With a SIMD backend and a compiler targeting BMI2 (-mbmi2, or
+    /arch:AVX2 on MSVC) this is one pdep per component and decoding one
+    pext; Zen 1 and 2 run those in slow microcode, define MZ_NO_BMI2 when
+    targeting them. hilbert_encode gives keys over the same bits along a
+    Hilbert curve instead, where consecutive keys are always neighbouring
+    cells; Morton order jumps at every power of two boundary but is cheaper
+    to compute. Both curves start at the origin, so small coordinates give
+    small keys whatever their width.
+
+    radix_sort sorts u64 keys and carries any array of values along with
+    them. It is a stable LSD radix sort over 8 bit digits that skips the
+    digits where every key is the same, so keys using the low 30 bits take
+    4 passes. Counting and scattering are split across threads with
+    parallel_for.
+
+    spatial_sort reorders points along a curve so that points close in
+    space end up close in memory, which is what neighbour queries, grid
+    inserts and BVH builds over the array want; spatial_order writes the
+    permutation instead, for sorting other arrays the same way. Float
+    points are quantized over their bounds to 16 bits per axis in 2D and
+    10 in 3D, plenty for ordering purposes. Integer points are used as
+    they are, signed ones offset so that the order runs through 0.
+*/
+namespace mz {
+
+    namespace detail {
+        // Spreads the low 32 bits of v to the even bits
+        constexpr mz_force_inline u64 morton_spread2(u64 v) {
+            v &= 0xffffffffull;
+            v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+            v = (v | (v << 8))  & 0x00ff00ff00ff00ffull;
+            v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0full;
+            v = (v | (v << 2))  & 0x3333333333333333ull;
+            v = (v | (v << 1))  & 0x5555555555555555ull;
+            return v;
+        }
+        constexpr mz_force_inline u64 morton_compact2(u64 v) {
+            v &= 0x5555555555555555ull;
+            v = (v | (v >> 1))  & 0x3333333333333333ull;
+            v = (v | (v >> 2))  & 0x0f0f0f0f0f0f0f0full;
+            v = (v | (v >> 4))  & 0x00ff00ff00ff00ffull;
+            v = (v | (v >> 8))  & 0x0000ffff0000ffffull;
+            v = (v | (v >> 16)) & 0x00000000ffffffffull;
+            return v;
+        }
+
+        // Spreads the low 21 bits of v to every third bit
+        constexpr mz_force_inline u64 morton_spread3(u64 v) {
+            v &= 0x1fffffull;
+            v = (v | (v << 32)) & 0x001f00000000ffffull;
+            v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+            v = (v | (v << 8))  & 0x100f00f00f00f00full;
+            v = (v | (v << 4))  & 0x10c30c30c30c30c3ull;
+            v = (v | (v << 2))  & 0x1249249249249249ull;
+            return v;
+        }
+        constexpr mz_force_inline u64 morton_compact3(u64 v) {
+            v &= 0x1249249249249249ull;
+            v = (v | (v >> 2))  & 0x10c30c30c30c30c3ull;
+            v = (v | (v >> 4))  & 0x100f00f00f00f00full;
+            v = (v | (v >> 8))  & 0x001f0000ff0000ffull;
+            v = (v | (v >> 16)) & 0x001f00000000ffffull;
+            v = (v | (v >> 32)) & 0x00000000001fffffull;
+            return v;
+        }
+
+        /*
+            2D Hilbert curve as a state machine: the state is which of the 4
+            rotations/reflections of the base pattern the current quadrant
+            uses (bit 0 transposed, bit 1 complemented), and every level of
+            coordinate bits emits one base 4 digit. The tables run 4 levels
+            at a time, indexed by state << 8 | x nibble << 4 | y nibble, and
+            hold the 8 key bits | next state << 8, and the other way around.
+        */
+        struct hilbert2_tables {
+            u16 encode[1024];
+            u16 decode[1024];
+
+            constexpr hilbert2_tables() : encode(), decode() {
+                for (u32 state = 0; state < 4; state++) {
+                    for (u32 xy = 0; xy < 256; xy++) {
+                        u32 s = state & 1, c = state >> 1, key = 0;
+                        for (u32 level = 4; level-- > 0;) {
+                            u32 rx = ((xy >> (4 + level)) & 1) ^ c;
+                            u32 ry = ((xy >> level) & 1) ^ c;
+                            if (s) { u32 t = rx; rx = ry; ry = t; }
+                            key = (key << 2) | ((3 * rx) ^ ry);
+                            if (ry == 0) {
+                                s ^= 1;
+                                c ^= rx;
+                            }
+                        }
+                        const u32 next = s | (c << 1);
+                        encode[(state << 8) | xy] = (u16)(key | (next << 8));
+                        decode[(state << 8) | key] = (u16)(xy | (next << 8));
+                    }
+                }
+            }
+        };
+        constexpr hilbert2_tables hilbert2_lut{};
+    }
+
+    inline u64 morton_encode(const u32vec2& p) {
+#if defined(MZ_BMI2)
+        return _pdep_u64(p.x, 0x5555555555555555ull) | _pdep_u64(p.y, 0xaaaaaaaaaaaaaaaaull);
+#else
+        return detail::morton_spread2(p.x) | (detail::morton_spread2(p.y) << 1);
+#endif
+    }
+    inline u64 morton_encode(const u32vec3& p) {
+#if defined(MZ_BMI2)
+        return _pdep_u64(p.x, 0x1249249249249249ull) | _pdep_u64(p.y, 0x2492492492492492ull) | _pdep_u64(p.z, 0x4924924924924924ull);
+#else
+        return detail::morton_spread3(p.x) | (detail::morton_spread3(p.y) << 1) | (detail::morton_spread3(p.z) << 2);
+#endif
+    }
+
+    inline u32vec2 morton_decode2(u64 code) {
+#if defined(MZ_BMI2)
+        return u32vec2((u32)_pext_u64(code, 0x5555555555555555ull), (u32)_pext_u64(code, 0xaaaaaaaaaaaaaaaaull));
+#else
+        return u32vec2((u32)detail::morton_compact2(code), (u32)detail::morton_compact2(code >> 1));
+#endif
+    }
+    inline u32vec3 morton_decode3(u64 code) {
+#if defined(MZ_BMI2)
+        return u32vec3((u32)_pext_u64(code, 0x1249249249249249ull), (u32)_pext_u64(code, 0x2492492492492492ull), (u32)_pext_u64(code, 0x4924924924924924ull));
+#else
+        return u32vec3((u32)detail::morton_compact3(code), (u32)detail::morton_compact3(code >> 1), (u32)detail::morton_compact3(code >> 2));
+#endif
+    }
+
+    inline u64 hilbert_encode(const u32vec2& p) {
+        u64 key = 0;
+        u32 state = 0;
+        for (s32 shift = 28; shift >= 0; shift -= 4) {
+            const u32 xy = (((p.x >> shift) & 15) << 4) | ((p.y >> shift) & 15);
+            const u32 e = detail::hilbert2_lut.encode[(state << 8) | xy];
+            key = (key << 8) | (e & 0xff);
+            state = e >> 8;
+        }
+        return key;
+    }
+    inline u32vec2 hilbert_decode2(u64 key) {
+        u32 x = 0, y = 0, state = 0;
+        for (s32 shift = 56; shift >= 0; shift -= 8) {
+            const u32 d = detail::hilbert2_lut.decode[(state << 8) | (u32)((key >> shift) & 0xff)];
+            x = (x << 4) | ((d >> 4) & 15);
+            y = (y << 4) | (d & 15);
+            state = d >> 8;
+        }
+        return u32vec2(x, y);
+    }
+
+    /*
+        Skilling's transform from "Programming the Hilbert curve" (2004) on
+        the low 1 to 21 bits of each component. Its cost is linear in
+        bits, so pass the bits the coordinates actually use; keys made with
+        different bits do not order the same way.
+    */
+    inline u64 hilbert_encode(const u32vec3& p, u32 bits = 21) {
+        const u32 used = (1u << bits) - 1;
+        u32 x[3] = { p.x & used, p.y & used, p.z & used };
+        // Branch free: set bits invert the lower bits of x[0], clear ones swap them with x[i]'s
+        for (u32 bit = bits - 1; bit > 0; bit--) {
+            const u32 mask = (1u << bit) - 1;
+            for (u32 i = 0; i < 3; i++) {
+                const u32 set = 0u - ((x[i] >> bit) & 1);
+                x[0] ^= mask & set;
+                const u32 t = (x[0] ^ x[i]) & mask & ~set;
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
+        x[1] ^= x[0];
+        x[2] ^= x[1];
+        u32 t = 0;
+        for (u32 bit = bits - 1; bit > 0; bit--)
+            t ^= ((1u << bit) - 1) & (0u - ((x[2] >> bit) & 1));
+        x[0] ^= t;
+        x[1] ^= t;
+        x[2] ^= t;
+        // x[0] holds the most significant bit of every level
+        return morton_encode(u32vec3(x[2], x[1], x[0]));
+    }
+    inline u32vec3 hilbert_decode3(u64 key, u32 bits = 21) {
+        const u32vec3 m = morton_decode3(key);
+        u32 x[3] = { m.z, m.y, m.x };
+        const u32 t = x[2] >> 1;
+        x[2] ^= x[1];
+        x[1] ^= x[0];
+        x[0] ^= t;
+        for (u32 bit = 1; bit < bits; bit++) {
+            const u32 mask = (1u << bit) - 1;
+            for (u32 i = 3; i-- > 0;) {
+                const u32 set = 0u - ((x[i] >> bit) & 1);
+                x[0] ^= mask & set;
+                const u32 s = (x[0] ^ x[i]) & mask & ~set;
+                x[0] ^= s;
+                x[i] ^= s;
+            }
+        }
+        return u32vec3(x[0], x[1], x[2]);
+    }
+
+    // Sorts keys ascending and applies the same permutation to values, see the top of the file
+    template <typename value_t = u32>
+    inline void radix_sort(span<u64> keys, span<typename span<value_t>::value_type> values, parallelism par = {}) {
+        const size_t count = std::min(keys.count, values.count);
+        if (count < 2) return;
+
+        // Digits that differ between any two keys
+        const u64 first = keys[0];
+        const u64 varying = parallel_reduce(count, 4096, (u64)0, par, [&](size_t begin, size_t end) {
+            u64 d = 0;
+            for (size_t i = begin; i < end; i++) d |= keys[i] ^ first;
+            return d;
+        }, [](u64 a, u64 b) { return a | b; });
+
+        // Each chunk keeps its own counts so the scatter stays stable across threads
+        const size_t chunk = 1 << 16;
+        const size_t chunks = (count + chunk - 1) / chunk;
+        std::vector<size_t> offsets(chunks * 256);
+        std::vector<u64> key_buffer(count);
+        std::vector<value_t> value_buffer(count);
+
+        u64* key_src = keys.ptr;
+        u64* key_dst = key_buffer.data();
+        value_t* value_src = values.ptr;
+        value_t* value_dst = value_buffer.data();
+
+        for (u32 shift = 0; shift < 64; shift += 8) {
+            if (((varying >> shift) & 0xff) == 0) continue;
+
+            parallel_for(chunks, 1, par, [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; c++) {
+                    size_t* counts = &offsets[c * 256];
+                    std::fill(counts, counts + 256, (size_t)0);
+                    const size_t last = std::min(count, (c + 1) * chunk);
+                    for (size_t i = c * chunk; i < last; i++) counts[(key_src[i] >> shift) & 0xff]++;
+                }
+            });
+
+            size_t sum = 0;
+            for (u32 digit = 0; digit < 256; digit++) {
+                for (size_t c = 0; c < chunks; c++) {
+                    const size_t n = offsets[c * 256 + digit];
+                    offsets[c * 256 + digit] = sum;
+                    sum += n;
+                }
+            }
+
+            parallel_for(chunks, 1, par, [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; c++) {
+                    size_t* next = &offsets[c * 256];
+                    const size_t last = std::min(count, (c + 1) * chunk);
+                    for (size_t i = c * chunk; i < last; i++) {
+                        const size_t j = next[(key_src[i] >> shift) & 0xff]++;
+                        key_dst[j] = key_src[i];
+                        value_dst[j] = std::move(value_src[i]);
+                    }
+                }
+            });
+
+            std::swap(key_src, key_dst);
+            std::swap(value_src, value_dst);
+        }
+
+        if (key_src != keys.ptr) {
+            parallel_for(count, 4096, par, [&](size_t begin, size_t end) {
+                std::copy(key_src + begin, key_src + end, keys.ptr + begin);
+                std::move(value_src + begin, value_src + end, values.ptr + begin);
+            });
+        }
+    }
+
+    enum class curve {
+        morton,
+        hilbert
+    };
+
+    namespace detail {
+        // Cells per unit over extent, 0 when every point has the same coordinate
+        template <u32 bits, typename value_t>
+        mz_force_inline value_t curve_scale(value_t extent) {
+            return extent > (value_t)0 ? (value_t)((1u << bits) - 1) / extent : (value_t)0;
+        }
+
+        template <typename vec_t> struct curve_traits;
+        template <typename value_t>
+        struct curve_traits<vec2<value_t>> {
+            typedef vec2<value_t> vec_type;
+            static constexpr u32 bits = std::is_floating_point<value_t>::value ? 16 : 32;
+
+            static u64 key(const u32vec2& c, curve k) { return k == curve::hilbert ? hilbert_encode(c) : morton_encode(c); }
+            static vec_type lower(const vec_type& a, const vec_type& b) { return vec_type(std::min(a.x, b.x), std::min(a.y, b.y)); }
+            static vec_type upper(const vec_type& a, const vec_type& b) { return vec_type(std::max(a.x, b.x), std::max(a.y, b.y)); }
+            static vec_type scale(const vec_type& extent) { return vec_type(curve_scale<bits>(extent.x), curve_scale<bits>(extent.y)); }
+        };
+        template <typename value_t>
+        struct curve_traits<vec3<value_t>> {
+            typedef vec3<value_t> vec_type;
+            static constexpr u32 bits = std::is_floating_point<value_t>::value ? 10 : 21;
+
+            static u64 key(const u32vec3& c, curve k) { return k == curve::hilbert ? hilbert_encode(c, bits) : morton_encode(c); }
+            static vec_type lower(const vec_type& a, const vec_type& b) { return vec_type(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+            static vec_type upper(const vec_type& a, const vec_type& b) { return vec_type(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+            static vec_type scale(const vec_type& extent) { return vec_type(curve_scale<bits>(extent.x), curve_scale<bits>(extent.y), curve_scale<bits>(extent.z)); }
+        };
+
+        // Grid coordinate of v, scale is cells per unit from lo; integers are used as they are
+        template <typename value_t, u32 bits>
+        mz_force_inline u32 curve_coord(value_t v, value_t lo, value_t scale) {
+            constexpr u32 cells = (u32)((1ull << bits) - 1);
+            if constexpr (std::is_floating_point<value_t>::value) {
+                value_t q = (v - lo) * scale;
+                q = q >= (value_t)0 ? q : (value_t)0; // and NaN
+                return q < (value_t)cells ? (u32)q : cells;
+            } else {
+                return ((u32)v + (std::is_signed<value_t>::value ? 1u << (bits - 1) : 0u)) & cells;
+            }
+        }
+
+        template <typename value_t>
+        mz_force_inline u32vec2 curve_coords(const vec2<value_t>& p, const vec2<value_t>& lo, const vec2<value_t>& scale) {
+            constexpr u32 bits = curve_traits<vec2<value_t>>::bits;
+            return u32vec2(curve_coord<value_t, bits>(p.x, lo.x, scale.x), curve_coord<value_t, bits>(p.y, lo.y, scale.y));
+        }
+        template <typename value_t>
+        mz_force_inline u32vec3 curve_coords(const vec3<value_t>& p, const vec3<value_t>& lo, const vec3<value_t>& scale) {
+            constexpr u32 bits = curve_traits<vec3<value_t>>::bits;
+            return u32vec3(curve_coord<value_t, bits>(p.x, lo.x, scale.x), curve_coord<value_t, bits>(p.y, lo.y, scale.y), curve_coord<value_t, bits>(p.z, lo.z, scale.z));
+        }
+
+        template <typename vec_t>
+        inline void spatial_keys(span<const vec_t> points, span<u64> keys, curve k, parallelism par) {
+            typedef typename vec_t::value_type value_t;
+            typedef curve_traits<vec_t> traits;
+            const size_t count = std::min(points.count, keys.count);
+            if (count == 0) return;
+
+            vec_t lo = points[0], scale = points[0];
+            if constexpr (std::is_floating_point<value_t>::value) {
+                typedef std::pair<vec_t, vec_t> bounds;
+                bounds b = parallel_reduce(count, 4096, bounds(points[0], points[0]), par, [&](size_t begin, size_t end) {
+                    bounds r(points[begin], points[begin]);
+                    for (size_t i = begin + 1; i < end; i++) {
+                        r.first = traits::lower(r.first, points[i]);
+                        r.second = traits::upper(r.second, points[i]);
+                    }
+                    return r;
+                }, [](const bounds& a, const bounds& c) { return bounds(traits::lower(a.first, c.first), traits::upper(a.second, c.second)); });
+
+                lo = b.first;
+                scale = traits::scale(b.second - b.first);
+            }
+
+            parallel_for(count, 4096, par, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) keys[i] = traits::key(curve_coords(points[i], lo, scale), k);
+            });
+        }
+    }
+
+    // Curve key of every point, the ones spatial_sort sorts by
+    template <typename value_t = f32>
+    inline void spatial_keys(span<const typename vec2<value_t>::vec_type> points, span<u64> keys, curve k = curve::morton, parallelism par = {}) {
+        detail::spatial_keys(points, keys, k, par);
+    }
+    template <typename value_t = f32>
+    inline void spatial_keys(span<const typename vec3<value_t>::vec_type> points, span<u64> keys, curve k = curve::morton, parallelism par = {}) {
+        detail::spatial_keys(points, keys, k, par);
+    }
+
+    // Reorders points along the curve
+    template <typename value_t = f32>
+    inline void spatial_sort(span<typename vec2<value_t>::vec_type> points, curve k = curve::morton, parallelism par = {}) {
+        std::vector<u64> keys(points.count);
+        detail::spatial_keys(span<const vec2<value_t>>(points), span<u64>(keys), k, par);
+        radix_sort<vec2<value_t>>(span<u64>(keys), points, par);
+    }
+    template <typename value_t = f32>
+    inline void spatial_sort(span<typename vec3<value_t>::vec_type> points, curve k = curve::morton, parallelism par = {}) {
+        std::vector<u64> keys(points.count);
+        detail::spatial_keys(span<const vec3<value_t>>(points), span<u64>(keys), k, par);
+        radix_sort<vec3<value_t>>(span<u64>(keys), points, par);
+    }
+
+    // order[i] is the index of the i-th point along the curve
+    template <typename value_t = f32>
+    inline void spatial_order(span<const typename vec2<value_t>::vec_type> points, span<u32> order, curve k = curve::morton, parallelism par = {}) {
+        const size_t count = std::min(points.count, order.count);
+        std::vector<u64> keys(count);
+        detail::spatial_keys(points, span<u64>(keys), k, par);
+        for (size_t i = 0; i < count; i++) order[i] = (u32)i;
+        radix_sort<u32>(span<u64>(keys), order.subspan(0, count), par);
+    }
+    template <typename value_t = f32>
+    inline void spatial_order(span<const typename vec3<value_t>::vec_type> points, span<u32> order, curve k = curve::morton, parallelism par = {}) {
+        const size_t count = std::min(points.count, order.count);
+        std::vector<u64> keys(count);
+        detail::spatial_keys(points, span<u64>(keys), k, par);
+        for (size_t i = 0; i < count; i++) order[i] = (u32)i;
+        radix_sort<u32>(span<u64>(keys), order.subspan(0, count), par);
+    }
+}
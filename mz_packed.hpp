@@ -0,0 +1,320 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "mz_vector.hpp"
+
+/*
+    Compact formats for vertex and instance streams:
+
+    - half:               IEEE 754 binary16
+    - unorm<u8/u16>:      [0, 1] in 8 or 16 bits
+    - snorm<s8/s16>:      [-1, 1] in 8 or 16 bits, the lowest value also decodes to -1
+    - packed_vec<c, n>:   n of the above, hvec2/3/4, unorm8vec4, snorm16vec2, ...
+    - snorm1010102:       xyz as 10 bit snorms and w as a 2 bit one (-1, 0 or 1,
+                          eg. tangent handedness) in 4 bytes
+    - octahedral<s8/s16>: unit vectors folded onto an octahedron and stored as
+                          2 snorms, oct16 / oct32
+
+    They all convert from and to vec2/3/4 of the matching width. Encoding
+    clamps and rounds to nearest, scaling in f64 so the result is correctly
+    rounded (a float scaling rounds twice). NaN encodes as 0 (half keeps NaN).
+
+    Each type has static pack(span of fvecN, span of the type) and
+    unpack(span of the type, span of fvecN) for whole arrays, converting
+    min(in.count, out.count) elements. With a SIMD backend halves go 4 at a
+    time: F16C when the compiler targets it (-mf16c, or /arch:AVX2 on MSVC),
+    otherwise SSE2 or NEON, with the same bits as the scalar conversion.
+*/
+namespace mz {
+    // 2, 3 or 4 for vec2/3/4, 0 for anything else
+    template <typename vec_t> struct vec_width : std::integral_constant<u32, 0> {};
+    template <typename value_t> struct vec_width<vec2<value_t>> : std::integral_constant<u32, 2> {};
+    template <typename value_t> struct vec_width<vec3<value_t>> : std::integral_constant<u32, 3> {};
+    template <typename value_t> struct vec_width<vec4<value_t>> : std::integral_constant<u32, 4> {};
+
+    template <u32 width> struct float_vec;
+    template <> struct float_vec<2> { typedef fvec2 type; };
+    template <> struct float_vec<3> { typedef fvec3 type; };
+    template <> struct float_vec<4> { typedef fvec4 type; };
+
+    struct half {
+        u16 bits;
+
+        half() = default;
+        mz_force_inline half(f32 v) : bits(simd::half_from_f32(v)) {}
+
+        mz_force_inline operator f32() const {
+            return simd::f32_from_half(bits);
+        }
+
+        static constexpr mz_force_inline half from_bits(u16 bits) {
+            half h{};
+            h.bits = bits;
+            return h;
+        }
+    };
+
+    template <typename storage_t>
+    struct unorm {
+        static_assert(std::is_unsigned<storage_t>::value && sizeof(storage_t) <= 2, "unorm is stored in u8 or u16");
+        static constexpr f32 scale = (f32)std::numeric_limits<storage_t>::max();
+
+        storage_t bits;
+
+        unorm() = default;
+        constexpr mz_force_inline unorm(f32 v) : bits(encode(v)) {}
+
+        constexpr mz_force_inline operator f32() const {
+            return (f32)bits / scale;
+        }
+
+        static constexpr mz_force_inline unorm from_bits(storage_t bits) {
+            unorm u{};
+            u.bits = bits;
+            return u;
+        }
+
+        // Clamped with selects rather than branches so array loops vectorize
+        static constexpr mz_force_inline storage_t encode(f32 v) {
+            f32 c = v > 0.f ? v : 0.f;
+            c = c < 1.f ? c : 1.f;
+            return (storage_t)((f64)c * scale + 0.5);
+        }
+    };
+
+    template <typename storage_t>
+    struct snorm {
+        static_assert(std::is_signed<storage_t>::value && sizeof(storage_t) <= 2, "snorm is stored in s8 or s16");
+        static constexpr f32 scale = (f32)std::numeric_limits<storage_t>::max();
+
+        storage_t bits;
+
+        snorm() = default;
+        constexpr mz_force_inline snorm(f32 v) : bits((storage_t)encode(v, scale)) {}
+
+        constexpr mz_force_inline operator f32() const {
+            return decode(bits, scale);
+        }
+
+        static constexpr mz_force_inline snorm from_bits(storage_t bits) {
+            snorm s{};
+            s.bits = bits;
+            return s;
+        }
+
+        // Shared with the bit packed formats, which pass their own scale
+        static constexpr mz_force_inline s32 encode(f32 v, f32 scale) {
+            f64 c = v > -1.f ? v : -1.f;
+            c = c < 1. ? c : 1.;
+            c = v == v ? c * scale : 0.;
+            return (s32)(c + (c < 0. ? -0.5 : 0.5));
+        }
+        static constexpr mz_force_inline f32 decode(s32 bits, f32 scale) {
+            f32 r = (f32)bits / scale;
+            return r > -1.f ? r : -1.f;
+        }
+    };
+
+    template <typename component_t, u32 n>
+    struct packed_vec {
+        typedef component_t component_type;
+        typedef decltype(component_t::bits) storage_type;
+        typedef typename float_vec<n>::type vec_type;
+        static constexpr u32 width = n;
+
+        component_t ptr[n];
+
+        packed_vec() = default;
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == n>::type>
+        mz_force_inline packed_vec(const vec_t& v) {
+            for (u32 i = 0; i < n; i++)
+                ptr[i] = component_t((f32)v.ptr[i]);
+        }
+
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == n>::type>
+        mz_force_inline operator vec_t() const {
+            vec_t v;
+            for (u32 i = 0; i < n; i++)
+                v.ptr[i] = (typename vec_t::value_type)(f32)ptr[i];
+            return v;
+        }
+        mz_force_inline vec_type to_vec() const {
+            return *this;
+        }
+
+        // The arrays are walked as flat component streams, so vec3s cost no more than vec4s
+        static void pack(span<const vec_type> in, span<packed_vec> out) {
+            const size_t count = (in.count < out.count ? in.count : out.count) * n, blocks = count & ~(size_t)3;
+            const f32* src = reinterpret_cast<const f32*>(in.ptr);
+            component_t* dst = reinterpret_cast<component_t*>(out.ptr);
+            size_t i = 0;
+            if constexpr (simd::enabled) {
+                for (; i < blocks; i += 4) {
+                    if constexpr (std::is_same<component_t, half>::value) simd::pack_half4(src + i, reinterpret_cast<u16*>(dst + i));
+                    else simd::pack_norm4(src + i, reinterpret_cast<storage_type*>(dst + i));
+                }
+            }
+            for (; i < count; i++)
+                dst[i] = component_t(src[i]);
+        }
+        static void unpack(span<const packed_vec> in, span<vec_type> out) {
+            const size_t count = (in.count < out.count ? in.count : out.count) * n, blocks = count & ~(size_t)3;
+            const component_t* src = reinterpret_cast<const component_t*>(in.ptr);
+            f32* dst = reinterpret_cast<f32*>(out.ptr);
+            size_t i = 0;
+            if constexpr (simd::enabled) {
+                for (; i < blocks; i += 4) {
+                    if constexpr (std::is_same<component_t, half>::value) simd::unpack_half4(reinterpret_cast<const u16*>(src + i), dst + i);
+                    else simd::unpack_norm4(reinterpret_cast<const storage_type*>(src + i), dst + i);
+                }
+            }
+            for (; i < count; i++)
+                dst[i] = (f32)src[i];
+        }
+    };
+
+    struct snorm1010102 {
+        u32 bits;
+
+        snorm1010102() = default;
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == 3 || vec_width<vec_t>::value == 4>::type>
+        mz_force_inline snorm1010102(const vec_t& v) {
+            f32 w = 0.f;
+            if constexpr (vec_width<vec_t>::value == 4) w = (f32)v.w;
+            bits = ((u32)snorm<s16>::encode((f32)v.x, 511.f) & 0x3FF)
+                 | ((u32)snorm<s16>::encode((f32)v.y, 511.f) & 0x3FF) << 10
+                 | ((u32)snorm<s16>::encode((f32)v.z, 511.f) & 0x3FF) << 20
+                 | ((u32)snorm<s16>::encode(w, 1.f) & 0x3) << 30;
+        }
+
+        // vec3s drop w
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == 3 || vec_width<vec_t>::value == 4>::type>
+        mz_force_inline operator vec_t() const {
+            typedef typename vec_t::value_type value_t;
+            vec_t v;
+            v.x = (value_t)snorm<s16>::decode((s32)(bits << 22) >> 22, 511.f);
+            v.y = (value_t)snorm<s16>::decode((s32)(bits << 12) >> 22, 511.f);
+            v.z = (value_t)snorm<s16>::decode((s32)(bits << 2) >> 22, 511.f);
+            if constexpr (vec_width<vec_t>::value == 4) v.w = (value_t)snorm<s16>::decode((s32)bits >> 30, 1.f);
+            return v;
+        }
+
+        static void pack(span<const fvec3> in, span<snorm1010102> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+        static void pack(span<const fvec4> in, span<snorm1010102> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+        static void unpack(span<const snorm1010102> in, span<fvec3> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+        static void unpack(span<const snorm1010102> in, span<fvec4> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+    };
+
+    /*
+        Unit vector projected onto the octahedron |x| + |y| + |z| = 1, with
+        the lower half folded over the upper one, so 2 components cover the
+        whole sphere about evenly. Doesn't need a unit vector to encode, a
+        zero vector decodes as (0, 0, 1). Decoding normalizes.
+    */
+    template <typename storage_t>
+    struct octahedral {
+        snorm<storage_t> x, y;
+
+        octahedral() = default;
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == 3>::type>
+        mz_force_inline octahedral(const vec_t& v) {
+            f32 vx = (f32)v.x, vy = (f32)v.y, vz = (f32)v.z;
+            f32 l1 = std::abs(vx) + std::abs(vy) + std::abs(vz);
+            f32 px = l1 > 0.f ? vx / l1 : 0.f, py = l1 > 0.f ? vy / l1 : 0.f;
+            if (vz < 0.f) fold(px, py);
+            x = px;
+            y = py;
+        }
+
+        template <typename vec_t, typename = typename std::enable_if<vec_width<vec_t>::value == 3>::type>
+        mz_force_inline operator vec_t() const {
+            f32 px = x, py = y;
+            f32 pz = 1.f - std::abs(px) - std::abs(py);
+            if (pz < 0.f) fold(px, py);
+            return fvec3(px, py, pz).normalize(precise);
+        }
+        mz_force_inline fvec3 to_vec() const {
+            return *this;
+        }
+
+        static void pack(span<const fvec3> in, span<octahedral> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+        static void unpack(span<const octahedral> in, span<fvec3> out) {
+            const size_t count = in.count < out.count ? in.count : out.count;
+            for (size_t i = 0; i < count; i++)
+                out.ptr[i] = in.ptr[i];
+        }
+
+    private:
+        // Reflects across the octahedron's edges, its own inverse
+        static mz_force_inline void fold(f32& px, f32& py) {
+            f32 fx = (1.f - std::abs(py)) * (px >= 0.f ? 1.f : -1.f);
+            f32 fy = (1.f - std::abs(px)) * (py >= 0.f ? 1.f : -1.f);
+            px = fx;
+            py = fy;
+        }
+    };
+
+    typedef packed_vec<half, 2> hvec2;
+    typedef packed_vec<half, 3> hvec3;
+    typedef packed_vec<half, 4> hvec4;
+
+    typedef packed_vec<unorm<u8>, 2>  unorm8vec2;
+    typedef packed_vec<unorm<u8>, 3>  unorm8vec3;
+    typedef packed_vec<unorm<u8>, 4>  unorm8vec4;
+    typedef packed_vec<snorm<s8>, 2>  snorm8vec2;
+    typedef packed_vec<snorm<s8>, 3>  snorm8vec3;
+    typedef packed_vec<snorm<s8>, 4>  snorm8vec4;
+    typedef packed_vec<unorm<u16>, 2> unorm16vec2;
+    typedef packed_vec<unorm<u16>, 3> unorm16vec3;
+    typedef packed_vec<unorm<u16>, 4> unorm16vec4;
+    typedef packed_vec<snorm<s16>, 2> snorm16vec2;
+    typedef packed_vec<snorm<s16>, 3> snorm16vec3;
+    typedef packed_vec<snorm<s16>, 4> snorm16vec4;
+
+    typedef octahedral<s8>  oct16;
+    typedef octahedral<s16> oct32;
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mz_common.hpp"
+
+/*
+    Parallel loops for the batch functions.
+
+    parallel_for(count, grain, par, fn) calls fn(begin, end) over disjoint
+    ranges covering [0, count). grain is the smallest range worth handing
+    to a thread, and every range boundary is a multiple of it, so picking
+    a grain whose output is a whole number of cache lines (eg. 512 items
+    of a u64 bit mask, 16 vec4<f32>) means two threads never write the
+    same line. Inputs of at most one grain run on the calling thread.
+
+    par is either a thread count, which splits the range evenly over that
+    many new threads for the call (0 = hardware concurrency), or an
+    executor: a persistent work-stealing pool. The executor cuts the range
+    into grain aligned chunks, deals each worker a contiguous run of them,
+    and lets idle workers steal the back half of someone else's run, so
+    uneven work (culling, narrow phase) balances itself without threads
+    being created per call. The calling thread works too.
+
+    par defaults to 1: batch functions run on the calling thread and never
+    start threads unless the caller passes a thread count or an executor.
+
+    parallel_reduce(count, grain, identity, par, map, combine) folds
+    map(begin, end) results with combine. Partial results are combined in
+    range order over ranges that only depend on count and grain, so
+    floating point reductions give the same result for any thread count.
+
+    fn must not throw. Calls made from inside an executor's own loop, and
+    calls from several threads into one executor, run correctly: nested
+    ones run on the calling thread, concurrent ones one after another.
+*/
+namespace mz {
+
+    class executor {
+    public:
+        // nthreads includes the calling thread, 0 = hardware concurrency
+        explicit executor(u32 nthreads = 0) {
+            if (nthreads == 0) nthreads = std::thread::hardware_concurrency();
+            if (nthreads == 0) nthreads = 1;
+            slots.reset(new slot[nthreads]);
+            slot_count = nthreads;
+            for (u32 i = 1; i < nthreads; i++)
+                workers.emplace_back(&executor::worker, this, i);
+        }
+        ~executor() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& w : workers) w.join();
+        }
+        executor(const executor&) = delete;
+        executor& operator=(const executor&) = delete;
+
+        u32 size() const {
+            return slot_count;
+        }
+
+        template <typename fn_t>
+        void parallel_for(size_t count, size_t grain, fn_t&& fn) {
+            if (grain == 0) grain = 1;
+            // Around 8 chunks per thread leaves enough to steal without scheduling every grain
+            size_t chunk = (count / ((size_t)slot_count * 8) + grain - 1) / grain * grain;
+            if (chunk < grain) chunk = grain;
+            if (slot_count == 1 || count <= chunk || current() == this) {
+                if (count) fn((size_t)0, count);
+                return;
+            }
+
+            std::lock_guard<std::mutex> submitting(submit);
+            job j;
+            j.call = [](void* fn, size_t begin, size_t end) { (*(typename std::remove_reference<fn_t>::type*)fn)(begin, end); };
+            j.fn = (void*)&fn;
+            j.count = count;
+            j.chunk = chunk;
+            const size_t chunks = (count + chunk - 1) / chunk;
+            j.remaining.store(chunks, std::memory_order_relaxed);
+            for (u32 i = 0; i < slot_count; i++) {
+                slots[i].begin = chunks * i / slot_count;
+                slots[i].end = chunks * (i + 1) / slot_count;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current_job = &j;
+                generation++;
+            }
+            wake.notify_all();
+
+            executor* outer = current();
+            current() = this;
+            work(j, 0);
+            current() = outer;
+            while (j.remaining.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+
+            // Workers that haven't picked the job up by now never will
+            std::unique_lock<std::mutex> lock(mutex);
+            current_job = NULL;
+            idle.wait(lock, [&] { return active == 0; });
+        }
+
+    private:
+        struct job {
+            void (*call)(void*, size_t, size_t);
+            void* fn;
+            size_t count, chunk;
+            std::atomic<size_t> remaining;
+        };
+
+        // One run of chunk indices per thread, on its own cache line
+        struct alignas(64) slot {
+            std::mutex lock;
+            size_t begin = 0, end = 0;
+        };
+
+        static executor*& current() {
+            static thread_local executor* e = NULL;
+            return e;
+        }
+
+        bool pop(u32 self, size_t& c) {
+            slot& s = slots[self];
+            std::lock_guard<std::mutex> lock(s.lock);
+            if (s.begin == s.end) return false;
+            c = s.begin++;
+            return true;
+        }
+
+        bool steal(u32 self, size_t& c) {
+            for (u32 k = 1; k < slot_count; k++) {
+                slot& victim = slots[(self + k) % slot_count];
+                size_t begin, end;
+                {
+                    std::lock_guard<std::mutex> lock(victim.lock);
+                    if (victim.begin == victim.end) continue;
+                    end = victim.end;
+                    victim.end -= (end - victim.begin + 1) / 2;
+                    begin = victim.end;
+                }
+                c = begin;
+                std::lock_guard<std::mutex> lock(slots[self].lock);
+                slots[self].begin = begin + 1;
+                slots[self].end = end;
+                return true;
+            }
+            return false;
+        }
+
+        void work(job& j, u32 self) {
+            size_t c;
+            while (pop(self, c) || steal(self, c)) {
+                size_t begin = c * j.chunk;
+                size_t end = begin + j.chunk < j.count ? begin + j.chunk : j.count;
+                j.call(j.fn, begin, end);
+                j.remaining.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        void worker(u32 self) {
+            current() = this;
+            u64 seen = 0;
+            for (;;) {
+                job* j;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || (current_job && generation != seen); });
+                    if (stopping) return;
+                    seen = generation;
+                    j = current_job;
+                    active++;
+                }
+                work(*j, self);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--active == 0) idle.notify_all();
+            }
+        }
+
+        std::unique_ptr<slot[]> slots;
+        u32 slot_count;
+        std::vector<std::thread> workers;
+
+        std::mutex submit;
+        std::mutex mutex;
+        std::condition_variable wake, idle;
+        job* current_job = NULL;
+        u64 generation = 0;
+        u32 active = 0;
+        bool stopping = false;
+    };
+
+    // A thread count (0 = hardware concurrency) or an executor, see above.
+    // The default runs inline on the calling thread.
+    struct parallelism {
+        u32 nthreads;
+        executor* exec;
+
+        parallelism(u32 nthreads = 1) : nthreads(nthreads), exec(NULL) {}
+        parallelism(executor& exec) : nthreads(0), exec(&exec) {}
+    };
+
+    template <typename fn_t>
+    inline void parallel_for(size_t count, size_t grain, parallelism par, fn_t&& fn) {
+        if (grain == 0) grain = 1;
+        if (par.exec) {
+            par.exec->parallel_for(count, grain, fn);
+            return;
+        }
+
+        u32 nthreads = par.nthreads;
+        if (nthreads == 0) nthreads = std::thread::hardware_concurrency();
+        if (nthreads == 0) nthreads = 1;
+
+        size_t chunk = (count + nthreads - 1) / nthreads;
+        chunk = (chunk + grain - 1) / grain * grain;
+        if (nthreads == 1 || chunk >= count) {
+            if (count) fn((size_t)0, count);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t begin = chunk; begin < count; begin += chunk) {
+            size_t end = begin + chunk < count ? begin + chunk : count;
+            workers.emplace_back([&fn, begin, end] { fn(begin, end); });
+        }
+        fn((size_t)0, chunk);
+        for (auto& w : workers) w.join();
+    }
+
+    template <typename value_t, typename map_t, typename combine_t>
+    inline value_t parallel_reduce(size_t count, size_t grain, value_t identity, parallelism par, map_t&& map, combine_t&& combine) {
+        if (grain == 0) grain = 1;
+        // At most 1024 partial results, fixed by count and grain alone
+        size_t chunk = (count / 1024 + grain - 1) / grain * grain;
+        if (chunk < grain) chunk = grain;
+        const size_t chunks = (count + chunk - 1) / chunk;
+
+        std::vector<value_t> partials(chunks, identity);
+        parallel_for(count, chunk, par, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b += chunk)
+                partials[b / chunk] = map(b, b + chunk < end ? b + chunk : end);
+        });
+
+        value_t result = identity;
+        for (size_t i = 0; i < chunks; i++)
+            result = combine(result, partials[i]);
+        return result;
+    }
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_matrix.hpp"
+
+namespace mz {
+
+    /*
+        Unit quaternion rotation, stored as (x, y, z, w) with w the scalar
+        part. Uses the same right-handed convention as mat4::rotate, so
+        quat::from_axis_angle(a, axis).to_mat4() == transformation::rotation(a, axis).
+        Composition reads like matrices: (a * b) rotates by b first, then a.
+    */
+    template <typename value_t = default_value_t>
+    struct MZ_API quat {
+        typedef value_t       value_type;
+        typedef quat<value_t> quat_type;
+        typedef vec3<value_t> vec3_type;
+        typedef vec4<value_t> vec4_type;
+        typedef mat4<value_t> mat4_type;
+
+        union {
+            value_t ptr[4];
+            struct { value_t x, y, z, w; };
+            struct { vec3<value_t> xyz; };
+            vec4<value_t> v4;
+        };
+
+        constexpr mz_force_inline quat() : x((value_t)0), y((value_t)0), z((value_t)0), w((value_t)1) {}
+        constexpr mz_force_inline quat(value_t x, value_t y, value_t z, value_t w) : x(x), y(y), z(z), w(w) {}
+        template <typename rhs_value_t>
+        constexpr mz_force_inline explicit quat(const vec4<rhs_value_t>& v) : x((value_t)v.x), y((value_t)v.y), z((value_t)v.z), w((value_t)v.w) {}
+        template <typename rhs_value_t>
+        constexpr mz_force_inline quat(const quat<rhs_value_t>& q) : x((value_t)q.x), y((value_t)q.y), z((value_t)q.z), w((value_t)q.w) {}
+
+        // axis is expected to be normalized
+        static constexpr mz_force_inline quat_type from_axis_angle(value_t angle, const vec3_type& axis) {
+            value_t half = angle / (value_t)2;
+            value_t s = (value_t)math::sin(half);
+            return quat_type(axis.x * s, axis.y * s, axis.z * s, (value_t)math::cos(half));
+        }
+
+        // Same rotation as .rotate(euler.x, { 1, 0, 0 }).rotate(euler.y, { 0, 1, 0 }).rotate(euler.z, { 0, 0, 1 })
+        static constexpr mz_force_inline quat_type from_euler(const vec3_type& euler) {
+            value_t hx = euler.x / (value_t)2, hy = euler.y / (value_t)2, hz = euler.z / (value_t)2;
+            value_t sx = (value_t)math::sin(hx), cx = (value_t)math::cos(hx);
+            value_t sy = (value_t)math::sin(hy), cy = (value_t)math::cos(hy);
+            value_t sz = (value_t)math::sin(hz), cz = (value_t)math::cos(hz);
+
+            return quat_type(
+                sx * cy * cz + cx * sy * sz,
+                cx * sy * cz - sx * cy * sz,
+                cx * cy * sz + sx * sy * cz,
+                cx * cy * cz - sx * sy * sz
+            );
+        }
+
+        // Extracts the rotation from the upper 3x3 of m, which must not contain scale
+        static constexpr quat_type from_mat4(const mat4_type& m) {
+            value_t m00 = m.rows[0].x, m01 = m.rows[0].y, m02 = m.rows[0].z;
+            value_t m10 = m.rows[1].x, m11 = m.rows[1].y, m12 = m.rows[1].z;
+            value_t m20 = m.rows[2].x, m21 = m.rows[2].y, m22 = m.rows[2].z;
+
+            value_t trace = m00 + m11 + m22;
+            if (trace > (value_t)0) {
+                value_t s = (value_t)math::sqrt(trace + (value_t)1) * (value_t)2;
+                return quat_type((m21 - m12) / s, (m02 - m20) / s, (m10 - m01) / s, s / (value_t)4);
+            } else if (m00 > m11 && m00 > m22) {
+                value_t s = (value_t)math::sqrt((value_t)1 + m00 - m11 - m22) * (value_t)2;
+                return quat_type(s / (value_t)4, (m01 + m10) / s, (m02 + m20) / s, (m21 - m12) / s);
+            } else if (m11 > m22) {
+                value_t s = (value_t)math::sqrt((value_t)1 + m11 - m00 - m22) * (value_t)2;
+                return quat_type((m01 + m10) / s, s / (value_t)4, (m12 + m21) / s, (m02 - m20) / s);
+            } else {
+                value_t s = (value_t)math::sqrt((value_t)1 + m22 - m00 - m11) * (value_t)2;
+                return quat_type((m02 + m20) / s, (m12 + m21) / s, s / (value_t)4, (m10 - m01) / s);
+            }
+        }
+
+        constexpr mz_force_inline mat4_type to_mat4() const {
+            value_t xx = x * x, yy = y * y, zz = z * z;
+            value_t xy = x * y, xz = x * z, yz = y * z;
+            value_t wx = w * x, wy = w * y, wz = w * z;
+
+            mat4_type m((value_t)1);
+            m.rows[0].x = (value_t)1 - (value_t)2 * (yy + zz);
+            m.rows[0].y = (value_t)2 * (xy - wz);
+            m.rows[0].z = (value_t)2 * (xz + wy);
+
+            m.rows[1].x = (value_t)2 * (xy + wz);
+            m.rows[1].y = (value_t)1 - (value_t)2 * (xx + zz);
+            m.rows[1].z = (value_t)2 * (yz - wx);
+
+            m.rows[2].x = (value_t)2 * (xz - wy);
+            m.rows[2].y = (value_t)2 * (yz + wx);
+            m.rows[2].z = (value_t)1 - (value_t)2 * (xx + yy);
+            return m;
+        }
+
+        constexpr mz_force_inline value_t dot(const quat_type& rhs) const {
+            return x * rhs.x + y * rhs.y + z * rhs.z + w * rhs.w;
+        }
+        constexpr mz_force_inline value_t magnitude() const {
+            return (value_t)math::sqrt(dot(*this));
+        }
+        constexpr mz_force_inline quat_type normalize() const {
+            value_t mag = magnitude();
+            return mag ? quat_type(x / mag, y / mag, z / mag, w / mag) : quat_type();
+        }
+        constexpr mz_force_inline quat_type conjugate() const {
+            return quat_type(-x, -y, -z, w);
+        }
+        // For unit quaternions this is the same as conjugate()
+        constexpr mz_force_inline quat_type inverse() const {
+            value_t d = dot(*this);
+            return quat_type(-x / d, -y / d, -z / d, w / d);
+        }
+
+        // *this = *this * rhs
+        constexpr mz_force_inline quat_type& multiply(const quat_type& rhs) {
+            value_t rx = w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y;
+            value_t ry = w * rhs.y - x * rhs.z + y * rhs.w + z * rhs.x;
+            value_t rz = w * rhs.z + x * rhs.y - y * rhs.x + z * rhs.w;
+            value_t rw = w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z;
+            x = rx; y = ry; z = rz; w = rw;
+            return *this;
+        }
+
+        // v' = v + w * t + xyz x t, t = 2 * (xyz x v). 15 mul + 15 add
+        constexpr mz_force_inline vec3_type rotate(const vec3_type& v) const {
+            value_t tx = (value_t)2 * (y * v.z - z * v.y);
+            value_t ty = (value_t)2 * (z * v.x - x * v.z);
+            value_t tz = (value_t)2 * (x * v.y - y * v.x);
+            return vec3_type(
+                v.x + w * tx + (y * tz - z * ty),
+                v.y + w * ty + (z * tx - x * tz),
+                v.z + w * tz + (x * ty - y * tx)
+            );
+        }
+
+        mz_force_inline void to_axis_angle(value_t& angle, vec3_type& axis) const {
+            value_t cw = w < (value_t)-1 ? (value_t)-1 : (w > (value_t)1 ? (value_t)1 : w);
+            angle = (value_t)2 * (value_t)math::acos(cw);
+            value_t s = (value_t)math::sqrt((value_t)1 - cw * cw);
+            axis = s > (value_t)0.0001 ? vec3_type(x / s, y / s, z / s) : vec3_type((value_t)1, (value_t)0, (value_t)0);
+        }
+
+        constexpr mz_force_inline quat_type operator-() const {
+            return quat_type(-x, -y, -z, -w);
+        }
+
+        constexpr mz_force_inline friend quat_type operator*(quat_type lhs, const quat_type& rhs) {
+            return lhs.multiply(rhs);
+        }
+        constexpr mz_force_inline quat_type& operator*=(const quat_type& rhs) {
+            return multiply(rhs);
+        }
+        constexpr mz_force_inline friend vec3_type operator*(const quat_type& lhs, const vec3_type& rhs) {
+            return lhs.rotate(rhs);
+        }
+
+        template <typename rhs_value_t>
+        constexpr mz_force_inline bool operator==(const quat<rhs_value_t>& rhs) const {
+            return x == rhs.x && y == rhs.y && z == rhs.z && w == rhs.w;
+        }
+        template <typename rhs_value_t>
+        constexpr mz_force_inline bool operator!=(const quat<rhs_value_t>& rhs) const {
+            return !(*this == rhs);
+        }
+    };
+
+    // Normalized linear interpolation along the shortest arc. Cheap and
+    // good enough when a and b are close, eg. between animation keys.
+    template <typename value_t>
+    inline quat<value_t> nlerp(const quat<value_t>& a, const quat<value_t>& b, value_t t) {
+        value_t sign = a.dot(b) < (value_t)0 ? (value_t)-1 : (value_t)1;
+        value_t ia = (value_t)1 - t, ib = t * sign;
+        return quat<value_t>(
+            a.x * ia + b.x * ib,
+            a.y * ia + b.y * ib,
+            a.z * ia + b.z * ib,
+            a.w * ia + b.w * ib
+        ).normalize();
+    }
+
+    // Constant angular velocity interpolation along the shortest arc. Falls
+    // back to nlerp when a and b are nearly parallel.
+    template <typename value_t>
+    inline quat<value_t> slerp(const quat<value_t>& a, const quat<value_t>& b, value_t t) {
+        value_t d = a.dot(b);
+        quat<value_t> end = b;
+        if (d < (value_t)0) {
+            d = -d;
+            end = -b;
+        }
+
+        if (d > (value_t)0.9995) return nlerp(a, end, t);
+
+        value_t theta = (value_t)math::acos(d);
+        value_t sin_theta = (value_t)math::sin(theta);
+        value_t ia = (value_t)math::sin(((value_t)1 - t) * theta) / sin_theta;
+        value_t ib = (value_t)math::sin(t * theta) / sin_theta;
+        return quat<value_t>(
+            a.x * ia + end.x * ib,
+            a.y * ia + end.y * ib,
+            a.z * ia + end.z * ib,
+            a.w * ia + end.w * ib
+        );
+    }
+
+    namespace transformation {
+        template <typename value_t>
+        constexpr mat4<value_t> rotation(const quat<value_t>& q) {
+            return q.to_mat4();
+        }
+
+        template <typename value_t>
+        constexpr mz_force_inline void quat_rotation_3x3(const quat<value_t>& q, vec3<value_t>& r0, vec3<value_t>& r1, vec3<value_t>& r2) {
+            value_t xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+            value_t xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+            value_t wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+            r0 = vec3<value_t>((value_t)1 - (value_t)2 * (yy + zz), (value_t)2 * (xy - wz), (value_t)2 * (xz + wy));
+            r1 = vec3<value_t>((value_t)2 * (xy + wz), (value_t)1 - (value_t)2 * (xx + zz), (value_t)2 * (yz - wx));
+            r2 = vec3<value_t>((value_t)2 * (xz - wy), (value_t)2 * (yz + wx), (value_t)1 - (value_t)2 * (xx + yy));
+        }
+
+        // translation(position) * rotation.to_mat4() * scale(scale), no trig at all
+        template <typename value_t>
+        constexpr mat4<value_t> trs(const vec3<value_t>& position, const quat<value_t>& rotation, const vec3<value_t>& scale) {
+            vec3<value_t> r0, r1, r2;
+            quat_rotation_3x3(rotation, r0, r1, r2);
+            return trs(position, r0, r1, r2, scale);
+        }
+
+        template <typename value_t>
+        constexpr mat4<value_t> inverse_trs(const vec3<value_t>& position, const quat<value_t>& rotation, const vec3<value_t>& scale) {
+            vec3<value_t> r0, r1, r2;
+            quat_rotation_3x3(rotation, r0, r1, r2);
+            return inverse_trs(position, r0, r1, r2, scale);
+        }
+
+        template <typename value_t>
+        inline void trs(span<const vec3<value_t>> positions, span<const quat<value_t>> rotations, span<const vec3<value_t>> scales, span<mat4<value_t>> out) {
+            size_t n = out.size();
+            if (positions.size() < n) n = positions.size();
+            if (rotations.size() < n) n = rotations.size();
+            if (scales.size() < n)    n = scales.size();
+
+            for (size_t i = 0; i < n; i++)
+                out[i] = trs(positions[i], rotations[i], scales[i]);
+        }
+
+        template <typename value_t>
+        inline void inverse_trs(span<const vec3<value_t>> positions, span<const quat<value_t>> rotations, span<const vec3<value_t>> scales, span<mat4<value_t>> out) {
+            size_t n = out.size();
+            if (positions.size() < n) n = positions.size();
+            if (rotations.size() < n) n = rotations.size();
+            if (scales.size() < n)    n = scales.size();
+
+            for (size_t i = 0; i < n; i++)
+                out[i] = inverse_trs(positions[i], rotations[i], scales[i]);
+        }
+    }
+
+    template<typename TStream, typename value_t>
+    inline TStream& operator<<(TStream& str, const quat<value_t>& q) {
+        return str
+               << "{ x: " << __d_p(5) << q.x
+               << ", y: " << __d_p(5) << q.y
+               << ", z: " << __d_p(5) << q.z
+               << ", w: " << __d_p(5) << q.w
+               << " }";
+    }
+
+    typedef quat<f32> fquat;
+    typedef quat<f64> dquat;
+}
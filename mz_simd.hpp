@@ -0,0 +1,969 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "mz_common.hpp"
+
+#if defined(MZ_SIMD_AVX)
+    #include <immintrin.h>
+#elif defined(MZ_SIMD_SSE)
+    #include <emmintrin.h>
+#elif defined(MZ_SIMD_NEON)
+    #include <arm_neon.h>
+#endif
+
+/*
+    Kernels backing the vec4<f32> and mat4<f32> SIMD paths. They work on
+    raw f32 pointers (a vec4<f32> is 4 packed floats, a mat4<f32> is 4 such
+    rows) so this header doesn't depend on the vector or matrix types.
+    Nothing here requires alignment.
+*/
+namespace mz {
+namespace simd {
+
+#ifdef MZ_SIMD_ENABLED
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+
+    // True if vec4<value_t>/mat4<value_t> take the SIMD paths
+    template <typename value_t>
+    constexpr bool accelerated = enabled && std::is_same<value_t, f32>::value;
+
+    // Max difference from the scalar code, only reached if the compiler
+    // contracts the scalar expressions into FMA. Otherwise results are exact.
+    // Element-wise ops never differ. Sums of products (dot, mat4 multiply)
+    // differ by at most tolerance_ulp epsilons of the sum of the absolute
+    // products, which is tolerance_ulp ULP of the result unless it cancels.
+    constexpr u32 tolerance_ulp = 2;
+
+    // mat4_inverse eliminates blockwise rather than by the scalar cofactors,
+    // so elements differ by up to this many epsilons of the largest element
+    // in their row, for well conditioned matrices (transforms, diagonally
+    // dominant). The difference grows with the condition number.
+    constexpr u32 inverse_tolerance_ulp = 16;
+
+    /*
+        f32 <-> IEEE half bits, rounding to nearest even like F16C. NaNs keep
+        their top payload bits and become quiet, also like F16C, so every
+        backend's pack_half4/unpack_half4 gives the same bits as these.
+    */
+    mz_force_inline u16 half_from_f32(f32 v) {
+        u32 f = 0;
+        memcpy(&f, &v, 4);
+        u32 sign = (f >> 16) & 0x8000, a = f & 0x7FFFFFFF;
+        if (a >= 0x7F800000) return (u16)(sign | 0x7C00 | (a > 0x7F800000 ? 0x200 | ((a >> 13) & 0x3FF) : 0));
+        if (a >= 0x47800000) return (u16)(sign | 0x7C00);
+        if (a < 0x38800000) {
+            // Below the smallest normal half: adding 0.5 lines the half mantissa up with the f32 one and rounds it
+            f32 magnitude = 0;
+            memcpy(&magnitude, &a, 4);
+            magnitude += 0.5f;
+            memcpy(&a, &magnitude, 4);
+            return (u16)(sign | (a - 0x3F000000));
+        }
+        // Rebias the exponent and round half to even in one add, overflowing into infinity if needed
+        a += 0xC8000FFF + ((a >> 13) & 1);
+        return (u16)(sign | (a >> 13));
+    }
+    mz_force_inline f32 f32_from_half(u16 h) {
+        u32 expmant = h & 0x7FFF, sign = (u32)(h & 0x8000) << 16;
+        f32 scaled = 0, magic = 0;
+        u32 shifted = expmant << 13, magic_bits = (254 - 15) << 23;
+        memcpy(&scaled, &shifted, 4);
+        memcpy(&magic, &magic_bits, 4);
+        scaled *= magic; // rebias the exponent, denormal halves included
+        u32 r = 0;
+        memcpy(&r, &scaled, 4);
+        if (expmant >= 0x7C00) r |= 0x7F800000;
+        if (expmant > 0x7C00)  r |= 0x400000;
+        r |= sign;
+        f32 result = 0;
+        memcpy(&result, &r, 4);
+        return result;
+    }
+
+#if defined(MZ_SIMD_SSE)
+
+    typedef __m128 f32x4;
+
+    mz_force_inline f32x4 load(const f32* p)          { return _mm_loadu_ps(p); }
+    mz_force_inline void  store(f32* p, f32x4 v)       { _mm_storeu_ps(p, v); }
+    mz_force_inline f32x4 set1(f32 s)                  { return _mm_set1_ps(s); }
+    mz_force_inline f32x4 add(f32x4 a, f32x4 b)        { return _mm_add_ps(a, b); }
+    mz_force_inline f32x4 sub(f32x4 a, f32x4 b)        { return _mm_sub_ps(a, b); }
+    mz_force_inline f32x4 mul(f32x4 a, f32x4 b)        { return _mm_mul_ps(a, b); }
+    mz_force_inline f32x4 div(f32x4 a, f32x4 b)        { return _mm_div_ps(a, b); }
+    mz_force_inline f32x4 sqrt(f32x4 a)                { return _mm_sqrt_ps(a); }
+
+    // a / b in lanes where b != 0, 0 elsewhere
+    mz_force_inline f32x4 div_or_zero(f32x4 a, f32x4 b) {
+        return _mm_and_ps(_mm_div_ps(a, b), _mm_cmpneq_ps(b, _mm_setzero_ps()));
+    }
+
+    // Per lane sqrt(x * x + y * y) squared and summed in f64, then rounded
+    // to f32, same as vec2::magnitude(precise)
+    mz_force_inline f32x4 length_f64(f32x4 x, f32x4 y) {
+        __m128d xl = _mm_cvtps_pd(x), xh = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+        __m128d yl = _mm_cvtps_pd(y), yh = _mm_cvtps_pd(_mm_movehl_ps(y, y));
+        __m128d lo = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xl, xl), _mm_mul_pd(yl, yl)));
+        __m128d hi = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(xh, xh), _mm_mul_pd(yh, yh)));
+        return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    }
+
+    mz_force_inline f32x4 min(f32x4 a, f32x4 b)        { return _mm_min_ps(a, b); }
+    mz_force_inline f32x4 max(f32x4 a, f32x4 b)        { return _mm_max_ps(a, b); }
+
+    // Comparisons give all-ones/all-zero lane masks, movemask packs
+    // their top bits into bits 0-3, select takes a where the mask is set
+    mz_force_inline f32x4 cmpge(f32x4 a, f32x4 b)      { return _mm_cmpge_ps(a, b); }
+    mz_force_inline f32x4 cmple(f32x4 a, f32x4 b)      { return _mm_cmple_ps(a, b); }
+    mz_force_inline f32x4 cmpneq(f32x4 a, f32x4 b)     { return _mm_cmpneq_ps(a, b); }
+    mz_force_inline f32x4 bit_and(f32x4 a, f32x4 b)    { return _mm_and_ps(a, b); }
+    mz_force_inline f32x4 select(f32x4 m, f32x4 a, f32x4 b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+    // Even lanes of a then b, and odd lanes of a then b
+    mz_force_inline void unzip(f32x4 a, f32x4 b, f32x4& even, f32x4& odd) {
+        even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        odd  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    // (a[i0], a[i1], b[i2], b[i3])
+    template <int i0, int i1, int i2, int i3>
+    mz_force_inline f32x4 shuffle(f32x4 a, f32x4 b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0)); }
+    mz_force_inline u32   movemask(f32x4 m)            { return (u32)_mm_movemask_ps(m); }
+
+    // Interleaved <-> planar for 4 consecutive vec2/vec3/vec4 of f32
+
+    mz_force_inline void load2(const f32* p, f32x4& x, f32x4& y) {
+        __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4);
+        x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    mz_force_inline void store2(f32* p, f32x4 x, f32x4 y) {
+        _mm_storeu_ps(p,     _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(p + 4, _mm_unpackhi_ps(x, y));
+    }
+
+    mz_force_inline void load3(const f32* p, f32x4& x, f32x4& y, f32x4& z) {
+        __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+        x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+    mz_force_inline void store3(f32* p, f32x4 x, f32x4 y, f32x4 z) {
+        __m128 a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        _mm_storeu_ps(p,     a);
+        _mm_storeu_ps(p + 4, b);
+        _mm_storeu_ps(p + 8, c);
+    }
+
+    mz_force_inline void load4(const f32* p, f32x4& x, f32x4& y, f32x4& z, f32x4& w) {
+        x = _mm_loadu_ps(p); y = _mm_loadu_ps(p + 4); z = _mm_loadu_ps(p + 8); w = _mm_loadu_ps(p + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+    }
+    mz_force_inline void store4(f32* p, f32x4 x, f32x4 y, f32x4 z, f32x4 w) {
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(p, x); _mm_storeu_ps(p + 4, y); _mm_storeu_ps(p + 8, z); _mm_storeu_ps(p + 12, w);
+    }
+
+    // ((a.x*b.x + a.y*b.y) + a.z*b.z) + a.w*b.w, same order as vec4::dot
+    mz_force_inline f32 dot4(const f32* a, const f32* b) {
+        __m128 m = _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+        __m128 s = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+        s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+        s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 3, 3, 3)));
+        return _mm_cvtss_f32(s);
+    }
+
+    mz_force_inline f32 sqrt1(f32 s) {
+        return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(s)));
+    }
+
+    // Hardware estimate (12 bits) refined by one Newton step
+    mz_force_inline f32 rsqrt1(f32 s) {
+        __m128 v = _mm_set_ss(s);
+        __m128 r = _mm_rsqrt_ss(v);
+        __m128 rr_v = _mm_mul_ss(_mm_mul_ss(r, r), v);
+        return _mm_cvtss_f32(_mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), r), _mm_sub_ss(_mm_set_ss(3.f), rr_v)));
+    }
+
+    // v * rsqrt(dot(v, v)) without leaving the register or branching, 0 for
+    // a zero vector. Sums as (x + y) + (z + w), unlike dot4.
+    mz_force_inline void normalize4_fast(const f32* v, f32* out) {
+        __m128 a = _mm_loadu_ps(v);
+        __m128 m = _mm_mul_ps(a, a);
+        __m128 l2 = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        l2 = _mm_add_ps(l2, _mm_shuffle_ps(l2, l2, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128 r = _mm_rsqrt_ps(l2);
+        r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_mul_ps(r, r), l2)));
+        _mm_storeu_ps(out, _mm_and_ps(_mm_mul_ps(a, r), _mm_cmpneq_ps(l2, _mm_setzero_ps())));
+    }
+
+    // out = rows * v, summed column by column like mat4::multiply(vec4)
+    mz_force_inline void mat4_multiply_vec4(const f32* rows, const f32* v, f32* out) {
+        __m128 c0 = _mm_loadu_ps(rows + 0);
+        __m128 c1 = _mm_loadu_ps(rows + 4);
+        __m128 c2 = _mm_loadu_ps(rows + 8);
+        __m128 c3 = _mm_loadu_ps(rows + 12);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+        __m128 vec = _mm_loadu_ps(v);
+        __m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_storeu_ps(out, r);
+    }
+
+    #if defined(MZ_SIMD_AVX)
+
+    mz_force_inline __m256 broadcast_row(const f32* p) {
+        __m128 r = _mm_loadu_ps(p);
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(r), r, 1);
+    }
+
+    mz_force_inline __m256 linear_combine_2rows(__m256 a, __m256 b0, __m256 b1, __m256 b2, __m256 b3) {
+        __m256 r = _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+        return r;
+    }
+
+    // dst = dst * rhs, two rows per 256-bit register. rhs may alias dst.
+    mz_force_inline void mat4_multiply(f32* dst, const f32* rhs) {
+        __m256 b0 = broadcast_row(rhs + 0);
+        __m256 b1 = broadcast_row(rhs + 4);
+        __m256 b2 = broadcast_row(rhs + 8);
+        __m256 b3 = broadcast_row(rhs + 12);
+
+        __m256 r01 = linear_combine_2rows(_mm256_loadu_ps(dst + 0), b0, b1, b2, b3);
+        __m256 r23 = linear_combine_2rows(_mm256_loadu_ps(dst + 8), b0, b1, b2, b3);
+
+        _mm256_storeu_ps(dst + 0, r01);
+        _mm256_storeu_ps(dst + 8, r23);
+    }
+
+    #else
+
+    mz_force_inline __m128 linear_combine(__m128 a, __m128 b0, __m128 b1, __m128 b2, __m128 b3) {
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+        return r;
+    }
+
+    // dst = dst * rhs, one row per register. rhs may alias dst.
+    mz_force_inline void mat4_multiply(f32* dst, const f32* rhs) {
+        __m128 b0 = _mm_loadu_ps(rhs + 0);
+        __m128 b1 = _mm_loadu_ps(rhs + 4);
+        __m128 b2 = _mm_loadu_ps(rhs + 8);
+        __m128 b3 = _mm_loadu_ps(rhs + 12);
+
+        __m128 r0 = linear_combine(_mm_loadu_ps(dst + 0),  b0, b1, b2, b3);
+        __m128 r1 = linear_combine(_mm_loadu_ps(dst + 4),  b0, b1, b2, b3);
+        __m128 r2 = linear_combine(_mm_loadu_ps(dst + 8),  b0, b1, b2, b3);
+        __m128 r3 = linear_combine(_mm_loadu_ps(dst + 12), b0, b1, b2, b3);
+
+        _mm_storeu_ps(dst + 0,  r0);
+        _mm_storeu_ps(dst + 4,  r1);
+        _mm_storeu_ps(dst + 8,  r2);
+        _mm_storeu_ps(dst + 12, r3);
+    }
+
+    #endif
+
+    /*
+        Packed s32 fixed point (vec4 of mz::fixed<frac_bits, s32>). Same
+        results as the scalar operators in mz_fixed.hpp, bit for bit: add and
+        subtract saturate, multiply rounds half up and saturates. SSE2 only,
+        so the signed 32 x 32 products are built from unsigned ones.
+    */
+    mz_force_inline void add4_saturate(s32* dst, const s32* rhs) {
+        __m128i a = _mm_loadu_si128((const __m128i*)dst), b = _mm_loadu_si128((const __m128i*)rhs);
+        __m128i r = _mm_add_epi32(a, b);
+        __m128i overflow = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r)), 31);
+        __m128i saturated = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(0x7FFFFFFF));
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(overflow, saturated), _mm_andnot_si128(overflow, r)));
+    }
+
+    mz_force_inline void subtract4_saturate(s32* dst, const s32* rhs) {
+        __m128i a = _mm_loadu_si128((const __m128i*)dst), b = _mm_loadu_si128((const __m128i*)rhs);
+        __m128i r = _mm_sub_epi32(a, b);
+        __m128i overflow = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r)), 31);
+        __m128i saturated = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(0x7FFFFFFF));
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(overflow, saturated), _mm_andnot_si128(overflow, r)));
+    }
+
+    template <u32 frac_bits>
+    mz_force_inline void multiply4_fixed(s32* dst, const s32* rhs) {
+        static_assert(frac_bits >= 1 && frac_bits <= 31, "frac_bits out of range");
+        __m128i a = _mm_loadu_si128((const __m128i*)dst), b = _mm_loadu_si128((const __m128i*)rhs);
+        __m128i low_dwords = _mm_set1_epi64x(0xFFFFFFFF);
+        __m128i round = _mm_set1_epi64x((s64)1 << (frac_bits - 1));
+
+        // Unsigned products of lanes 0, 2 and 1, 3, then the usual fix for
+        // signed operands: subtract b from the high half if a < 0 and vice versa
+        __m128i p02 = _mm_mul_epu32(a, b);
+        __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        __m128i fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b), _mm_and_si128(_mm_srai_epi32(b, 31), a));
+        p02 = _mm_add_epi64(_mm_sub_epi64(p02, _mm_slli_epi64(fix, 32)), round);
+        p13 = _mm_add_epi64(_mm_sub_epi64(p13, _mm_andnot_si128(low_dwords, fix)), round);
+
+        __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi64(p02, frac_bits), low_dwords), _mm_slli_epi64(_mm_srli_epi64(p13, frac_bits), 32));
+        __m128i high = _mm_or_si128(_mm_srli_epi64(p02, 32), _mm_andnot_si128(low_dwords, p13));
+
+        // Fits if bits frac_bits + 31 and up of the product are all copies of the result's sign
+        __m128i fits = _mm_cmpeq_epi32(_mm_srai_epi32(high, frac_bits - 1), _mm_srai_epi32(r, 31));
+        __m128i saturated = _mm_xor_si128(_mm_srai_epi32(high, 31), _mm_set1_epi32(0x7FFFFFFF));
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(fits, r), _mm_andnot_si128(fits, saturated)));
+    }
+
+    // 4 floats to 4 IEEE halves and back, same bits as half_from_f32/f32_from_half
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+    mz_force_inline void pack_half4(const f32* in, u16* out) {
+        _mm_storel_epi64((__m128i*)out, _mm_cvtps_ph(_mm_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT));
+    }
+    mz_force_inline void unpack_half4(const u16* in, f32* out) {
+        _mm_storeu_ps(out, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)in)));
+    }
+#else
+    mz_force_inline void pack_half4(const f32* in, u16* out) {
+        __m128i f = _mm_castps_si128(_mm_loadu_ps(in));
+        __m128i sign = _mm_and_si128(f, _mm_set1_epi32((s32)0x80000000));
+        __m128i a = _mm_xor_si128(f, sign);
+
+        __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3F000000));
+        __m128i odd = _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1));
+        __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a, _mm_set1_epi32((s32)0xC8000FFF)), odd), 13);
+        __m128i is_subnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), a);
+        __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+
+        __m128i is_nan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7F800000));
+        __m128i payload = _mm_and_si128(is_nan, _mm_or_si128(_mm_set1_epi32(0x200), _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(0x3FF))));
+        __m128i special = _mm_or_si128(_mm_set1_epi32(0x7C00), payload);
+        __m128i is_finite = _mm_cmpgt_epi32(_mm_set1_epi32(0x47800000), a);
+        __m128i h = _mm_or_si128(_mm_and_si128(is_finite, finite), _mm_andnot_si128(is_finite, special));
+
+        // Sign in bits 15 and up keeps every lane in s16 range for the saturating pack
+        h = _mm_or_si128(h, _mm_srai_epi32(sign, 16));
+        _mm_storel_epi64((__m128i*)out, _mm_packs_epi32(h, h));
+    }
+    mz_force_inline void unpack_half4(const u16* in, f32* out) {
+        __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)in), _mm_setzero_si128());
+        __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+        __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+        __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+        __m128i inf_nan = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(0x7F800000));
+        __m128i quiet = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7C00)), _mm_set1_epi32(0x400000));
+        _mm_storeu_ps(out, _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(_mm_or_si128(inf_nan, quiet), sign))));
+    }
+#endif
+
+    /*
+        4 floats to 4 unorm/snorm integers of storage_t (u8, s8, u16 or s16)
+        and back, with the same results as mz::unorm/mz::snorm: clamped,
+        NaN to 0, scaled in f64 and rounded half away from 0; decoding
+        divides and clamps the lowest snorm value to -1.
+    */
+    template <typename storage_t>
+    mz_force_inline void pack_norm4(const f32* in, storage_t* out) {
+        constexpr bool is_signed = std::is_signed<storage_t>::value;
+        __m128 v = _mm_loadu_ps(in);
+        v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(is_signed ? -1.f : 0.f)), _mm_set1_ps(1.f));
+        __m128d scale = _mm_set1_pd((f64)std::numeric_limits<storage_t>::max());
+        __m128d lo = _mm_mul_pd(_mm_cvtps_pd(v), scale), hi = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), scale);
+        lo = _mm_add_pd(lo, _mm_or_pd(_mm_set1_pd(0.5), _mm_and_pd(lo, _mm_set1_pd(-0.))));
+        hi = _mm_add_pd(hi, _mm_or_pd(_mm_set1_pd(0.5), _mm_and_pd(hi, _mm_set1_pd(-0.))));
+        __m128i q = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+        if constexpr (sizeof(storage_t) == 2) {
+            // No unsigned 32 -> 16 pack before SSE4.1, so bias u16 into s16 range and back
+            if constexpr (!is_signed) q = _mm_sub_epi32(q, _mm_set1_epi32(0x8000));
+            q = _mm_packs_epi32(q, q);
+            if constexpr (!is_signed) q = _mm_xor_si128(q, _mm_set1_epi16((s16)0x8000));
+            _mm_storel_epi64((__m128i*)out, q);
+        } else {
+            q = _mm_packs_epi32(q, q);
+            q = is_signed ? _mm_packs_epi16(q, q) : _mm_packus_epi16(q, q);
+            s32 bytes = _mm_cvtsi128_si32(q);
+            memcpy(out, &bytes, 4);
+        }
+    }
+    template <typename storage_t>
+    mz_force_inline void unpack_norm4(const storage_t* in, f32* out) {
+        __m128i q;
+        if constexpr (sizeof(storage_t) == 2) {
+            q = _mm_loadl_epi64((const __m128i*)in);
+            q = std::is_signed<storage_t>::value ? _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16) : _mm_unpacklo_epi16(q, _mm_setzero_si128());
+        } else {
+            s32 bytes = 0;
+            memcpy(&bytes, in, 4);
+            q = _mm_cvtsi32_si128(bytes);
+            if constexpr (std::is_signed<storage_t>::value) {
+                q = _mm_unpacklo_epi8(q, q);
+                q = _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 24);
+            } else {
+                q = _mm_unpacklo_epi16(_mm_unpacklo_epi8(q, _mm_setzero_si128()), _mm_setzero_si128());
+            }
+        }
+        __m128 v = _mm_div_ps(_mm_cvtepi32_ps(q), _mm_set1_ps((f32)std::numeric_limits<storage_t>::max()));
+        _mm_storeu_ps(out, std::is_signed<storage_t>::value ? _mm_max_ps(v, _mm_set1_ps(-1.f)) : v);
+    }
+
+    /*
+        4 RGBA8 pixels: rgb = round(rgb * a / 255), alpha unchanged. The
+        division is the exact (t + (t >> 8)) >> 8 with t = c * a + 128.
+    */
+    mz_force_inline __m128i premultiply_u16(__m128i c) {
+        // Alpha over its pixel's lanes, 255 in the alpha lane itself so it multiplies to itself
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm_or_si128(_mm_and_si128(a, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)), _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    mz_force_inline void premultiply_rgba8x4(u8* p) {
+        __m128i px = _mm_loadu_si128((const __m128i*)p);
+        __m128i lo = premultiply_u16(_mm_unpacklo_epi8(px, _mm_setzero_si128()));
+        __m128i hi = premultiply_u16(_mm_unpackhi_epi8(px, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i*)p, _mm_packus_epi16(lo, hi));
+    }
+
+#elif defined(MZ_SIMD_NEON)
+
+    typedef float32x4_t f32x4;
+
+    mz_force_inline f32x4 load(const f32* p)          { return vld1q_f32(p); }
+    mz_force_inline void  store(f32* p, f32x4 v)       { vst1q_f32(p, v); }
+    mz_force_inline f32x4 set1(f32 s)                  { return vdupq_n_f32(s); }
+    mz_force_inline f32x4 add(f32x4 a, f32x4 b)        { return vaddq_f32(a, b); }
+    mz_force_inline f32x4 sub(f32x4 a, f32x4 b)        { return vsubq_f32(a, b); }
+    mz_force_inline f32x4 mul(f32x4 a, f32x4 b)        { return vmulq_f32(a, b); }
+    mz_force_inline f32x4 div(f32x4 a, f32x4 b)        { return vdivq_f32(a, b); }
+    mz_force_inline f32x4 sqrt(f32x4 a)                { return vsqrtq_f32(a); }
+
+    // a / b in lanes where b != 0, 0 elsewhere
+    mz_force_inline f32x4 div_or_zero(f32x4 a, f32x4 b) {
+        uint32x4_t nonzero = vmvnq_u32(vceqq_f32(b, vdupq_n_f32(0.f)));
+        return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(a, b)), nonzero));
+    }
+
+    // Per lane sqrt(x * x + y * y) squared and summed in f64, then rounded
+    // to f32, same as vec2::magnitude(precise)
+    mz_force_inline f32x4 length_f64(f32x4 x, f32x4 y) {
+        float64x2_t xl = vcvt_f64_f32(vget_low_f32(x)), xh = vcvt_high_f64_f32(x);
+        float64x2_t yl = vcvt_f64_f32(vget_low_f32(y)), yh = vcvt_high_f64_f32(y);
+        float64x2_t lo = vsqrtq_f64(vaddq_f64(vmulq_f64(xl, xl), vmulq_f64(yl, yl)));
+        float64x2_t hi = vsqrtq_f64(vaddq_f64(vmulq_f64(xh, xh), vmulq_f64(yh, yh)));
+        return vcvt_high_f32_f64(vcvt_f32_f64(lo), hi);
+    }
+
+    mz_force_inline f32x4 min(f32x4 a, f32x4 b)        { return vminq_f32(a, b); }
+    mz_force_inline f32x4 max(f32x4 a, f32x4 b)        { return vmaxq_f32(a, b); }
+
+    // Comparisons give all-ones/all-zero lane masks, movemask packs
+    // their top bits into bits 0-3, select takes a where the mask is set
+    mz_force_inline f32x4 cmpge(f32x4 a, f32x4 b)      { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+    mz_force_inline f32x4 cmple(f32x4 a, f32x4 b)      { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+    mz_force_inline f32x4 cmpneq(f32x4 a, f32x4 b)     { return vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a, b))); }
+    mz_force_inline f32x4 bit_and(f32x4 a, f32x4 b) {
+        return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+    }
+    mz_force_inline f32x4 select(f32x4 m, f32x4 a, f32x4 b) { return vbslq_f32(vreinterpretq_u32_f32(m), a, b); }
+
+    // Even lanes of a then b, and odd lanes of a then b
+    mz_force_inline void unzip(f32x4 a, f32x4 b, f32x4& even, f32x4& odd) {
+        even = vuzp1q_f32(a, b);
+        odd  = vuzp2q_f32(a, b);
+    }
+    template <int i0, int i1, int i2, int i3>
+    mz_force_inline f32x4 shuffle(f32x4 a, f32x4 b) {
+#if defined(__clang__)
+        return __builtin_shufflevector(a, b, i0, i1, i2 + 4, i3 + 4);
+#else
+        f32x4 r = vdupq_n_f32(vgetq_lane_f32(a, i0));
+        r = vsetq_lane_f32(vgetq_lane_f32(a, i1), r, 1);
+        r = vsetq_lane_f32(vgetq_lane_f32(b, i2), r, 2);
+        return vsetq_lane_f32(vgetq_lane_f32(b, i3), r, 3);
+#endif
+    }
+    mz_force_inline u32 movemask(f32x4 m) {
+        static const int32_t shifts[4] = { 0, 1, 2, 3 };
+        uint32x4_t top = vshrq_n_u32(vreinterpretq_u32_f32(m), 31);
+        return vaddvq_u32(vshlq_u32(top, vld1q_s32(shifts)));
+    }
+
+    // Interleaved <-> planar for 4 consecutive vec2/vec3/vec4 of f32
+
+    mz_force_inline void load2(const f32* p, f32x4& x, f32x4& y) {
+        float32x4x2_t v = vld2q_f32(p); x = v.val[0]; y = v.val[1];
+    }
+    mz_force_inline void store2(f32* p, f32x4 x, f32x4 y) {
+        float32x4x2_t v = { { x, y } }; vst2q_f32(p, v);
+    }
+    mz_force_inline void load3(const f32* p, f32x4& x, f32x4& y, f32x4& z) {
+        float32x4x3_t v = vld3q_f32(p); x = v.val[0]; y = v.val[1]; z = v.val[2];
+    }
+    mz_force_inline void store3(f32* p, f32x4 x, f32x4 y, f32x4 z) {
+        float32x4x3_t v = { { x, y, z } }; vst3q_f32(p, v);
+    }
+    mz_force_inline void load4(const f32* p, f32x4& x, f32x4& y, f32x4& z, f32x4& w) {
+        float32x4x4_t v = vld4q_f32(p); x = v.val[0]; y = v.val[1]; z = v.val[2]; w = v.val[3];
+    }
+    mz_force_inline void store4(f32* p, f32x4 x, f32x4 y, f32x4 z, f32x4 w) {
+        float32x4x4_t v = { { x, y, z, w } }; vst4q_f32(p, v);
+    }
+
+    // ((a.x*b.x + a.y*b.y) + a.z*b.z) + a.w*b.w, same order as vec4::dot
+    mz_force_inline f32 dot4(const f32* a, const f32* b) {
+        float32x4_t m = vmulq_f32(vld1q_f32(a), vld1q_f32(b));
+        f32 s = vgetq_lane_f32(m, 0) + vgetq_lane_f32(m, 1);
+        s = s + vgetq_lane_f32(m, 2);
+        return s + vgetq_lane_f32(m, 3);
+    }
+
+    mz_force_inline f32 sqrt1(f32 s) {
+        return vget_lane_f32(vsqrt_f32(vdup_n_f32(s)), 0);
+    }
+
+    // Hardware estimate (8 bits) refined by two Newton steps
+    mz_force_inline f32 rsqrt1(f32 s) {
+        float32x2_t v = vdup_n_f32(s);
+        float32x2_t r = vrsqrte_f32(v);
+        r = vmul_f32(r, vrsqrts_f32(vmul_f32(v, r), r));
+        r = vmul_f32(r, vrsqrts_f32(vmul_f32(v, r), r));
+        return vget_lane_f32(r, 0);
+    }
+
+    // v * rsqrt(dot(v, v)) without branching, 0 for a zero vector
+    mz_force_inline void normalize4_fast(const f32* v, f32* out) {
+        float32x4_t a = vld1q_f32(v);
+        float32x4_t l2 = vdupq_n_f32(vaddvq_f32(vmulq_f32(a, a)));
+        float32x4_t r = vrsqrteq_f32(l2);
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(l2, r), r));
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(l2, r), r));
+        uint32x4_t nonzero = vmvnq_u32(vceqq_f32(l2, vdupq_n_f32(0.f)));
+        vst1q_f32(out, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_f32(a, r)), nonzero)));
+    }
+
+    // Plain mul + add rather than vmlaq/vfmaq so the rounding matches scalar
+    mz_force_inline float32x4_t linear_combine(float32x4_t a, float32x4_t b0, float32x4_t b1, float32x4_t b2, float32x4_t b3) {
+        float32x4_t r = vmulq_laneq_f32(b0, a, 0);
+        r = vaddq_f32(r, vmulq_laneq_f32(b1, a, 1));
+        r = vaddq_f32(r, vmulq_laneq_f32(b2, a, 2));
+        r = vaddq_f32(r, vmulq_laneq_f32(b3, a, 3));
+        return r;
+    }
+
+    // out = rows * v, summed column by column like mat4::multiply(vec4)
+    mz_force_inline void mat4_multiply_vec4(const f32* rows, const f32* v, f32* out) {
+        float32x4x4_t cols = vld4q_f32(rows);
+        float32x4_t vec = vld1q_f32(v);
+        float32x4_t r = vmulq_laneq_f32(cols.val[0], vec, 0);
+        r = vaddq_f32(r, vmulq_laneq_f32(cols.val[1], vec, 1));
+        r = vaddq_f32(r, vmulq_laneq_f32(cols.val[2], vec, 2));
+        r = vaddq_f32(r, vmulq_laneq_f32(cols.val[3], vec, 3));
+        vst1q_f32(out, r);
+    }
+
+    // dst = dst * rhs, one row per register. rhs may alias dst.
+    mz_force_inline void mat4_multiply(f32* dst, const f32* rhs) {
+        float32x4_t b0 = vld1q_f32(rhs + 0);
+        float32x4_t b1 = vld1q_f32(rhs + 4);
+        float32x4_t b2 = vld1q_f32(rhs + 8);
+        float32x4_t b3 = vld1q_f32(rhs + 12);
+
+        float32x4_t r0 = linear_combine(vld1q_f32(dst + 0),  b0, b1, b2, b3);
+        float32x4_t r1 = linear_combine(vld1q_f32(dst + 4),  b0, b1, b2, b3);
+        float32x4_t r2 = linear_combine(vld1q_f32(dst + 8),  b0, b1, b2, b3);
+        float32x4_t r3 = linear_combine(vld1q_f32(dst + 12), b0, b1, b2, b3);
+
+        vst1q_f32(dst + 0,  r0);
+        vst1q_f32(dst + 4,  r1);
+        vst1q_f32(dst + 8,  r2);
+        vst1q_f32(dst + 12, r3);
+    }
+
+    // Packed s32 fixed point, same results as the scalar operators in mz_fixed.hpp
+    mz_force_inline void add4_saturate(s32* dst, const s32* rhs) {
+        vst1q_s32(dst, vqaddq_s32(vld1q_s32(dst), vld1q_s32(rhs)));
+    }
+
+    mz_force_inline void subtract4_saturate(s32* dst, const s32* rhs) {
+        vst1q_s32(dst, vqsubq_s32(vld1q_s32(dst), vld1q_s32(rhs)));
+    }
+
+    // vrshrq adds the rounding half before shifting, vqmovn saturates
+    template <u32 frac_bits>
+    mz_force_inline void multiply4_fixed(s32* dst, const s32* rhs) {
+        static_assert(frac_bits >= 1 && frac_bits <= 31, "frac_bits out of range");
+        int32x4_t a = vld1q_s32(dst), b = vld1q_s32(rhs);
+        int64x2_t lo = vrshrq_n_s64(vmull_s32(vget_low_s32(a), vget_low_s32(b)), frac_bits);
+        int64x2_t hi = vrshrq_n_s64(vmull_s32(vget_high_s32(a), vget_high_s32(b)), frac_bits);
+        vst1q_s32(dst, vcombine_s32(vqmovn_s64(lo), vqmovn_s64(hi)));
+    }
+
+    mz_force_inline void pack_half4(const f32* in, u16* out) {
+        vst1_u16(out, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in))));
+    }
+    mz_force_inline void unpack_half4(const u16* in, f32* out) {
+        vst1q_f32(out, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in))));
+    }
+
+    template <typename storage_t>
+    mz_force_inline void pack_norm4(const f32* in, storage_t* out) {
+        constexpr bool is_signed = std::is_signed<storage_t>::value;
+        float32x4_t v = vld1q_f32(in);
+        v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vceqq_f32(v, v)));
+        v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(is_signed ? -1.f : 0.f)), vdupq_n_f32(1.f));
+        // vcvta rounds half away from 0 like the scalar code
+        f64 scale = (f64)std::numeric_limits<storage_t>::max();
+        int64x2_t lo = vcvtaq_s64_f64(vmulq_n_f64(vcvt_f64_f32(vget_low_f32(v)), scale));
+        int64x2_t hi = vcvtaq_s64_f64(vmulq_n_f64(vcvt_high_f64_f32(v), scale));
+        int32x4_t q = vcombine_s32(vmovn_s64(lo), vmovn_s64(hi));
+        if constexpr (sizeof(storage_t) == 2) {
+            if constexpr (is_signed) vst1_s16((s16*)out, vmovn_s32(q));
+            else                     vst1_u16((u16*)out, vmovn_u32(vreinterpretq_u32_s32(q)));
+        } else {
+            int8x8_t b = vmovn_s16(vcombine_s16(vmovn_s32(q), vmovn_s32(q)));
+            s32 bytes = vget_lane_s32(vreinterpret_s32_s8(b), 0);
+            memcpy(out, &bytes, 4);
+        }
+    }
+    template <typename storage_t>
+    mz_force_inline void unpack_norm4(const storage_t* in, f32* out) {
+        f32 v[4];
+        for (u32 i = 0; i < 4; i++)
+            v[i] = (f32)in[i];
+        float32x4_t r = vdivq_f32(vld1q_f32(v), vdupq_n_f32((f32)std::numeric_limits<storage_t>::max()));
+        vst1q_f32(out, std::is_signed<storage_t>::value ? vmaxq_f32(r, vdupq_n_f32(-1.f)) : r);
+    }
+
+    // 4 RGBA8 pixels: rgb = round(rgb * a / 255), alpha unchanged. vraddhn
+    // with the rounded shift is the exact (t + (t >> 8)) >> 8, t = c * a + 128.
+    mz_force_inline void premultiply_rgba8x4(u8* p) {
+        static const u8 alpha_lanes[16] = { 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15 };
+        static const u8 alpha_mask[16] = { 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255 };
+        uint8x16_t px = vld1q_u8(p);
+        uint8x16_t a = vbslq_u8(vld1q_u8(alpha_mask), vdupq_n_u8(255), vqtbl1q_u8(px, vld1q_u8(alpha_lanes)));
+        uint16x8_t lo = vmull_u8(vget_low_u8(px), vget_low_u8(a)), hi = vmull_high_u8(px, a);
+        vst1q_u8(p, vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8))));
+    }
+
+#else
+
+    // Scalar stand-ins so code written against the kernels compiles
+    // without a backend. vec4/mat4 never call these, they use their own
+    // scalar code when simd::accelerated is false.
+
+    struct f32x4 { f32 v[4]; };
+
+    mz_force_inline f32x4 load(const f32* p)   { return { { p[0], p[1], p[2], p[3] } }; }
+    mz_force_inline void  store(f32* p, f32x4 v) { for (u32 i = 0; i < 4; i++) p[i] = v.v[i]; }
+    mz_force_inline f32x4 set1(f32 s)           { return { { s, s, s, s } }; }
+    mz_force_inline f32x4 add(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+    mz_force_inline f32x4 sub(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+    mz_force_inline f32x4 mul(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+    mz_force_inline f32x4 div(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+    mz_force_inline f32x4 sqrt(f32x4 a)         { for (u32 i = 0; i < 4; i++) a.v[i] = std::sqrt(a.v[i]); return a; }
+
+    mz_force_inline f32x4 div_or_zero(f32x4 a, f32x4 b) {
+        for (u32 i = 0; i < 4; i++)
+            a.v[i] = b.v[i] != 0.f ? a.v[i] / b.v[i] : 0.f;
+        return a;
+    }
+
+    mz_force_inline f32x4 length_f64(f32x4 x, f32x4 y) {
+        for (u32 i = 0; i < 4; i++) x.v[i] = (f32)std::sqrt((f64)x.v[i] * (f64)x.v[i] + (f64)y.v[i] * (f64)y.v[i]);
+        return x;
+    }
+
+    mz_force_inline f32x4 min(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+    mz_force_inline f32x4 max(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+
+    // Masks are all-ones/all-zero bit patterns, like the hardware backends
+    mz_force_inline f32 lane_float(u32 bits) {
+        f32 f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    mz_force_inline u32 lane_bits(f32 f) {
+        u32 bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    mz_force_inline f32x4 cmpge(f32x4 a, f32x4 b)  { for (u32 i = 0; i < 4; i++) a.v[i] = lane_float(a.v[i] >= b.v[i] ? 0xFFFFFFFFu : 0u); return a; }
+    mz_force_inline f32x4 cmple(f32x4 a, f32x4 b)  { for (u32 i = 0; i < 4; i++) a.v[i] = lane_float(a.v[i] <= b.v[i] ? 0xFFFFFFFFu : 0u); return a; }
+    mz_force_inline f32x4 cmpneq(f32x4 a, f32x4 b) { for (u32 i = 0; i < 4; i++) a.v[i] = lane_float(a.v[i] != b.v[i] ? 0xFFFFFFFFu : 0u); return a; }
+    mz_force_inline f32x4 bit_and(f32x4 a, f32x4 b) {
+        for (u32 i = 0; i < 4; i++) a.v[i] = lane_float(lane_bits(a.v[i]) & lane_bits(b.v[i]));
+        return a;
+    }
+    mz_force_inline f32x4 select(f32x4 m, f32x4 a, f32x4 b) {
+        for (u32 i = 0; i < 4; i++) a.v[i] = lane_bits(m.v[i]) ? a.v[i] : b.v[i];
+        return a;
+    }
+
+    mz_force_inline void unzip(f32x4 a, f32x4 b, f32x4& even, f32x4& odd) {
+        even = { { a.v[0], a.v[2], b.v[0], b.v[2] } };
+        odd  = { { a.v[1], a.v[3], b.v[1], b.v[3] } };
+    }
+    template <int i0, int i1, int i2, int i3>
+    mz_force_inline f32x4 shuffle(f32x4 a, f32x4 b) { return { { a.v[i0], a.v[i1], b.v[i2], b.v[i3] } }; }
+    mz_force_inline u32 movemask(f32x4 m) {
+        u32 bits = 0;
+        for (u32 i = 0; i < 4; i++) bits |= (lane_bits(m.v[i]) >> 31) << i;
+        return bits;
+    }
+
+    mz_force_inline void load2(const f32* p, f32x4& x, f32x4& y) {
+        for (u32 i = 0; i < 4; i++) { x.v[i] = p[i * 2]; y.v[i] = p[i * 2 + 1]; }
+    }
+    mz_force_inline void store2(f32* p, f32x4 x, f32x4 y) {
+        for (u32 i = 0; i < 4; i++) { p[i * 2] = x.v[i]; p[i * 2 + 1] = y.v[i]; }
+    }
+    mz_force_inline void load3(const f32* p, f32x4& x, f32x4& y, f32x4& z) {
+        for (u32 i = 0; i < 4; i++) { x.v[i] = p[i * 3]; y.v[i] = p[i * 3 + 1]; z.v[i] = p[i * 3 + 2]; }
+    }
+    mz_force_inline void store3(f32* p, f32x4 x, f32x4 y, f32x4 z) {
+        for (u32 i = 0; i < 4; i++) { p[i * 3] = x.v[i]; p[i * 3 + 1] = y.v[i]; p[i * 3 + 2] = z.v[i]; }
+    }
+    mz_force_inline void load4(const f32* p, f32x4& x, f32x4& y, f32x4& z, f32x4& w) {
+        for (u32 i = 0; i < 4; i++) { x.v[i] = p[i * 4]; y.v[i] = p[i * 4 + 1]; z.v[i] = p[i * 4 + 2]; w.v[i] = p[i * 4 + 3]; }
+    }
+    mz_force_inline void store4(f32* p, f32x4 x, f32x4 y, f32x4 z, f32x4 w) {
+        for (u32 i = 0; i < 4; i++) { p[i * 4] = x.v[i]; p[i * 4 + 1] = y.v[i]; p[i * 4 + 2] = z.v[i]; p[i * 4 + 3] = w.v[i]; }
+    }
+
+    mz_force_inline f32 dot4(const f32* a, const f32* b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    }
+
+    mz_force_inline f32 sqrt1(f32 s) {
+        return std::sqrt(s);
+    }
+
+    mz_force_inline f32 rsqrt1(f32 s) {
+        return 1.f / std::sqrt(s);
+    }
+
+    mz_force_inline void normalize4_fast(const f32* v, f32* out) {
+        f32 l2 = dot4(v, v);
+        store(out, l2 ? mul(load(v), set1(rsqrt1(l2))) : set1(0.f));
+    }
+
+    mz_force_inline void mat4_multiply_vec4(const f32* rows, const f32* v, f32* out) {
+        f32 r[4];
+        for (u32 i = 0; i < 4; i++)
+            r[i] = dot4(rows + i * 4, v);
+        for (u32 i = 0; i < 4; i++)
+            out[i] = r[i];
+    }
+
+    mz_force_inline void mat4_multiply(f32* dst, const f32* rhs) {
+        f32 r[16];
+        for (u32 i = 0; i < 4; i++)
+            for (u32 j = 0; j < 4; j++)
+                r[i * 4 + j] = dst[i * 4 + 0] * rhs[0 + j] + dst[i * 4 + 1] * rhs[4 + j] + dst[i * 4 + 2] * rhs[8 + j] + dst[i * 4 + 3] * rhs[12 + j];
+        for (u32 i = 0; i < 16; i++)
+            dst[i] = r[i];
+    }
+
+    mz_force_inline s32 saturate_s32(s64 v) {
+        return v > 0x7FFFFFFF ? 0x7FFFFFFF : v < -(s64)0x80000000 ? (s32)0x80000000 : (s32)v;
+    }
+
+    mz_force_inline void add4_saturate(s32* dst, const s32* rhs) {
+        for (u32 i = 0; i < 4; i++)
+            dst[i] = saturate_s32((s64)dst[i] + rhs[i]);
+    }
+
+    mz_force_inline void subtract4_saturate(s32* dst, const s32* rhs) {
+        for (u32 i = 0; i < 4; i++)
+            dst[i] = saturate_s32((s64)dst[i] - rhs[i]);
+    }
+
+    template <u32 frac_bits>
+    mz_force_inline void multiply4_fixed(s32* dst, const s32* rhs) {
+        for (u32 i = 0; i < 4; i++)
+            dst[i] = saturate_s32(((s64)dst[i] * rhs[i] + ((s64)1 << (frac_bits - 1))) >> frac_bits);
+    }
+
+    mz_force_inline void pack_half4(const f32* in, u16* out) {
+        for (u32 i = 0; i < 4; i++)
+            out[i] = half_from_f32(in[i]);
+    }
+    mz_force_inline void unpack_half4(const u16* in, f32* out) {
+        for (u32 i = 0; i < 4; i++)
+            out[i] = f32_from_half(in[i]);
+    }
+
+    template <typename storage_t>
+    mz_force_inline void pack_norm4(const f32* in, storage_t* out) {
+        constexpr f64 scale = (f64)std::numeric_limits<storage_t>::max();
+        for (u32 i = 0; i < 4; i++) {
+            f64 c = in[i] > (std::is_signed<storage_t>::value ? -1.f : 0.f) ? in[i] : (std::is_signed<storage_t>::value ? -1.f : 0.f);
+            c = c < 1. ? c : 1.;
+            c = in[i] == in[i] ? c * scale : 0.;
+            out[i] = (storage_t)(s32)(c + (c < 0. ? -0.5 : 0.5));
+        }
+    }
+    template <typename storage_t>
+    mz_force_inline void unpack_norm4(const storage_t* in, f32* out) {
+        for (u32 i = 0; i < 4; i++) {
+            f32 v = (f32)in[i] / (f32)std::numeric_limits<storage_t>::max();
+            out[i] = v > -1.f ? v : -1.f;
+        }
+    }
+
+    mz_force_inline void premultiply_rgba8x4(u8* p) {
+        for (u32 i = 0; i < 16; i++) {
+            if ((i & 3) == 3) continue;
+            u32 t = (u32)p[i] * p[i | 3] + 128;
+            p[i] = (u8)((t + (t >> 8)) >> 8);
+        }
+    }
+
+#endif
+
+    mz_force_inline void add4(f32* dst, const f32* rhs)      { store(dst, add(load(dst), load(rhs))); }
+    mz_force_inline void subtract4(f32* dst, const f32* rhs) { store(dst, sub(load(dst), load(rhs))); }
+    mz_force_inline void multiply4(f32* dst, const f32* rhs) { store(dst, mul(load(dst), load(rhs))); }
+    mz_force_inline void divide4(f32* dst, const f32* rhs)   { store(dst, div(load(dst), load(rhs))); }
+
+    mz_force_inline void add4(f32* dst, f32 rhs)      { store(dst, add(load(dst), set1(rhs))); }
+    mz_force_inline void subtract4(f32* dst, f32 rhs) { store(dst, sub(load(dst), set1(rhs))); }
+    mz_force_inline void multiply4(f32* dst, f32 rhs) { store(dst, mul(load(dst), set1(rhs))); }
+    mz_force_inline void divide4(f32* dst, f32 rhs)   { store(dst, div(load(dst), set1(rhs))); }
+
+    // A mat4<f32> with every element broadcast to its own register, for
+    // transforming 4 planar vectors at a time. Each row is summed in the
+    // same order as the matching mat4::multiply overload.
+    struct mat4_broadcast {
+        f32x4 m[16];
+
+        mz_force_inline mat4_broadcast(const f32* rows) {
+            for (u32 i = 0; i < 16; i++)
+                m[i] = set1(rows[i]);
+        }
+
+        // row . (x, y, 0, 1)
+        mz_force_inline f32x4 point(u32 row, f32x4 x, f32x4 y) const {
+            const f32x4* r = m + row * 4;
+            return add(add(mul(r[0], x), mul(r[1], y)), r[3]);
+        }
+        // row . (x, y, z, 1)
+        mz_force_inline f32x4 point(u32 row, f32x4 x, f32x4 y, f32x4 z) const {
+            const f32x4* r = m + row * 4;
+            return add(add(add(mul(r[0], x), mul(r[1], y)), mul(r[2], z)), r[3]);
+        }
+        // row . (x, y, z, 0)
+        mz_force_inline f32x4 vector(u32 row, f32x4 x, f32x4 y, f32x4 z) const {
+            const f32x4* r = m + row * 4;
+            return add(add(mul(r[0], x), mul(r[1], y)), mul(r[2], z));
+        }
+        // row . (x, y, z, w)
+        mz_force_inline f32x4 full(u32 row, f32x4 x, f32x4 y, f32x4 z, f32x4 w) const {
+            const f32x4* r = m + row * 4;
+            return add(add(add(mul(r[0], x), mul(r[1], y)), mul(r[2], z)), mul(r[3], w));
+        }
+    };
+
+    // 2x2 matrices (x y / z w) in one register: a * b, adj(a) * b and a * adj(b)
+    mz_force_inline f32x4 mat2_multiply(f32x4 a, f32x4 b) {
+        return add(mul(a, shuffle<0, 3, 0, 3>(b, b)), mul(shuffle<1, 0, 3, 2>(a, a), shuffle<2, 1, 2, 1>(b, b)));
+    }
+    mz_force_inline f32x4 mat2_adj_multiply(f32x4 a, f32x4 b) {
+        return sub(mul(shuffle<3, 3, 0, 0>(a, a), b), mul(shuffle<1, 1, 2, 2>(a, a), shuffle<2, 3, 0, 1>(b, b)));
+    }
+    mz_force_inline f32x4 mat2_multiply_adj(f32x4 a, f32x4 b) {
+        return sub(mul(a, shuffle<3, 0, 3, 0>(b, b)), mul(shuffle<1, 0, 3, 2>(a, a), shuffle<2, 1, 2, 1>(b, b)));
+    }
+
+    // Writes the inverse of the 4x4 matrix m to out (which may be m) and
+    // returns the determinant. Blockwise: with m = (A B / C D) in 2x2
+    // blocks, every block of the adjugate is a few 2x2 products, ~40
+    // multiplies in total. Singular matrices write inf/NaN.
+    mz_force_inline f32 mat4_inverse(const f32* m, f32* out) {
+        const f32x4 r0 = load(m), r1 = load(m + 4), r2 = load(m + 8), r3 = load(m + 12);
+        const f32x4 a = shuffle<0, 1, 0, 1>(r0, r1), b = shuffle<2, 3, 2, 3>(r0, r1);
+        const f32x4 c = shuffle<0, 1, 0, 1>(r2, r3), d = shuffle<2, 3, 2, 3>(r2, r3);
+
+        // (|A|, |B|, |C|, |D|)
+        const f32x4 dets = sub(mul(shuffle<0, 2, 0, 2>(r0, r2), shuffle<1, 3, 1, 3>(r1, r3)),
+                               mul(shuffle<1, 3, 1, 3>(r0, r2), shuffle<0, 2, 0, 2>(r1, r3)));
+        const f32x4 det_a = shuffle<0, 0, 0, 0>(dets, dets), det_b = shuffle<1, 1, 1, 1>(dets, dets);
+        const f32x4 det_c = shuffle<2, 2, 2, 2>(dets, dets), det_d = shuffle<3, 3, 3, 3>(dets, dets);
+
+        const f32x4 dc = mat2_adj_multiply(d, c);
+        const f32x4 ab = mat2_adj_multiply(a, b);
+        f32x4 x = sub(mul(det_d, a), mat2_multiply(b, dc));
+        f32x4 w = sub(mul(det_a, d), mat2_multiply(c, ab));
+        f32x4 y = sub(mul(det_b, c), mat2_multiply_adj(d, ab));
+        f32x4 z = sub(mul(det_c, b), mat2_multiply_adj(a, dc));
+
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        f32x4 tr = mul(ab, shuffle<0, 2, 1, 3>(dc, dc));
+        tr = add(tr, shuffle<2, 3, 0, 1>(tr, tr));
+        tr = add(tr, shuffle<1, 0, 3, 2>(tr, tr));
+        const f32x4 det = sub(add(mul(det_a, det_d), mul(det_b, det_c)), tr);
+
+        static const f32 signs[4] = { 1.f, -1.f, -1.f, 1.f };
+        const f32x4 scale = div(load(signs), det);
+        x = mul(x, scale);
+        y = mul(y, scale);
+        z = mul(z, scale);
+        w = mul(w, scale);
+
+        // Transposing each adjugate block and interleaving the blocks into rows in one go
+        store(out,      shuffle<3, 1, 3, 1>(x, y));
+        store(out + 4,  shuffle<2, 0, 2, 0>(x, y));
+        store(out + 8,  shuffle<3, 1, 3, 1>(z, w));
+        store(out + 12, shuffle<2, 0, 2, 0>(z, w));
+
+        f32 lanes[4];
+        store(lanes, det);
+        return lanes[0];
+    }
+
+    mz_force_inline f32 magnitude4(const f32* v) {
+        return sqrt1(dot4(v, v));
+    }
+
+    // Divides by the magnitude rather than multiplying by its reciprocal to
+    // match vec4::normalize exactly
+    mz_force_inline void normalize4(const f32* v, f32* out) {
+        f32 mag = magnitude4(v);
+        store(out, mag ? div(load(v), set1(mag)) : set1(0.f));
+    }
+}
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+/*
+
+MIT License
+
+Copyright (c) 2020 Charlie Malmqvist (asbott https://github.com/asbott)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <new>
+#include <string.h>
+
+#include "mz_vector.hpp"
+
+namespace mz {
+
+    template <typename value_t, u32 N>
+    struct soa_aos_type;
+    template <typename value_t>
+    struct soa_aos_type<value_t, 2> { typedef vec2<value_t> type; };
+    template <typename value_t>
+    struct soa_aos_type<value_t, 3> { typedef vec3<value_t> type; };
+    template <typename value_t>
+    struct soa_aos_type<value_t, 4> { typedef vec4<value_t> type; };
+
+    /*
+        Structure-of-arrays storage for N-component vectors. Every component
+        lives in its own stream, and each stream is aligned to soa_alignment
+        and padded to a multiple of soa_padding elements so bulk kernels can
+        run whole SIMD registers without a scalar tail. Padding lanes hold
+        garbage after bulk operations; only [0, size()) is meaningful.
+
+        Bulk operations mirror the vec2/vec3/vec4 member functions, applied
+        element-wise across the whole container.
+    */
+    constexpr size_t soa_alignment = 32;
+    constexpr size_t soa_padding   = 8;
+
+    template <typename value_t, u32 N>
+    struct MZ_API soa_vec {
+        static_assert(N >= 2 && N <= 4, "mz::soa_vec: only 2, 3 and 4 components are supported");
+
+        typedef value_t value_type;
+        typedef soa_vec<value_t, N> soa_type;
+        typedef typename soa_aos_type<value_t, N>::type aos_type;
+
+        static constexpr u32 components = N;
+
+        soa_vec() : _data(NULL), _count(0), _capacity(0) {}
+        explicit soa_vec(size_t count) : soa_vec() {
+            resize(count);
+        }
+        soa_vec(span<const aos_type> aos) : soa_vec() {
+            from_aos(aos);
+        }
+        soa_vec(const soa_type& src) : soa_vec() {
+            *this = src;
+        }
+        soa_vec(soa_type&& src) : _data(src._data), _count(src._count), _capacity(src._capacity) {
+            src._data = NULL;
+            src._count = src._capacity = 0;
+        }
+        ~soa_vec() {
+            release();
+        }
+
+        soa_type& operator=(const soa_type& src) {
+            if (this == &src) return *this;
+            resize(src._count);
+            for (u32 c = 0; c < N; c++)
+                memcpy(stream(c), src.stream(c), _count * sizeof(value_t));
+            return *this;
+        }
+        soa_type& operator=(soa_type&& src) {
+            if (this == &src) return *this;
+            release();
+            _data = src._data;
+            _count = src._count;
+            _capacity = src._capacity;
+            src._data = NULL;
+            src._count = src._capacity = 0;
+            return *this;
+        }
+
+        mz_force_inline size_t size() const     { return _count; }
+        mz_force_inline size_t capacity() const { return _capacity; }
+        mz_force_inline bool   empty() const    { return _count == 0; }
+
+        // Stream c holds component c of every element
+        mz_force_inline value_t*       stream(u32 c)       { return _data + c * _capacity; }
+        mz_force_inline const value_t* stream(u32 c) const { return _data + c * _capacity; }
+
+        mz_force_inline value_t*       x()       { return stream(0); }
+        mz_force_inline const value_t* x() const { return stream(0); }
+        mz_force_inline value_t*       y()       { return stream(1); }
+        mz_force_inline const value_t* y() const { return stream(1); }
+        mz_force_inline value_t*       z()       { static_assert(N >= 3, "mz::soa_vec: no z stream"); return stream(2); }
+        mz_force_inline const value_t* z() const { static_assert(N >= 3, "mz::soa_vec: no z stream"); return stream(2); }
+        mz_force_inline value_t*       w()       { static_assert(N >= 4, "mz::soa_vec: no w stream"); return stream(3); }
+        mz_force_inline const value_t* w() const { static_assert(N >= 4, "mz::soa_vec: no w stream"); return stream(3); }
+
+        void reserve(size_t count) {
+            if (count <= _capacity) return;
+
+            size_t capacity = (count + soa_padding - 1) / soa_padding * soa_padding;
+            value_t* data = (value_t*)::operator new(capacity * N * sizeof(value_t), std::align_val_t(soa_alignment));
+            memset(data, 0, capacity * N * sizeof(value_t));
+
+            if (_data) {
+                for (u32 c = 0; c < N; c++)
+                    memcpy(data + c * capacity, stream(c), _count * sizeof(value_t));
+                ::operator delete(_data, std::align_val_t(soa_alignment));
+            }
+
+            _data = data;
+            _capacity = capacity;
+        }
+        // New elements are zero, whether or not the storage grows
+        void resize(size_t count) {
+            if (count > _capacity) {
+                reserve(count > _capacity * 2 ? count : _capacity * 2);
+            } else if (count > _count) {
+                for (u32 c = 0; c < N; c++)
+                    memset(stream(c) + _count, 0, (count - _count) * sizeof(value_t));
+            }
+            _count = count;
+        }
+        void clear() {
+            _count = 0;
+        }
+
+        void push_back(const aos_type& v) {
+            resize(_count + 1);
+            set(_count - 1, v);
+        }
+
+        mz_force_inline aos_type get(size_t i) const {
+            aos_type v;
+            for (u32 c = 0; c < N; c++)
+                v.ptr[c] = stream(c)[i];
+            return v;
+        }
+        mz_force_inline void set(size_t i, const aos_type& v) {
+            for (u32 c = 0; c < N; c++)
+                stream(c)[i] = v.ptr[c];
+        }
+
+        // Replaces the contents with the interleaved vectors in aos
+        void from_aos(span<const aos_type> aos) {
+            resize(aos.size());
+            for (u32 c = 0; c < N; c++) {
+                value_t* s = stream(c);
+                for (size_t i = 0; i < aos.size(); i++)
+                    s[i] = aos[i].ptr[c];
+            }
+        }
+        // Writes the first min(aos.size(), size()) elements back out interleaved
+        void to_aos(span<aos_type> aos) const {
+            size_t n = aos.size() < _count ? aos.size() : _count;
+            for (u32 c = 0; c < N; c++) {
+                const value_t* s = stream(c);
+                for (size_t i = 0; i < n; i++)
+                    aos[i].ptr[c] = s[i];
+            }
+        }
+
+        soa_type& add(const soa_type& rhs)      { return apply(rhs, op_add()); }
+        soa_type& subtract(const soa_type& rhs) { return apply(rhs, op_sub()); }
+        soa_type& multiply(const soa_type& rhs) { return apply(rhs, op_mul()); }
+        soa_type& divide(const soa_type& rhs)   { return apply(rhs, op_div()); }
+
+        soa_type& add(const aos_type& rhs)      { return apply(rhs, op_add()); }
+        soa_type& subtract(const aos_type& rhs) { return apply(rhs, op_sub()); }
+        soa_type& multiply(const aos_type& rhs) { return apply(rhs, op_mul()); }
+        soa_type& divide(const aos_type& rhs)   { return apply(rhs, op_div()); }
+
+        soa_type& add(value_t rhs)      { return apply(aos_type(rhs), op_add()); }
+        soa_type& subtract(value_t rhs) { return apply(aos_type(rhs), op_sub()); }
+        soa_type& multiply(value_t rhs) { return apply(aos_type(rhs), op_mul()); }
+        soa_type& divide(value_t rhs)   { return apply(aos_type(rhs), op_div()); }
+
+        // out[i] = get(i).dot(rhs.get(i)), for the elements out, *this and rhs all have
+        void dot(const soa_type& rhs, span<value_t> out) const {
+            size_t n = out.size() < _count ? out.size() : _count;
+            n = n < rhs._count ? n : rhs._count;
+            if constexpr (simd::accelerated<value_t>) {
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4)
+                    simd::store(out.ptr + i, dot_lanes(*this, rhs, i));
+                for (; i < n; i++)
+                    out[i] = get(i).dot(rhs.get(i));
+            } else {
+                for (size_t i = 0; i < n; i++)
+                    out[i] = get(i).dot(rhs.get(i));
+            }
+        }
+
+        // out[i] = get(i).magnitude(precise)
+        void magnitude(span<value_t> out) const {
+            size_t n = out.size() < _count ? out.size() : _count;
+            if constexpr (simd::accelerated<value_t>) {
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4)
+                    simd::store(out.ptr + i, magnitude_lanes(i));
+                for (; i < n; i++)
+                    out[i] = get(i).magnitude(precise);
+            } else {
+                for (size_t i = 0; i < n; i++)
+                    out[i] = get(i).magnitude();
+            }
+        }
+
+        // Normalizes every element in place, zero vectors stay zero
+        soa_type& normalize() {
+            if constexpr (simd::accelerated<value_t>) {
+                for (size_t i = 0; i < _capacity; i += 4) {
+                    simd::f32x4 mag = magnitude_lanes(i);
+                    for (u32 c = 0; c < N; c++)
+                        simd::store(stream(c) + i, simd::div_or_zero(simd::load(stream(c) + i), mag));
+                }
+            } else {
+                for (size_t i = 0; i < _count; i++)
+                    set(i, get(i).normalize());
+            }
+            return *this;
+        }
+
+        // out[i] = get(i).cross(rhs.get(i)), out is resized to the shorter of *this and rhs
+        void cross(const soa_type& rhs, soa_type& out) const {
+            static_assert(N == 3, "mz::soa_vec: cross is only defined for 3 components");
+            size_t n = _count < rhs._count ? _count : rhs._count;
+            out.resize(n);
+            const value_t* ax = x(); const value_t* ay = y(); const value_t* az = z();
+            const value_t* bx = rhs.x(); const value_t* by = rhs.y(); const value_t* bz = rhs.z();
+            value_t* ox = out.x(); value_t* oy = out.y(); value_t* oz = out.z();
+
+            if constexpr (simd::accelerated<value_t>) {
+                for (size_t i = 0; i < n; i += 4) {
+                    simd::f32x4 x0 = simd::load(ax + i), y0 = simd::load(ay + i), z0 = simd::load(az + i);
+                    simd::f32x4 x1 = simd::load(bx + i), y1 = simd::load(by + i), z1 = simd::load(bz + i);
+                    simd::f32x4 cx = simd::sub(simd::mul(y0, z1), simd::mul(z0, y1));
+                    simd::f32x4 cy = simd::sub(simd::mul(z0, x1), simd::mul(x0, z1));
+                    simd::f32x4 cz = simd::sub(simd::mul(x0, y1), simd::mul(y0, x1));
+                    simd::store(ox + i, cx);
+                    simd::store(oy + i, cy);
+                    simd::store(oz + i, cz);
+                }
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    value_t cx = ay[i] * bz[i] - az[i] * by[i];
+                    value_t cy = az[i] * bx[i] - ax[i] * bz[i];
+                    value_t cz = ax[i] * by[i] - ay[i] * bx[i];
+                    ox[i] = cx;
+                    oy[i] = cy;
+                    oz[i] = cz;
+                }
+            }
+        }
+
+    private:
+        value_t* _data;
+        size_t _count;
+        size_t _capacity;
+
+        void release() {
+            if (_data) ::operator delete(_data, std::align_val_t(soa_alignment));
+            _data = NULL;
+            _count = _capacity = 0;
+        }
+
+        struct op_add { template <typename T> mz_force_inline T operator()(T a, T b) const { return a + b; } mz_force_inline simd::f32x4 operator()(simd::f32x4 a, simd::f32x4 b) const { return simd::add(a, b); } };
+        struct op_sub { template <typename T> mz_force_inline T operator()(T a, T b) const { return a - b; } mz_force_inline simd::f32x4 operator()(simd::f32x4 a, simd::f32x4 b) const { return simd::sub(a, b); } };
+        struct op_mul { template <typename T> mz_force_inline T operator()(T a, T b) const { return a * b; } mz_force_inline simd::f32x4 operator()(simd::f32x4 a, simd::f32x4 b) const { return simd::mul(a, b); } };
+        struct op_div { template <typename T> mz_force_inline T operator()(T a, T b) const { return a / b; } mz_force_inline simd::f32x4 operator()(simd::f32x4 a, simd::f32x4 b) const { return simd::div(a, b); } };
+
+        // Element-wise ops run over the full padded capacity when using SIMD
+        // so there's no tail. If rhs is shorter only its elements are applied.
+        template <typename op_t>
+        mz_force_inline soa_type& apply(const soa_type& rhs, op_t op) {
+            size_t count = _count < rhs._count ? _count : rhs._count;
+            for (u32 c = 0; c < N; c++) {
+                value_t* dst = stream(c);
+                const value_t* src = rhs.stream(c);
+                size_t i = 0;
+                if constexpr (simd::accelerated<value_t>) {
+                    size_t n = count < _count ? count & ~(size_t)3 : (_capacity < rhs._capacity ? _capacity : rhs._capacity);
+                    for (; i < n; i += 4)
+                        simd::store(dst + i, op(simd::load(dst + i), simd::load(src + i)));
+                }
+                for (; i < count; i++)
+                    dst[i] = (value_t)op(dst[i], src[i]);
+            }
+            return *this;
+        }
+        template <typename op_t>
+        mz_force_inline soa_type& apply(const aos_type& rhs, op_t op) {
+            for (u32 c = 0; c < N; c++) {
+                value_t* dst = stream(c);
+                value_t s = rhs.ptr[c];
+                if constexpr (simd::accelerated<value_t>) {
+                    simd::f32x4 s4 = simd::set1(s);
+                    for (size_t i = 0; i < _capacity; i += 4)
+                        simd::store(dst + i, op(simd::load(dst + i), s4));
+                } else {
+                    for (size_t i = 0; i < _count; i++)
+                        dst[i] = (value_t)op(dst[i], s);
+                }
+            }
+            return *this;
+        }
+
+        // Per-lane magnitude of elements [i, i + 4), summed in f64 for 2
+        // components like vec2::magnitude(precise), in f32 like vec3/vec4
+        mz_force_inline simd::f32x4 magnitude_lanes(size_t i) const {
+            if constexpr (N == 2) {
+                return simd::length_f64(simd::load(stream(0) + i), simd::load(stream(1) + i));
+            } else {
+                return simd::sqrt(dot_lanes(*this, *this, i));
+            }
+        }
+
+        // Per-lane dot product of elements [i, i + 4), summed in the same
+        // order as vecN::dot so results match the AoS types exactly
+        static mz_force_inline simd::f32x4 dot_lanes(const soa_type& a, const soa_type& b, size_t i) {
+            simd::f32x4 sum = simd::mul(simd::load(a.stream(0) + i), simd::load(b.stream(0) + i));
+            for (u32 c = 1; c < N; c++)
+                sum = simd::add(sum, simd::mul(simd::load(a.stream(c) + i), simd::load(b.stream(c) + i)));
+            return sum;
+        }
+    };
+
+    template <typename value_t>
+    using soa_vec2 = soa_vec<value_t, 2>;
+    template <typename value_t>
+    using soa_vec3 = soa_vec<value_t, 3>;
+    template <typename value_t>
+    using soa_vec4 = soa_vec<value_t, 4>;
+
+    typedef soa_vec2<f32> soa_fvec2;
+    typedef soa_vec3<f32> soa_fvec3;
+    typedef soa_vec4<f32> soa_fvec4;
+    typedef soa_vec2<f64> soa_dvec2;
+    typedef soa_vec3<f64> soa_dvec3;
+    typedef soa_vec4<f64> soa_dvec4;
+    typedef soa_vec2<s32> soa_ivec2;
+    typedef soa_vec3<s32> soa_ivec3;
+    typedef soa_vec4<s32> soa_ivec4;
+}
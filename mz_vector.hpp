@@ -27,6 +27,8 @@ SOFTWARE.
 */
 
 #include "mz_common.hpp"
+#include "mz_math.hpp"
+#include "mz_simd.hpp"
 
 #define __d_p(x) std::fixed << std::setprecision(x)
 
@@ -138,6 +140,12 @@ namespace mz {
     typedef range<f32> frange;
     typedef range<s32> irange;
 
+    // Expression nodes from mz_expr.hpp, which the eager operators leave to mz_expr
+    template <typename value_t, typename = void>
+    struct is_expression : std::false_type {};
+    template <typename value_t>
+    struct is_expression<value_t, typename std::enable_if<std::is_void<typename value_t::expression_tag>::value>::type> : std::true_type {};
+
     template <typename value_t = default_value_t>
     struct MZ_API vec2 {
         typedef value_t       value_type;
@@ -170,22 +178,51 @@ namespace mz {
         }
 
         constexpr mz_force_inline value_t magnitude() const {
-            return (value_t)sqrt((f64)x * (f64)x + (f64)y * (f64)y);
+            return magnitude(default_precision);
+        }
+        // Summed in f64 so large components neither overflow nor lose precision
+        constexpr mz_force_inline value_t magnitude(precise_t) const {
+            if constexpr (scalar_traits<value_t>::custom) {
+                return math::length(x, y);
+            } else {
+                return (value_t)math::sqrt((f64)x * (f64)x + (f64)y * (f64)y);
+            }
+        }
+        constexpr mz_force_inline value_t magnitude(fast_t) const {
+            if constexpr (std::is_floating_point<value_t>::value) {
+                return math::sqrt(x * x + y * y);
+            } else {
+                return magnitude(precise);
+            }
         }
         constexpr mz_force_inline value_t average() const {
             return (x + y) / (value_t)2;
         }
         constexpr mz_force_inline vec_type normalize() const {
-            value_t mag = magnitude();
+            return normalize(default_precision);
+        }
+        constexpr mz_force_inline vec_type normalize(precise_t) const {
+            value_t mag = magnitude(precise);
             return mag ? vec_type(x / mag, y / mag) : vec_type(0);
         }
+        // Multiplies by math::rsqrt of the squared magnitude
+        constexpr mz_force_inline vec_type normalize(fast_t) const {
+            if constexpr (std::is_floating_point<value_t>::value) {
+                value_t l2 = x * x + y * y;
+                if (!l2) return vec_type(0);
+                value_t inv = math::rsqrt(l2, fast);
+                return vec_type(x * inv, y * inv);
+            } else {
+                return normalize(precise);
+            }
+        }
         constexpr mz_force_inline vec_type abs() const {
             return vec_type(x < (value_t)0 ? x * (value_t)-1 : x, y < (value_t)0 ? y * (value_t)-1 : y);
         }
         constexpr mz_force_inline value_t distance(const vec_type& rhs) const {
             value_t a = x - rhs.x;
             value_t b = y - rhs.y;
-            return sqrt(a * a + b * b);
+            return (value_t)math::length(a, b);
         }
         constexpr mz_force_inline value_t dot(const vec_type& rhs) const {
             return x * rhs.x + y * rhs.y;
@@ -260,28 +297,28 @@ namespace mz {
             return vec_type(-x, -y);
         }
 
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator+(vec_type lhs, const rhs_candidate_t& rhs) {
             if constexpr (std::is_convertible<rhs_candidate_t, value_t>())
                 return lhs.add((value_t)rhs);
             else 
                 return lhs.add((vec_type)rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator-(vec_type lhs, const rhs_candidate_t& rhs) {
             if constexpr (std::is_convertible<rhs_candidate_t, value_t>())
                 return lhs.subtract((value_t)rhs);
             else 
                 return lhs.subtract((vec_type)rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator*(vec_type lhs, const rhs_candidate_t& rhs) {
             if constexpr (std::is_convertible<rhs_candidate_t, value_t>())
                 return lhs.multiply((value_t)rhs);
             else 
                 return lhs.multiply((vec_type)rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator/(vec_type lhs, const rhs_candidate_t& rhs) {
             if constexpr (std::is_convertible<rhs_candidate_t, value_t>())
                 return lhs.divide((value_t)rhs);
@@ -363,8 +400,27 @@ namespace mz {
         }
 
         template <typename angle_t>
-        static inline vec_type from_angle(angle_t angle) {
-            return { (value_t)std::cos((f64)angle), (value_t)std::sin((f64)angle) };
+        static constexpr mz_force_inline vec_type from_angle(angle_t angle) {
+            return from_angle(angle, default_precision);
+        }
+        template <typename angle_t>
+        static constexpr mz_force_inline vec_type from_angle(angle_t angle, precise_t) {
+            if constexpr (scalar_traits<value_t>::custom) {
+                value_t s = 0, c = 0;
+                math::sincos((value_t)angle, s, c, precise);
+                return { c, s };
+            } else {
+                f64 s = 0, c = 0;
+                math::sincos((f64)angle, s, c, precise);
+                return { (value_t)c, (value_t)s };
+            }
+        }
+        // Evaluated in value_t rather than f64, so fvec2 gets the fast f32 kernel
+        template <typename angle_t>
+        static constexpr mz_force_inline vec_type from_angle(angle_t angle, fast_t) {
+            math::result_t<value_t> s = 0, c = 0;
+            math::sincos((math::result_t<value_t>)angle, s, c, fast);
+            return { (value_t)c, (value_t)s };
         }
     };
 
@@ -375,7 +431,7 @@ namespace mz {
 
         static constexpr value_t zero = (value_t)0;
 
-        constexpr mz_force_inline vec3() : x(zero), y(zero) {}
+        constexpr mz_force_inline vec3() : x(zero), y(zero), z(zero) {}
         template <typename value_x_t, typename value_y_t, typename value_z_t>
         constexpr mz_force_inline vec3(value_x_t x, value_y_t y, value_z_t z) : x((value_t)x), y((value_t)y), z((value_t)z) {}
         template <typename rhs_value_t>
@@ -410,15 +466,38 @@ namespace mz {
         }
 
         constexpr mz_force_inline value_t magnitude() const {
-            return sqrt(x * x + y * y + z * z);
+            return (value_t)math::length(x, y, z);
+        }
+        // Already computed in value_t, and a square root costs about as much
+        // as the rsqrt estimate, so fast is the same as precise here. The
+        // tags are accepted for generic code.
+        constexpr mz_force_inline value_t magnitude(precise_t) const {
+            return magnitude();
+        }
+        constexpr mz_force_inline value_t magnitude(fast_t) const {
+            return magnitude();
         }
         constexpr mz_force_inline value_t average() const {
             return (x + y + z) / (value_t)3;
         }
         constexpr mz_force_inline vec_type normalize() const {
+            return normalize(default_precision);
+        }
+        constexpr mz_force_inline vec_type normalize(precise_t) const {
             value_t mag = magnitude();
             return mag ? vec_type(x / mag, y / mag, z / mag) : vec_type(0);
         }
+        // Multiplies by math::rsqrt of the squared magnitude
+        constexpr mz_force_inline vec_type normalize(fast_t) const {
+            if constexpr (std::is_floating_point<value_t>::value) {
+                value_t l2 = x * x + y * y + z * z;
+                if (!l2) return vec_type(0);
+                value_t inv = math::rsqrt(l2, fast);
+                return vec_type(x * inv, y * inv, z * inv);
+            } else {
+                return normalize(precise);
+            }
+        }
         constexpr mz_force_inline vec_type abs() const {
             return vec_type(x < (value_t)0 ? x * (value_t)-1 : x, y < (value_t)0 ? y * (value_t)-1 : y, z < (value_t)0 ? z * (value_t)-1 : z);
         }
@@ -426,7 +505,7 @@ namespace mz {
             value_t a = x - rhs.x;
             value_t b = y - rhs.y;
             value_t c = z - rhs.z;
-            return sqrt(a * a + b * b + c * c);
+            return (value_t)math::length(a, b, c);
         }
         constexpr mz_force_inline value_t dot(const vec_type& rhs) const {
             return x * rhs.x + y * rhs.y + z * rhs.z;
@@ -513,19 +592,19 @@ namespace mz {
             return vec_type(-x, -y, -z);
         }
 
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator+(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.add(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator-(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.subtract(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator*(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.multiply(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator/(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.divide(rhs);
         }
@@ -634,7 +713,19 @@ namespace mz {
         }
 
         constexpr mz_force_inline value_t magnitude() const {
-            return sqrt(x * x + y * y + z * z + w * w);
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) return simd::magnitude4(ptr);
+            }
+            return (value_t)math::length(x, y, z, w);
+        }
+        // Already computed in value_t, and a square root costs about as much
+        // as the rsqrt estimate, so fast is the same as precise here. The
+        // tags are accepted for generic code.
+        constexpr mz_force_inline value_t magnitude(precise_t) const {
+            return magnitude();
+        }
+        constexpr mz_force_inline value_t magnitude(fast_t) const {
+            return magnitude();
         }
         constexpr mz_force_inline value_t average() const {
             return (x + y + z + w) / (value_t)4;
@@ -643,9 +734,37 @@ namespace mz {
             return vec2<value_t>{ z - (z - x) / 2.f, w - (w - y) / 2.f };
         }
         constexpr mz_force_inline vec_type normalize() const {
+            return normalize(default_precision);
+        }
+        constexpr mz_force_inline vec_type normalize(precise_t) const {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    vec_type result;
+                    simd::normalize4(ptr, result.ptr);
+                    return result;
+                }
+            }
             value_t mag = magnitude();
             return mag ? vec_type(x / mag, y / mag, z / mag, w / mag) : vec_type(0);
         }
+        // Multiplies by math::rsqrt of the squared magnitude
+        constexpr mz_force_inline vec_type normalize(fast_t) const {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    vec_type result;
+                    simd::normalize4_fast(ptr, result.ptr);
+                    return result;
+                }
+            }
+            if constexpr (std::is_floating_point<value_t>::value) {
+                value_t l2 = x * x + y * y + z * z + w * w;
+                if (!l2) return vec_type(0);
+                value_t inv = math::rsqrt(l2, fast);
+                return vec_type(x * inv, y * inv, z * inv, w * inv);
+            } else {
+                return normalize(precise);
+            }
+        }
         constexpr mz_force_inline vec_type abs() const {
             return vec_type(x < (value_t)0 ? x * (value_t)-1 : x, y < (value_t)0 ? y * (value_t)-1 : y, z < (value_t)0 ? z * (value_t)-1 : z, w < (value_t)0 ? w * (value_t)-1 : w);
         }
@@ -654,9 +773,12 @@ namespace mz {
             value_t b = y - rhs.y;
             value_t c = z - rhs.z;
             value_t d = w - rhs.w;
-            return sqrt(a * a + b * b + c * c + d * d);
+            return (value_t)math::length(a, b, c, d);
         }
         constexpr mz_force_inline value_t dot(const vec_type& rhs) const {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) return simd::dot4(ptr, rhs.ptr);
+            }
             return x * rhs.x + y * rhs.y + z * rhs.z + w * rhs.w;
         }
 
@@ -666,6 +788,18 @@ namespace mz {
                 vec_type as_same_type = (vec_type)rhs;
                 return add(as_same_type);
             } else {
+                if constexpr (simd::accelerated<value_t>) {
+                    if (!mz_is_constant_evaluated()) {
+                        simd::add4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
+                if constexpr (scalar_traits<value_t>::packed4) {
+                    if (!mz_is_constant_evaluated()) {
+                        scalar_traits<value_t>::add4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
                 x += rhs.x;
                 y += rhs.y;
                 z += rhs.z;
@@ -679,6 +813,18 @@ namespace mz {
                 vec_type as_same_type = (vec_type)rhs;
                 return subtract(as_same_type);
             } else {
+                if constexpr (simd::accelerated<value_t>) {
+                    if (!mz_is_constant_evaluated()) {
+                        simd::subtract4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
+                if constexpr (scalar_traits<value_t>::packed4) {
+                    if (!mz_is_constant_evaluated()) {
+                        scalar_traits<value_t>::subtract4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
                 x -= rhs.x;
                 y -= rhs.y;
                 z -= rhs.z;
@@ -692,6 +838,18 @@ namespace mz {
                 vec_type as_same_type = (vec_type)rhs;
                 return multiply(as_same_type);
             } else {
+                if constexpr (simd::accelerated<value_t>) {
+                    if (!mz_is_constant_evaluated()) {
+                        simd::multiply4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
+                if constexpr (scalar_traits<value_t>::packed4) {
+                    if (!mz_is_constant_evaluated()) {
+                        scalar_traits<value_t>::multiply4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
                 x *= rhs.x;
                 y *= rhs.y;
                 z *= rhs.z;
@@ -705,6 +863,12 @@ namespace mz {
                 vec_type as_same_type = (vec_type)rhs;
                 return divide(as_same_type);
             } else {
+                if constexpr (simd::accelerated<value_t>) {
+                    if (!mz_is_constant_evaluated()) {
+                        simd::divide4(ptr, rhs.ptr);
+                        return *this;
+                    }
+                }
                 x /= rhs.x;
                 y /= rhs.y;
                 z /= rhs.z;
@@ -713,6 +877,12 @@ namespace mz {
             }
         }
         constexpr mz_force_inline vec_type& add(value_t rhs) {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    simd::add4(ptr, rhs);
+                    return *this;
+                }
+            }
             x += rhs;
             y += rhs;
             z += rhs;
@@ -720,6 +890,12 @@ namespace mz {
             return *this;
         }
         constexpr mz_force_inline vec_type& subtract(value_t rhs) {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    simd::subtract4(ptr, rhs);
+                    return *this;
+                }
+            }
             x -= rhs;
             y -= rhs;
             z -= rhs;
@@ -727,6 +903,12 @@ namespace mz {
             return *this;
         }
         constexpr mz_force_inline vec_type& multiply(value_t rhs) {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    simd::multiply4(ptr, rhs);
+                    return *this;
+                }
+            }
             x *= rhs;
             y *= rhs;
             z *= rhs;
@@ -734,6 +916,12 @@ namespace mz {
             return *this;
         }
         constexpr mz_force_inline vec_type& divide(value_t rhs) {
+            if constexpr (simd::accelerated<value_t>) {
+                if (!mz_is_constant_evaluated()) {
+                    simd::divide4(ptr, rhs);
+                    return *this;
+                }
+            }
             x /= rhs;
             y /= rhs;
             z /= rhs;
@@ -745,19 +933,19 @@ namespace mz {
             return vec_type(-x, -y, -z, -w);
         }
 
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator+(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.add(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator-(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.subtract(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator*(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.multiply(rhs);
         }
-        template <typename rhs_candidate_t>
+        template <typename rhs_candidate_t, typename = typename std::enable_if<!is_expression<rhs_candidate_t>::value>::type>
         constexpr mz_force_inline friend vec_type operator/(vec_type lhs, const rhs_candidate_t& rhs) {
             return lhs.divide(rhs);
         }
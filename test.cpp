@@ -1,8 +1,1427 @@
 #include "mz_vector.hpp"
 #include "mz_matrix.hpp"
+#include "mz_matrix2d.hpp"
+#include "mz_soa.hpp"
+#include "mz_expr.hpp"
+#include "mz_fixed.hpp"
+#include "mz_packed.hpp"
+#include "mz_color.hpp"
+#include "mz_frustum.hpp"
+#include "mz_parallel.hpp"
+#include "mz_hierarchy.hpp"
+#include "mz_hashmap.hpp"
+#include "mz_morton.hpp"
+#include "mz_algorithms.hpp"
+#include "mz_broadphase.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <ostream>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    std::cout << "FAILED: " << what << "\n";
+    failures++;
+}
+
+// mat4, transformation:: and projection:: in constant expressions. Any of
+// them losing constexpr breaks the build here.
+constexpr mz::fmat4 constexpr_ui = mz::projection::ortho(0.f, 1280.f, 0.f, 720.f, -1.f, 1.f);
+constexpr mz::fmat4 constexpr_camera = mz::projection::perspective(1.2f, 16.f / 9.f, .1f, 100.f) *
+                                       mz::projection::look_at(mz::fvec3(3, 4, 5), mz::fvec3(0), mz::fvec3(0, 1, 0));
+constexpr mz::fmat4 constexpr_model = mz::transformation::trs(mz::fvec3(1, 2, 3), mz::fvec3(0.f, 1.5707963f, 0.f), mz::fvec3(2, 2, 2)) * constexpr_ui;
+constexpr mz::fmat4 constexpr_chain = mz::transformation::translation(mz::fvec3(5, 6, 7)).rotate(0.5f, mz::fvec3(0, 0, 1)).scale(mz::fvec3(1, 0, 0));
+constexpr mz::fmat4 constexpr_inverse = [] {
+    mz::fmat4 m = mz::transformation::translation(mz::fvec3(5, 6, 7));
+    m.invert();
+    return m;
+}();
+static_assert(constexpr_ui.rows[0].x == 2.f / 1280.f && constexpr_ui.rows[1].w == -1.f && constexpr_ui.rows[3].w == 1.f, "constexpr ortho");
+static_assert(constexpr_camera.rows[3].z < 0.f && constexpr_camera.rows[3].w > 0.f, "constexpr perspective * look_at");
+constexpr bool constexpr_near(mz::f32 a, mz::f32 b) { return a - b < 1e-6f && b - a < 1e-6f; }
+static_assert(constexpr_near(constexpr_model.rows[0].w, 1.f) && constexpr_near(constexpr_model.rows[2].x, -4.f / 1280.f) &&
+              constexpr_near(constexpr_model.rows[2].w, 5.f), "constexpr trs * ortho");
+static_assert(constexpr_chain.rows[0].w == 5.f && constexpr_chain.rows[0].x > 1.75f && constexpr_chain.rows[2].z == 1.f, "constexpr translate/rotate/scale");
+static_assert(constexpr_near(mz::math::acos(.5f), 1.04719755f) && mz::math::acos(1.f) == 0.f && constexpr_near(mz::math::acos(-1.f), 3.14159265f), "constexpr acos");
+static_assert(constexpr_inverse.rows[0].w == -5.f && constexpr_inverse.rows[2].w == -7.f && constexpr_inverse.determinant() == 1.f, "constexpr invert");
+
+// Distance between two floats in units in the last place
+static mz::u32 ulp_distance(mz::f32 a, mz::f32 b) {
+    mz::s32 ia = 0, ib = 0;
+    std::memcpy(&ia, &a, 4);
+    std::memcpy(&ib, &b, 4);
+    const mz::s64 oa = ia < 0 ? (mz::s64)INT32_MIN - ia : ia, ob = ib < 0 ? (mz::s64)INT32_MIN - ib : ib;
+    return (mz::u32)std::min<mz::s64>(oa > ob ? oa - ob : ob - oa, UINT32_MAX);
+}
+
+// SIMD results against the scalar code written out in the same order. Only
+// meaningful when built with -DMZ_SIMD; without it both sides are scalar.
+static void test_simd() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<mz::f32> unit(-1.f, 1.f);
+    auto random_vec = [&]() { return mz::fvec4(unit(rng), unit(rng), unit(rng), unit(rng)) * 100.f; };
+    auto close = [](mz::f32 a, mz::f32 b) { return ulp_distance(a, b) <= mz::simd::tolerance_ulp; };
+    // Sums of products are measured against the sum of the absolute products, see tolerance_ulp
+    auto close_sum = [](mz::f32 a, mz::f32 b, const mz::fvec4& lhs, const mz::fvec4& rhs) {
+        const mz::f32 terms = std::abs(lhs.x * rhs.x) + std::abs(lhs.y * rhs.y) + std::abs(lhs.z * rhs.z) + std::abs(lhs.w * rhs.w);
+        return std::abs(a - b) <= mz::simd::tolerance_ulp * std::numeric_limits<mz::f32>::epsilon() * terms;
+    };
+
+    int bad = 0;
+    for (int i = 0; i < 10000; i++) {
+        const mz::fvec4 a = random_vec(), b = random_vec();
+        const mz::fvec4 sum = a + b, difference = a - b, product = a * b, quotient = a / b, scaled = a * b.x;
+        for (mz::u32 c = 0; c < 4; c++)
+            bad += !close(sum.ptr[c], a.ptr[c] + b.ptr[c]) || !close(difference.ptr[c], a.ptr[c] - b.ptr[c]) ||
+                   !close(product.ptr[c], a.ptr[c] * b.ptr[c]) || !close(quotient.ptr[c], a.ptr[c] / b.ptr[c]) ||
+                   !close(scaled.ptr[c], a.ptr[c] * b.x);
+
+        const mz::f32 dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+        const mz::f32 magnitude = std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+        const mz::fvec4 normal = a.normalize(mz::precise);
+        bad += !close_sum(a.dot(b), dot, a, b) || !close(a.magnitude(), magnitude);
+        for (mz::u32 c = 0; c < 4; c++)
+            bad += !close(normal.ptr[c], a.ptr[c] / magnitude);
+    }
+    check(bad == 0, "SIMD vec4 ops within tolerance_ulp of scalar");
+
+    bad = 0;
+    for (int i = 0; i < 10000; i++) {
+        const mz::fmat4 a(random_vec(), random_vec(), random_vec(), random_vec());
+        const mz::fmat4 b(random_vec(), random_vec(), random_vec(), random_vec());
+        const mz::fvec4 v = random_vec();
+        const mz::fmat4 product = a * b;
+        const mz::fvec4 transformed = a * v;
+        for (mz::u32 r = 0; r < 4; r++) {
+            const mz::fvec4& row = a.rows[r];
+            bad += !close_sum(transformed.ptr[r], row.x * v.x + row.y * v.y + row.z * v.z + row.w * v.w, row, v);
+            for (mz::u32 c = 0; c < 4; c++) {
+                const mz::fvec4 column(b.rows[0].ptr[c], b.rows[1].ptr[c], b.rows[2].ptr[c], b.rows[3].ptr[c]);
+                bad += !close_sum(product.rows[r].ptr[c], row.x * column.x + row.y * column.y + row.z * column.z + row.w * column.w, row, column);
+            }
+        }
+    }
+    check(bad == 0, "SIMD mat4 multiply within tolerance_ulp of scalar");
+
+    // The blockwise inverse eliminates in a different order than the scalar
+    // cofactors, so it is held to the row-relative inverse_tolerance_ulp
+    bad = 0;
+    for (int i = 0; i < 10000; i++) {
+        mz::fmat4 m(random_vec(), random_vec(), random_vec(), random_vec());
+        if (i % 2) {
+            for (mz::u32 r = 0; r < 4; r++) m.rows[r].ptr[r] += 400.f;
+        } else {
+            m = mz::transformation::trs(random_vec().xyz * 0.1f, mz::fquat::from_axis_angle(unit(rng) * 3.f, random_vec().xyz.normalize()),
+                                        mz::fvec3(1.5f) + mz::fvec3(unit(rng), unit(rng), unit(rng)));
+        }
+        mz::fmat4 simd, scalar;
+        m.inverse(simd);
+        const mz::f32 inv_det = 1.f / m.adjugate(scalar);
+        for (mz::u32 r = 0; r < 4; r++) {
+            mz::f32 largest = 0.f;
+            for (mz::u32 c = 0; c < 4; c++) largest = std::max(largest, std::abs(scalar.rows[r].ptr[c] * inv_det));
+            for (mz::u32 c = 0; c < 4; c++)
+                bad += !(std::abs(simd.rows[r].ptr[c] - scalar.rows[r].ptr[c] * inv_det) <=
+                         mz::simd::inverse_tolerance_ulp * std::numeric_limits<mz::f32>::epsilon() * largest);
+        }
+    }
+    check(bad == 0, "SIMD mat4 inverse within inverse_tolerance_ulp of scalar");
+}
+
+// The fast math bounds documented in mz_math.hpp, against f64 references
+static void test_fast_math() {
+    mz::u32 sin_ulp = 0, cos_ulp = 0, tan_ulp = 0, rsqrt_ulp = 0;
+    mz::f64 absolute = 0.;
+    const mz::f32 pi = 3.14159265f;
+    for (int i = 0; i <= 1000000; i++) {
+        const mz::f32 x = -pi + 2.f * pi * (mz::f32)i / 1000000.f, wide = -8192.f + 16384.f * (mz::f32)i / 1000000.f;
+        sin_ulp = std::max(sin_ulp, ulp_distance(mz::math::sin(x, mz::fast), (mz::f32)std::sin((mz::f64)x)));
+        cos_ulp = std::max(cos_ulp, ulp_distance(mz::math::cos(x, mz::fast), (mz::f32)std::cos((mz::f64)x)));
+        absolute = std::max({ absolute, std::abs(mz::math::sin(wide, mz::fast) - std::sin((mz::f64)wide)),
+                              std::abs(mz::math::cos(wide, mz::fast) - std::cos((mz::f64)wide)) });
+        const mz::f32 t = -1.4999f + 2.9998f * (mz::f32)i / 1000000.f;
+        tan_ulp = std::max(tan_ulp, ulp_distance(mz::math::tan(t, mz::fast), (mz::f32)std::tan((mz::f64)t)));
+    }
+    // Every positive normal exponent, with random mantissas
+    std::mt19937 rng(13);
+    for (int i = 0; i < 1000000; i++) {
+        const mz::u32 bits = 0x00800000u + rng() % (0x7f800000u - 0x00800000u);
+        mz::f32 x = 0.f;
+        std::memcpy(&x, &bits, 4);
+        rsqrt_ulp = std::max(rsqrt_ulp, ulp_distance(mz::math::rsqrt(x, mz::fast), (mz::f32)(1. / std::sqrt((mz::f64)x))));
+    }
+    check(sin_ulp <= 1 && cos_ulp <= 1, "fast sin/cos within 1 ulp for |x| <= pi");
+    check(absolute < 8e-8, "fast sin/cos within 8e-8 for |x| <= 8192");
+    check(tan_ulp <= 3, "fast tan within 3 ulp for |x| < 1.5");
+    check(rsqrt_ulp <= 4, "fast rsqrt within 4 ulp");
+
+    // rsqrt's 4 ulp plus rounding in the squares and the products
+    std::uniform_real_distribution<mz::f32> unit(-100.f, 100.f);
+    const mz::f32 tolerance = 6.f * std::numeric_limits<mz::f32>::epsilon();
+    bool normalized = true;
+    for (int i = 0; i < 100000; i++) {
+        const mz::fvec2 a(unit(rng), unit(rng));
+        const mz::fvec3 b(unit(rng), unit(rng), unit(rng));
+        const mz::fvec4 c(unit(rng), unit(rng), unit(rng), unit(rng));
+        normalized = normalized && (a.normalize(mz::fast) - a.normalize(mz::precise)).magnitude() < tolerance &&
+                     (b.normalize(mz::fast) - b.normalize(mz::precise)).magnitude() < tolerance &&
+                     (c.normalize(mz::fast) - c.normalize(mz::precise)).magnitude() < tolerance;
+    }
+    check(normalized && mz::fvec3(0.f).normalize(mz::fast) == mz::fvec3(0.f) && mz::fvec4(0.f).normalize(mz::fast) == mz::fvec4(0.f),
+          "normalize(fast) close to normalize(precise)");
+}
+
+// Mismatched sizes only touch the elements both sides have
+static void test_soa() {
+    std::vector<mz::fvec3> a = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 2, 3 }, { 4, 5, 6 } };
+    std::vector<mz::fvec3> b = { { 0, 1, 0 }, { 0, 0, 1 } };
+
+    mz::soa_fvec3 sa(a), sb(b);
+    std::vector<mz::fvec3> out(8, mz::fvec3(-1.f));
+    sa.to_aos(out);
+    check(out[4].z == 6.f && out[5].x == -1.f && out[7].z == -1.f, "soa to_aos stops at size()");
+
+    std::vector<mz::f32> dots(5, -1.f);
+    sa.dot(sb, dots);
+    check(dots[0] == 0.f && dots[1] == 0.f && dots[2] == -1.f, "soa dot stops at rhs.size()");
+
+    mz::soa_fvec3 c;
+    sa.cross(sb, c);
+    check(c.size() == 2 && c.get(0).z == 1.f && c.get(1).x == 1.f, "soa cross stops at rhs.size()");
+
+    sa.add(sb);
+    check(sa.get(0).y == 1.f && sa.get(1).z == 1.f && sa.get(2).z == 1.f && sa.get(4).x == 4.f, "soa add stops at rhs.size()");
+
+    // vec2 sums in f64, so huge components don't overflow and the bulk
+    // results are the member functions' bit for bit
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<mz::f32> mantissa(-1.f, 1.f);
+    std::uniform_int_distribution<int> exponent(-60, 60);
+    std::vector<mz::fvec2> v2(37);
+    for (auto& v : v2) v = mz::fvec2(std::ldexp(mantissa(rng), exponent(rng)), std::ldexp(mantissa(rng), exponent(rng)));
+    v2[3] = mz::fvec2(3e30f, -4e30f);
+    v2[5] = mz::fvec2(0.f);
+    mz::soa_fvec2 s2(v2);
+    std::vector<mz::f32> mags(v2.size());
+    s2.magnitude(mags);
+    s2.normalize();
+    bool same = mags[3] == 5e30f;
+    for (size_t i = 0; i < v2.size(); i++) {
+        mz::fvec2 n = v2[i].normalize(mz::precise);
+        same = same && mags[i] == v2[i].magnitude(mz::precise) && s2.get(i).x == n.x && s2.get(i).y == n.y;
+    }
+    check(same, "soa vec2 magnitude and normalize match the member functions");
+
+    // Growing within the capacity zeroes the new elements like reallocating does
+    mz::soa_fvec2 grow(v2);
+    grow.resize(2);
+    grow.resize(v2.size());
+    bool zeroed = grow.get(0).x == v2[0].x;
+    for (size_t i = 2; i < v2.size(); i++) zeroed = zeroed && grow.get(i).x == 0.f && grow.get(i).y == 0.f;
+    check(zeroed, "soa resize zeroes new elements");
+}
+
+static void test_expr() {
+    std::vector<mz::fvec3> p = { { 1, 1, 1 }, { 2, 2, 2 }, { 3, 3, 3 }, { 4, 4, 4 } };
+    std::vector<mz::fvec3> v = { { 1, 0, 0 }, { 0, 1, 0 } };
+    mz::fvec3 g(0, 0, -1);
+
+    mz::fvec3 e = mz::lazy(p[0]) * 2.f - g;
+    check(e.x == 2.f && e.z == 3.f, "expr single vector");
+
+    // v is shorter than p, so only its two elements are written
+    mz::expr::assign(p, mz::lazy(p) + mz::lazy(v) * 2.f + g);
+    check(p[0].x == 3.f && p[0].z == 0.f && p[1].y == 4.f && p[2].x == 3.f && p[3].z == 4.f, "expr assign stops at the shortest array");
+}
+
+#if defined(__SIZEOF_INT128__)
+// fixed ops against the same rules computed in 128 bit integers
+template <typename fixed_t>
+static void test_fixed_ops(const char* name) {
+    typedef typename fixed_t::storage_type raw_t;
+    typedef __int128 wide_t;
+    const wide_t lo = fixed_t::raw_min, hi = fixed_t::raw_max, one = (wide_t)1 << fixed_t::fraction_bits;
+    auto saturate = [&](wide_t r) { return (raw_t)(r < lo ? lo : r > hi ? hi : r); };
+    // floor(n / d + 1 / 2), ie. halves up, for d > 0
+    auto round_div = [](wide_t n, wide_t d) { wide_t q = n / d - (n % d < 0), r = n - q * d; return q + (2 * r >= d); };
+
+    std::mt19937_64 rng(15);
+    const raw_t edges[] = { 0, 1, -1, (raw_t)one, (raw_t)-one, (raw_t)(one / 2), fixed_t::raw_max, fixed_t::raw_min, (raw_t)(fixed_t::raw_max - 1), (raw_t)(fixed_t::raw_min + 1) };
+    int bad = 0;
+    for (int i = 0; i < 200000; i++) {
+        raw_t ra = i < 100 ? edges[i % 10] : (raw_t)(rng() >> (rng() % (sizeof(raw_t) * 8)));
+        raw_t rb = i < 100 ? edges[i / 10] : (raw_t)(rng() >> (rng() % (sizeof(raw_t) * 8)));
+        if ((rng() & 1) && ra != fixed_t::raw_min) ra = (raw_t)-ra;
+        if ((rng() & 1) && rb != fixed_t::raw_min) rb = (raw_t)-rb;
+        fixed_t a = fixed_t::from_raw(ra), b = fixed_t::from_raw(rb);
+
+        bad += (a + b).raw != saturate((wide_t)ra + rb);
+        bad += (a - b).raw != saturate((wide_t)ra - rb);
+        bad += (-a).raw != saturate(-(wide_t)ra);
+        bad += (a * b).raw != saturate(round_div((wide_t)ra * rb, one));
+        if (rb != 0) bad += (a / b).raw != saturate(rb > 0 ? round_div((wide_t)ra * one, rb) : round_div(-(wide_t)ra * one, -(wide_t)rb));
+        else         bad += (a / b).raw != (ra == 0 ? 0 : ra < 0 ? fixed_t::raw_min : fixed_t::raw_max);
+    }
+    std::string what = std::string(name) + " matches the 128 bit reference";
+    check(bad == 0, what.c_str());
+}
+#endif
+
+template <typename fixed_t>
+static void test_fixed_matrix(const char* name) {
+    typedef mz::vec3<fixed_t> vec3_t;
+    typedef mz::vec4<fixed_t> vec4_t;
+    typedef mz::mat4<fixed_t> mat_t;
+    auto same = [](const mat_t& a, const mat_t& b) {
+        bool equal = true;
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++) equal = equal && a.rows[r].ptr[c] == b.rows[r].ptr[c];
+        return equal;
+    };
+
+    // Dyadic translation and scale, so every product and the inverse are exact
+    const vec3_t position(fixed_t(1.5), fixed_t(2), fixed_t(-3)), scale(fixed_t(2), fixed_t(0.5), fixed_t(4));
+    const mat_t m = mz::transformation::trs(position, vec3_t(fixed_t(0)), scale);
+    const mat_t t = mz::transformation::translation(position);
+
+    mat_t expected_inverse((fixed_t)1);
+    expected_inverse.rows[0] = vec4_t(fixed_t(0.5), fixed_t(0), fixed_t(0), fixed_t(-0.75));
+    expected_inverse.rows[1] = vec4_t(fixed_t(0), fixed_t(2), fixed_t(0), fixed_t(-4));
+    expected_inverse.rows[2] = vec4_t(fixed_t(0), fixed_t(0), fixed_t(0.25), fixed_t(0.75));
+
+    mat_t inverse = m, t_inverse = t;
+    bool inverted = inverse.try_invert() && t_inverse.try_invert();
+    std::string what = std::string(name) + " trs inverts exactly";
+    check(inverted && same(inverse, expected_inverse) && same(t_inverse, mz::transformation::translation(-position)), what.c_str());
+
+    what = std::string(name) + " matrix times its inverse is the identity";
+    check(same(m * inverse, mat_t((fixed_t)1)) && same(t * t_inverse, mat_t((fixed_t)1)) && same(inverse * m, mat_t((fixed_t)1)), what.c_str());
+
+    const vec4_t p = m * vec4_t(fixed_t(1), fixed_t(-2), fixed_t(0.25), fixed_t(1));
+    const vec4_t back = inverse * p;
+    what = std::string(name) + " matrix transforms exactly";
+    check(p == vec4_t(fixed_t(3.5), fixed_t(1), fixed_t(-2), fixed_t(1)) && back == vec4_t(fixed_t(1), fixed_t(-2), fixed_t(0.25), fixed_t(1)), what.c_str());
+}
+static void test_fixed() {
+#if defined(__SIZEOF_INT128__)
+    test_fixed_ops<mz::q16_16>("q16_16");
+    test_fixed_ops<mz::q32_32>("q32_32");
+#endif
+    static_assert((mz::q16_16(1.5) * mz::q16_16(-2)).raw == -3 * 65536, "q16_16 multiply at compile time");
+    static_assert((mz::q32_32(1) / mz::q32_32(3)).raw == 0x55555555, "q32_32 divide rounds at compile time");
+
+    // sqrt rounds to nearest
+    int bad = 0;
+    for (mz::s32 raw = 0; raw < (1 << 24); raw += 997) {
+        mz::f64 exact = std::sqrt((mz::f64)raw / 65536.) * 65536.;
+        bad += std::abs((mz::f64)mz::math::sqrt(mz::q16_16::from_raw(raw)).raw - exact) > 0.5;
+    }
+    check(bad == 0, "q16_16 sqrt rounds to nearest");
+    check(mz::math::sqrt(mz::q16_16(-4)).raw == 0, "fixed sqrt of a negative is 0");
+
+    // Packed SIMD lanes give the scalar results, saturation included
+    mz::q16vec4 a(mz::q16_16(1.25), mz::q16_16(-3), mz::q16_16::highest(), mz::q16_16(0.5));
+    mz::q16vec4 b(mz::q16_16(-0.75), mz::q16_16(7.5), mz::q16_16(2), mz::q16_16::lowest());
+    mz::q16vec4 sum = a + b, product = a * b;
+    bool same = true;
+    for (int c = 0; c < 4; c++) same = same && sum.ptr[c] == a.ptr[c] + b.ptr[c] && product.ptr[c] == a.ptr[c] * b.ptr[c];
+    check(same, "q16vec4 lanes match scalar q16_16");
+
+    mz::q16vec3 v(mz::q16_16(3), mz::q16_16(4), mz::q16_16(12));
+    check(v.magnitude() == mz::q16_16(13), "q16vec3 magnitude");
+    check(mz::q16_16(1e10).raw == mz::q16_16::raw_max && mz::q16_16(std::nan("")).raw == 0, "fixed from float saturates, NaN gives 0");
+
+    test_fixed_matrix<mz::q16_16>("q16mat4");
+    test_fixed_matrix<mz::q32_32>("q32mat4");
+}
+
+// Encoding is correctly rounded, and the bulk SIMD kernels match the scalar conversions
+template <typename packed_t>
+static void test_norm(const char* name) {
+    typedef typename packed_t::component_type component_t;
+    typedef typename packed_t::storage_type storage_t;
+    const mz::f64 scale = (mz::f64)std::numeric_limits<storage_t>::max(), low = std::is_signed<storage_t>::value ? -1. : 0.;
+
+    std::vector<mz::fvec4> in;
+    int bad = 0;
+    for (mz::u32 bits = 0; bits <= 0x3f800000u; bits += 4099) {
+        mz::f32 v;
+        std::memcpy(&v, &bits, 4);
+        for (mz::f32 x : { v, -v }) {
+            mz::f64 c = x < low ? low : x;
+            mz::f64 exact = std::floor(std::abs(c) * scale + 0.5) * (c < 0. ? -1. : 1.);
+            bad += (mz::f64)component_t(x).bits != exact;
+        }
+        in.push_back(mz::fvec4(v, -v, v * 3.f, -v * 0.5f));
+    }
+    in.push_back(mz::fvec4(std::nanf(""), INFINITY, -INFINITY, 2.f));
+
+    std::vector<packed_t> out(in.size());
+    packed_t::pack(in, out);
+    for (size_t i = 0; i < in.size(); i++)
+        for (mz::u32 c = 0; c < 4; c++) bad += out[i].ptr[c].bits != component_t(in[i].ptr[c]).bits;
+
+    // Every code decodes and encodes back to itself
+    for (mz::s32 code = std::numeric_limits<storage_t>::min() + std::is_signed<storage_t>::value; code <= std::numeric_limits<storage_t>::max(); code++) {
+        component_t x = component_t::from_bits((storage_t)code);
+        bad += component_t((mz::f32)x).bits != (storage_t)code;
+    }
+    std::string what = std::string(name) + " encodes correctly rounded and round trips";
+    check(bad == 0, what.c_str());
+}
+
+static void test_packed() {
+    test_norm<mz::unorm8vec4>("unorm8");
+    test_norm<mz::unorm16vec4>("unorm16");
+    test_norm<mz::snorm8vec4>("snorm8");
+    test_norm<mz::snorm16vec4>("snorm16");
+    check((mz::f32)mz::snorm<mz::s8>::from_bits(-128) == -1.f, "snorm lowest code decodes to -1");
+
+    // Every half survives f32 and back, and the kernels agree with the scalar conversion
+    int bad = 0;
+    std::vector<mz::hvec4> halves(16384), repacked(16384);
+    std::vector<mz::fvec4> floats(16384);
+    for (mz::u32 bits = 0; bits < 65536; bits++) {
+        mz::half h;
+        h.bits = (mz::u16)bits;
+        mz::f32 f = h;
+        bad += std::isnan(f) ? !std::isnan((mz::f32)mz::half(f)) : mz::half(f).bits != bits;
+        halves[bits / 4].ptr[bits % 4] = h;
+    }
+    mz::hvec4::unpack(halves, floats);
+    mz::hvec4::pack(floats, repacked);
+    for (mz::u32 bits = 0; bits < 65536; bits++) {
+        mz::f32 f = floats[bits / 4].ptr[bits % 4], scalar = halves[bits / 4].ptr[bits % 4];
+        bad += std::memcmp(&f, &scalar, 4) != 0;
+        bad += !std::isnan(f) && repacked[bits / 4].ptr[bits % 4].bits != bits;
+    }
+    check(bad == 0, "half round trips all 65536 values");
+    check(mz::half(65520.f).bits == 0x7c00 && mz::half(1.f + 1.f / 4096.f).bits == 0x3c00, "half rounds to nearest even and overflows to infinity");
+
+    mz::fvec4 t = mz::snorm1010102(mz::fvec4(0.5f, -0.25f, 1.f, -1.f));
+    check(std::abs(t.x - 0.5f) <= 0.5f / 511.f && std::abs(t.y + 0.25f) <= 0.5f / 511.f && t.z == 1.f && t.w == -1.f, "snorm1010102 round trip");
+
+    std::mt19937 rng(16);
+    std::normal_distribution<mz::f32> gauss;
+    mz::f32 worst16 = 1.f, worst32 = 1.f;
+    for (int i = 0; i < 10000; i++) {
+        mz::fvec3 n = mz::fvec3(gauss(rng), gauss(rng), gauss(rng)).normalize();
+        worst16 = std::min(worst16, mz::oct16(n).to_vec().dot(n));
+        worst32 = std::min(worst32, mz::oct32(n).to_vec().dot(n));
+    }
+    // Within about 1.1 degrees for oct16 and 0.08 for oct32
+    check(worst16 > 0.9998f && worst32 > 0.999999f, "octahedral round trip error");
+    check(mz::oct16(mz::fvec3(0.f)).to_vec().z == 1.f, "octahedral zero vector decodes to +z");
+}
+
+static void test_color() {
+    auto to_linear = [](mz::f64 c) { return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4); };
+    auto to_srgb   = [](mz::f64 l) { return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1. / 2.4) - 0.055; };
+
+    int bad = 0;
+    for (mz::u32 c = 0; c < 256; c++) {
+        bad += mz::srgb8_to_linear((mz::u8)c) != (mz::f32)to_linear(c / 255.);
+        bad += mz::linear_to_srgb8(mz::srgb8_to_linear((mz::u8)c)) != c;
+        bad += mz::to_bcolor(mz::to_fcolor(mz::bcolor4((mz::u8)c))).x != c;
+    }
+    check(bad == 0, "8 bit sRGB and unorm colors round trip");
+
+    // Correctly rounded encoding, and the fast curves within their documented error
+    bad = 0;
+    mz::f64 worst_linear = 0., worst_srgb = 0.;
+    std::vector<mz::fcolor16> colors;
+    for (mz::u32 i = 0; i <= 100000; i++) {
+        mz::f32 v = i / 100000.f;
+        bad += mz::linear_to_srgb8(v) != (mz::u32)std::floor(to_srgb(v) * 255. + 0.5);
+        worst_srgb = std::max(worst_srgb, std::abs(mz::linear_to_srgb(v, mz::fast) - to_srgb(v)));
+        if (v >= 1e-3f) worst_linear = std::max(worst_linear, std::abs(mz::srgb_to_linear(v, mz::fast) / to_linear(v) - 1.));
+        colors.push_back(mz::fcolor16(v, 1.f - v, v * v, v));
+    }
+    check(bad == 0, "linear_to_srgb8 is correctly rounded");
+    check(worst_linear < 3e-5 && worst_srgb < 1e-5, "fast sRGB curves within their error bounds");
+
+    // Image versions give the same bits as the single color ones
+    std::vector<mz::fcolor16> linear(colors.size()), premultiplied = colors;
+    std::vector<mz::bcolor4> bytes(colors.size());
+    mz::srgb_to_linear(colors, linear, mz::fast);
+    mz::linear_to_srgb8(colors, bytes);
+    mz::premultiply(mz::span<mz::fcolor16>(premultiplied));
+    bad = 0;
+    for (size_t i = 0; i < colors.size(); i++) {
+        mz::fcolor16 l = mz::srgb_to_linear(colors[i], mz::fast), p = mz::premultiply(colors[i]);
+        mz::bcolor4 b = mz::linear_to_srgb8(colors[i]);
+        bad += std::memcmp(&l, &linear[i], sizeof(l)) != 0 || std::memcmp(&p, &premultiplied[i], sizeof(p)) != 0 || std::memcmp(&b, &bytes[i], sizeof(b)) != 0;
+    }
+    check(bad == 0, "image color conversions match the per color ones");
+
+    // u8 premultiply is round(c * a / 255) for every pair, 4 pixels at a time too
+    bad = 0;
+    std::vector<mz::bcolor4> pixels;
+    for (mz::u32 a = 0; a < 256; a++)
+        for (mz::u32 c = 0; c < 256; c++) pixels.push_back(mz::bcolor4((mz::u8)c, (mz::u8)(255 - c), (mz::u8)(c / 2), (mz::u8)a));
+    std::vector<mz::bcolor4> scaled = pixels;
+    mz::premultiply(mz::span<mz::bcolor4>(scaled));
+    for (size_t i = 0; i < pixels.size(); i++) {
+        const mz::bcolor4& p = pixels[i];
+        for (mz::u32 c = 0; c < 3; c++) bad += scaled[i].ptr[c] != (p.ptr[c] * p.w * 2 + 255) / 510;
+        bad += scaled[i].w != p.w;
+    }
+    check(bad == 0, "u8 premultiply rounds to nearest");
+    check(mz::unpremultiply(mz::bcolor4(10, 20, 30, 0)) == mz::bcolor4(0, 0, 0, 0), "unpremultiply of zero alpha");
+}
+
+static void test_frustum() {
+    // Camera at z = 10 looking down -z
+    mz::ffrustum f = mz::ffrustum::from_matrix(mz::projection::perspective(1.2f, 16.f / 9.f, .1f, 100.f) * mz::transformation::translation(mz::fvec3(0, 0, -10)));
+    check(f.contains(mz::fvec3(0, 0, 0)) && !f.contains(mz::fvec3(0, 0, 20)) && !f.contains(mz::fvec3(0, 0, -95)), "frustum contains");
+    check(f.intersects(mz::fvec4(0, 0, 10.5f, 1.f)) && !f.intersects(mz::fvec4(0, 0, 12, 1.f)), "frustum sphere against the near plane");
+    check(f.intersects(mz::faabb(mz::fvec3(-1, -1, -91), mz::fvec3(1, 1, -89))) && !f.intersects(mz::faabb(mz::fvec3(500, 0, 0), mz::fvec3(501, 1, 1))), "frustum box");
+
+    std::mt19937 rng(18);
+    std::uniform_real_distribution<mz::f32> pos(-60.f, 60.f), size(0.f, 4.f);
+    const size_t count = 5000;
+    std::vector<mz::fvec4> spheres(count);
+    std::vector<mz::faabb> boxes(count);
+    for (size_t i = 0; i < count; i++) {
+        spheres[i] = mz::fvec4(pos(rng), pos(rng), pos(rng), size(rng));
+        mz::fvec3 lo(pos(rng), pos(rng), pos(rng));
+        boxes[i] = mz::faabb(lo, lo + mz::fvec3(size(rng), size(rng), size(rng)));
+    }
+    spheres[7] = mz::fvec4(std::nanf(""), 0.f, 0.f, 1.f);
+
+    // Batches, with and without hints and threads, agree with the single tests
+    std::vector<mz::u64> visible((count + 63) / 64), boxes_visible((count + 63) / 64), threaded((count + 63) / 64);
+    std::vector<mz::u8> hints(count, 0), box_hints(count, 0);
+    std::vector<mz::u32> indices(count);
+    int bad = 0;
+    for (int frame = 0; frame < 2; frame++) {
+        mz::frustum_cull(f, spheres, visible, hints);
+        mz::frustum_cull(f, boxes, boxes_visible);
+        mz::frustum_cull(f, spheres, threaded, {}, mz::parallelism(3));
+        size_t n = mz::frustum_cull_compact(f, boxes, indices, box_hints, mz::parallelism(3));
+        size_t k = 0;
+        for (size_t i = 0; i < count; i++) {
+            bool sphere = (visible[i / 64] >> (i % 64)) & 1, box = (boxes_visible[i / 64] >> (i % 64)) & 1;
+            bad += sphere != f.intersects(spheres[i]) || sphere != (bool)((threaded[i / 64] >> (i % 64)) & 1);
+            bad += box != f.intersects(boxes[i]);
+            if (box) bad += k >= n || indices[k++] != i;
+        }
+        bad += k != n;
+    }
+    check(bad == 0, "frustum_cull matches intersects");
+    check(!((visible[0] >> 7) & 1), "frustum culls NaN spheres");
+
+    // A short mask gets only the words it has, short hints are ignored
+    std::vector<mz::u64> one_word(1, 0);
+    std::vector<mz::u8> few_hints(10, 0);
+    mz::frustum_cull(f, mz::span<const mz::fvec4>(spheres.data(), 200), mz::span<mz::u64>(one_word), mz::span<mz::u8>(few_hints));
+    bool short_ok = one_word[0] == visible[0];
+    for (mz::u8 h : few_hints) short_ok = short_ok && h == 0;
+    mz::frustum_cull(f, mz::span<const mz::faabb>(boxes.data(), 200), mz::span<mz::u64>(one_word), mz::span<mz::u8>(few_hints));
+    check(short_ok && one_word[0] == boxes_visible[0], "frustum_cull stops at the visible and hints spans");
+}
+
+static void test_parallel() {
+    mz::executor pool(3);
+    const size_t count = 100003, grain = 64;
+    std::vector<mz::f32> values(count);
+    for (size_t i = 0; i < count; i++) values[i] = 1.f / (mz::f32)(i + 1);
+    auto sum = [&](size_t begin, size_t end) { mz::f32 s = 0; for (size_t i = begin; i < end; i++) s += values[i]; return s; };
+    auto add = [](mz::f32 a, mz::f32 b) { return a + b; };
+    const mz::f32 serial = mz::parallel_reduce(count, 256, 0.f, 1, sum, add);
+
+    int bad = 0;
+    for (mz::parallelism par : { mz::parallelism(), mz::parallelism(1), mz::parallelism(3), mz::parallelism(0), mz::parallelism(pool) }) {
+        // Every index exactly once, in ranges that start on a grain boundary
+        std::vector<std::atomic<mz::u32>> hits(count);
+        std::atomic<int> misaligned(0);
+        mz::parallel_for(count, grain, par, [&](size_t begin, size_t end) {
+            misaligned += begin % grain != 0 || end <= begin || end > count;
+            for (size_t i = begin; i < end; i++) hits[i]++;
+        });
+        bad += misaligned;
+        for (auto& h : hits) bad += h != 1;
+        bad += mz::parallel_reduce(count, 256, 0.f, par, sum, add) != serial;
+    }
+    check(bad == 0, "parallel_for covers the range, parallel_reduce is deterministic");
+
+    // The default never leaves the calling thread
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> elsewhere(0);
+    mz::parallel_for(count, 1, {}, [&](size_t, size_t) { elsewhere += std::this_thread::get_id() != caller; });
+    check(elsewhere == 0, "default parallelism runs inline");
+
+    // Loops started from inside the pool's own loop run on the calling thread
+    std::atomic<size_t> nested(0);
+    mz::parallel_for(64, 1, pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            mz::parallel_for(100, 10, pool, [&](size_t b, size_t e) { nested += e - b; });
+    });
+    check(nested == 6400, "nested executor loops");
+}
+
+template <typename mat_t>
+static bool nearly_equal(const mat_t& a, const mat_t& b, mz::f32 tolerance) {
+    for (mz::u32 r = 0; r < 4; r++)
+        for (mz::u32 c = 0; c < 4; c++)
+            if (!(std::abs(a.rows[r].ptr[c] - b.rows[r].ptr[c]) <= tolerance)) return false;
+    return true;
+}
+
+static void test_quat() {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<mz::f64> unit(-1., 1.);
+    auto random_quat = [&]() { return mz::dquat(mz::dvec4(unit(rng), unit(rng), unit(rng), unit(rng)).normalize()); };
+    // q and -q are the same rotation
+    auto same_rotation = [](const mz::dquat& a, const mz::dquat& b) { return std::abs(std::abs(a.dot(b)) - 1.) < 1e-12; };
+    auto arc = [](const mz::dquat& a, const mz::dquat& b) { return 2. * std::acos(std::min(std::abs(a.dot(b)), 1.)); };
+
+    // acos's compile time series, which fixed point quaternions also use, against std::acos
+    mz::u32 acos_ulp = 0;
+    for (int i = 0; i <= 200000; i++) {
+        const mz::f64 x = -1. + 2. * i / 200000.;
+        acos_ulp = std::max(acos_ulp, ulp_distance((mz::f32)mz::math::detail::acos(x), (mz::f32)std::acos(x)));
+    }
+    check(acos_ulp <= 1, "math::acos series within 1 ulp of std::acos");
+    const mz::dvec3 x_axis(1., 0., 0.), y_axis(0., 1., 0.), z_axis(0., 0., 1.);
+
+    bool axis_angle = true, euler = true, round_trip = true, compose = true, rotate = true;
+    for (int i = 0; i < 1000; i++) {
+        const mz::dvec3 axis = mz::dvec3(unit(rng), unit(rng), unit(rng)).normalize(), angles(unit(rng) * 3., unit(rng) * 3., unit(rng) * 3.);
+        const mz::f64 angle = unit(rng) * 3.;
+        axis_angle = axis_angle && nearly_equal(mz::dquat::from_axis_angle(angle, axis).to_mat4(), mz::transformation::rotation(angle, axis), 1e-12f);
+        euler = euler && nearly_equal(mz::dquat::from_euler(angles).to_mat4(),
+                                      mz::dmat4(1.).rotate(angles.x, x_axis).rotate(angles.y, y_axis).rotate(angles.z, z_axis), 1e-12f);
+
+        // Random quaternions reach every branch of from_mat4
+        const mz::dquat a = random_quat(), b = random_quat();
+        round_trip = round_trip && same_rotation(mz::dquat::from_mat4(a.to_mat4()), a) && nearly_equal(mz::dquat::from_mat4(a.to_mat4()).to_mat4(), a.to_mat4(), 1e-12f);
+        compose = compose && nearly_equal((a * b).to_mat4(), a.to_mat4() * b.to_mat4(), 1e-12f);
+        const mz::dvec3 v(unit(rng), unit(rng), unit(rng));
+        rotate = rotate && ((a * v) - a.to_mat4() * v).magnitude() < 1e-12;
+    }
+    check(axis_angle, "quat from_axis_angle matches transformation::rotation");
+    check(euler, "quat from_euler matches chained rotate");
+    check(round_trip, "quat from_mat4/to_mat4 round trip");
+    check(compose, "quat multiply matches mat4 compose");
+    check(rotate, "quat rotate matches to_mat4");
+
+    bool endpoints = true, shortest = true, velocity = true, nlerped = true;
+    for (int i = 0; i < 1000; i++) {
+        const mz::dquat a = random_quat();
+        const mz::dquat b = i % 2 ? random_quat() : -random_quat();
+        endpoints = endpoints && same_rotation(mz::slerp(a, b, 0.), a) && same_rotation(mz::slerp(a, b, 1.), b) &&
+                    same_rotation(mz::nlerp(a, b, 0.), a) && same_rotation(mz::nlerp(a, b, 1.), b);
+        // -b is the same rotation, both take the shorter way round
+        const mz::f64 t = (unit(rng) + 1.) / 2.;
+        shortest = shortest && same_rotation(mz::slerp(a, b, t), mz::slerp(a, -b, t)) && same_rotation(mz::nlerp(a, b, t), mz::nlerp(a, -b, t)) &&
+                   arc(a, mz::slerp(a, b, t)) <= arc(a, b) + 1e-9;
+        velocity = velocity && std::abs(arc(a, mz::slerp(a, b, t)) - t * arc(a, b)) < 1e-9;
+        nlerped = nlerped && std::abs(mz::nlerp(a, b, t).magnitude() - 1.) < 1e-12 && std::abs(mz::slerp(a, b, t).magnitude() - 1.) < 1e-12;
+    }
+    check(endpoints, "slerp/nlerp endpoints");
+    check(shortest, "slerp/nlerp take the shortest arc");
+    check(velocity, "slerp has constant angular velocity");
+    check(nlerped, "slerp/nlerp stay normalized");
+
+    // Nearly parallel inputs fall back to nlerp instead of dividing by sin(~0)
+    const mz::dquat a = random_quat(), b = (a * mz::dquat::from_axis_angle(1e-6, z_axis)).normalize();
+    const mz::dquat halfway = mz::slerp(a, b, 0.5), same = mz::slerp(a, a, 0.5);
+    const mz::fquat fa = a, fhalfway = mz::slerp(fa, mz::fquat(b), 0.5f);
+    check(same_rotation(same, a) && std::abs(arc(a, halfway) - 0.5e-6) < 1e-9 && std::abs(arc(halfway, b) - 0.5e-6) < 1e-9 &&
+          std::isfinite(fhalfway.w) && std::abs(fhalfway.magnitude() - 1.f) < 1e-6f, "slerp of nearly parallel quaternions");
+}
+
+static void test_affine() {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<mz::f64> unit(-1., 1.);
+    auto random_row = [&]() { return mz::dvec4(unit(rng), unit(rng), unit(rng), unit(rng) * 100.); };
+
+    int inverted = 0, rigid = 0, multiplied = 0, tested = 0;
+    for (int i = 0; i < 1000; i++) {
+        const mz::dmat4 m(random_row(), random_row(), random_row(), mz::dvec4(0., 0., 0., 1.));
+        // Keep away from singular, where no inverse round trips
+        if (std::abs(m.determinant()) < 1e-2) continue;
+        tested++;
+        mz::dmat4 inverse = m;
+        inverse.invert_affine();
+        inverted += m.is_affine() && inverse.is_affine() && nearly_equal(inverse * m, mz::dmat4(1.), 1e-9f) && nearly_equal(m * inverse, mz::dmat4(1.), 1e-9f);
+
+        const mz::dmat4 other(random_row(), random_row(), random_row(), mz::dvec4(0., 0., 0., 1.));
+        const mz::daffine3 product = mz::daffine3(m) * mz::daffine3(other);
+        const mz::dvec3 v(unit(rng), unit(rng), unit(rng));
+        multiplied += nearly_equal(product.to_mat4(), m * other, 1e-12f) && (mz::daffine3(m) * v - m * v).magnitude() < 1e-12 &&
+                      std::abs(mz::daffine3(m).determinant() - m.determinant()) < 1e-12;
+
+        const mz::dmat4 rotation = mz::transformation::trs(mz::dvec3(unit(rng), unit(rng), unit(rng)) * 100., mz::dvec3(unit(rng), unit(rng), unit(rng)) * 3., mz::dvec3(1.));
+        mz::dmat4 fast = rotation, general = rotation;
+        fast.invert_rigid();
+        general.invert();
+        rigid += nearly_equal(fast, general, 1e-12f);
+    }
+    check(inverted == tested && tested > 900, "invert_affine round trips affine matrices");
+    check(multiplied == tested, "affine3 multiply matches mat4");
+    check(rigid == tested, "invert_rigid matches the general inverse");
+
+    const mz::fmat4 perspective = mz::projection::perspective(1.2f, 1.5f, 0.1f, 100.f);
+    check(!perspective.is_affine() && mz::transformation::trs(mz::fvec3(1.f), mz::fvec3(2.f), mz::fvec3(3.f)).is_affine() &&
+          mz::projection::look_at(mz::fvec3(3.f, 4.f, 5.f), mz::fvec3(0.f), mz::fvec3(0.f, 1.f, 0.f)).is_affine(), "is_affine rejects projections");
+}
+
+static void test_trs() {
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<mz::f64> unit(-1., 1.);
+    const mz::dvec3 x_axis(1., 0., 0.), y_axis(0., 1., 0.), z_axis(0., 0., 1.);
+
+    bool fused = true, inverse = true;
+    for (int i = 0; i < 1000; i++) {
+        const mz::dvec3 position = mz::dvec3(unit(rng), unit(rng), unit(rng)) * 100., euler = mz::dvec3(unit(rng), unit(rng), unit(rng)) * 3.;
+        const mz::dvec3 scale(std::pow(10., unit(rng)), std::pow(10., unit(rng)), -std::pow(10., unit(rng)));
+        const mz::dquat q = mz::dquat(mz::dvec4(unit(rng), unit(rng), unit(rng), unit(rng)).normalize());
+
+        const mz::dmat4 chain = mz::transformation::translation(position).rotate(euler.x, x_axis).rotate(euler.y, y_axis).rotate(euler.z, z_axis) *
+                                mz::transformation::scale(scale);
+        const mz::dmat4 quat_chain = mz::transformation::translation(position) * q.to_mat4() * mz::transformation::scale(scale);
+        fused = fused && nearly_equal(mz::transformation::trs(position, euler, scale), chain, 1e-9f) &&
+                nearly_equal(mz::transformation::trs(position, q, scale), quat_chain, 1e-9f);
+        inverse = inverse && nearly_equal(mz::transformation::inverse_trs(position, euler, scale) * mz::transformation::trs(position, euler, scale), mz::dmat4(1.), 1e-9f) &&
+                  nearly_equal(mz::transformation::inverse_trs(position, q, scale) * mz::transformation::trs(position, q, scale), mz::dmat4(1.), 1e-9f);
+    }
+    check(fused, "trs matches the translate * rotate * scale chain");
+    check(inverse, "inverse_trs inverts trs");
+
+    // Batch versions match the single ones exactly and stop at the shortest array
+    std::vector<mz::fvec3> positions(100), eulers(100), scales(99);
+    std::vector<mz::fquat> rotations(100);
+    for (size_t i = 0; i < positions.size(); i++) {
+        positions[i] = mz::fvec3((mz::f32)unit(rng), (mz::f32)unit(rng), (mz::f32)unit(rng));
+        eulers[i] = positions[i] * 3.f;
+        rotations[i] = mz::fquat::from_euler(eulers[i]);
+        if (i < scales.size()) scales[i] = mz::fvec3(1.f) + positions[i] * 0.5f;
+    }
+    std::vector<mz::fmat4> out(100, mz::fmat4(0.f)), inverse_out(100, mz::fmat4(0.f)), quat_out(100, mz::fmat4(0.f)), quat_inverse_out(100, mz::fmat4(0.f));
+    mz::transformation::trs<mz::f32>(positions, eulers, scales, out);
+    mz::transformation::inverse_trs<mz::f32>(positions, eulers, scales, inverse_out);
+    mz::transformation::trs<mz::f32>(positions, rotations, scales, quat_out);
+    mz::transformation::inverse_trs<mz::f32>(positions, rotations, scales, quat_inverse_out);
+    bool batch = nearly_equal(out[99], mz::fmat4(0.f), 0.f) && nearly_equal(inverse_out[99], mz::fmat4(0.f), 0.f) &&
+                 nearly_equal(quat_out[99], mz::fmat4(0.f), 0.f) && nearly_equal(quat_inverse_out[99], mz::fmat4(0.f), 0.f);
+    for (size_t i = 0; i < scales.size(); i++)
+        batch = batch && nearly_equal(out[i], mz::transformation::trs(positions[i], eulers[i], scales[i]), 0.f) &&
+                nearly_equal(inverse_out[i], mz::transformation::inverse_trs(positions[i], eulers[i], scales[i]), 0.f) &&
+                nearly_equal(quat_out[i], mz::transformation::trs(positions[i], rotations[i], scales[i]), 0.f) &&
+                nearly_equal(quat_inverse_out[i], mz::transformation::inverse_trs(positions[i], rotations[i], scales[i]), 0.f);
+    check(batch, "batch trs/inverse_trs match the single versions");
+
+    // mat4::scale keeps its original meaning: multiply by a diagonal of 1 + scale
+    bool scaled = true;
+    for (int i = 0; i < 100; i++) {
+        const mz::fvec4 r(mz::fvec4((mz::f32)unit(rng), (mz::f32)unit(rng), (mz::f32)unit(rng), (mz::f32)unit(rng)) * 10.f);
+        const mz::fmat4 m(r, r * 0.5f + mz::fvec4(1.f), r * -2.f, mz::fvec4(r.w, r.z, r.y, r.x));
+        const mz::fvec3 s((mz::f32)unit(rng) * 2.f, (mz::f32)unit(rng) * 2.f, (mz::f32)unit(rng) * 2.f);
+        mz::fmat4 diagonal(1.f);
+        diagonal.rows[0].x += s.x;
+        diagonal.rows[1].y += s.y;
+        diagonal.rows[2].z += s.z;
+        mz::fmat4 direct = m;
+        direct.scale(s);
+        scaled = scaled && nearly_equal(direct, m * diagonal, 0.f);
+    }
+    mz::fmat4 identity(1.f);
+    identity.scale(mz::fvec3(1.f, 2.f, -1.f));
+    check(scaled && identity.rows[0].x == 2.f && identity.rows[1].y == 3.f && identity.rows[2].z == 0.f && identity.rows[3].w == 1.f,
+          "mat4::scale multiplies by a diagonal of 1 + scale");
+}
+
+static void test_hierarchy() {
+    mz::transform_hierarchy<mz::f32> h;
+    std::mt19937 rng(20);
+    std::uniform_real_distribution<mz::f32> unit(-1.f, 1.f);
+    std::vector<mz::u32> nodes;
+    for (mz::u32 i = 0; i < 600; i++) {
+        mz::u32 parent = i < 4 ? h.null_node : nodes[rng() % nodes.size()];
+        mz::fquat q = mz::fquat::from_axis_angle(unit(rng) * 3.f, mz::fvec3(unit(rng), unit(rng), 1.f).normalize());
+        nodes.push_back(h.insert(parent, mz::fvec3(unit(rng), unit(rng), unit(rng)), q, mz::fvec3(1.f + unit(rng) * 0.1f)));
+    }
+
+    // World matrices against the product of local transforms up the parent chain
+    auto verify = [&]() {
+        bool ok = true;
+        for (mz::u32 id : h.ids()) {
+            mz::fmat4 expected = mz::transformation::trs(h.position(id), h.rotation(id), h.scale(id));
+            for (mz::u32 p = h.parent(id); p != h.null_node; p = h.parent(p)) {
+                expected = mz::transformation::trs(h.position(p), h.rotation(p), h.scale(p)) * expected;
+                ok = ok && h.index(p) < h.index(id);
+            }
+            ok = ok && nearly_equal(h.world(id), expected, 1e-3f);
+        }
+        return ok;
+    };
+
+    h.update();
+    check(verify(), "hierarchy world matrices");
+
+    mz::executor pool(3);
+    for (int i = 0; i < 50; i++) h.set_position(nodes[rng() % nodes.size()], mz::fvec3(unit(rng), 0.f, 0.f));
+    h.update(pool);
+    check(verify(), "hierarchy dirty update");
+
+    mz::u32 root = nodes[0], child = h.insert(root), grandchild = h.insert(child);
+    check(!h.set_parent(root, grandchild) && h.set_parent(grandchild, nodes[1]), "hierarchy set_parent rejects cycles");
+    const size_t before = h.size();
+    h.remove(child);
+    h.update(pool);
+    check(h.size() == before - 1 && h.parent(grandchild) == nodes[1] && verify(), "hierarchy set_parent then remove keeps the moved node");
+
+    // Removing a node that still has children drops its whole subtree
+    const mz::u32 top = h.insert(nodes[2]), left = h.insert(top), right = h.insert(top), leaf = h.insert(left);
+    h.update(pool);
+    const size_t with_subtree = h.size();
+    h.remove(top);
+    h.update(pool);
+    bool gone = h.size() == with_subtree - 4;
+    for (mz::u32 id : h.ids()) gone = gone && id != top && id != left && id != right && id != leaf;
+    check(gone && verify(), "hierarchy remove drops descendants");
+}
+
+static void test_inverse() {
+    std::mt19937 rng(21);
+    std::uniform_real_distribution<mz::f32> unit(-1.f, 1.f);
+    auto random_row = [&]() { return mz::fvec4(unit(rng), unit(rng), unit(rng), unit(rng)); };
+    auto magnitude = [&]() { return std::pow(10.f, unit(rng) * 3.f); };
+
+    // Rank 3 at any scale: the determinant is only rounding noise
+    std::vector<mz::fmat4> singular(1000), inverses(1000);
+    int rejected = 0;
+    for (mz::fmat4& m : singular) {
+        const mz::fvec4 a = random_row() * magnitude(), b = random_row() * magnitude(), c = random_row() * magnitude();
+        m = mz::fmat4(a, b, c, a * unit(rng) + b * unit(rng) + c * unit(rng));
+        mz::fmat4 copy = m;
+        rejected += !copy.try_invert() && std::memcmp(&copy, &m, sizeof(m)) == 0;
+    }
+    check(rejected == 1000, "try_invert rejects rank 3 matrices");
+    std::vector<mz::u64> bits(16);
+    check(mz::invert_all<mz::f32>(singular, inverses, bits) == 1000 && bits[0] == ~(mz::u64)0, "invert_all flags rank 3 matrices");
+    // A short mask gets only the words it has, the count still covers every matrix
+    std::vector<mz::u64> few(4, 0);
+    check(mz::invert_all<mz::f32>(singular, inverses, mz::span<mz::u64>(few.data(), 3), mz::parallelism(3)) == 1000 &&
+          few[2] == ~(mz::u64)0 && few[3] == 0, "invert_all stops at singular.size() words");
+
+    mz::fmat2x3 m2(mz::fvec3(2.f, 3.f, 1.f), mz::fvec3(2.f * 0.1f, 3.f * 0.1f, 5.f));
+    mz::fmat3 m3;
+    m3.rows[0] = mz::fvec3(0.3f, 0.7f, 0.1f);
+    m3.rows[1] = mz::fvec3(0.5f, -0.2f, 0.9f);
+    m3.rows[2] = m3.rows[0] * 0.3f + m3.rows[1] * 0.7f;
+    check(!m2.try_invert() && !m3.try_invert(), "2D try_invert rejects singular matrices");
+
+    // Invertible ones, including large translations and tiny scales, round trip
+    int good = 0, bounded = 0;
+    std::vector<mz::fmat4> mixed(1000);
+    for (int i = 0; i < 1000; i++) {
+        mz::fmat4 m = i % 2 ? mz::fmat4(random_row(), random_row(), random_row(), random_row())
+                            : mz::transformation::trs(mz::fvec3(unit(rng), unit(rng), unit(rng)) * 1e4f,
+                                                      mz::fquat::from_axis_angle(unit(rng) * 3.f, mz::fvec3(0.f, 1.f, 0.f)),
+                                                      mz::fvec3(magnitude(), magnitude(), magnitude()) * 1e-3f);
+        mixed[i] = m;
+        const mz::f32 exact = m.determinant_bound(), loose = m.determinant_bound(mz::fast);
+        bounded += loose >= exact;
+        mz::fmat4 inverse = m;
+        if (!inverse.try_invert()) continue;
+        // Near singular random matrices amplify rounding, so allow for their condition
+        const mz::f32 condition = m.determinant_bound() / std::abs(m.determinant());
+        good += nearly_equal(m * inverse, mz::fmat4(), 1e-5f * std::min(condition, 1e3f));
+    }
+    check(good >= 990, "try_invert round trips invertible matrices");
+    check(bounded == 1000, "fast determinant_bound is never below the exact one");
+
+    // The sqrt free fast accept in invert_all doesn't change which matrices pass
+    for (size_t i = 0; i < 200; i++) mixed[i * 5] = singular[i];
+    std::vector<mz::u64> mixed_bits((mixed.size() + 63) / 64);
+    mz::invert_all<mz::f32>(mixed, inverses, mixed_bits);
+    bool agree = true;
+    for (size_t i = 0; i < mixed.size(); i++) {
+        mz::fmat4 copy = mixed[i];
+        agree = agree && copy.try_invert() != (bool)((mixed_bits[i / 64] >> (i % 64)) & 1);
+    }
+    check(agree, "invert_all rejects what try_invert rejects");
+}
+
+// Bit for bit, unless the compiler may contract each inlined copy of the
+// scalar loops into FMA differently, in which case within rounding
+template <typename vec_t>
+static bool same_output(const std::vector<vec_t>& a, const std::vector<vec_t>& b) {
+#if defined(__FP_FAST_FMAF)
+    for (size_t i = 0; i < a.size(); i++)
+        if (!((a[i] - b[i]).magnitude() <= 1e-5f * (1.f + b[i].magnitude()))) return false;
+    return a.size() == b.size();
+#else
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(vec_t)) == 0;
+#endif
+}
+
+static void test_transform_batch() {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<mz::f32> unit(-10.f, 10.f);
+    const mz::fmat4 m = mz::projection::perspective(1.2f, 1.5f, 0.1f, 100.f) *
+                        mz::transformation::trs(mz::fvec3(1.f, -2.f, -30.f), mz::fvec3(0.3f, -0.7f, 1.1f), mz::fvec3(2.f, 0.5f, 1.5f));
+    // Not a multiple of 4 or of the 2048 element parallel ranges, to reach the scalar tails
+    const size_t n = 10003;
+    std::vector<mz::fvec2> in2(n), points2(n), parallel2(n);
+    std::vector<mz::fvec3> in3(n), points3(n), vectors3(n), projected3(n), parallel3(n);
+    std::vector<mz::fvec4> in4(n), full4(n), parallel4(n);
+    for (size_t i = 0; i < n; i++) {
+        in2[i] = mz::fvec2(unit(rng), unit(rng));
+        in3[i] = mz::fvec3(unit(rng), unit(rng), unit(rng));
+        in4[i] = mz::fvec4(unit(rng), unit(rng), unit(rng), unit(rng));
+    }
+
+    mz::transform_points<mz::f32>(m, in2, points2);
+    mz::transform_points<mz::f32>(m, in3, points3);
+    mz::transform_vectors<mz::f32>(m, in3, vectors3);
+    mz::transform_vec4<mz::f32>(m, in4, full4);
+    mz::transform_points_perspective<mz::f32>(m, in3, projected3);
+    // Within rounding, as -mfma may contract the scalar path
+    auto near = [](auto a, auto b) { return (a - b).magnitude() <= 1e-5f * (1.f + b.magnitude()); };
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) {
+        const mz::fvec4 clip = m * mz::fvec4(in3[i], 1.f);
+        const mz::fvec4 direction = m * mz::fvec4(in3[i], 0.f);
+        ok = ok && near(points2[i], m * in2[i]) && near(points3[i], m * in3[i]) && near(vectors3[i], direction.xyz) &&
+             near(full4[i], m * in4[i]) && near(projected3[i], clip.xyz / clip.w);
+    }
+    check(ok, "mat4 batch transforms match multiply");
+
+    // In place gives the same results as out of place
+    parallel2 = in2;
+    mz::transform_points<mz::f32>(m, parallel2, parallel2);
+    ok = same_output(parallel2, points2);
+    parallel3 = in3;
+    mz::transform_points<mz::f32>(m, parallel3, parallel3);
+    ok = ok && same_output(parallel3, points3);
+    parallel3 = in3;
+    mz::transform_vectors<mz::f32>(m, parallel3, parallel3);
+    ok = ok && same_output(parallel3, vectors3);
+    parallel3 = in3;
+    mz::transform_points_perspective<mz::f32>(m, parallel3, parallel3);
+    ok = ok && same_output(parallel3, projected3);
+    parallel4 = in4;
+    mz::transform_vec4<mz::f32>(m, parallel4, parallel4);
+    ok = ok && same_output(parallel4, full4);
+    check(ok, "mat4 batch transforms in place");
+
+    mz::executor pool(3);
+    mz::transform_points<mz::f32>(m, in2, parallel2, pool);
+    ok = same_output(parallel2, points2);
+    mz::transform_points<mz::f32>(m, in3, parallel3, pool);
+    ok = ok && same_output(parallel3, points3);
+    mz::transform_vectors<mz::f32>(m, in3, parallel3, mz::parallelism(3));
+    ok = ok && same_output(parallel3, vectors3);
+    mz::transform_points_perspective<mz::f32>(m, in3, parallel3, pool);
+    ok = ok && same_output(parallel3, projected3);
+    mz::transform_vec4<mz::f32>(m, in4, parallel4, mz::parallelism(3));
+    ok = ok && same_output(parallel4, full4);
+    check(ok, "parallel mat4 batch transforms match");
+}
+
+static void test_transform_2d() {
+    std::mt19937 rng(22);
+    std::uniform_real_distribution<mz::f32> unit(-10.f, 10.f);
+    const mz::fmat2x3 m = mz::transformation::trs(mz::fvec2(3.f, -2.f), 0.7f, mz::fvec2(2.f, 0.5f));
+    std::vector<mz::fvec2> in(10001), points(in.size()), vectors(in.size()), parallel(in.size());
+    for (mz::fvec2& v : in) v = mz::fvec2(unit(rng), unit(rng));
+
+    mz::transform_points<mz::f32>(m, in, points);
+    mz::transform_vectors<mz::f32>(m, in, vectors);
+    // Within rounding, as -mfma may contract the scalar path
+    bool ok = true;
+    for (size_t i = 0; i < in.size(); i++)
+        ok = ok && (points[i] - m.multiply(in[i])).magnitude() < 1e-5f && (vectors[i] - m.transform_vector(in[i])).magnitude() < 1e-5f;
+    check(ok, "transform_points/transform_vectors match multiply");
+
+    mz::executor pool(3);
+    mz::transform_vectors<mz::f32>(m, in, parallel, pool);
+    check(std::memcmp(parallel.data(), vectors.data(), vectors.size() * sizeof(mz::fvec2)) == 0, "parallel transform_vectors matches");
+    mz::transform_points<mz::f32>(m, in, parallel, mz::parallelism(3));
+    check(std::memcmp(parallel.data(), points.data(), points.size() * sizeof(mz::fvec2)) == 0, "parallel transform_points matches");
+
+    // Normals stay perpendicular to transformed tangents
+    const mz::fmat4 model = mz::transformation::trs(mz::fvec3(1.f, 2.f, 3.f), mz::fquat::from_axis_angle(0.4f, mz::fvec3(0.f, 0.f, 1.f)), mz::fvec3(3.f, 1.f, 0.25f));
+    const mz::fmat3 normals = mz::transformation::normal_matrix(model);
+    const mz::fvec3 tangent(1.f, 1.f, 0.f), normal(1.f, -1.f, 2.f);
+    const mz::fvec3 t = mz::fmat3(model).multiply(tangent), n = normals.multiply(normal);
+    check(std::abs(t.dot(n)) < 1e-5f * t.magnitude() * n.magnitude(), "normal_matrix keeps normals perpendicular");
+}
+
+template <typename map_t, typename value_t>
+static bool same_contents(const map_t& map, const std::unordered_map<mz::ivec2, value_t, mz::vec_hash<mz::ivec2>>& expected) {
+    size_t n = 0;
+    for (auto kv : map) {
+        auto it = expected.find(kv.first);
+        if (it == expected.end() || it->second != kv.second) return false;
+        n++;
+    }
+    return n == expected.size() && map.size() == expected.size();
+}
+
+static void test_hashmap() {
+    std::mt19937 rng(23);
+    // Small coordinates so inserts, hits and erases all happen, with tombstone rehashes
+    auto random_key = [&]() { return mz::ivec2((mz::s32)(rng() % 64) - 32, (mz::s32)(rng() % 64) - 32); };
+
+    mz::flat_hash_map<mz::ivec2, int> map;
+    mz::flat_hash_map<mz::ivec2, bool> flags;
+    std::unordered_map<mz::ivec2, int, mz::vec_hash<mz::ivec2>> expected;
+    std::unordered_map<mz::ivec2, bool, mz::vec_hash<mz::ivec2>> expected_flags;
+    bool ok = true;
+    for (int i = 0; i < 50000; i++) {
+        const mz::ivec2 key = random_key();
+        switch (rng() % 4) {
+            case 0: map[key] += i; expected[key] += i; break;
+            case 1: ok = ok && map.insert(key, i).second == expected.emplace(key, i).second; break;
+            case 2: ok = ok && map.erase(key) == expected.erase(key); break;
+            default: ok = ok && map.contains(key) == (expected.count(key) != 0); break;
+        }
+        bool& flag = flags[key];
+        flag = !flag;
+        expected_flags[key] = !expected_flags[key];
+        if (rng() % 3 == 0) { flags.erase(key); expected_flags.erase(key); }
+        if (i % 10000 == 9999) ok = ok && same_contents(map, expected) && same_contents(flags, expected_flags);
+    }
+    check(ok, "flat_hash_map matches std::unordered_map");
+
+    mz::flat_hash_set<mz::ivec2> set;
+    std::vector<mz::ivec2> keys;
+    for (int i = 0; i < 1000; i++) keys.push_back(random_key());
+    size_t inserted = 0;
+    for (const mz::ivec2& k : keys) inserted += set.insert(k).second;
+    std::sort(keys.begin(), keys.end(), [](const mz::ivec2& a, const mz::ivec2& b) { return a.x != b.x ? a.x < b.x : a.y < b.y; });
+    const size_t unique = (size_t)(std::unique(keys.begin(), keys.end()) - keys.begin());
+    check(inserted == unique && set.size() == unique && set.count(keys[0]) == 1 && !set.contains(mz::ivec2(1000, 0)), "flat_hash_set keeps unique keys");
+}
+
+static void test_morton() {
+    std::mt19937_64 rng(24);
+
+    // Against std::stable_sort on (key, original index), with and without threads
+    bool sorted = true;
+    for (mz::u64 mask : { (mz::u64)0xff, (mz::u64)0x3fffffff, ~(mz::u64)0, (mz::u64)0xff << 56 }) {
+        for (size_t n : { (size_t)0, (size_t)1, (size_t)1000, (size_t)100000 }) {
+            std::vector<mz::u64> keys(n);
+            std::vector<mz::u32> values(n);
+            std::vector<std::pair<mz::u64, mz::u32>> expected(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = rng() & mask;
+                values[i] = (mz::u32)i;
+                expected[i] = { keys[i], (mz::u32)i };
+            }
+            std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            std::vector<mz::u64> parallel_keys = keys;
+            std::vector<mz::u32> parallel_values = values;
+            mz::radix_sort<mz::u32>(keys, values);
+            mz::radix_sort<mz::u32>(parallel_keys, parallel_values, mz::parallelism(3));
+            for (size_t i = 0; i < n; i++)
+                sorted = sorted && keys[i] == expected[i].first && values[i] == expected[i].second && parallel_values[i] == values[i];
+        }
+    }
+    check(sorted, "radix_sort matches std::stable_sort");
+
+    bool round_trip = true;
+    for (int i = 0; i < 10000; i++) {
+        const mz::u32vec2 p2((mz::u32)rng(), (mz::u32)rng());
+        const mz::u32vec3 p3((mz::u32)rng() & 0x1fffff, (mz::u32)rng() & 0x1fffff, (mz::u32)rng() & 0x1fffff);
+        round_trip = round_trip && mz::morton_decode2(mz::morton_encode(p2)) == p2 && mz::morton_decode3(mz::morton_encode(p3)) == p3
+                                && mz::hilbert_decode2(mz::hilbert_encode(p2)) == p2 && mz::hilbert_decode3(mz::hilbert_encode(p3)) == p3;
+    }
+    check(round_trip, "morton and hilbert round trips");
+
+    // Consecutive Hilbert keys are neighbouring cells, starting at the origin
+    bool adjacent = mz::hilbert_decode2(0) == mz::u32vec2(0, 0) && mz::hilbert_decode3(0, 4) == mz::u32vec3(0, 0, 0);
+    for (mz::u64 key = 1; key < 65536; key++) {
+        const mz::u32vec2 a = mz::hilbert_decode2(key - 1), b = mz::hilbert_decode2(key);
+        adjacent = adjacent && (a.x > b.x ? a.x - b.x : b.x - a.x) + (a.y > b.y ? a.y - b.y : b.y - a.y) == 1;
+    }
+    for (mz::u64 key = 1; key < 4096; key++) {
+        const mz::u32vec3 a = mz::hilbert_decode3(key - 1, 4), b = mz::hilbert_decode3(key, 4);
+        adjacent = adjacent && (a.x > b.x ? a.x - b.x : b.x - a.x) + (a.y > b.y ? a.y - b.y : b.y - a.y) + (a.z > b.z ? a.z - b.z : b.z - a.z) == 1;
+    }
+    check(adjacent, "hilbert keys step between neighbours");
+
+    // spatial_sort agrees with spatial_order and leaves the keys ascending
+    std::uniform_real_distribution<mz::f32> unit(-100.f, 100.f);
+    bool consistent = true;
+    for (mz::curve k : { mz::curve::morton, mz::curve::hilbert }) {
+        std::vector<mz::fvec3> points(20000), sorted_points;
+        for (mz::fvec3& p : points) p = mz::fvec3(unit(rng), unit(rng), unit(rng));
+        std::vector<mz::u32> order(points.size());
+        mz::spatial_order<mz::f32>(points, order, k, mz::parallelism(3));
+        sorted_points = points;
+        mz::spatial_sort<mz::f32>(sorted_points, k);
+        std::vector<mz::u64> keys(points.size());
+        mz::spatial_keys<mz::f32>(sorted_points, keys, k);
+        for (size_t i = 0; i < points.size(); i++)
+            consistent = consistent && sorted_points[i] == points[order[i]] && (i == 0 || keys[i - 1] <= keys[i]);
+    }
+    check(consistent, "spatial_sort matches spatial_order");
+}
+
+// Random convex polygon on a quarter grid, so that touching and exactly
+// collinear configurations come up often
+template <typename value_t>
+static mz::u32 random_convex(std::mt19937& rng, mz::vec2<value_t>* points) {
+    std::uniform_real_distribution<value_t> unit(-1, 1);
+    const mz::vec2<value_t> center(unit(rng) * 3, unit(rng) * 3);
+    const value_t radius = 1 + (unit(rng) + 1) * 2;
+    const mz::u32 n = 3 + rng() % 6;
+    std::vector<value_t> angles(n);
+    for (value_t& a : angles) a = (unit(rng) + 1) * (value_t)3.14159265358979;
+    std::sort(angles.begin(), angles.end());
+    mz::u32 count = 0;
+    for (value_t a : angles) {
+        const mz::vec2<value_t> p(std::round((center.x + std::cos(a) * radius) * 4) / 4, std::round((center.y + std::sin(a) * radius) * 4) / 4);
+        // Snapping can make points coincide or turn the wrong way, keep only strict left turns
+        while (count >= 2 && mz::detail::cross2(points[count - 1] - points[count - 2], p - points[count - 1]) <= 0) count--;
+        if (count == 0 || p != points[count - 1]) points[count++] = p;
+    }
+    while (count >= 3 && (mz::detail::cross2(points[count - 1] - points[count - 2], points[0] - points[count - 1]) <= 0 ||
+                          mz::detail::cross2(points[0] - points[count - 1], points[1] - points[0]) <= 0)) count--;
+    return count;
+}
+
+template <typename value_t>
+static void test_gjk_pairs(const char* what) {
+    std::mt19937 rng(25);
+    int agree = 0, depth_agree = 0, total = 0;
+    mz::vec2<value_t> pa[8], pb[8];
+    for (int i = 0; i < 20000; i++) {
+        const mz::Polygon2D<value_t> a = { pa, random_convex(rng, pa) }, b = { pb, random_convex(rng, pb) };
+        if (a.npoints < 3 || b.npoints < 3) continue;
+        total++;
+        const bool sat = mz::polygon2ds_intersect(a, b);
+        const mz::Polygon2DContact<value_t> contact = mz::polygon2ds_contact(a, b);
+        agree += sat == mz::polygon2ds_intersect_gjk(a, b) && sat == contact.intersects;
+        const mz::Polygon2DSeparation<value_t> separation = mz::polygon2ds_separation(a, b);
+        depth_agree += !sat || std::abs(contact.depth - separation.depth) <= (value_t)1e-3;
+    }
+    check(agree == total && depth_agree == total && total > 10000, what);
+}
+
+// Large f32 polygons pushed apart until they overlap by only 0.5: the
+// Minkowski difference's rounding is then bigger than the depth, which
+// used to make EPA re-add supports it already had without ever stopping
+static void test_gjk_large() {
+    std::mt19937 rng(25);
+    int good = 0, total = 0;
+    mz::fvec2 pa[8], pb[8];
+    for (int i = 0; i < 4000; i++) {
+        const mz::Polygon2D<mz::f32> a = { pa, random_convex(rng, pa) }, b = { pb, random_convex(rng, pb) };
+        if (a.npoints < 3 || b.npoints < 3) continue;
+        for (mz::u32 k = 0; k < a.npoints; k++) pa[k] *= 4096.f;
+        for (mz::u32 k = 0; k < b.npoints; k++) pb[k] *= 4096.f;
+        mz::Polygon2DSeparation<mz::f32> separation = mz::polygon2ds_separation(a, b);
+        if (!separation.intersects) continue;
+        const mz::fvec2 shift = separation.normal * (separation.depth - .5f);
+        for (mz::u32 k = 0; k < b.npoints; k++) pb[k] += shift;
+        separation = mz::polygon2ds_separation(a, b);
+        if (!separation.intersects) continue;
+
+        total++;
+        const mz::Polygon2DContact<mz::f32> contact = mz::polygon2ds_contact(a, b);
+        good += contact.intersects && std::abs(contact.depth - separation.depth) <= .01f;
+    }
+    check(good == total && total > 1000, "polygon2ds_contact on large, shallow f32 overlaps");
+}
+
+static void test_gjk() {
+    // GJK used to stop on an edge through the origin here and call it apart
+    const mz::dvec2 pa[] = { { -2.75, -2.25 }, { 0.75, -2.75 }, { 2.25, -2 }, { 2.25, 2.5 }, { -2.75, 1.75 } };
+    const mz::dvec2 pb[] = { { -3, -1.25 }, { 0, -1 }, { 0.25, -3.75 }, { -1.25, -4.25 }, { -2.25, -4.25 }, { -3.25, -3 } };
+    const mz::Polygon2D<mz::f64> a = { pa, 5 }, b = { pb, 6 };
+    const mz::Polygon2DContact<mz::f64> contact = mz::polygon2ds_contact(a, b);
+    const mz::Polygon2DSeparation<mz::f64> separation = mz::polygon2ds_separation(a, b);
+    check(mz::polygon2ds_intersect(a, b) && mz::polygon2ds_intersect_gjk(a, b) && contact.intersects &&
+          std::abs(contact.depth - separation.depth) < 1e-9, "polygon2ds_contact on a deep overlap");
+
+    test_gjk_pairs<mz::f32>("GJK and EPA match SAT (f32)");
+    test_gjk_pairs<mz::f64>("GJK and EPA match SAT (f64)");
+    test_gjk_large();
+}
+
+static void test_ray_batch() {
+    std::mt19937 rng(10);
+    // Integer coordinates keep every product exact, so -mfma can't move a hit across an endpoint
+    auto coord = [&]() { return (mz::f32)((int)(rng() % 101) - 50); };
+    const mz::fray2d ray(mz::fvec2(-39.f, 16.f), mz::fvec2(39.f, -16.f));
+    const mz::fvec2 direction(39.f, -16.f);
+    // Not a multiple of 4, so both the SIMD lanes and the scalar tail run
+    std::vector<mz::fray2d> segments(1003);
+    for (size_t i = 0; i < segments.size(); i++) {
+        const mz::fvec2 a(coord(), coord()), b(coord(), coord());
+        if (i % 10 == 0)      segments[i] = mz::fray2d(a, a + direction * (mz::f32)(rng() % 3 + 1));             // parallel
+        else if (i % 10 == 1) segments[i] = mz::fray2d(ray.p1 + direction * (mz::f32)(rng() % 3), ray.p2);       // collinear, overlapping
+        else                  segments[i] = mz::fray2d(a, b);
+    }
+
+    std::vector<mz::u64> hits((segments.size() + 63) / 64, ~(mz::u64)0);
+    std::vector<mz::f32> ts(segments.size(), -1.f);
+    const mz::Ray2DBatchHit<mz::f32> result = mz::ray2d_intersect_batch(ray, segments, hits, ts);
+
+    bool ok = true, filled = true;
+    size_t count = 0;
+    mz::s64 nearest = -1;
+    mz::fvec2 nearest_point;
+    for (size_t i = 0; i < segments.size(); i++) {
+        mz::fvec2 point(std::nan(""), std::nan(""));
+        const bool hit = mz::ray2ds_intersect(ray, segments[i], &point);
+        ok = ok && hit == (bool)((hits[i / 64] >> (i % 64)) & 1) && (!hit || ts[i] >= 0.f) && (hit || ts[i] == -1.f);
+        if (!hit) continue;
+        const mz::fvec2 expected(ray.p1.x + ts[i] * (ray.p2.x - ray.p1.x), ray.p1.y + ts[i] * (ray.p2.y - ray.p1.y));
+        filled = filled && point == expected;
+        if (nearest < 0 || ts[i] < ts[nearest]) {
+            nearest = (mz::s64)i;
+            nearest_point = point;
+        }
+        count++;
+    }
+    check(ok && count > 50 && result.count == count && result.nearest == nearest && result.t == ts[nearest] && result.point == nearest_point,
+          "ray2d_intersect_batch matches ray2ds_intersect");
+    check(filled, "ray2ds_intersect fills the intersection point");
+
+    // Short output spans are written up to their size, the result still covers everything
+    std::vector<mz::u64> few_hits(2, ~(mz::u64)0);
+    std::vector<mz::f32> few_ts(101, -1.f);
+    const mz::Ray2DBatchHit<mz::f32> clamped = mz::ray2d_intersect_batch(ray, segments, mz::span<mz::u64>(few_hits.data(), 1), mz::span<mz::f32>(few_ts.data(), 100));
+    check(clamped.count == count && clamped.nearest == nearest && few_hits[0] == hits[0] && few_hits[1] == ~(mz::u64)0 &&
+          std::equal(few_ts.begin(), few_ts.begin() + 100, ts.begin()) && few_ts[100] == -1.f, "ray2d_intersect_batch stops at the span sizes");
+}
+
+static void test_polygon_batch() {
+    std::mt19937 rng(7);
+    std::vector<mz::fvec2> points;
+    std::vector<mz::uvec2> ranges;
+    while (ranges.size() < 300) {
+        mz::fvec2 p[8];
+        const mz::u32 n = random_convex(rng, p);
+        if (n < 3) continue;
+        ranges.push_back(mz::uvec2((mz::u32)points.size(), n));
+        points.insert(points.end(), p, p + n);
+    }
+    const mz::Polygon2DSoup<mz::f32> soup = { points, ranges };
+    // Not a multiple of 64, so the last word is partial
+    std::vector<mz::uvec2> pairs(5037);
+    for (mz::uvec2& pair : pairs) pair = mz::uvec2(rng() % 300, rng() % 300);
+
+    const size_t words = (pairs.size() + 63) / 64;
+    std::vector<mz::u64> hits(words + 1, ~(mz::u64)0);
+    std::vector<mz::Polygon2DSeparation<mz::f32>> separations(pairs.size());
+    mz::polygon2ds_intersect_batch(soup, pairs, mz::span<mz::u64>(hits.data(), words), mz::parallelism(3));
+    mz::polygon2ds_separation_batch(soup, pairs, separations, mz::parallelism(3));
+    bool ok = hits[words] == ~(mz::u64)0 && (hits[words - 1] >> (pairs.size() % 64)) == 0;
+    size_t intersecting = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        const mz::Polygon2D<mz::f32> a = soup[pairs[i].x], b = soup[pairs[i].y];
+        const bool hit = (hits[i / 64] >> (i % 64)) & 1;
+        const mz::Polygon2DSeparation<mz::f32> single = mz::polygon2ds_separation(a, b);
+        ok = ok && hit == mz::polygon2ds_intersect(a, b) && separations[i].intersects == single.intersects &&
+             separations[i].depth == single.depth && separations[i].normal == single.normal;
+        intersecting += hit;
+    }
+    check(ok && intersecting > 100 && intersecting < pairs.size() - 100, "polygon2ds batch functions match the single pair ones");
+
+    // Too few words: only the pairs that fit are tested, nothing past them is written
+    std::vector<mz::u64> few(11, ~(mz::u64)0);
+    mz::polygon2ds_intersect_batch(soup, pairs, mz::span<mz::u64>(few.data(), 10), mz::parallelism(3));
+    check(std::equal(few.begin(), few.begin() + 10, hits.begin()) && few[10] == ~(mz::u64)0, "polygon2ds_intersect_batch stops at hits.size() * 64 pairs");
+}
+
+// Broadphase results against brute force over the live rects, where
+// rects[id] is the rect of proxy id and alive[id] says if it exists
+template <typename broadphase_t>
+static bool same_pairs(const broadphase_t& bp, const std::vector<mz::frect>& rects, const std::vector<bool>& alive) {
+    std::vector<std::pair<mz::u32, mz::u32>> found, expected;
+    bool ordered = true;
+    bp.query_pairs([&](mz::u32 a, mz::u32 b) {
+        ordered = ordered && a < b;
+        found.emplace_back(a, b);
+    });
+    for (mz::u32 a = 0; a < rects.size(); a++)
+        for (mz::u32 b = a + 1; b < rects.size(); b++)
+            if (alive[a] && alive[b] && mz::rects_intersect(rects[a], rects[b])) expected.emplace_back(a, b);
+    // Sorted but not deduplicated, so a pair reported twice is a mismatch
+    std::sort(found.begin(), found.end());
+    return ordered && found == expected;
+}
+
+template <typename broadphase_t>
+static bool same_region(const broadphase_t& bp, const std::vector<mz::frect>& rects, const std::vector<bool>& alive, const mz::frect& region) {
+    std::vector<mz::u32> found, expected;
+    bp.query(region, [&](mz::u32 id) { found.push_back(id); });
+    for (mz::u32 id = 0; id < rects.size(); id++)
+        if (alive[id] && mz::rects_intersect(rects[id], region)) expected.push_back(id);
+    std::sort(found.begin(), found.end());
+    return found == expected;
+}
+
+// Rects from a fraction of a cell up to several cells across
+static mz::frect random_rect(std::mt19937& rng) {
+    std::uniform_real_distribution<mz::f32> position(-150.f, 150.f), size(0.5f, 40.f);
+    return mz::frect(position(rng), position(rng), size(rng), size(rng));
+}
+
+static void test_uniform_grid() {
+    std::mt19937 rng(8);
+    mz::funiform_grid grid(10.f);
+    std::vector<mz::frect> rects;
+    std::vector<bool> alive;
+    auto insert = [&](const mz::frect& r) {
+        const mz::u32 id = grid.insert(r);
+        if (id >= rects.size()) {
+            rects.resize(id + 1);
+            alive.resize(id + 1, false);
+        }
+        rects[id] = r;
+        alive[id] = true;
+    };
+    for (int i = 0; i < 500; i++) insert(random_rect(rng));
+
+    bool pairs = same_pairs(grid, rects, alive), regions = true;
+    for (int round = 0; round < 20; round++) {
+        for (mz::u32 id = 0; id < rects.size(); id++) {
+            if (!alive[id]) continue;
+            const mz::u32 action = rng() % 10;
+            if (action < 4) {
+                // Small moves mostly stay within the same cells
+                rects[id].pos += mz::fvec2((mz::f32)(rng() % 200) / 100.f - 1.f, (mz::f32)(rng() % 200) / 100.f - 1.f);
+                grid.move(id, rects[id]);
+            } else if (action < 6) {
+                rects[id] = random_rect(rng);
+                grid.move(id, rects[id]);
+            } else if (action == 6) {
+                grid.remove(id);
+                alive[id] = false;
+            }
+        }
+        // Reuses the removed ids
+        for (int i = 0; i < 30; i++) insert(random_rect(rng));
+
+        pairs = pairs && same_pairs(grid, rects, alive) && grid.size() == (size_t)std::count(alive.begin(), alive.end(), true);
+        for (int i = 0; i < 20; i++) regions = regions && same_region(grid, rects, alive, random_rect(rng));
+    }
+    check(pairs, "uniform_grid query_pairs matches brute force after moves and removals");
+    check(regions, "uniform_grid query matches brute force");
+
+    std::vector<mz::frect> fresh(300);
+    for (mz::frect& r : fresh) r = random_rect(rng);
+    grid.rebuild(fresh);
+    const std::vector<bool> all(fresh.size(), true);
+    check(grid.size() == fresh.size() && same_pairs(grid, fresh, all) && same_region(grid, fresh, all, mz::frect(-20.f, -20.f, 45.f, 45.f)),
+          "uniform_grid rebuild");
+}
+
+// Entry fraction of p1 -> p2 into r (edges included), or -1 if it misses
+static mz::f64 slab_entry(const mz::fray2d& seg, const mz::frect& r) {
+    const mz::f64 p[2] = { seg.p1.x, seg.p1.y }, d[2] = { (mz::f64)seg.p2.x - seg.p1.x, (mz::f64)seg.p2.y - seg.p1.y };
+    const mz::f64 lo[2] = { r.x, r.y }, hi[2] = { (mz::f64)r.x + r.width, (mz::f64)r.y + r.height };
+    mz::f64 enter = 0., leave = 1.;
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0.) {
+            if (p[axis] < lo[axis] || p[axis] > hi[axis]) return -1.;
+            continue;
+        }
+        mz::f64 a = (lo[axis] - p[axis]) / d[axis], b = (hi[axis] - p[axis]) / d[axis];
+        if (a > b) std::swap(a, b);
+        enter = std::max(enter, a);
+        leave = std::min(leave, b);
+    }
+    return enter <= leave ? enter : -1.;
+}
+
+static void test_aabb_tree() {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<mz::f32> position(-150.f, 150.f);
+    mz::aabb_tree<mz::f32> tree(2.f);
+    std::vector<mz::frect> rects;
+    std::vector<bool> alive;
+    auto insert = [&](const mz::frect& r) {
+        const mz::u32 id = tree.insert(r);
+        if (id >= rects.size()) {
+            rects.resize(id + 1);
+            alive.resize(id + 1, false);
+        }
+        rects[id] = r;
+        alive[id] = true;
+    };
+    for (int i = 0; i < 500; i++) insert(random_rect(rng));
+
+    bool pairs = same_pairs(tree, rects, alive), regions = true, points = true, casts = true, fattened = true;
+    for (int round = 0; round < 20; round++) {
+        for (mz::u32 id = 0; id < rects.size(); id++) {
+            if (!alive[id]) continue;
+            const mz::u32 action = rng() % 10;
+            if (action < 4) {
+                // Within the margin the fat box still holds the rect
+                rects[id].pos += mz::fvec2((mz::f32)(rng() % 200) / 100.f - 1.f, (mz::f32)(rng() % 200) / 100.f - 1.f);
+                const mz::fvec4 fat = tree.fat_bounds(id);
+                const bool inside = fat.x1 <= rects[id].x && fat.y1 <= rects[id].y && rects[id].x + rects[id].width <= fat.x2 && rects[id].y + rects[id].height <= fat.y2;
+                fattened = fattened && tree.move(id, rects[id]) == !inside;
+            } else if (action < 6) {
+                rects[id] = random_rect(rng);
+                tree.move(id, rects[id]);
+            } else if (action == 6) {
+                tree.remove(id);
+                alive[id] = false;
+            }
+        }
+        for (int i = 0; i < 30; i++) insert(random_rect(rng));
+
+        pairs = pairs && same_pairs(tree, rects, alive) && tree.size() == (size_t)std::count(alive.begin(), alive.end(), true);
+        for (int i = 0; i < 20; i++) {
+            regions = regions && same_region(tree, rects, alive, random_rect(rng));
+
+            const mz::fvec2 p(position(rng), position(rng));
+            std::vector<mz::u32> found, expected;
+            tree.query(p, [&](mz::u32 id) { found.push_back(id); });
+            for (mz::u32 id = 0; id < rects.size(); id++)
+                if (alive[id] && mz::rect_contains(rects[id], p)) expected.push_back(id);
+            std::sort(found.begin(), found.end());
+            points = points && found == expected;
+
+            // Every hit, then only the closest by returning t
+            const mz::fray2d seg(mz::fvec2(position(rng), position(rng)), mz::fvec2(position(rng), position(rng)));
+            std::vector<std::pair<mz::u32, mz::f32>> hits;
+            tree.cast(seg, [&](mz::u32 id, mz::f32 t) { hits.emplace_back(id, t); return 1.f; });
+            std::sort(hits.begin(), hits.end());
+            mz::f64 nearest = 2.;
+            size_t next = 0;
+            for (mz::u32 id = 0; id < rects.size(); id++) {
+                const mz::f64 t = alive[id] ? slab_entry(seg, rects[id]) : -1.;
+                if (t < 0.) continue;
+                nearest = std::min(nearest, t);
+                casts = casts && next < hits.size() && hits[next].first == id && std::abs(hits[next].second - t) < 1e-5;
+                next++;
+            }
+            casts = casts && next == hits.size();
+            mz::f32 closest = 2.f;
+            tree.cast(seg, [&](mz::u32, mz::f32 t) { closest = std::min(closest, t); return t; });
+            casts = casts && (hits.empty() ? closest == 2.f : std::abs(closest - nearest) < 1e-5);
+        }
+    }
+    check(pairs, "aabb_tree query_pairs matches brute force after moves and removals");
+    check(regions && points, "aabb_tree rect and point queries match brute force");
+    check(casts, "aabb_tree cast matches a slab test");
+    check(fattened, "aabb_tree move only reinserts rects leaving their fat box");
+
+    // Sorted insertion would degenerate into a list without rebalancing
+    mz::aabb_tree<mz::f32> sorted;
+    for (int i = 0; i < 4096; i++) sorted.insert(mz::frect((mz::f32)i * 2.f, 0.f, 1.f, 1.f));
+    check(sorted.size() == 4096 && sorted.height() <= 2 * 12, "aabb_tree height stays logarithmic");
+}
 
 int main() {
     mz::fvec2 f2 = { .5f, .1f };
@@ -22,4 +1441,31 @@ int main() {
     std::cout << "i4: "     << i4     << "\n";
     std::cout << "u644: "   << u644   << "\n";
     std::cout << "mat: "    << mat    << "\n";
-}
\ No newline at end of file
+
+    test_simd();
+    test_fast_math();
+    test_soa();
+    test_expr();
+    test_fixed();
+    test_packed();
+    test_color();
+    test_frustum();
+    test_parallel();
+    test_quat();
+    test_affine();
+    test_trs();
+    test_hierarchy();
+    test_inverse();
+    test_transform_batch();
+    test_transform_2d();
+    test_hashmap();
+    test_morton();
+    test_gjk();
+    test_ray_batch();
+    test_polygon_batch();
+    test_uniform_grid();
+    test_aabb_tree();
+
+    std::cout << (failures ? "some tests failed\n" : "all tests passed\n");
+    return failures != 0;
+}